@@ -0,0 +1,213 @@
+#ifndef FLEET_PLANNER_INCLUDE_GUARD_HPP
+#define FLEET_PLANNER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Library for prioritized multi-robot planning with a space-time reservation table
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace nuplan
+{
+
+  /// \brief A cell of the planning grid
+  struct Cell
+  {
+    int x = 0; ///< column index
+    int y = 0; ///< row index
+
+    /// \brief create the cell at (0, 0)
+    Cell();
+
+    /// \brief create a cell
+    /// \param col - the column index
+    /// \param row - the row index
+    Cell(int col, int row);
+
+    /// \brief check if two cells are the same
+    /// \param rhs - the cell to compare with
+    /// \returns true if both indices match
+    bool operator==(const Cell & rhs) const;
+  };
+
+  /// \brief A binary occupancy grid
+  class Grid
+  {
+  public:
+    /// \brief create an empty 0x0 grid
+    Grid();
+
+    /// \brief create a grid where every cell is free
+    /// \param width - the number of columns
+    /// \param height - the number of rows
+    Grid(int width, int height);
+
+    /// \brief mark a cell as occupied or free
+    /// \param c - the cell to set
+    /// \param occupied - true if the cell is an obstacle
+    void setOccupied(Cell c, bool occupied);
+
+    /// \brief check if a cell is inside the grid and not an obstacle
+    /// \param c - the cell to check
+    /// \returns true if the robot can be in the cell
+    bool isFree(Cell c) const;
+
+    /// \brief convert a cell into its row major index
+    /// \param c - the cell
+    /// \returns the index of the cell
+    int index(Cell c) const;
+
+    /// \brief merge square blocks of cells into one, so a robot fits in a cell of the result
+    /// \param factor - the number of cells along each side of a block
+    /// \returns a grid where a block is occupied if any of its cells is, or if it runs past the edge
+    Grid coarsen(int factor) const;
+
+    /// \brief grow every obstacle by a radius, so a point robot in the result keeps a round robot clear
+    /// \param radius - the radius to grow by (cells)
+    /// \returns a grid where a cell is occupied if an obstacle is within the radius of it
+    Grid inflate(int radius) const;
+
+    /// \brief get the number of columns
+    int width() const;
+
+    /// \brief get the number of rows
+    int height() const;
+
+  private:
+    int w = 0; // number of columns
+    int h = 0; // number of rows
+    std::vector<uint8_t> occupied; // 1 for an obstacle, row major
+  };
+
+  /// \brief Hashed table of the cells each robot will occupy at each time step.
+  /// Each reservation is a 64 bit key (x, y, t) and a robot id stored in an open
+  /// addressed table. Every plan starts from a cleared table, so reservations expire with the plan
+  /// that made them.
+  class ReservationTable
+  {
+  public:
+    /// \brief create a table
+    /// \param capacity - the number of reservations expected, the table is sized to twice this
+    explicit ReservationTable(unsigned int capacity=4096);
+
+    /// \brief remove every reservation
+    void clear();
+
+    /// \brief reserve a cell at a time step
+    /// \param c - the cell
+    /// \param t - the time step
+    /// \param robot - the id of the robot
+    void reserve(Cell c, int t, int robot);
+
+    /// \brief reserve a cell from a time step onward, for a robot parked at its goal
+    /// \param c - the cell
+    /// \param t - the first time step the robot is parked
+    /// \param robot - the id of the robot
+    void park(Cell c, int t, int robot);
+
+    /// \brief get the robot that holds a cell at a time step
+    /// \param c - the cell
+    /// \param t - the time step
+    /// \returns the robot id, or -1 if the cell is free
+    int owner(Cell c, int t) const;
+
+    /// \brief check if a move from one cell to another between t and t+1 is allowed
+    /// \param from - the cell at time t
+    /// \param to - the cell at time t+1
+    /// \param t - the time step the move starts
+    /// \param robot - the id of the moving robot
+    /// \returns true if the target is free and no robot swaps places with this one
+    bool canMove(Cell from, Cell to, int t, int robot) const;
+
+    /// \brief get the last time step a cell is reserved by a moving robot
+    /// \param c - the cell
+    /// \returns the last reserved time step, or -1 if never reserved
+    int lastReserved(Cell c) const;
+
+    /// \brief get the number of live reservations
+    unsigned int size() const;
+
+  private:
+    struct Entry
+    {
+      uint64_t key; // packed x, y, t. 0 marks an empty slot
+      int32_t robot; // id of the robot holding the cell
+    };
+
+    /// \brief pack a cell and time into a hash key
+    static uint64_t pack(Cell c, int t);
+
+    /// \brief pack a cell into a key
+    static uint32_t packCell(Cell c);
+
+    /// \brief find the slot of a key, or the empty slot where it belongs
+    unsigned int find(uint64_t key) const;
+
+    /// \brief insert an entry without growing the table
+    void insert(uint64_t key, int32_t robot);
+
+    /// \brief double the number of slots and rehash
+    void grow();
+
+    std::vector<Entry> slots; // open addressed table, size is a power of 2
+    unsigned int count = 0; // number of live entries
+    std::vector<Entry> scratch; // reused when rehashing
+
+    std::unordered_map<uint32_t, std::pair<int, int32_t>> parked; // packed cell -> (first parked time, robot)
+    std::unordered_map<uint32_t, int> last_reserved; // packed cell -> last reserved time
+  };
+
+  /// \brief Plans robots one at a time in priority order with space-time A*.
+  /// Each robot avoids the reservations of every robot planned before it. A robot is taken to fill
+  /// exactly one cell, so the grid should be coarsened until a cell is as wide as a robot.
+  class FleetPlanner
+  {
+  public:
+    /// \brief create a planner
+    /// \param grid - the occupancy grid shared by the fleet
+    /// \param horizon - the max number of time steps in a plan
+    FleetPlanner(Grid grid, int horizon);
+
+    /// \brief plan paths for the fleet
+    /// \param starts - the start cell of each robot, in priority order
+    /// \param goals - the goal cell of each robot
+    /// \returns the cell occupied at each time step for each robot, empty if no path was found
+    std::vector<std::vector<Cell>> plan(const std::vector<Cell> & starts, const std::vector<Cell> & goals);
+
+    /// \brief get the reservations made by the last plan
+    /// \returns the reservation table
+    const ReservationTable & reservations() const;
+
+  private:
+    struct Node
+    {
+      int cell; // row major cell index
+      int t; // time step
+      int g; // cost from the start
+      int f; // g plus heuristic
+      int parent; // index in the node pool, -1 for the start
+    };
+
+    /// \brief space-time A* for one robot against the current reservations
+    /// \returns the path, empty if no path was found within the horizon
+    std::vector<Cell> search(Cell start, Cell goal, int robot);
+
+    /// \brief fill the heuristic buffer with the true grid distance to the goal
+    void computeHeuristic(Cell goal);
+
+    Grid grid; // shared occupancy grid
+    int horizon = 0; // max time steps in a plan
+    ReservationTable table; // reservations of the robots planned so far
+
+    // search buffers, reused between robots
+    std::vector<Node> pool; // every node created by the search
+    std::vector<int> open; // heap of indices into pool
+    std::unordered_set<uint64_t> closed; // (cell, t) keys closed by the current search, only the visited ones
+    std::vector<int> heuristic; // grid distance from each cell to the goal
+    std::vector<int> frontier; // bfs queue for the heuristic
+  };
+
+}
+#endif
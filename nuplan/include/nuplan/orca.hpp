@@ -0,0 +1,148 @@
+#ifndef ORCA_INCLUDE_GUARD_HPP
+#define ORCA_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Optimal Reciprocal Collision Avoidance (ORCA) velocity filter
+///
+/// See: J. van den Berg, S. J. Guy, M. Lin and D. Manocha, Reciprocal n-Body
+/// Collision Avoidance, Robotics Research (2011)
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace nuplan
+{
+
+  /// \brief A disc shaped robot or obstacle in the plane
+  struct Agent
+  {
+    double x = 0; ///< x position
+    double y = 0; ///< y position
+    double vx = 0; ///< x velocity
+    double vy = 0; ///< y velocity
+    double radius = 0; ///< radius of the disc
+  };
+
+  /// \brief A half plane of allowed velocities.
+  /// The allowed velocities lie to the left of the line through point along direction.
+  struct Line
+  {
+    rigid2d::Vector2D point; ///< a point on the line
+    rigid2d::Vector2D direction; ///< unit direction of the line
+  };
+
+  /// \brief Uniform grid hash for finding nearby robots
+  class SpatialHash
+  {
+  public:
+    /// \brief create an empty hash
+    /// \param cell_size - the side length of a hash cell, best set to the query radius
+    explicit SpatialHash(double cell_size);
+
+    /// \brief remove every point, keeping the allocated buckets
+    void clear();
+
+    /// \brief add a point
+    /// \param id - the id returned by query()
+    /// \param x - the x position
+    /// \param y - the y position
+    void insert(int id, double x, double y);
+
+    /// \brief find every point within a radius
+    /// \param x - the x position of the center
+    /// \param y - the y position of the center
+    /// \param radius - the search radius
+    /// \param ids [out] - the ids of the points found, cleared first
+    void query(double x, double y, double radius, std::vector<int> & ids) const;
+
+  private:
+    struct Point
+    {
+      int id; // id given to insert()
+      double x; // x position
+      double y; // y position
+    };
+
+    /// \brief pack the indices of a cell into a key
+    static uint64_t key(int cx, int cy);
+
+    double cell_size = 1.0; // side length of a cell
+    std::unordered_map<uint64_t, std::vector<Point>> buckets; // points in each cell
+  };
+
+  /// \brief Filters a preferred velocity into one that is collision free for a time horizon,
+  /// assuming every neighbor runs the same filter.
+  /// Neighbor constraints are built in one branch free pass over structure of array buffers
+  /// so the compiler can vectorize it.
+  class OrcaFilter
+  {
+  public:
+    /// \brief create a filter
+    /// \param time_horizon - the time (s) to guarantee no collision with other robots
+    /// \param obstacle_horizon - the time (s) to guarantee no collision with static obstacles
+    /// \param time_step - the control period (s), used to resolve collisions that already happened
+    /// \param max_speed - the max translational speed of the robot
+    OrcaFilter(double time_horizon, double obstacle_horizon, double time_step, double max_speed);
+
+    /// \brief compute a safe velocity
+    /// \param self - the robot running the filter
+    /// \param preferred - the velocity the robot would like to move at
+    /// \param neighbors - the nearby robots, which take half the responsibility for avoiding a collision
+    /// \param obstacles - the nearby static obstacles, which take none of it
+    /// \returns the velocity closest to preferred that satisfies every constraint,
+    /// or the least unsafe velocity if no velocity satisfies the constraints
+    rigid2d::Vector2D computeVelocity(const Agent & self, const rigid2d::Vector2D & preferred,
+                                      const std::vector<Agent> & neighbors, const std::vector<Agent> & obstacles);
+
+    /// \brief get the constraints built by the last call to computeVelocity()
+    /// \returns the half planes, obstacles first
+    const std::vector<Line> & constraints() const;
+
+  private:
+    /// \brief build the constraints of every neighbor and obstacle in one pass
+    void buildConstraints(const Agent & self, const std::vector<Agent> & neighbors, const std::vector<Agent> & obstacles);
+
+    /// \brief solve the 1D program on one line against the lines before it
+    /// \returns false if the line is infeasible
+    bool linearProgram1(const std::vector<Line> & lines, unsigned int line_no, const rigid2d::Vector2D & opt, bool direction_opt, rigid2d::Vector2D & result) const;
+
+    /// \brief solve the 2D program inside the speed circle
+    /// \returns the index of the line that failed, or the number of lines on success
+    unsigned int linearProgram2(const std::vector<Line> & lines, const rigid2d::Vector2D & opt, bool direction_opt, rigid2d::Vector2D & result) const;
+
+    /// \brief minimize the max violation of the soft constraints, keeping the obstacle constraints hard
+    void linearProgram3(unsigned int num_obstacle_lines, unsigned int begin_line, rigid2d::Vector2D & result);
+
+    double inv_horizon = 0; // 1 / time_horizon
+    double inv_obstacle_horizon = 0; // 1 / obstacle_horizon
+    double inv_time_step = 0; // 1 / time_step
+    double max_speed = 0; // radius of the speed circle
+
+    // structure of array inputs to the constraint pass, one entry per neighbor or obstacle
+    std::vector<double> rel_x, rel_y; // position of the other disc relative to self
+    std::vector<double> rel_vx, rel_vy; // velocity of self relative to the other disc
+    std::vector<double> comb_r; // sum of the radii
+    std::vector<double> inv_t; // 1 / horizon of the constraint
+    std::vector<double> share; // share of the avoidance taken by self
+
+    // structure of array outputs of the constraint pass
+    std::vector<double> out_px, out_py, out_dx, out_dy;
+
+    std::vector<Line> lines; // constraints, obstacles first
+    std::vector<Line> projected; // scratch for linearProgram3
+  };
+
+  /// \brief Convert a planar velocity into a twist a diff drive robot can follow.
+  /// The robot turns toward the velocity and drives forward at its projection on the heading.
+  /// \param vel - the planar velocity
+  /// \param heading - the current heading of the robot
+  /// \param max_speed - the max translational speed
+  /// \param max_rot - the max rotational speed
+  /// \param heading_gain - proportional gain on the heading error
+  /// \returns the twist, which never drives backward
+  rigid2d::Twist2D velocityToTwist(const rigid2d::Vector2D & vel, double heading, double max_speed, double max_rot, double heading_gain);
+
+}
+#endif
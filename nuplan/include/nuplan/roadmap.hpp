@@ -0,0 +1,188 @@
+#ifndef ROADMAP_INCLUDE_GUARD_HPP
+#define ROADMAP_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A lazy probabilistic roadmap over an occupancy grid, kept across queries
+///
+/// The roadmap samples nodes in the free cells and joins each to its nearest neighbors, without
+/// checking the edges. A query searches the graph with A* assuming every unchecked edge is free,
+/// then checks only the edges on the path it found. A blocked edge is cached and the search runs
+/// again, so most edges are never checked and a checked edge is never checked twice.
+///
+/// See: R. Bohlin and L. E. Kavraki, Path Planning Using Lazy PRM, ICRA (2000)
+///
+/// When a cell changes, only the edges that cross it lose their cached state. Positions are in
+/// cells, with the center of cell (i, j) at (i + 0.5, j + 0.5).
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuplan/fleet_planner.hpp"
+
+namespace nuplan
+{
+
+  /// \brief A 2d tree of points for nearest neighbor and radius queries.
+  /// Built once over every point, in a flat array with the median of each range at its middle.
+  class KdTree
+  {
+  public:
+    /// \brief create an empty tree
+    KdTree();
+
+    /// \brief build the tree
+    /// \param points - the points, their indices are the ids returned by the queries
+    void build(const std::vector<rigid2d::Vector2D> & points);
+
+    /// \brief find the nearest points
+    /// \param p - the query point
+    /// \param k - the max number of points to find
+    /// \param radius - the max distance of a point
+    /// \param ids [out] - the ids of the points found, nearest first
+    void nearest(rigid2d::Vector2D p, unsigned int k, double radius, std::vector<int> & ids) const;
+
+    /// \brief find every point within a radius
+    /// \param p - the center
+    /// \param radius - the search radius
+    /// \param ids [out] - the ids of the points found, in no order
+    void within(rigid2d::Vector2D p, double radius, std::vector<int> & ids) const;
+
+    /// \brief get the number of points in the tree
+    unsigned int size() const;
+
+  private:
+    /// \brief sort a range of the order about its median, splitting on x at even depths
+    void buildRange(int begin, int end, int depth);
+
+    /// \brief descend a range for the k nearest, keeping a max heap of (distance squared, id)
+    void nearestRange(int begin, int end, int depth, rigid2d::Vector2D p, unsigned int k,
+                      std::vector<std::pair<double, int>> & best, double & bound) const;
+
+    /// \brief descend a range for every point within a radius
+    void withinRange(int begin, int end, int depth, rigid2d::Vector2D p, double r2, std::vector<int> & ids) const;
+
+    std::vector<rigid2d::Vector2D> points; // the points, indexed by id
+    std::vector<int> order; // ids, each range split about its middle
+  };
+
+  /// \brief The settings of a roadmap
+  struct RoadmapParams
+  {
+    unsigned int num_nodes = 400; ///< nodes sampled in the free cells
+    unsigned int neighbors = 8; ///< nearest nodes each node is joined to
+    double connect_radius = 15.0; ///< longest edge (cells)
+    uint32_t seed = 1; ///< seed of the node sampling
+  };
+
+  /// \brief The cached state of an edge
+  enum class EdgeState : uint8_t
+  {
+    Unknown = 0, ///< not checked since it was made or since a cell it crosses changed
+    Free = 1, ///< every cell it crosses is free
+    Blocked = 2 ///< it crosses an occupied cell
+  };
+
+  /// \brief A lazy PRM that keeps its nodes, edges and checked edges between queries
+  class Roadmap
+  {
+  public:
+    /// \brief create an empty roadmap over a 0x0 grid
+    Roadmap();
+
+    /// \brief sample a roadmap over a grid, no edge is checked
+    /// \param grid - the occupancy grid
+    /// \param params - the settings
+    Roadmap(const Grid & grid, const RoadmapParams & params);
+
+    /// \brief find a path
+    /// \param start - the start position (cells)
+    /// \param goal - the goal position (cells)
+    /// \returns the start, the roadmap nodes along the path and the goal, empty if there is no path
+    std::vector<rigid2d::Vector2D> plan(rigid2d::Vector2D start, rigid2d::Vector2D goal);
+
+    /// \brief mark a cell as occupied or free, the edges crossing it are checked again when next used
+    /// \param c - the cell to set
+    /// \param occupied - true if the cell is an obstacle
+    void setOccupied(Cell c, bool occupied);
+
+    /// \brief take on a new version of the map, only the cells that changed invalidate edges
+    /// \param grid - the new grid
+    /// \returns false if the size of the grid changed, and the roadmap was sampled again
+    bool updateGrid(const Grid & grid);
+
+    /// \brief write the grid, the nodes, the edges and their states to a file
+    /// \param path - the file to write
+    /// \returns true on success
+    bool save(const std::string & path) const;
+
+    /// \brief read a roadmap written by save()
+    /// \param path - the file to read
+    /// \returns true on success, the roadmap is unchanged otherwise
+    bool load(const std::string & path);
+
+    /// \brief get the grid the roadmap was checked against
+    const Grid & grid() const;
+
+    /// \brief get the settings the roadmap was sampled with, or loaded with
+    const RoadmapParams & parameters() const;
+
+    /// \brief get the nodes
+    const std::vector<rigid2d::Vector2D> & nodes() const;
+
+    /// \brief get the number of edges
+    unsigned int numEdges() const;
+
+    /// \brief get the number of edges with a state
+    /// \param state - the state to count
+    unsigned int countEdges(EdgeState state) const;
+
+    /// \brief get the number of edge collision checks run since the roadmap was made or loaded
+    uint64_t checks() const;
+
+  private:
+    struct Edge
+    {
+      int a; // node at one end
+      int b; // node at the other end
+      double length; // (cells)
+      EdgeState state; // cached collision state
+    };
+
+    /// \brief sample the nodes and join them to their neighbors
+    void sample();
+
+    /// \brief join each node to its nearest neighbors, and index the edges by node
+    void connect();
+
+    /// \brief walk the cells under a segment
+    /// \returns true if every cell is free
+    bool segmentFree(rigid2d::Vector2D p, rigid2d::Vector2D q) const;
+
+    /// \brief get the state of an edge, checking it if unknown
+    EdgeState check(int edge);
+
+    /// \brief A* over the roadmap and the start and goal nodes, taking unchecked edges as free
+    /// \param start - the start, the node after the roadmap nodes
+    /// \param goal - the goal, the node after the start
+    /// \param extra - the edges of the start and the goal, their ids follow the roadmap edges
+    /// \returns the edge ids of the path from the start, empty if there is none
+    std::vector<int> search(rigid2d::Vector2D start, rigid2d::Vector2D goal, const std::vector<Edge> & extra);
+
+    Grid cells; // the occupancy grid
+    RoadmapParams params; // settings
+    std::vector<rigid2d::Vector2D> points; // nodes
+    std::vector<Edge> edges; // undirected edges
+    std::vector<std::vector<int>> adjacent; // edge ids of each node
+    KdTree tree; // nodes, for joining and invalidation
+    uint64_t num_checks = 0; // collision checks run
+
+    // search buffers, reused between queries
+    std::vector<double> g; // cost from the start
+    std::vector<int> parent; // edge into each node, -1 for none
+    std::vector<uint32_t> visited; // stamp of the search that reached each node
+    uint32_t stamp = 0; // id of the current search
+  };
+
+}
+#endif
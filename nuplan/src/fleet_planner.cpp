@@ -0,0 +1,187 @@
+/// \file
+/// \brief This node plans collision free paths for a fleet of robots that share one map
+///
+/// PARAMETERS:
+///     robot_names (std::vector<std::string>) the namespace of each robot, in priority order
+///     goals (std::vector<double>) the goal of each robot in the map frame, as x0, y0, x1, y1, ...
+///     horizon (int) the max number of time steps in a plan
+///     robot_radius (double) the radius of each robot, the map is planned on at cells at least twice as wide
+///     step_time (double) the time it takes a robot to move one planning cell
+///     frequency (double) the frequency to replan at
+///     frame_id (std::string) the frame of the map
+/// PUBLISHES:
+///     /<robot>/plan (nav_msgs/Path): the planned path of each robot, stamped with the time each cell is reached
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
+/// SUBSCRIBES:
+///     /map (nav_msgs/OccupancyGrid): the shared occupancy grid
+///     /<robot>/odom (nav_msgs/Odometry): the current pose of each robot
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+
+#include <nav_msgs/OccupancyGrid.h>
+#include <nav_msgs/Odometry.h>
+#include <nav_msgs/Path.h>
+
+#include "rigid2d/topic_monitor.hpp"
+#include "nuplan/fleet_planner.hpp"
+
+// Global Variables
+static nav_msgs::OccupancyGrid cur_map;
+static int got_map = 0;
+static std::vector<nav_msgs::Odometry> cur_odom;
+static std::vector<int> got_odom;
+static int cell_factor = 1; // map cells along each side of a planning cell
+
+/// \brief Callback for the map subscriber
+///
+void callback_map(const nav_msgs::OccupancyGrid::ConstPtr data)
+{
+  cur_map = *data;
+  got_map = 1;
+}
+
+/// \brief Convert a position in the map frame into a planning cell
+/// \param x - the x position
+/// \param y - the y position
+/// \return the cell containing the position
+nuplan::Cell toCell(double x, double y)
+{
+  double res = cur_map.info.resolution * cell_factor;
+  return nuplan::Cell(std::floor((x - cur_map.info.origin.position.x) / res), std::floor((y - cur_map.info.origin.position.y) / res));
+}
+
+/// \brief Main function for the fleet_planner node
+///
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "fleet_planner");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+  rigid2d::TopicMonitor monitor(n);
+
+  std::vector<std::string> robot_names;
+  std::vector<double> goal_list;
+  int horizon = 200;
+  double robot_radius = 0.135;
+  double step_time = 1.5;
+  double frequency = 1.0;
+  std::string frame_id = "map";
+
+  pn.getParam("robot_names", robot_names);
+  pn.getParam("goals", goal_list);
+  pn.getParam("horizon", horizon);
+  pn.getParam("robot_radius", robot_radius);
+  pn.getParam("step_time", step_time);
+  pn.getParam("frequency", frequency);
+  pn.getParam("frame_id", frame_id);
+
+  ROS_INFO_STREAM("FLEET: Got number of robots: " << robot_names.size());
+  ROS_INFO_STREAM("FLEET: Got horizon: " << horizon);
+  ROS_INFO_STREAM("FLEET: Got robot radius: " << robot_radius);
+  ROS_INFO_STREAM("FLEET: Got step time: " << step_time);
+  ROS_INFO_STREAM("FLEET: Got frequency: " << frequency);
+  ROS_INFO_STREAM("FLEET: Got frame id: " << frame_id);
+
+  if(goal_list.size() != 2*robot_names.size())
+  {
+    ROS_ERROR_STREAM("FLEET: goals must hold an x and y for each robot.");
+    return 1;
+  }
+
+  ros::Subscriber map_sub = n.subscribe<nav_msgs::OccupancyGrid>("map", 1, callback_map);
+
+  std::vector<ros::Subscriber> odom_subs;
+  std::vector<ros::Publisher> plan_pubs;
+
+  cur_odom.resize(robot_names.size());
+  got_odom.assign(robot_names.size(), 0);
+
+  for(unsigned int i = 0; i < robot_names.size(); i++)
+  {
+    boost::function<void(const nav_msgs::Odometry::ConstPtr &)> callback_odom =
+      [i](const nav_msgs::Odometry::ConstPtr & data) { cur_odom.at(i) = *data; got_odom.at(i) = 1; };
+
+    odom_subs.push_back(monitor.subscribe<nav_msgs::Odometry>(n, robot_names.at(i) + "/odom", callback_odom));
+    plan_pubs.push_back(n.advertise<nav_msgs::Path>(robot_names.at(i) + "/plan", 1));
+  }
+
+  std::unique_ptr<nuplan::FleetPlanner> planner;
+  ros::Time map_stamp;
+
+  ros::Rate r(frequency);
+
+  while(ros::ok())
+  {
+    ros::spinOnce();
+
+    bool ready = got_map == 1;
+    for(auto got : got_odom) ready = ready && got == 1;
+
+    if(ready)
+    {
+      // rebuild the planner, and its search buffers, only when the map changes
+      if(!planner || cur_map.header.stamp != map_stamp)
+      {
+        nuplan::Grid grid(cur_map.info.width, cur_map.info.height);
+        for(unsigned int y = 0; y < cur_map.info.height; y++)
+        {
+          for(unsigned int x = 0; x < cur_map.info.width; x++)
+          {
+            // unknown (-1) cells are treated as obstacles
+            int8_t val = cur_map.data.at(y * cur_map.info.width + x);
+            grid.setOccupied(nuplan::Cell(x, y), val != 0);
+          }
+        }
+
+        // a robot fills one planning cell, so robots in different cells and robots next to walls do not touch
+        cell_factor = std::max(1, static_cast<int>(std::ceil(2.0 * robot_radius / cur_map.info.resolution)));
+        planner.reset(new nuplan::FleetPlanner(grid.coarsen(cell_factor), horizon));
+        map_stamp = cur_map.header.stamp;
+      }
+
+      std::vector<nuplan::Cell> starts, goals;
+      for(unsigned int i = 0; i < robot_names.size(); i++)
+      {
+        starts.push_back(toCell(cur_odom.at(i).pose.pose.position.x, cur_odom.at(i).pose.pose.position.y));
+        goals.push_back(toCell(goal_list.at(2*i), goal_list.at(2*i + 1)));
+      }
+
+      std::vector<std::vector<nuplan::Cell>> paths = planner->plan(starts, goals);
+
+      ros::Time now = ros::Time::now();
+      double res = cur_map.info.resolution * cell_factor;
+
+      for(unsigned int i = 0; i < paths.size(); i++)
+      {
+        nav_msgs::Path path;
+        path.header.frame_id = frame_id;
+        path.header.stamp = now;
+
+        for(unsigned int t = 0; t < paths.at(i).size(); t++)
+        {
+          geometry_msgs::PoseStamped pose;
+          pose.header.frame_id = frame_id;
+          pose.header.stamp = now + ros::Duration(t * step_time);
+
+          pose.pose.position.x = cur_map.info.origin.position.x + (paths.at(i).at(t).x + 0.5) * res;
+          pose.pose.position.y = cur_map.info.origin.position.y + (paths.at(i).at(t).y + 0.5) * res;
+          pose.pose.orientation.w = 1.0;
+
+          path.poses.push_back(pose);
+        }
+
+        plan_pubs.at(i).publish(path);
+      }
+    }
+
+    r.sleep();
+  }
+}
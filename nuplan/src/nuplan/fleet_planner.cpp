@@ -0,0 +1,382 @@
+/// \file
+/// \brief Source file for the prioritized fleet planning library
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "nuplan/fleet_planner.hpp"
+
+namespace nuplan
+{
+
+  // Moves available at each time step: wait, then the 4 connected neighbors
+  static const int move_x[5] = {0, 1, -1, 0, 0};
+  static const int move_y[5] = {0, 0, 0, 1, -1};
+
+  // Cell ==================================================================
+  Cell::Cell()
+  {
+    x = 0;
+    y = 0;
+  }
+
+  Cell::Cell(int col, int row)
+  {
+    x = col;
+    y = row;
+  }
+
+  bool Cell::operator==(const Cell & rhs) const
+  {
+    return x == rhs.x && y == rhs.y;
+  }
+
+  // Grid ==================================================================
+  Grid::Grid()
+  {
+    w = 0;
+    h = 0;
+  }
+
+  Grid::Grid(int width, int height)
+  {
+    w = width;
+    h = height;
+    occupied.assign(w*h, 0);
+  }
+
+  void Grid::setOccupied(Cell c, bool occ)
+  {
+    if(c.x < 0 || c.y < 0 || c.x >= w || c.y >= h) return;
+    occupied.at(index(c)) = occ ? 1 : 0;
+  }
+
+  bool Grid::isFree(Cell c) const
+  {
+    if(c.x < 0 || c.y < 0 || c.x >= w || c.y >= h) return false;
+    return occupied[index(c)] == 0;
+  }
+
+  int Grid::index(Cell c) const
+  {
+    return c.y * w + c.x;
+  }
+
+  Grid Grid::coarsen(int factor) const
+  {
+    factor = std::max(1, factor);
+    Grid coarse((w + factor - 1) / factor, (h + factor - 1) / factor);
+
+    for(int y = 0; y < coarse.h; y++)
+    {
+      for(int x = 0; x < coarse.w; x++)
+      {
+        bool occ = false;
+        for(int dy = 0; dy < factor && !occ; dy++)
+        {
+          for(int dx = 0; dx < factor && !occ; dx++) occ = !isFree(Cell(x*factor + dx, y*factor + dy));
+        }
+        coarse.setOccupied(Cell(x, y), occ);
+      }
+    }
+
+    return coarse;
+  }
+
+  Grid Grid::inflate(int radius) const
+  {
+    Grid inflated(*this);
+    if(radius <= 0) return inflated;
+
+    for(int y = 0; y < h; y++)
+    {
+      for(int x = 0; x < w; x++)
+      {
+        if(!occupied[index(Cell(x, y))]) continue;
+        for(int dy = -radius; dy <= radius; dy++)
+        {
+          for(int dx = -radius; dx <= radius; dx++)
+          {
+            Cell c(x + dx, y + dy);
+            if(dx*dx + dy*dy > radius*radius || c.x < 0 || c.y < 0 || c.x >= w || c.y >= h) continue;
+            inflated.setOccupied(c, true);
+          }
+        }
+      }
+    }
+
+    return inflated;
+  }
+
+  int Grid::width() const
+  {
+    return w;
+  }
+
+  int Grid::height() const
+  {
+    return h;
+  }
+
+  // ReservationTable ======================================================
+  ReservationTable::ReservationTable(unsigned int capacity)
+  {
+    unsigned int size = 16;
+    while(size < 2*capacity) size *= 2;
+
+    slots.assign(size, Entry{0, -1});
+  }
+
+  uint64_t ReservationTable::pack(Cell c, int t)
+  {
+    // top bit set so a valid key is never 0
+    return (1ull << 63) | (static_cast<uint64_t>(c.x & 0xffff) << 47) | (static_cast<uint64_t>(c.y & 0xffff) << 31) | static_cast<uint64_t>(t & 0x7fffffff);
+  }
+
+  uint32_t ReservationTable::packCell(Cell c)
+  {
+    return (static_cast<uint32_t>(c.x & 0xffff) << 16) | static_cast<uint32_t>(c.y & 0xffff);
+  }
+
+  unsigned int ReservationTable::find(uint64_t key) const
+  {
+    unsigned int mask = slots.size() - 1;
+    unsigned int i = static_cast<unsigned int>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+
+    // linear probing
+    while(slots[i].key != 0 && slots[i].key != key) i = (i + 1) & mask;
+
+    return i;
+  }
+
+  void ReservationTable::insert(uint64_t key, int32_t robot)
+  {
+    unsigned int i = find(key);
+    if(slots[i].key == 0) count++;
+
+    slots[i].key = key;
+    slots[i].robot = robot;
+  }
+
+  void ReservationTable::grow()
+  {
+    scratch.swap(slots);
+    slots.assign(2*scratch.size(), Entry{0, -1});
+    count = 0;
+
+    for(auto & e : scratch)
+    {
+      if(e.key != 0) insert(e.key, e.robot);
+    }
+  }
+
+  void ReservationTable::clear()
+  {
+    std::fill(slots.begin(), slots.end(), Entry{0, -1});
+    count = 0;
+    parked.clear();
+    last_reserved.clear();
+  }
+
+  void ReservationTable::reserve(Cell c, int t, int robot)
+  {
+    // keep the load factor under 1/2 so probes stay short
+    if(2*(count + 1) > slots.size()) grow();
+
+    insert(pack(c, t), robot);
+
+    auto last = last_reserved.find(packCell(c));
+    if(last == last_reserved.end())
+    {
+      last_reserved.emplace(packCell(c), t);
+    }
+    else
+    {
+      last->second = std::max(last->second, t);
+    }
+  }
+
+  void ReservationTable::park(Cell c, int t, int robot)
+  {
+    parked[packCell(c)] = std::make_pair(t, robot);
+  }
+
+  int ReservationTable::owner(Cell c, int t) const
+  {
+    const Entry & e = slots[find(pack(c, t))];
+    if(e.key != 0) return e.robot;
+
+    auto p = parked.find(packCell(c));
+    if(p != parked.end() && p->second.first <= t) return p->second.second;
+
+    return -1;
+  }
+
+  bool ReservationTable::canMove(Cell from, Cell to, int t, int robot) const
+  {
+    // the target cell must be free when the robot arrives
+    int other = owner(to, t + 1);
+    if(other >= 0 && other != robot) return false;
+
+    // no other robot can come the opposite way through the same edge
+    if(from == to) return true;
+
+    other = owner(to, t);
+    if(other >= 0 && other != robot && owner(from, t + 1) == other) return false;
+
+    return true;
+  }
+
+  int ReservationTable::lastReserved(Cell c) const
+  {
+    auto last = last_reserved.find(packCell(c));
+    return last == last_reserved.end() ? -1 : last->second;
+  }
+
+  unsigned int ReservationTable::size() const
+  {
+    return count;
+  }
+
+  // FleetPlanner ==========================================================
+  FleetPlanner::FleetPlanner(Grid grid, int horizon)
+  {
+    this->grid = grid;
+    this->horizon = horizon;
+
+    heuristic.resize(grid.width() * grid.height());
+  }
+
+  std::vector<std::vector<Cell>> FleetPlanner::plan(const std::vector<Cell> & starts, const std::vector<Cell> & goals)
+  {
+    std::vector<std::vector<Cell>> paths(starts.size());
+
+    table.clear();
+
+    // lower priority robots are still sitting at their start at t = 0
+    for(unsigned int i = 0; i < starts.size(); i++) table.reserve(starts.at(i), 0, i);
+
+    for(unsigned int i = 0; i < starts.size(); i++)
+    {
+      paths.at(i) = search(starts.at(i), goals.at(i), i);
+
+      if(paths.at(i).empty())
+      {
+        std::cout << "No path found for robot " << i << ", holding it at its start\n";
+        table.park(starts.at(i), 0, i);
+        continue;
+      }
+
+      for(unsigned int t = 0; t < paths.at(i).size(); t++) table.reserve(paths.at(i).at(t), t, i);
+      table.park(paths.at(i).back(), paths.at(i).size() - 1, i);
+    }
+
+    return paths;
+  }
+
+  const ReservationTable & FleetPlanner::reservations() const
+  {
+    return table;
+  }
+
+  void FleetPlanner::computeHeuristic(Cell goal)
+  {
+    std::fill(heuristic.begin(), heuristic.end(), -1);
+    frontier.clear();
+
+    if(!grid.isFree(goal)) return;
+
+    heuristic.at(grid.index(goal)) = 0;
+    frontier.push_back(grid.index(goal));
+
+    // breadth first search out from the goal
+    for(unsigned int head = 0; head < frontier.size(); head++)
+    {
+      int cur = frontier.at(head);
+      Cell c(cur % grid.width(), cur / grid.width());
+
+      for(int m = 1; m < 5; m++)
+      {
+        Cell n(c.x + move_x[m], c.y + move_y[m]);
+        if(!grid.isFree(n) || heuristic.at(grid.index(n)) >= 0) continue;
+
+        heuristic.at(grid.index(n)) = heuristic.at(cur) + 1;
+        frontier.push_back(grid.index(n));
+      }
+    }
+  }
+
+  std::vector<Cell> FleetPlanner::search(Cell start, Cell goal, int robot)
+  {
+    std::vector<Cell> path;
+
+    if(!grid.isFree(start)) return path;
+
+    computeHeuristic(goal);
+    if(heuristic.at(grid.index(start)) < 0) return path;
+
+    // clear keeps the buckets, so the set only grows to the largest search
+    closed.clear();
+    pool.clear();
+    open.clear();
+
+    auto cmp = [this](int a, int b)
+    {
+      const Node & na = pool[a];
+      const Node & nb = pool[b];
+      return na.f > nb.f || (na.f == nb.f && na.g < nb.g);
+    };
+
+    pool.push_back(Node{grid.index(start), 0, 0, heuristic.at(grid.index(start)), -1});
+    open.push_back(0);
+
+    int goal_index = grid.index(goal);
+    int found = -1;
+
+    while(!open.empty())
+    {
+      std::pop_heap(open.begin(), open.end(), cmp);
+      int cur = open.back();
+      open.pop_back();
+
+      Node node = pool[cur];
+
+      if(!closed.insert(static_cast<uint64_t>(node.cell) * (horizon + 1) + node.t).second) continue;
+
+      // the robot can stop here if nobody needs the goal afterwards
+      if(node.cell == goal_index && table.lastReserved(goal) <= node.t)
+      {
+        found = cur;
+        break;
+      }
+
+      if(node.t >= horizon) continue;
+
+      Cell c(node.cell % grid.width(), node.cell / grid.width());
+
+      for(int m = 0; m < 5; m++)
+      {
+        Cell n(c.x + move_x[m], c.y + move_y[m]);
+        if(!grid.isFree(n)) continue;
+
+        int n_index = grid.index(n);
+        if(closed.count(static_cast<uint64_t>(n_index) * (horizon + 1) + node.t + 1)) continue;
+        if(!table.canMove(c, n, node.t, robot)) continue;
+
+        pool.push_back(Node{n_index, node.t + 1, node.g + 1, node.g + 1 + heuristic.at(n_index), cur});
+        open.push_back(pool.size() - 1);
+        std::push_heap(open.begin(), open.end(), cmp);
+      }
+    }
+
+    if(found < 0) return path;
+
+    for(int i = found; i >= 0; i = pool[i].parent)
+    {
+      path.push_back(Cell(pool[i].cell % grid.width(), pool[i].cell / grid.width()));
+    }
+    std::reverse(path.begin(), path.end());
+
+    return path;
+  }
+}
@@ -0,0 +1,341 @@
+/// \file
+/// \brief Source file for the ORCA velocity filter
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "nuplan/orca.hpp"
+
+namespace nuplan
+{
+
+  static constexpr double epsilon = 1e-9;
+
+  /// \brief 2D cross product
+  static double det(const rigid2d::Vector2D & a, const rigid2d::Vector2D & b)
+  {
+    return a.x * b.y - a.y * b.x;
+  }
+
+  /// \brief Build the ORCA half plane of each disc in a batch.
+  /// Every case of the velocity obstacle is computed and the right one selected,
+  /// so the loop has no branches and vectorizes (see the flags on this file in CMakeLists.txt).
+  /// The outputs are restrict so the compiler does not need a runtime alias check for every pair of buffers.
+  static void halfPlanes(unsigned int n, const double * px_in, const double * py_in, const double * vx_in, const double * vy_in,
+                         const double * r_in, const double * inv_in, const double * share_in,
+                         double self_vx, double self_vy, double inv_step,
+                         double * __restrict px_out, double * __restrict py_out, double * __restrict dx_out, double * __restrict dy_out)
+  {
+    for(unsigned int i = 0; i < n; i++)
+    {
+      double px = px_in[i];
+      double py = py_in[i];
+      double vx = vx_in[i];
+      double vy = vy_in[i];
+      double r = r_in[i];
+      double inv_horizon_i = inv_in[i];
+      double share_i = share_in[i];
+
+      double dist_sq = px*px + py*py;
+      double r_sq = r*r;
+      bool colliding = dist_sq <= r_sq;
+
+      // vector from the center of the cutoff circle to the relative velocity
+      double inv = colliding ? inv_step : inv_horizon_i;
+      double wx = vx - inv*px;
+      double wy = vy - inv*py;
+      double w_sq = wx*wx + wy*wy;
+      double dot1 = wx*px + wy*py;
+
+      // project on the cutoff circle
+      double w_len = std::sqrt(w_sq);
+      double inv_w = 1.0 / std::max(w_len, epsilon);
+      double unit_wx = wx * inv_w;
+      double unit_wy = wy * inv_w;
+      double cut_scale = r*inv - w_len;
+
+      double cut_ux = cut_scale * unit_wx;
+      double cut_uy = cut_scale * unit_wy;
+
+      // project on the nearest leg of the cone
+      double leg = std::sqrt(std::max(dist_sq - r_sq, 0.0));
+      double inv_d = 1.0 / std::max(dist_sq, epsilon);
+      double left_dx = (px*leg - py*r) * inv_d;
+      double left_dy = (px*r + py*leg) * inv_d;
+      double right_dx = -(px*leg + py*r) * inv_d;
+      double right_dy = -(-px*r + py*leg) * inv_d;
+
+      bool left = px*wy - py*wx > 0;
+      double leg_dx = left ? left_dx : right_dx;
+      double leg_dy = left ? left_dy : right_dy;
+      double dot2 = vx*leg_dx + vy*leg_dy;
+      double leg_ux = dot2*leg_dx - vx;
+      double leg_uy = dot2*leg_dy - vy;
+
+      bool cutoff = colliding | ((dot1 < 0) & (dot1*dot1 > r_sq*w_sq));
+
+      double dx = cutoff ? unit_wy : leg_dx;
+      double dy = cutoff ? -unit_wx : leg_dy;
+      double ux = cutoff ? cut_ux : leg_ux;
+      double uy = cutoff ? cut_uy : leg_uy;
+
+      px_out[i] = self_vx + share_i*ux;
+      py_out[i] = self_vy + share_i*uy;
+      dx_out[i] = dx;
+      dy_out[i] = dy;
+    }
+  }
+
+  // SpatialHash ===========================================================
+  SpatialHash::SpatialHash(double cell_size)
+  {
+    this->cell_size = cell_size;
+  }
+
+  uint64_t SpatialHash::key(int cx, int cy)
+  {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+  }
+
+  void SpatialHash::clear()
+  {
+    for(auto & b : buckets) b.second.clear();
+  }
+
+  void SpatialHash::insert(int id, double x, double y)
+  {
+    int cx = std::floor(x / cell_size);
+    int cy = std::floor(y / cell_size);
+    buckets[key(cx, cy)].push_back(Point{id, x, y});
+  }
+
+  void SpatialHash::query(double x, double y, double radius, std::vector<int> & ids) const
+  {
+    ids.clear();
+
+    int cx_min = std::floor((x - radius) / cell_size);
+    int cx_max = std::floor((x + radius) / cell_size);
+    int cy_min = std::floor((y - radius) / cell_size);
+    int cy_max = std::floor((y + radius) / cell_size);
+
+    for(int cx = cx_min; cx <= cx_max; cx++)
+    {
+      for(int cy = cy_min; cy <= cy_max; cy++)
+      {
+        auto b = buckets.find(key(cx, cy));
+        if(b == buckets.end()) continue;
+
+        for(auto & p : b->second)
+        {
+          double dx = p.x - x;
+          double dy = p.y - y;
+          if(dx*dx + dy*dy <= radius*radius) ids.push_back(p.id);
+        }
+      }
+    }
+  }
+
+  // OrcaFilter ============================================================
+  OrcaFilter::OrcaFilter(double time_horizon, double obstacle_horizon, double time_step, double max_speed)
+  {
+    inv_horizon = 1.0 / time_horizon;
+    inv_obstacle_horizon = 1.0 / obstacle_horizon;
+    inv_time_step = 1.0 / time_step;
+    this->max_speed = max_speed;
+  }
+
+  rigid2d::Vector2D OrcaFilter::computeVelocity(const Agent & self, const rigid2d::Vector2D & preferred,
+                                                const std::vector<Agent> & neighbors, const std::vector<Agent> & obstacles)
+  {
+    buildConstraints(self, neighbors, obstacles);
+
+    rigid2d::Vector2D result;
+    unsigned int failed = linearProgram2(lines, preferred, false, result);
+
+    if(failed < lines.size()) linearProgram3(obstacles.size(), failed, result);
+
+    return result;
+  }
+
+  const std::vector<Line> & OrcaFilter::constraints() const
+  {
+    return lines;
+  }
+
+  void OrcaFilter::buildConstraints(const Agent & self, const std::vector<Agent> & neighbors, const std::vector<Agent> & obstacles)
+  {
+    unsigned int n = obstacles.size() + neighbors.size();
+
+    rel_x.resize(n);
+    rel_y.resize(n);
+    rel_vx.resize(n);
+    rel_vy.resize(n);
+    comb_r.resize(n);
+    inv_t.resize(n);
+    share.resize(n);
+
+    out_px.resize(n);
+    out_py.resize(n);
+    out_dx.resize(n);
+    out_dy.resize(n);
+
+    // gather, obstacles first so linearProgram3 can keep them hard
+    for(unsigned int i = 0; i < n; i++)
+    {
+      bool is_obstacle = i < obstacles.size();
+      const Agent & other = is_obstacle ? obstacles[i] : neighbors[i - obstacles.size()];
+
+      rel_x[i] = other.x - self.x;
+      rel_y[i] = other.y - self.y;
+      rel_vx[i] = self.vx - other.vx;
+      rel_vy[i] = self.vy - other.vy;
+      comb_r[i] = self.radius + other.radius;
+      inv_t[i] = is_obstacle ? inv_obstacle_horizon : inv_horizon;
+      share[i] = is_obstacle ? 1.0 : 0.5;
+    }
+
+    halfPlanes(n, rel_x.data(), rel_y.data(), rel_vx.data(), rel_vy.data(), comb_r.data(), inv_t.data(), share.data(),
+               self.vx, self.vy, inv_time_step, out_px.data(), out_py.data(), out_dx.data(), out_dy.data());
+
+    lines.resize(n);
+    for(unsigned int i = 0; i < n; i++)
+    {
+      lines[i].point = rigid2d::Vector2D(out_px[i], out_py[i]);
+      lines[i].direction = rigid2d::Vector2D(out_dx[i], out_dy[i]);
+    }
+  }
+
+  bool OrcaFilter::linearProgram1(const std::vector<Line> & lines, unsigned int line_no, const rigid2d::Vector2D & opt, bool direction_opt, rigid2d::Vector2D & result) const
+  {
+    const Line & line = lines[line_no];
+
+    double dot = line.point.dot(line.direction);
+    double discriminant = dot*dot + max_speed*max_speed - line.point.dot(line.point);
+
+    // the line misses the speed circle
+    if(discriminant < 0) return false;
+
+    double sqrt_disc = std::sqrt(discriminant);
+    double t_left = -dot - sqrt_disc;
+    double t_right = -dot + sqrt_disc;
+
+    for(unsigned int i = 0; i < line_no; i++)
+    {
+      double denominator = det(line.direction, lines[i].direction);
+      double numerator = det(lines[i].direction, line.point - lines[i].point);
+
+      // parallel lines
+      if(std::fabs(denominator) <= epsilon)
+      {
+        if(numerator < 0) return false;
+        continue;
+      }
+
+      double t = numerator / denominator;
+      if(denominator >= 0) t_right = std::min(t_right, t);
+      else t_left = std::max(t_left, t);
+
+      if(t_left > t_right) return false;
+    }
+
+    if(direction_opt)
+    {
+      result = line.point + (opt.dot(line.direction) > 0 ? t_right : t_left) * line.direction;
+    }
+    else
+    {
+      double t = std::clamp(line.direction.dot(opt - line.point), t_left, t_right);
+      result = line.point + t * line.direction;
+    }
+
+    return true;
+  }
+
+  unsigned int OrcaFilter::linearProgram2(const std::vector<Line> & lines, const rigid2d::Vector2D & opt, bool direction_opt, rigid2d::Vector2D & result) const
+  {
+    if(direction_opt)
+    {
+      result = opt * max_speed;
+    }
+    else if(opt.dot(opt) > max_speed*max_speed)
+    {
+      result = opt.normalize() * max_speed;
+    }
+    else
+    {
+      result = opt;
+    }
+
+    for(unsigned int i = 0; i < lines.size(); i++)
+    {
+      // the result is outside this half plane, move it onto the line
+      if(det(lines[i].direction, lines[i].point - result) > 0)
+      {
+        rigid2d::Vector2D prev = result;
+        if(!linearProgram1(lines, i, opt, direction_opt, result))
+        {
+          result = prev;
+          return i;
+        }
+      }
+    }
+
+    return lines.size();
+  }
+
+  void OrcaFilter::linearProgram3(unsigned int num_obstacle_lines, unsigned int begin_line, rigid2d::Vector2D & result)
+  {
+    double distance = 0;
+
+    for(unsigned int i = begin_line; i < lines.size(); i++)
+    {
+      if(det(lines[i].direction, lines[i].point - result) <= distance) continue;
+
+      // the obstacle lines stay hard, the other lines become bisectors with line i
+      projected.assign(lines.begin(), lines.begin() + num_obstacle_lines);
+
+      for(unsigned int j = num_obstacle_lines; j < i; j++)
+      {
+        Line line;
+        double determinant = det(lines[i].direction, lines[j].direction);
+
+        if(std::fabs(determinant) <= epsilon)
+        {
+          // same direction, line j is implied by line i
+          if(lines[i].direction.dot(lines[j].direction) > 0) continue;
+
+          line.point = 0.5 * (lines[i].point + lines[j].point);
+        }
+        else
+        {
+          line.point = lines[i].point + (det(lines[j].direction, lines[i].point - lines[j].point) / determinant) * lines[i].direction;
+        }
+
+        line.direction = (lines[j].direction - lines[i].direction).normalize();
+        projected.push_back(line);
+      }
+
+      rigid2d::Vector2D prev = result;
+      rigid2d::Vector2D perp(-lines[i].direction.y, lines[i].direction.x);
+
+      // should only fail from rounding, when the result is already optimal
+      if(linearProgram2(projected, perp, true, result) < projected.size()) result = prev;
+
+      distance = det(lines[i].direction, lines[i].point - result);
+    }
+  }
+
+  // Diff drive ============================================================
+  rigid2d::Twist2D velocityToTwist(const rigid2d::Vector2D & vel, double heading, double max_speed, double max_rot, double heading_gain)
+  {
+    double speed = std::sqrt(vel.x*vel.x + vel.y*vel.y);
+    if(speed < epsilon) return rigid2d::Twist2D(0, 0, 0);
+
+    double error = rigid2d::normalize_angle(std::atan2(vel.y, vel.x) - heading);
+
+    double v = std::clamp(speed * std::cos(error), 0.0, max_speed);
+    double w = std::clamp(heading_gain * error, -max_rot, max_rot);
+
+    return rigid2d::Twist2D(w, v, 0);
+  }
+}
@@ -0,0 +1,563 @@
+/// \file
+/// \brief Source file for the lazy probabilistic roadmap
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <tuple>
+#include <functional>
+
+#include "nuplan/roadmap.hpp"
+
+namespace nuplan
+{
+
+  // roadmap file header, followed by the version
+  static const char roadmap_magic[4] = {'N', 'U', 'R', 'M'};
+  static const uint32_t roadmap_version = 1;
+
+  /// \brief visit the cells under a segment in order, stopping early if the visitor returns false
+  /// \returns false if the visitor stopped the walk
+  template <class Visit>
+  static bool walkSegment(rigid2d::Vector2D p, rigid2d::Vector2D q, Visit visit)
+  {
+    Cell c(std::floor(p.x), std::floor(p.y));
+    const Cell end(std::floor(q.x), std::floor(q.y));
+
+    const double dx = q.x - p.x, dy = q.y - p.y;
+    const double inf = std::numeric_limits<double>::infinity();
+    const int step_x = dx > 0 ? 1 : -1, step_y = dy > 0 ? 1 : -1;
+
+    // the fraction of the segment to the next vertical and horizontal cell border
+    double t_x = dx != 0 ? (dx > 0 ? c.x + 1 - p.x : p.x - c.x) / std::fabs(dx) : inf;
+    double t_y = dy != 0 ? (dy > 0 ? c.y + 1 - p.y : p.y - c.y) / std::fabs(dy) : inf;
+    const double dt_x = dx != 0 ? 1.0 / std::fabs(dx) : inf, dt_y = dy != 0 ? 1.0 / std::fabs(dy) : inf;
+
+    // the walk takes exactly this many steps, so rounding can not run it past the end
+    int steps = std::abs(end.x - c.x) + std::abs(end.y - c.y);
+    if(!visit(c)) return false;
+    for(int i = 0; i < steps; i++)
+    {
+      if(t_x < t_y)
+      {
+        c.x += step_x;
+        t_x += dt_x;
+      }
+      else
+      {
+        c.y += step_y;
+        t_y += dt_y;
+      }
+      if(!visit(c)) return false;
+    }
+    return true;
+  }
+
+  template <class T>
+  static void writeValue(std::ofstream & out, const T & value)
+  {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  template <class T>
+  static bool readValue(std::ifstream & in, T & value)
+  {
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+  }
+
+  // KdTree ================================================================
+  KdTree::KdTree() {}
+
+  void KdTree::build(const std::vector<rigid2d::Vector2D> & pts)
+  {
+    points = pts;
+    order.resize(points.size());
+    for(unsigned int i = 0; i < order.size(); i++) order.at(i) = i;
+    buildRange(0, order.size(), 0);
+  }
+
+  void KdTree::buildRange(int begin, int end, int depth)
+  {
+    if(end - begin <= 1) return;
+
+    int mid = (begin + end) / 2;
+    bool split_x = depth % 2 == 0;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b)
+    {
+      return split_x ? points[a].x < points[b].x : points[a].y < points[b].y;
+    });
+
+    buildRange(begin, mid, depth + 1);
+    buildRange(mid + 1, end, depth + 1);
+  }
+
+  void KdTree::nearest(rigid2d::Vector2D p, unsigned int k, double radius, std::vector<int> & ids) const
+  {
+    ids.clear();
+    if(k == 0) return;
+
+    std::vector<std::pair<double, int>> best;
+    best.reserve(k + 1);
+    double bound = radius * radius;
+    nearestRange(0, order.size(), 0, p, k, best, bound);
+
+    std::sort_heap(best.begin(), best.end());
+    for(auto & b : best) ids.push_back(b.second);
+  }
+
+  void KdTree::nearestRange(int begin, int end, int depth, rigid2d::Vector2D p, unsigned int k,
+                            std::vector<std::pair<double, int>> & best, double & bound) const
+  {
+    if(begin >= end) return;
+
+    int mid = (begin + end) / 2;
+    int id = order[mid];
+    double dx = points[id].x - p.x, dy = points[id].y - p.y;
+    double d2 = dx*dx + dy*dy;
+
+    if(d2 <= bound)
+    {
+      best.emplace_back(d2, id);
+      std::push_heap(best.begin(), best.end());
+      if(best.size() > k)
+      {
+        std::pop_heap(best.begin(), best.end());
+        best.pop_back();
+      }
+      // once there are k, only a point nearer than the farthest of them can get in
+      if(best.size() == k) bound = std::min(bound, best.front().first);
+    }
+
+    double diff = depth % 2 == 0 ? p.x - points[id].x : p.y - points[id].y;
+    if(diff < 0)
+    {
+      nearestRange(begin, mid, depth + 1, p, k, best, bound);
+      if(diff*diff <= bound) nearestRange(mid + 1, end, depth + 1, p, k, best, bound);
+    }
+    else
+    {
+      nearestRange(mid + 1, end, depth + 1, p, k, best, bound);
+      if(diff*diff <= bound) nearestRange(begin, mid, depth + 1, p, k, best, bound);
+    }
+  }
+
+  void KdTree::within(rigid2d::Vector2D p, double radius, std::vector<int> & ids) const
+  {
+    ids.clear();
+    withinRange(0, order.size(), 0, p, radius * radius, ids);
+  }
+
+  void KdTree::withinRange(int begin, int end, int depth, rigid2d::Vector2D p, double r2, std::vector<int> & ids) const
+  {
+    if(begin >= end) return;
+
+    int mid = (begin + end) / 2;
+    int id = order[mid];
+    double dx = points[id].x - p.x, dy = points[id].y - p.y;
+    if(dx*dx + dy*dy <= r2) ids.push_back(id);
+
+    double diff = depth % 2 == 0 ? p.x - points[id].x : p.y - points[id].y;
+    if(diff <= 0 || diff*diff <= r2) withinRange(begin, mid, depth + 1, p, r2, ids);
+    if(diff >= 0 || diff*diff <= r2) withinRange(mid + 1, end, depth + 1, p, r2, ids);
+  }
+
+  unsigned int KdTree::size() const
+  {
+    return points.size();
+  }
+
+  // Roadmap ===============================================================
+  Roadmap::Roadmap() {}
+
+  Roadmap::Roadmap(const Grid & grid, const RoadmapParams & params) : cells(grid), params(params)
+  {
+    sample();
+  }
+
+  void Roadmap::sample()
+  {
+    points.clear();
+
+    std::mt19937 gen(params.seed);
+    std::uniform_real_distribution<double> ux(0.0, cells.width()), uy(0.0, cells.height());
+
+    // give up on a map with almost no free space
+    for(unsigned int tries = 0; points.size() < params.num_nodes && tries < 100 * params.num_nodes; tries++)
+    {
+      rigid2d::Vector2D p(ux(gen), uy(gen));
+      if(cells.isFree(Cell(std::floor(p.x), std::floor(p.y)))) points.push_back(p);
+    }
+
+    edges.clear();
+    connect();
+    num_checks = 0;
+  }
+
+  void Roadmap::connect()
+  {
+    tree.build(points);
+    adjacent.assign(points.size(), std::vector<int>());
+
+    // an edge already loaded is only indexed
+    for(unsigned int e = 0; e < edges.size(); e++)
+    {
+      adjacent.at(edges.at(e).a).push_back(e);
+      adjacent.at(edges.at(e).b).push_back(e);
+    }
+    if(!edges.empty()) return;
+
+    std::vector<int> near;
+    for(unsigned int i = 0; i < points.size(); i++)
+    {
+      // the node itself comes back first
+      tree.nearest(points.at(i), params.neighbors + 1, params.connect_radius, near);
+      for(int j : near)
+      {
+        if(j == static_cast<int>(i)) continue;
+
+        bool joined = false;
+        for(int e : adjacent.at(i)) joined = joined || edges.at(e).a == j || edges.at(e).b == j;
+        if(joined) continue;
+
+        edges.push_back(Edge{static_cast<int>(i), j, points.at(i).distance(points.at(j)), EdgeState::Unknown});
+        adjacent.at(i).push_back(edges.size() - 1);
+        adjacent.at(j).push_back(edges.size() - 1);
+      }
+    }
+  }
+
+  bool Roadmap::segmentFree(rigid2d::Vector2D p, rigid2d::Vector2D q) const
+  {
+    return walkSegment(p, q, [this](Cell c) { return cells.isFree(c); });
+  }
+
+  EdgeState Roadmap::check(int edge)
+  {
+    Edge & e = edges.at(edge);
+    if(e.state == EdgeState::Unknown)
+    {
+      num_checks++;
+      e.state = segmentFree(points.at(e.a), points.at(e.b)) ? EdgeState::Free : EdgeState::Blocked;
+    }
+    return e.state;
+  }
+
+  std::vector<rigid2d::Vector2D> Roadmap::plan(rigid2d::Vector2D start, rigid2d::Vector2D goal)
+  {
+    std::vector<rigid2d::Vector2D> path;
+
+    if(!cells.isFree(Cell(std::floor(start.x), std::floor(start.y)))) return path;
+    if(!cells.isFree(Cell(std::floor(goal.x), std::floor(goal.y)))) return path;
+
+    // the start and the goal join the graph for this query only, as the two nodes after the roadmap
+    const int n = points.size();
+    std::vector<Edge> extra;
+    std::vector<int> near;
+    for(int end = 0; end < 2; end++)
+    {
+      rigid2d::Vector2D p = end == 0 ? start : goal;
+      tree.nearest(p, params.neighbors, params.connect_radius, near);
+      for(int j : near) extra.push_back(Edge{n + end, j, p.distance(points.at(j)), EdgeState::Unknown});
+    }
+    if(start.distance(goal) <= params.connect_radius)
+    {
+      extra.push_back(Edge{n, n + 1, start.distance(goal), EdgeState::Unknown});
+    }
+
+    // every pass blocks at least one more edge, or returns
+    while(true)
+    {
+      std::vector<int> route = search(start, goal, extra);
+      if(route.empty()) return path;
+
+      bool blocked = false;
+      for(int id : route)
+      {
+        if(id < static_cast<int>(edges.size()))
+        {
+          blocked = check(id) == EdgeState::Blocked;
+        }
+        else
+        {
+          Edge & e = extra.at(id - edges.size());
+          rigid2d::Vector2D from = e.a == n ? start : goal;
+          rigid2d::Vector2D to = e.b == n + 1 ? goal : points.at(e.b);
+          if(e.state == EdgeState::Unknown) e.state = segmentFree(from, to) ? EdgeState::Free : EdgeState::Blocked;
+          blocked = e.state == EdgeState::Blocked;
+        }
+        if(blocked) break;
+      }
+      if(blocked) continue;
+
+      path.push_back(start);
+      int cur = n;
+      for(int id : route)
+      {
+        const Edge & e = id < static_cast<int>(edges.size()) ? edges.at(id) : extra.at(id - edges.size());
+        cur = e.a == cur ? e.b : e.a;
+        path.push_back(cur == n + 1 ? goal : points.at(cur));
+      }
+      return path;
+    }
+  }
+
+  std::vector<int> Roadmap::search(rigid2d::Vector2D start, rigid2d::Vector2D goal, const std::vector<Edge> & extra)
+  {
+    std::vector<int> route;
+
+    const int n = points.size();
+    const int num_edges = edges.size();
+    if(static_cast<int>(g.size()) < n + 2)
+    {
+      g.resize(n + 2);
+      parent.resize(n + 2);
+      visited.resize(n + 2, 0);
+    }
+
+    // a new stamp invalidates the costs of the previous search without clearing them
+    stamp++;
+    if(stamp == 0)
+    {
+      std::fill(visited.begin(), visited.end(), 0);
+      stamp = 1;
+    }
+
+    auto position = [&](int i) { return i < n ? points[i] : (i == n ? start : goal); };
+
+    // (f, g, node), the least f on top
+    using Entry = std::tuple<double, double, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+    g[n] = 0.0;
+    parent[n] = -1;
+    visited[n] = stamp;
+    open.emplace(start.distance(goal), 0.0, n);
+
+    auto relax = [&](int id, const Edge & e, int from, double cost)
+    {
+      if(e.state == EdgeState::Blocked) return;
+      int to = e.a == from ? e.b : e.a;
+      double next = cost + e.length;
+      if(visited[to] == stamp && g[to] <= next) return;
+
+      g[to] = next;
+      parent[to] = id;
+      visited[to] = stamp;
+      open.emplace(next + position(to).distance(goal), next, to);
+    };
+
+    while(!open.empty())
+    {
+      auto [f, cost, cur] = open.top();
+      open.pop();
+      (void)f;
+
+      // a stale entry, the node was reached more cheaply since
+      if(cost > g[cur]) continue;
+      if(cur == n + 1) break;
+
+      if(cur < n)
+      {
+        for(int id : adjacent[cur]) relax(id, edges[id], cur, cost);
+      }
+      for(unsigned int i = 0; i < extra.size(); i++)
+      {
+        if(extra[i].a == cur || extra[i].b == cur) relax(num_edges + i, extra[i], cur, cost);
+      }
+    }
+
+    if(visited[n + 1] != stamp) return route;
+
+    for(int cur = n + 1; cur != n;)
+    {
+      int id = parent[cur];
+      route.push_back(id);
+      const Edge & e = id < num_edges ? edges[id] : extra[id - num_edges];
+      cur = e.a == cur ? e.b : e.a;
+    }
+    std::reverse(route.begin(), route.end());
+
+    return route;
+  }
+
+  void Roadmap::setOccupied(Cell c, bool occupied)
+  {
+    if(cells.isFree(c) != occupied) return;
+    cells.setOccupied(c, occupied);
+
+    // only an edge with both ends near the cell can cross it
+    std::vector<int> near;
+    rigid2d::Vector2D center(c.x + 0.5, c.y + 0.5);
+    tree.within(center, params.connect_radius + 1.0, near);
+
+    for(int i : near)
+    {
+      for(int id : adjacent.at(i))
+      {
+        Edge & e = edges.at(id);
+
+        // a new obstacle only blocks free edges, a cleared cell only may unblock blocked ones
+        EdgeState from = occupied ? EdgeState::Free : EdgeState::Blocked;
+        if(e.state != from) continue;
+
+        bool crosses = !walkSegment(points.at(e.a), points.at(e.b), [&c](Cell v) { return !(v == c); });
+        if(crosses) e.state = occupied ? EdgeState::Blocked : EdgeState::Unknown;
+      }
+    }
+  }
+
+  bool Roadmap::updateGrid(const Grid & grid)
+  {
+    if(grid.width() != cells.width() || grid.height() != cells.height())
+    {
+      cells = grid;
+      sample();
+      return false;
+    }
+
+    for(int y = 0; y < grid.height(); y++)
+    {
+      for(int x = 0; x < grid.width(); x++)
+      {
+        Cell c(x, y);
+        if(grid.isFree(c) != cells.isFree(c)) setOccupied(c, !grid.isFree(c));
+      }
+    }
+    return true;
+  }
+
+  bool Roadmap::save(const std::string & path) const
+  {
+    std::ofstream out(path, std::ios::binary);
+    if(!out) return false;
+
+    out.write(roadmap_magic, sizeof(roadmap_magic));
+    writeValue(out, roadmap_version);
+    writeValue(out, params.num_nodes);
+    writeValue(out, params.neighbors);
+    writeValue(out, params.connect_radius);
+    writeValue(out, params.seed);
+
+    int32_t w = cells.width(), h = cells.height();
+    writeValue(out, w);
+    writeValue(out, h);
+    for(int y = 0; y < h; y++)
+    {
+      for(int x = 0; x < w; x++) writeValue(out, static_cast<uint8_t>(cells.isFree(Cell(x, y)) ? 0 : 1));
+    }
+
+    writeValue(out, static_cast<uint32_t>(points.size()));
+    for(auto & p : points)
+    {
+      writeValue(out, p.x);
+      writeValue(out, p.y);
+    }
+
+    writeValue(out, static_cast<uint32_t>(edges.size()));
+    for(auto & e : edges)
+    {
+      writeValue(out, static_cast<int32_t>(e.a));
+      writeValue(out, static_cast<int32_t>(e.b));
+      writeValue(out, static_cast<uint8_t>(e.state));
+    }
+
+    return static_cast<bool>(out);
+  }
+
+  bool Roadmap::load(const std::string & path)
+  {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+
+    char magic[4];
+    uint32_t version = 0;
+    if(!in.read(magic, sizeof(magic)) || std::memcmp(magic, roadmap_magic, sizeof(magic)) != 0) return false;
+    if(!readValue(in, version) || version != roadmap_version) return false;
+
+    RoadmapParams loaded_params;
+    int32_t w = 0, h = 0;
+    if(!readValue(in, loaded_params.num_nodes) || !readValue(in, loaded_params.neighbors) ||
+       !readValue(in, loaded_params.connect_radius) || !readValue(in, loaded_params.seed) ||
+       !readValue(in, w) || !readValue(in, h) || w < 0 || h < 0)
+    {
+      return false;
+    }
+
+    Grid loaded_cells(w, h);
+    for(int y = 0; y < h; y++)
+    {
+      for(int x = 0; x < w; x++)
+      {
+        uint8_t occupied = 0;
+        if(!readValue(in, occupied)) return false;
+        loaded_cells.setOccupied(Cell(x, y), occupied != 0);
+      }
+    }
+
+    uint32_t num_points = 0;
+    if(!readValue(in, num_points)) return false;
+    std::vector<rigid2d::Vector2D> loaded_points(num_points);
+    for(auto & p : loaded_points)
+    {
+      if(!readValue(in, p.x) || !readValue(in, p.y)) return false;
+    }
+
+    uint32_t num_edges = 0;
+    if(!readValue(in, num_edges)) return false;
+    std::vector<Edge> loaded_edges(num_edges);
+    for(auto & e : loaded_edges)
+    {
+      int32_t a = 0, b = 0;
+      uint8_t state = 0;
+      if(!readValue(in, a) || !readValue(in, b) || !readValue(in, state)) return false;
+      if(a < 0 || b < 0 || a >= static_cast<int32_t>(num_points) || b >= static_cast<int32_t>(num_points) || state > 2) return false;
+      e = Edge{a, b, loaded_points.at(a).distance(loaded_points.at(b)), static_cast<EdgeState>(state)};
+    }
+
+    cells = loaded_cells;
+    params = loaded_params;
+    points.swap(loaded_points);
+    edges.swap(loaded_edges);
+    connect();
+    num_checks = 0;
+    return true;
+  }
+
+  const Grid & Roadmap::grid() const
+  {
+    return cells;
+  }
+
+  const RoadmapParams & Roadmap::parameters() const
+  {
+    return params;
+  }
+
+  const std::vector<rigid2d::Vector2D> & Roadmap::nodes() const
+  {
+    return points;
+  }
+
+  unsigned int Roadmap::numEdges() const
+  {
+    return edges.size();
+  }
+
+  unsigned int Roadmap::countEdges(EdgeState state) const
+  {
+    unsigned int count = 0;
+    for(auto & e : edges) count += e.state == state;
+    return count;
+  }
+
+  uint64_t Roadmap::checks() const
+  {
+    return num_checks;
+  }
+
+}
@@ -0,0 +1,289 @@
+/// \file
+/// \brief This node filters the velocity command of one robot in a fleet so it does not collide
+/// with the other robots or the landmark cylinders, using ORCA
+///
+/// PARAMETERS:
+///     robot_name (std::string) the namespace of the robot this filter drives
+///     robot_names (std::vector<std::string>) the namespace of every robot in the fleet
+///     radius (double) the radius of each robot
+///     cylinder_radius (double) the radius of each landmark cylinder, slam only estimates their centers
+///     map_frame_id (std::string) the frame of the landmarks, used when their header has none
+///     safety_margin (double) extra radius to cover the error of a diff drive tracking a planar velocity
+///     time_horizon (double) the time (s) to guarantee no collision with another robot
+///     obstacle_horizon (double) the time (s) to guarantee no collision with a cylinder
+///     neighbor_dist (double) the max distance to consider other robots and cylinders
+///     tvel_lim (double) the maximum translational velocity
+///     avel_lim (double) the maximum angular velocity
+///     heading_gain (double) proportional gain turning the robot toward the safe velocity
+///     frequency (double) the frequency to publish commands at
+/// PUBLISHES:
+///     cmd_vel (geometry_msgs/Twist): the safe twist command
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
+/// SUBSCRIBES:
+///     cmd_vel_pref (geometry_msgs/Twist): the preferred twist from the path follower
+///     /<robot>/odom (nav_msgs/Odometry): the pose and velocity of every robot in the fleet
+///     /slam_landmark_data (nuslam/TurtleMap): the cylinders in the map frame
+///     /tf (tf2_msgs/TFMessage): the map to odom transform of this robot, to move the cylinders into its odom frame
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2_ros/transform_listener.h>
+
+#include <geometry_msgs/Twist.h>
+#include <nav_msgs/Odometry.h>
+
+#include "nuslam/TurtleMap.h"
+
+#include "rigid2d/rigid2d.hpp"
+#include "rigid2d/topic_monitor.hpp"
+#include "nuplan/orca.hpp"
+
+// Global Variables
+static geometry_msgs::Twist pref_cmd;
+static ros::Time pref_stamp;
+static nuslam::TurtleMap cur_landmarks;
+static std::vector<nav_msgs::Odometry> cur_odom;
+static std::vector<int> got_odom;
+
+/// \brief Callback for the preferred twist subscriber
+///
+void callback_pref(const geometry_msgs::Twist::ConstPtr data)
+{
+  pref_cmd = *data;
+  pref_stamp = ros::Time::now();
+}
+
+/// \brief Callback for the landmark subscriber
+///
+void callback_landmarks(const nuslam::TurtleMap::ConstPtr data)
+{
+  cur_landmarks = *data;
+}
+
+/// \brief Get the yaw from a ros pose message
+///
+static double getYawFromPose(geometry_msgs::Pose pose)
+{
+  auto r = 0.0, p = 0.0, y = 0.0;
+  tf2::Quaternion quat_tf2(pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w);
+  tf2::Matrix3x3 heading(quat_tf2);
+  heading.getRPY(r,p,y);
+
+  return y;
+}
+
+/// \brief Convert a tf2 transform into a planar transform
+///
+static rigid2d::Transform2D toTransform2D(const geometry_msgs::Transform & T)
+{
+  tf2::Quaternion quat_tf2(T.rotation.x, T.rotation.y, T.rotation.z, T.rotation.w);
+  auto r = 0.0, p = 0.0, y = 0.0;
+  tf2::Matrix3x3(quat_tf2).getRPY(r, p, y);
+
+  return rigid2d::Transform2D(rigid2d::Vector2D(T.translation.x, T.translation.y), y);
+}
+
+/// \brief Convert odometry into a disc moving in the plane
+/// \param odom - the odometry, with the twist in the body frame
+/// \param radius - the radius of the disc
+/// \return the agent
+static nuplan::Agent toAgent(const nav_msgs::Odometry & odom, double radius)
+{
+  double th = getYawFromPose(odom.pose.pose);
+
+  nuplan::Agent agent;
+  agent.x = odom.pose.pose.position.x;
+  agent.y = odom.pose.pose.position.y;
+  agent.vx = odom.twist.twist.linear.x * std::cos(th);
+  agent.vy = odom.twist.twist.linear.x * std::sin(th);
+  agent.radius = radius;
+
+  return agent;
+}
+
+/// \brief Main function for the orca_filter node
+///
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "orca_filter");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+  rigid2d::TopicMonitor monitor(n);
+
+  std::string robot_name;
+  std::vector<std::string> robot_names;
+  double radius = 0.105, safety_margin = 0.03, cylinder_radius = 0.04;
+  std::string map_frame_id = "map";
+  double time_horizon = 2.0, obstacle_horizon = 1.0;
+  double neighbor_dist = 1.5;
+  double tvel_lim = 0.22, avel_lim = 2.84;
+  double heading_gain = 3.0;
+  double frequency = 20.0;
+
+  pn.getParam("robot_name", robot_name);
+  pn.getParam("robot_names", robot_names);
+  pn.getParam("radius", radius);
+  pn.getParam("safety_margin", safety_margin);
+  pn.getParam("cylinder_radius", cylinder_radius);
+  pn.getParam("map_frame_id", map_frame_id);
+  pn.getParam("time_horizon", time_horizon);
+  pn.getParam("obstacle_horizon", obstacle_horizon);
+  pn.getParam("neighbor_dist", neighbor_dist);
+  pn.getParam("tvel_lim", tvel_lim);
+  pn.getParam("avel_lim", avel_lim);
+  pn.getParam("heading_gain", heading_gain);
+  pn.getParam("frequency", frequency);
+
+  ROS_INFO_STREAM("ORCA: Got robot name: " << robot_name);
+  ROS_INFO_STREAM("ORCA: Got number of robots: " << robot_names.size());
+  ROS_INFO_STREAM("ORCA: Got radius: " << radius);
+  ROS_INFO_STREAM("ORCA: Got safety margin: " << safety_margin);
+  ROS_INFO_STREAM("ORCA: Got cylinder radius: " << cylinder_radius);
+  ROS_INFO_STREAM("ORCA: Got map frame id: " << map_frame_id);
+  ROS_INFO_STREAM("ORCA: Got time horizon: " << time_horizon);
+  ROS_INFO_STREAM("ORCA: Got obstacle horizon: " << obstacle_horizon);
+  ROS_INFO_STREAM("ORCA: Got neighbor distance: " << neighbor_dist);
+  ROS_INFO_STREAM("ORCA: Got trans vel limit: " << tvel_lim);
+  ROS_INFO_STREAM("ORCA: Got ang. vel limit: " << avel_lim);
+  ROS_INFO_STREAM("ORCA: Got heading gain: " << heading_gain);
+  ROS_INFO_STREAM("ORCA: Got frequency: " << frequency);
+
+  int self = -1;
+  for(unsigned int i = 0; i < robot_names.size(); i++)
+  {
+    if(robot_names.at(i) == robot_name) self = i;
+  }
+
+  if(self < 0)
+  {
+    ROS_ERROR_STREAM("ORCA: robot_name must be one of robot_names.");
+    return 1;
+  }
+
+  ros::Subscriber pref_sub = monitor.subscribe<geometry_msgs::Twist>(n, "cmd_vel_pref", callback_pref);
+  ros::Subscriber landmark_sub = monitor.subscribe<nuslam::TurtleMap>(n, "/slam_landmark_data", callback_landmarks);
+  ros::Publisher cmd_pub = n.advertise<geometry_msgs::Twist>("cmd_vel", 1);
+
+  std::vector<ros::Subscriber> odom_subs;
+  cur_odom.resize(robot_names.size());
+  got_odom.assign(robot_names.size(), 0);
+
+  for(unsigned int i = 0; i < robot_names.size(); i++)
+  {
+    boost::function<void(const nav_msgs::Odometry::ConstPtr &)> callback_odom =
+      [i](const nav_msgs::Odometry::ConstPtr & data) { cur_odom.at(i) = *data; got_odom.at(i) = 1; };
+
+    odom_subs.push_back(monitor.subscribe<nav_msgs::Odometry>(n, "/" + robot_names.at(i) + "/odom", callback_odom));
+  }
+
+  tf2_ros::Buffer tf_buffer;
+  tf2_ros::TransformListener tf_listener(tf_buffer);
+
+  double robot_radius = radius + safety_margin;
+
+  nuplan::OrcaFilter filter(time_horizon, obstacle_horizon, 1.0 / frequency, tvel_lim);
+  nuplan::SpatialHash robot_hash(neighbor_dist);
+  nuplan::SpatialHash cylinder_hash(neighbor_dist);
+
+  std::vector<nuplan::Agent> neighbors, obstacles;
+  std::vector<rigid2d::Vector2D> cylinders; // centers in the odom frame of this robot
+  std::vector<int> found;
+
+  bool stopped = true;
+
+  ros::Rate r(frequency);
+
+  while(ros::ok())
+  {
+    ros::spinOnce();
+
+    // stop if the path follower goes quiet
+    bool stale = (ros::Time::now() - pref_stamp).toSec() > 5.0 / frequency;
+
+    if(got_odom.at(self) == 1 && !stale)
+    {
+      nuplan::Agent me = toAgent(cur_odom.at(self), robot_radius);
+      double th = getYawFromPose(cur_odom.at(self).pose.pose);
+
+      robot_hash.clear();
+      for(unsigned int i = 0; i < robot_names.size(); i++)
+      {
+        if(static_cast<int>(i) != self && got_odom.at(i) == 1)
+        {
+          robot_hash.insert(i, cur_odom.at(i).pose.pose.position.x, cur_odom.at(i).pose.pose.position.y);
+        }
+      }
+
+      // the robots are in their odom frames, the cylinders in the map frame of slam. Until slam
+      // publishes a correction the two frames are the same
+      const std::string & odom_frame = cur_odom.at(self).header.frame_id;
+      const std::string & landmark_frame = cur_landmarks.header.frame_id.empty() ? map_frame_id : cur_landmarks.header.frame_id;
+      rigid2d::Transform2D T_odom_map;
+      if(!odom_frame.empty() && odom_frame != landmark_frame)
+      {
+        try
+        {
+          T_odom_map = toTransform2D(tf_buffer.lookupTransform(odom_frame, landmark_frame, ros::Time(0)).transform);
+        }
+        catch(tf2::TransformException & e)
+        {
+          ROS_WARN_STREAM_THROTTLE(5.0, "ORCA: No transform from " << landmark_frame << " to " << odom_frame << ", using the cylinders as they are");
+        }
+      }
+
+      cylinders.clear();
+      cylinder_hash.clear();
+      for(unsigned int i = 0; i < cur_landmarks.centers.size(); i++)
+      {
+        cylinders.push_back(T_odom_map(rigid2d::Vector2D(cur_landmarks.centers.at(i).x, cur_landmarks.centers.at(i).y)));
+        cylinder_hash.insert(i, cylinders.back().x, cylinders.back().y);
+      }
+
+      neighbors.clear();
+      robot_hash.query(me.x, me.y, neighbor_dist, found);
+      for(auto i : found) neighbors.push_back(toAgent(cur_odom.at(i), robot_radius));
+
+      obstacles.clear();
+      cylinder_hash.query(me.x, me.y, neighbor_dist, found);
+      for(auto i : found)
+      {
+        nuplan::Agent cyl;
+        cyl.x = cylinders.at(i).x;
+        cyl.y = cylinders.at(i).y;
+        cyl.radius = cylinder_radius;
+        obstacles.push_back(cyl);
+      }
+
+      rigid2d::Vector2D preferred(pref_cmd.linear.x * std::cos(th), pref_cmd.linear.x * std::sin(th));
+      rigid2d::Vector2D safe = filter.computeVelocity(me, preferred, neighbors, obstacles);
+
+      geometry_msgs::Twist cmd = pref_cmd;
+
+      // only override the path follower when a constraint moved its velocity
+      if(safe.distance(preferred) > 1e-6)
+      {
+        rigid2d::Twist2D tw = nuplan::velocityToTwist(safe, th, tvel_lim, avel_lim, heading_gain);
+        cmd.linear.x = tw.vx;
+        cmd.angular.z = tw.wz;
+      }
+
+      cmd_pub.publish(cmd);
+      stopped = false;
+    }
+    else if(stale && !stopped)
+    {
+      cmd_pub.publish(geometry_msgs::Twist());
+      stopped = true;
+    }
+
+    r.sleep();
+  }
+}
@@ -0,0 +1,254 @@
+/// \file
+/// \brief This node plans paths for repeated missions on a lazy probabilistic roadmap kept across runs
+///
+/// PARAMETERS:
+///     num_nodes (int) the nodes sampled in the free space of the map
+///     neighbors (int) the nearest nodes each node is joined to
+///     connect_radius (double) the longest edge of the roadmap (m)
+///     seed (int) the seed of the node sampling
+///     robot_radius (double) the radius of the robot, the obstacles are grown by it before sampling and checking edges
+///     roadmap_file (std::string) the roadmap is loaded from here at start up and saved here on shutdown, empty for neither,
+///                  a roadmap sampled with other settings is sampled again
+///     frame_id (std::string) the frame of the map
+/// PUBLISHES:
+///     plan (nav_msgs/Path): the path to the last goal, through the roadmap nodes
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
+/// SUBSCRIBES:
+///     /map (nav_msgs/OccupancyGrid): the occupancy grid, a new map only invalidates the edges that cross changed cells
+///     odom (nav_msgs/Odometry): the current pose of the robot, moved into the map frame for planning
+///     /tf (tf2_msgs/TFMessage): the transform from the odom frame to the map frame
+///     goal (geometry_msgs/PoseStamped): the goal of a mission, in the map frame
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cmath>
+
+#include <ros/ros.h>
+
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2_ros/transform_listener.h>
+
+#include <geometry_msgs/PoseStamped.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <nav_msgs/Odometry.h>
+#include <nav_msgs/Path.h>
+
+#include "rigid2d/topic_monitor.hpp"
+#include "nuplan/roadmap.hpp"
+
+// Global Variables
+static nav_msgs::OccupancyGrid cur_map;
+static int got_map = 0;
+static nav_msgs::Odometry cur_odom;
+static int got_odom = 0;
+static std::unique_ptr<nuplan::Roadmap> roadmap;
+static nuplan::RoadmapParams roadmap_params;
+static double connect_radius = 0.5;
+static double robot_radius = 0.135;
+static std::string roadmap_file;
+static std::string frame_id = "map";
+static ros::Publisher plan_pub;
+static std::unique_ptr<tf2_ros::Buffer> tf_buffer;
+
+/// \brief Convert the occupancy grid message into a grid
+/// \return the grid, unknown (-1) cells are obstacles
+nuplan::Grid toGrid(const nav_msgs::OccupancyGrid & map)
+{
+  nuplan::Grid grid(map.info.width, map.info.height);
+  for(unsigned int y = 0; y < map.info.height; y++)
+  {
+    for(unsigned int x = 0; x < map.info.width; x++)
+    {
+      grid.setOccupied(nuplan::Cell(x, y), map.data.at(y * map.info.width + x) != 0);
+    }
+  }
+  return grid;
+}
+
+/// \brief Convert a tf2 transform into a planar transform
+///
+static rigid2d::Transform2D toTransform2D(const geometry_msgs::Transform & T)
+{
+  tf2::Quaternion quat_tf2(T.rotation.x, T.rotation.y, T.rotation.z, T.rotation.w);
+  auto r = 0.0, p = 0.0, y = 0.0;
+  tf2::Matrix3x3(quat_tf2).getRPY(r, p, y);
+
+  return rigid2d::Transform2D(rigid2d::Vector2D(T.translation.x, T.translation.y), y);
+}
+
+/// \brief Check if a loaded roadmap was sampled with the settings of this node
+///
+static bool sameParams(const nuplan::RoadmapParams & a, const nuplan::RoadmapParams & b)
+{
+  return a.num_nodes == b.num_nodes && a.neighbors == b.neighbors && a.seed == b.seed &&
+         std::fabs(a.connect_radius - b.connect_radius) < 1e-9;
+}
+
+/// \brief Callback for the map subscriber
+///
+void callback_map(const nav_msgs::OccupancyGrid::ConstPtr data)
+{
+  cur_map = *data;
+  got_map = 1;
+
+  // the roadmap plans for a point, so the obstacles are grown by the robot
+  int inflation = static_cast<int>(std::ceil(robot_radius / cur_map.info.resolution));
+  nuplan::Grid grid = toGrid(cur_map).inflate(inflation);
+
+  if(!roadmap)
+  {
+    roadmap.reset(new nuplan::Roadmap());
+    roadmap_params.connect_radius = connect_radius / cur_map.info.resolution;
+
+    // a roadmap from a previous run is kept if it was made for a map of this size with these settings
+    if(!roadmap_file.empty() && roadmap->load(roadmap_file))
+    {
+      if(roadmap->grid().width() != grid.width() || roadmap->grid().height() != grid.height())
+      {
+        ROS_WARN_STREAM("ROADMAP: The roadmap in " << roadmap_file << " is for a map of another size, sampling a new one");
+      }
+      else if(!sameParams(roadmap->parameters(), roadmap_params))
+      {
+        ROS_WARN_STREAM("ROADMAP: The roadmap in " << roadmap_file << " was sampled with other settings, sampling a new one");
+      }
+      else
+      {
+        roadmap->updateGrid(grid);
+        ROS_INFO_STREAM("ROADMAP: Loaded " << roadmap->nodes().size() << " nodes from " << roadmap_file);
+        return;
+      }
+    }
+
+    roadmap.reset(new nuplan::Roadmap(grid, roadmap_params));
+    ROS_INFO_STREAM("ROADMAP: Sampled " << roadmap->nodes().size() << " nodes and " << roadmap->numEdges() << " edges");
+    return;
+  }
+
+  if(!roadmap->updateGrid(grid)) ROS_INFO_STREAM("ROADMAP: The map changed size, sampled a new roadmap");
+}
+
+/// \brief Callback for the odometry subscriber
+///
+void callback_odom(const nav_msgs::Odometry::ConstPtr data)
+{
+  cur_odom = *data;
+  got_odom = 1;
+}
+
+/// \brief Callback for the goal subscriber, plans and publishes a path
+///
+void callback_goal(const geometry_msgs::PoseStamped::ConstPtr data)
+{
+  if(!got_map || !got_odom || !roadmap)
+  {
+    ROS_WARN_STREAM("ROADMAP: Need a map and odometry before a goal");
+    return;
+  }
+
+  // odometry is in the odom frame, the goal and the map are in the map frame
+  rigid2d::Vector2D robot(cur_odom.pose.pose.position.x, cur_odom.pose.pose.position.y);
+  const std::string & odom_frame = cur_odom.header.frame_id;
+  if(!odom_frame.empty() && odom_frame != frame_id)
+  {
+    try
+    {
+      robot = toTransform2D(tf_buffer->lookupTransform(frame_id, odom_frame, ros::Time(0)).transform)(robot);
+    }
+    catch(tf2::TransformException & e)
+    {
+      ROS_WARN_STREAM("ROADMAP: No transform from " << odom_frame << " to " << frame_id << ", cannot plan");
+      return;
+    }
+  }
+
+  // positions in cells
+  double res = cur_map.info.resolution;
+  double ox = cur_map.info.origin.position.x, oy = cur_map.info.origin.position.y;
+  rigid2d::Vector2D start((robot.x - ox) / res, (robot.y - oy) / res);
+  rigid2d::Vector2D goal((data->pose.position.x - ox) / res, (data->pose.position.y - oy) / res);
+
+  uint64_t checks = roadmap->checks();
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<rigid2d::Vector2D> cells = roadmap->plan(start, goal);
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  if(cells.empty())
+  {
+    ROS_WARN_STREAM("ROADMAP: No path to the goal");
+    return;
+  }
+  ROS_DEBUG_STREAM("ROADMAP: Planned in " << elapsed * 1e3 << " ms with " << roadmap->checks() - checks << " edge checks");
+
+  nav_msgs::Path path;
+  path.header.frame_id = frame_id;
+  path.header.stamp = ros::Time::now();
+
+  for(auto & c : cells)
+  {
+    geometry_msgs::PoseStamped pose;
+    pose.header = path.header;
+    pose.pose.position.x = ox + c.x * res;
+    pose.pose.position.y = oy + c.y * res;
+    pose.pose.orientation.w = 1.0;
+    path.poses.push_back(pose);
+  }
+
+  plan_pub.publish(path);
+}
+
+/// \brief Main function for the roadmap_planner node
+///
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "roadmap_planner");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+  rigid2d::TopicMonitor monitor(n);
+  tf_buffer.reset(new tf2_ros::Buffer());
+  tf2_ros::TransformListener tf_listener(*tf_buffer);
+
+  int num_nodes = roadmap_params.num_nodes;
+  int neighbors = roadmap_params.neighbors;
+  int seed = roadmap_params.seed;
+
+  pn.getParam("num_nodes", num_nodes);
+  pn.getParam("neighbors", neighbors);
+  pn.getParam("connect_radius", connect_radius);
+  pn.getParam("seed", seed);
+  pn.getParam("robot_radius", robot_radius);
+  pn.getParam("roadmap_file", roadmap_file);
+  pn.getParam("frame_id", frame_id);
+
+  roadmap_params.num_nodes = num_nodes;
+  roadmap_params.neighbors = neighbors;
+  roadmap_params.seed = seed;
+
+  ROS_INFO_STREAM("ROADMAP: Got number of nodes: " << num_nodes);
+  ROS_INFO_STREAM("ROADMAP: Got neighbors: " << neighbors);
+  ROS_INFO_STREAM("ROADMAP: Got connect radius: " << connect_radius);
+  ROS_INFO_STREAM("ROADMAP: Got seed: " << seed);
+  ROS_INFO_STREAM("ROADMAP: Got robot radius: " << robot_radius);
+  ROS_INFO_STREAM("ROADMAP: Got roadmap file: " << roadmap_file);
+  ROS_INFO_STREAM("ROADMAP: Got frame id: " << frame_id);
+
+  plan_pub = n.advertise<nav_msgs::Path>("plan", 1);
+
+  ros::Subscriber map_sub = n.subscribe<nav_msgs::OccupancyGrid>("map", 1, callback_map);
+  ros::Subscriber odom_sub = monitor.subscribe<nav_msgs::Odometry>(n, "odom", callback_odom);
+  ros::Subscriber goal_sub = n.subscribe<geometry_msgs::PoseStamped>("goal", 1, callback_goal);
+
+  ros::spin();
+
+  // keep the checked edges for the next run
+  if(roadmap && !roadmap_file.empty())
+  {
+    if(roadmap->save(roadmap_file)) ROS_INFO_STREAM("ROADMAP: Saved the roadmap to " << roadmap_file);
+    else ROS_WARN_STREAM("ROADMAP: Could not save the roadmap to " << roadmap_file);
+  }
+
+  return 0;
+}
@@ -0,0 +1,430 @@
+/// \file
+/// \brief Tests for the planning libraries
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <cstdio>
+
+#include "nuplan/fleet_planner.hpp"
+#include "nuplan/orca.hpp"
+#include "nuplan/roadmap.hpp"
+
+/// \brief check that no two robots share a cell or swap cells at any time step
+static bool collisionFree(const std::vector<std::vector<nuplan::Cell>> & paths)
+{
+  unsigned int t_max = 0;
+  for(auto & p : paths) t_max = std::max(t_max, static_cast<unsigned int>(p.size()));
+
+  // robots stay at the end of their path
+  auto at = [&](unsigned int i, unsigned int t) { return paths.at(i).at(std::min(t, static_cast<unsigned int>(paths.at(i).size() - 1))); };
+
+  for(unsigned int t = 0; t < t_max; t++)
+  {
+    for(unsigned int i = 0; i < paths.size(); i++)
+    {
+      for(unsigned int j = i + 1; j < paths.size(); j++)
+      {
+        if(at(i, t) == at(j, t)) return false;
+        if(t > 0 && at(i, t) == at(j, t - 1) && at(j, t) == at(i, t - 1)) return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// \brief check that a path starts at its start and only waits or steps to a free 4 connected neighbor
+static bool validPath(const nuplan::Grid & grid, const std::vector<nuplan::Cell> & path, nuplan::Cell start)
+{
+  if(path.empty() || !(path.front() == start)) return false;
+
+  for(unsigned int t = 0; t < path.size(); t++)
+  {
+    if(!grid.isFree(path.at(t))) return false;
+    if(t > 0 && std::abs(path.at(t).x - path.at(t - 1).x) + std::abs(path.at(t).y - path.at(t - 1).y) > 1) return false;
+  }
+  return true;
+}
+
+TEST(FleetPlanner, ReservationTable)
+{
+  nuplan::ReservationTable table(4);
+
+  for(int t = 0; t < 100; t++) table.reserve(nuplan::Cell(t, 2), t, 1);
+  table.park(nuplan::Cell(5, 5), 10, 2);
+
+  ASSERT_EQ(table.size(), 100u);
+  ASSERT_EQ(table.owner(nuplan::Cell(3, 2), 3), 1);
+  ASSERT_EQ(table.owner(nuplan::Cell(3, 2), 4), -1);
+  ASSERT_EQ(table.owner(nuplan::Cell(5, 5), 9), -1);
+  ASSERT_EQ(table.owner(nuplan::Cell(5, 5), 50), 2);
+  ASSERT_EQ(table.lastReserved(nuplan::Cell(7, 2)), 7);
+
+  // robot 0 may not swap places with robot 1
+  ASSERT_FALSE(table.canMove(nuplan::Cell(4, 2), nuplan::Cell(3, 2), 3, 0));
+
+  table.clear();
+  ASSERT_EQ(table.size(), 0u);
+  ASSERT_EQ(table.owner(nuplan::Cell(3, 2), 3), -1);
+  ASSERT_EQ(table.owner(nuplan::Cell(5, 5), 50), -1);
+  ASSERT_EQ(table.lastReserved(nuplan::Cell(7, 2)), -1);
+}
+
+TEST(FleetPlanner, CoarsenKeepsEveryObstacle)
+{
+  nuplan::Grid grid(7, 5);
+  grid.setOccupied(nuplan::Cell(2, 0), true);
+  grid.setOccupied(nuplan::Cell(6, 4), true);
+
+  nuplan::Grid coarse = grid.coarsen(3);
+  ASSERT_EQ(coarse.width(), 3);
+  ASSERT_EQ(coarse.height(), 2);
+
+  // a block is blocked by any of its cells, and by running past the edge of the grid
+  ASSERT_FALSE(coarse.isFree(nuplan::Cell(0, 0)));
+  ASSERT_TRUE(coarse.isFree(nuplan::Cell(1, 0)));
+  ASSERT_FALSE(coarse.isFree(nuplan::Cell(2, 0)));
+  ASSERT_FALSE(coarse.isFree(nuplan::Cell(0, 1)));
+  ASSERT_TRUE(grid.coarsen(1).isFree(nuplan::Cell(0, 4)));
+}
+
+TEST(FleetPlanner, InflateGrowsObstacles)
+{
+  nuplan::Grid grid(9, 9);
+  grid.setOccupied(nuplan::Cell(4, 4), true);
+  grid.setOccupied(nuplan::Cell(0, 8), true);
+
+  nuplan::Grid inflated = grid.inflate(2);
+  ASSERT_EQ(inflated.width(), 9);
+  ASSERT_EQ(inflated.height(), 9);
+
+  // a disc of the radius around each obstacle, clipped at the edge of the grid
+  ASSERT_FALSE(inflated.isFree(nuplan::Cell(4, 6)));
+  ASSERT_FALSE(inflated.isFree(nuplan::Cell(5, 5)));
+  ASSERT_TRUE(inflated.isFree(nuplan::Cell(6, 6)));
+  ASSERT_TRUE(inflated.isFree(nuplan::Cell(4, 7)));
+  ASSERT_FALSE(inflated.isFree(nuplan::Cell(2, 8)));
+  ASSERT_TRUE(inflated.isFree(nuplan::Cell(3, 8)));
+  ASSERT_TRUE(grid.inflate(0).isFree(nuplan::Cell(4, 5)));
+}
+
+TEST(FleetPlanner, CorridorSwap)
+{
+  // a 1 wide corridor with a pocket next to the second robot
+  nuplan::Grid grid(7, 2);
+  for(int x = 0; x < 7; x++) grid.setOccupied(nuplan::Cell(x, 1), x != 5);
+
+  nuplan::FleetPlanner planner(grid, 50);
+  auto paths = planner.plan({nuplan::Cell(0, 0), nuplan::Cell(6, 0)}, {nuplan::Cell(6, 0), nuplan::Cell(0, 0)});
+
+  ASSERT_FALSE(paths.at(0).empty());
+  ASSERT_FALSE(paths.at(1).empty());
+  ASSERT_EQ(paths.at(0).back(), nuplan::Cell(6, 0));
+  ASSERT_EQ(paths.at(1).back(), nuplan::Cell(0, 0));
+  ASSERT_TRUE(collisionFree(paths));
+}
+
+TEST(FleetPlanner, TwentyRobots)
+{
+  // 20 robots cross a 40x40 arena with a wall that has two gaps
+  nuplan::Grid grid(40, 40);
+  for(int y = 0; y < 40; y++)
+  {
+    if(y != 10 && y != 30) grid.setOccupied(nuplan::Cell(20, y), true);
+  }
+
+  std::vector<nuplan::Cell> starts, goals;
+  for(int i = 0; i < 20; i++)
+  {
+    starts.push_back(nuplan::Cell(2 + (i % 2), 2*i - (i % 2)));
+    goals.push_back(nuplan::Cell(37 - (i % 2), 38 - 2*i + (i % 2)));
+  }
+
+  nuplan::FleetPlanner planner(grid, 200);
+
+  auto paths = planner.plan(starts, goals);
+
+  ASSERT_EQ(paths.size(), 20u);
+  for(unsigned int i = 0; i < paths.size(); i++)
+  {
+    ASSERT_TRUE(validPath(grid, paths.at(i), starts.at(i)));
+    ASSERT_EQ(paths.at(i).back(), goals.at(i));
+    ASSERT_LE(paths.at(i).size(), 201u);
+  }
+  ASSERT_TRUE(collisionFree(paths));
+}
+
+/// \brief check a roadmap path by stepping along each segment in small steps
+static bool pathFree(const nuplan::Grid & grid, const std::vector<rigid2d::Vector2D> & path)
+{
+  for(unsigned int i = 1; i < path.size(); i++)
+  {
+    rigid2d::Vector2D d = path.at(i) - path.at(i - 1);
+    int steps = std::ceil(d.length() / 0.01);
+    for(int s = 0; s <= steps; s++)
+    {
+      rigid2d::Vector2D p = path.at(i - 1) + d * (static_cast<double>(s) / std::max(1, steps));
+      if(!grid.isFree(nuplan::Cell(std::floor(p.x), std::floor(p.y)))) return false;
+    }
+  }
+  return true;
+}
+
+/// \brief check that two paths pass through the same points
+static bool samePath(const std::vector<rigid2d::Vector2D> & a, const std::vector<rigid2d::Vector2D> & b)
+{
+  if(a.size() != b.size()) return false;
+  for(unsigned int i = 0; i < a.size(); i++)
+  {
+    if(a.at(i).x != b.at(i).x || a.at(i).y != b.at(i).y) return false;
+  }
+  return true;
+}
+
+/// \brief a 60x60 arena with a wall down the middle that is open at the top
+static nuplan::Grid wallGrid()
+{
+  nuplan::Grid grid(60, 60);
+  for(int y = 0; y < 50; y++) grid.setOccupied(nuplan::Cell(30, y), true);
+  return grid;
+}
+
+TEST(Roadmap, KdTree)
+{
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> u(0.0, 100.0);
+
+  std::vector<rigid2d::Vector2D> points;
+  for(int i = 0; i < 500; i++) points.push_back(rigid2d::Vector2D(u(gen), u(gen)));
+
+  nuplan::KdTree tree;
+  tree.build(points);
+  ASSERT_EQ(tree.size(), 500u);
+
+  for(int q = 0; q < 50; q++)
+  {
+    rigid2d::Vector2D p(u(gen), u(gen));
+
+    // brute force, nearest first
+    std::vector<std::pair<double, int>> all;
+    for(int i = 0; i < 500; i++) all.emplace_back(p.distance(points.at(i)), i);
+    std::sort(all.begin(), all.end());
+
+    std::vector<int> ids;
+    tree.nearest(p, 7, 20.0, ids);
+    std::vector<int> expected;
+    for(int i = 0; i < 7 && all.at(i).first <= 20.0; i++) expected.push_back(all.at(i).second);
+    ASSERT_EQ(ids, expected);
+
+    tree.within(p, 10.0, ids);
+    std::sort(ids.begin(), ids.end());
+    expected.clear();
+    for(auto & a : all) if(a.first <= 10.0) expected.push_back(a.second);
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(ids, expected);
+  }
+}
+
+TEST(Roadmap, LazyAndCached)
+{
+  nuplan::Grid grid = wallGrid();
+  nuplan::Roadmap roadmap(grid, nuplan::RoadmapParams());
+  ASSERT_EQ(roadmap.nodes().size(), 400u);
+
+  rigid2d::Vector2D start(5.5, 5.5), goal(55.5, 5.5);
+  auto path = roadmap.plan(start, goal);
+
+  ASSERT_GE(path.size(), 3u);
+  ASSERT_TRUE(samePath({path.front(), path.back()}, {start, goal}));
+  ASSERT_TRUE(pathFree(grid, path));
+
+  // only the edges the search tried were checked, each once
+  uint64_t checks = roadmap.checks();
+  ASSERT_GT(checks, 0u);
+  ASSERT_LT(checks, roadmap.numEdges() / 4);
+  ASSERT_EQ(roadmap.countEdges(nuplan::EdgeState::Free) + roadmap.countEdges(nuplan::EdgeState::Blocked), checks);
+
+  // the same mission again costs no checks
+  auto again = roadmap.plan(start, goal);
+  ASSERT_TRUE(samePath(again, path));
+  ASSERT_EQ(roadmap.checks(), checks);
+
+  // closing the gap blocks the free edges through it, and nothing else changes
+  unsigned int unknown = roadmap.countEdges(nuplan::EdgeState::Unknown);
+  for(int y = 50; y < 60; y++) roadmap.setOccupied(nuplan::Cell(30, y), true);
+  ASSERT_EQ(roadmap.countEdges(nuplan::EdgeState::Unknown), unknown);
+  ASSERT_TRUE(roadmap.plan(start, goal).empty());
+
+  // reopening it makes the blocked edges through it unknown again
+  unsigned int blocked = roadmap.countEdges(nuplan::EdgeState::Blocked);
+  for(int y = 50; y < 60; y++) roadmap.setOccupied(nuplan::Cell(30, y), false);
+  ASSERT_LT(roadmap.countEdges(nuplan::EdgeState::Blocked), blocked);
+  path = roadmap.plan(start, goal);
+  ASSERT_FALSE(path.empty());
+  ASSERT_TRUE(pathFree(roadmap.grid(), path));
+
+  // no way out of a walled in start
+  for(int x = 4; x <= 7; x++)
+  {
+    for(int y = 4; y <= 7; y++) roadmap.setOccupied(nuplan::Cell(x, y), x == 4 || x == 7 || y == 4 || y == 7);
+  }
+  ASSERT_TRUE(roadmap.plan(start, goal).empty());
+}
+
+TEST(Roadmap, SaveAndLoad)
+{
+  nuplan::Grid grid = wallGrid();
+  nuplan::Roadmap roadmap(grid, nuplan::RoadmapParams());
+
+  rigid2d::Vector2D start(5.5, 5.5), goal(55.5, 5.5);
+  auto path = roadmap.plan(start, goal);
+  ASSERT_FALSE(path.empty());
+
+  std::string file = "/tmp/nuplan_test_roadmap.bin";
+  ASSERT_TRUE(roadmap.save(file));
+
+  nuplan::Roadmap loaded;
+  ASSERT_TRUE(loaded.load(file));
+  std::remove(file.c_str());
+
+  ASSERT_EQ(loaded.nodes().size(), roadmap.nodes().size());
+  ASSERT_EQ(loaded.numEdges(), roadmap.numEdges());
+  ASSERT_EQ(loaded.countEdges(nuplan::EdgeState::Free), roadmap.countEdges(nuplan::EdgeState::Free));
+  ASSERT_EQ(loaded.parameters().num_nodes, roadmap.parameters().num_nodes);
+  ASSERT_EQ(loaded.parameters().seed, roadmap.parameters().seed);
+  ASSERT_DOUBLE_EQ(loaded.parameters().connect_radius, roadmap.parameters().connect_radius);
+
+  // the next run plans from the cache
+  ASSERT_TRUE(samePath(loaded.plan(start, goal), path));
+  ASSERT_EQ(loaded.checks(), 0u);
+
+  // a new map only touches the cells that changed
+  nuplan::Grid next = wallGrid();
+  next.setOccupied(nuplan::Cell(45, 20), true);
+  ASSERT_TRUE(loaded.updateGrid(next));
+  ASSERT_FALSE(loaded.grid().isFree(nuplan::Cell(45, 20)));
+
+  ASSERT_FALSE(loaded.load("/tmp/nuplan_test_missing.bin"));
+}
+
+TEST(Orca, SpatialHash)
+{
+  nuplan::SpatialHash hash(1.0);
+  for(int i = 0; i < 10; i++) hash.insert(i, 0.5*i, -0.5*i);
+
+  std::vector<int> ids;
+  hash.query(0, 0, 1.2, ids);
+  std::sort(ids.begin(), ids.end());
+
+  ASSERT_EQ(ids, std::vector<int>({0, 1}));
+
+  hash.clear();
+  hash.query(0, 0, 1.2, ids);
+  ASSERT_TRUE(ids.empty());
+}
+
+TEST(Orca, HeadOnSwap)
+{
+  // two robots drive almost straight at each other and must pass without touching.
+  // a perfectly symmetric start is a deadlock for ORCA, so one robot is slightly offset
+  nuplan::Agent a, b;
+  a.x = -1.0; a.y = 0.01; a.radius = 0.1;
+  b.x = 1.0; b.radius = 0.1;
+
+  nuplan::OrcaFilter filter_a(2.0, 1.0, 0.05, 0.2), filter_b(2.0, 1.0, 0.05, 0.2);
+
+  double min_dist = 2.0;
+  for(int k = 0; k < 400; k++)
+  {
+    rigid2d::Vector2D pref_a = (rigid2d::Vector2D(1.0, 0) - rigid2d::Vector2D(a.x, a.y)).normalize() * 0.2;
+    rigid2d::Vector2D pref_b = (rigid2d::Vector2D(-1.0, 0) - rigid2d::Vector2D(b.x, b.y)).normalize() * 0.2;
+
+    rigid2d::Vector2D va = filter_a.computeVelocity(a, pref_a, {b}, {});
+    rigid2d::Vector2D vb = filter_b.computeVelocity(b, pref_b, {a}, {});
+
+    a.vx = va.x; a.vy = va.y; a.x += 0.05*va.x; a.y += 0.05*va.y;
+    b.vx = vb.x; b.vy = vb.y; b.x += 0.05*vb.x; b.y += 0.05*vb.y;
+
+    min_dist = std::min(min_dist, std::hypot(a.x - b.x, a.y - b.y));
+  }
+
+  ASSERT_GE(min_dist, 0.2 - 1e-3);
+  ASSERT_GT(a.x, 0.5);
+  ASSERT_LT(b.x, -0.5);
+}
+
+TEST(Orca, StaticObstacle)
+{
+  // a cylinder sits on the straight line path, the robot must go around it
+  nuplan::Agent robot;
+  robot.x = -1.0; robot.radius = 0.1;
+
+  nuplan::Agent cylinder;
+  cylinder.radius = 0.05;
+  cylinder.y = 0.01;
+
+  nuplan::OrcaFilter filter(2.0, 1.0, 0.05, 0.2);
+
+  double min_dist = 2.0;
+  for(int k = 0; k < 400; k++)
+  {
+    rigid2d::Vector2D pref = (rigid2d::Vector2D(1.0, 0) - rigid2d::Vector2D(robot.x, robot.y)).normalize() * 0.2;
+    rigid2d::Vector2D v = filter.computeVelocity(robot, pref, {}, {cylinder});
+
+    robot.vx = v.x; robot.vy = v.y; robot.x += 0.05*v.x; robot.y += 0.05*v.y;
+    min_dist = std::min(min_dist, std::hypot(robot.x - cylinder.x, robot.y - cylinder.y));
+  }
+
+  ASSERT_GE(min_dist, 0.15 - 1e-3);
+  ASSERT_GT(robot.x, 0.5);
+}
+
+TEST(Orca, ManyNeighbors)
+{
+  // 48 neighbors in a ring around the robot, all moving toward it
+  nuplan::Agent self;
+  self.radius = 0.1;
+  self.vx = 0.1;
+
+  std::vector<nuplan::Agent> neighbors;
+  for(int i = 0; i < 48; i++)
+  {
+    double ang = 2.0 * rigid2d::PI * i / 48.0;
+    nuplan::Agent n;
+    n.x = 1.5 * std::cos(ang);
+    n.y = 1.5 * std::sin(ang);
+    n.vx = -0.05 * std::cos(ang);
+    n.vy = -0.05 * std::sin(ang);
+    n.radius = 0.1;
+    neighbors.push_back(n);
+  }
+
+  nuplan::OrcaFilter filter(2.0, 1.0, 0.05, 0.2);
+  rigid2d::Vector2D v = filter.computeVelocity(self, rigid2d::Vector2D(0.2, 0), neighbors, {});
+
+  // one half plane per neighbor, rebuilt in the same buffers on every call
+  for(int k = 0; k < 100; k++)
+  {
+    rigid2d::Vector2D again = filter.computeVelocity(self, rigid2d::Vector2D(0.2, 0), neighbors, {});
+    ASSERT_EQ(filter.constraints().size(), 48u);
+    ASSERT_EQ(again.x, v.x);
+    ASSERT_EQ(again.y, v.y);
+  }
+
+  ASSERT_LE(std::hypot(v.x, v.y), 0.2 + 1e-9);
+}
+
+TEST(Orca, DiffDriveTwist)
+{
+  // straight ahead drives forward without turning
+  rigid2d::Twist2D tw = nuplan::velocityToTwist(rigid2d::Vector2D(0.1, 0), 0, 0.2, 2.0, 3.0);
+  ASSERT_NEAR(tw.vx, 0.1, 1e-9);
+  ASSERT_NEAR(tw.wz, 0, 1e-9);
+
+  // behind the robot turns in place
+  tw = nuplan::velocityToTwist(rigid2d::Vector2D(-0.1, 0), 0, 0.2, 2.0, 3.0);
+  ASSERT_NEAR(tw.vx, 0, 1e-9);
+  ASSERT_NEAR(std::fabs(tw.wz), 2.0, 1e-9);
+}
@@ -1,7 +1,7 @@
 #ifndef LANDMARK_INCLUDE_GUARD_HPP
 #define LANDMARK_INCLUDE_GUARD_HPP
 /// \file
-/// \brief function to fit circles.
+/// \brief functions to cluster laser scans and fit circles.
 
 #include <vector>
 #include "rigid2d/rigid2d.hpp"
@@ -15,5 +15,46 @@ namespace cylinder
   ///         coordinates and the third is the radius
   std::vector<double> fit_circles(std::vector<rigid2d::Vector2D> cluster);
 
+  /// \brief function to split a laser scan into clusters of neighbouring points
+  /// \param ranges: the scan ranges, starting at angle_min
+  /// \param angle_min: the bearing of the first range
+  /// \param angle_increment: the bearing between two ranges
+  /// \param range_min: ranges at or below this are not valid
+  /// \param range_max: ranges at or above this are not valid
+  /// \param distance_threshold: the largest range jump between two points of a cluster
+  /// \return the x,y points of each cluster, in scan order. The last cluster is joined with
+  ///         the first when the scan wraps around between them
+  std::vector<std::vector<rigid2d::Vector2D>> cluster_scan(const std::vector<float> & ranges, double angle_min,
+                                                           double angle_increment, double range_min,
+                                                           double range_max, double distance_threshold);
+
+  /// \brief A landmark wrapped in retro-reflective tape, found from the intensities of a scan
+  ///
+  /// A landmark carries one or more vertical bands of tape separated by dark gaps, and its id
+  /// is the number of bands less one. The bands and gaps must each span a beam at the working range.
+  struct Reflector
+  {
+    std::vector<rigid2d::Vector2D> points; ///< the points from the first to the last bright beam
+    int bands = 0; ///< runs of bright beams
+    int id = -1; ///< bands - 1, or -1 when the pattern is cut off by an occlusion or the end of the scan
+  };
+
+  /// \brief function to find the retro-reflective landmarks of a laser scan in one pass
+  /// \param ranges: the scan ranges, starting at angle_min
+  /// \param intensities: the intensity of each range
+  /// \param angle_min: the bearing of the first range
+  /// \param angle_increment: the bearing between two ranges
+  /// \param range_min: ranges at or below this are not valid
+  /// \param range_max: ranges at or above this are not valid
+  /// \param intensity_threshold: the smallest intensity of a beam on tape
+  /// \param distance_threshold: the largest range jump between two beams on one landmark
+  /// \param max_gap: the most dark beams between two bands of one landmark
+  /// \return the landmarks, in scan order. The id is only read when the dark side of the same
+  ///         landmark is seen on both sides of its bands
+  std::vector<Reflector> find_reflectors(const std::vector<float> & ranges, const std::vector<float> & intensities,
+                                         double angle_min, double angle_increment, double range_min,
+                                         double range_max, double intensity_threshold, double distance_threshold,
+                                         int max_gap);
+
 }
 #endif
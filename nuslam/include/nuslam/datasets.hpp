@@ -0,0 +1,86 @@
+#ifndef DATASETS_INCLUDE_GUARD_HPP
+#define DATASETS_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Loaders for public 2D landmark SLAM datasets, as steps for the headless filters
+///
+/// A dataset is cut into steps of one body twist followed by the landmarks measured at the end of
+/// it, the same motion and measurement calls the nodes make on each scan. Two formats are read from
+/// local files:
+///
+/// A range and bearing log, the text format of the Victoria Park and simulated logs used to teach
+/// and compare EKF SLAM. Every ODOMETRY line starts a step and the measurement lines after it belong
+/// to that step:
+///     ODOMETRY rot1 trans rot2             rotate, drive and rotate again
+///     ODOMETRY i j dx dy dth [covariance]  the pose of j in the frame of i, as in the iSAM logs
+///     SENSOR id range bearing              a landmark, with id -1 when it is not labeled
+///     LANDMARK i id x y [covariance]       a landmark in the frame of pose i, as in the iSAM logs
+/// The logs carry no times, so step k is stamped k seconds, and no ground truth.
+///
+/// The UTIAS multi-robot cooperative localization and mapping datasets, a directory of
+/// Robot<n>_Odometry.dat (time, v, w), Robot<n>_Measurement.dat (time, barcode, range, bearing),
+/// Robot<n>_Groundtruth.dat (time, x, y, th), Landmark_Groundtruth.dat (subject, x, y, ...) and
+/// Barcodes.dat (subject, barcode). Velocities hold until the next odometry line and are integrated
+/// over fixed steps. Measurements of the other robots are left out, landmarks are labeled by subject.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/TurtleMap.h"
+#include "nuslam/fault_replay.hpp"
+
+namespace datasets
+{
+
+  /// \brief The motion and the measurements of one step
+  struct Step
+  {
+    int64_t stamp = 0; ///< the time at the end of the step (ns)
+    rigid2d::Twist2D odometry; ///< the body twist over the step, as the filters take it
+    nuslam::TurtleMap landmarks; ///< the landmarks measured at the end of the step, in the robot frame, labeled in ids
+  };
+
+  /// \brief The steps of one robot
+  struct RobotRun
+  {
+    std::string name; ///< robot name
+    rigid2d::Pose2D start; ///< the pose before the first step, the origin when there is no ground truth
+    std::vector<Step> steps; ///< the steps, in time order
+    std::vector<replay::TrajectoryPoint> truth; ///< the true poses in time order, empty when unknown
+  };
+
+  /// \brief A loaded dataset
+  struct Dataset
+  {
+    std::string name; ///< dataset name
+    std::vector<RobotRun> robots; ///< the robots
+    std::vector<rigid2d::Vector2D> landmarks; ///< the true landmark positions, empty when unknown
+    std::vector<int> landmark_ids; ///< the label of each true landmark
+  };
+
+  /// \brief Find the constant body twist the filter motion model needs to move by a displacement
+  ///
+  /// The filters drive arcs, which cannot slide sideways, so the twist turns by dth and drives the arc
+  /// whose chord is as long as the displacement. The end pose is exact when the displacement is an arc.
+  /// \param dx the forward displacement in the starting frame
+  /// \param dy the sideways displacement in the starting frame
+  /// \param dth the heading change
+  /// \returns the twist (wz, vx, 0) over one unit of time
+  rigid2d::Twist2D arcTwist(double dx, double dy, double dth);
+
+  /// \brief Load a range and bearing log
+  /// \param path the log file
+  /// \param dataset [out] one robot, with no ground truth
+  /// \returns false if the file could not be read, a line is malformed or there are no steps
+  bool loadRangeBearingLog(const std::string & path, Dataset & dataset);
+
+  /// \brief Load a UTIAS multi-robot dataset
+  /// \param directory the directory of the .dat files
+  /// \param dt the length of a step (s)
+  /// \param dataset [out] one run per robot with its ground truth, and the landmark map
+  /// \returns false if a file is missing or malformed
+  bool loadUtias(const std::string & directory, double dt, Dataset & dataset);
+
+}
+#endif
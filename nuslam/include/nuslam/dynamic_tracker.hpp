@@ -0,0 +1,102 @@
+#ifndef DYNAMIC_TRACKER_INCLUDE_GUARD_HPP
+#define DYNAMIC_TRACKER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Tracks laser clusters with constant velocity Kalman filters to find the ones that move
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace tracker
+{
+
+  /// \brief A cluster of laser points reduced to what the tracker needs
+  struct Cluster
+  {
+    rigid2d::Vector2D center; ///< mean of the points, in the robot frame
+    double radius = 0; ///< half the distance between the first and last points
+  };
+
+  /// \brief Summarize a cluster of laser points
+  /// \param points - the points of the cluster, in the robot frame
+  /// \returns the center and size of the cluster
+  Cluster summarize(const std::vector<rigid2d::Vector2D> & points);
+
+  /// \brief A constant velocity track of one cluster in the odometry frame
+  struct Track
+  {
+    int id = 0; ///< unique id of the track
+    Eigen::Vector4d state = Eigen::Vector4d::Zero(); ///< x, y, vx, vy in the odometry frame
+    Eigen::Matrix4d covariance = Eigen::Matrix4d::Identity(); ///< state covarience
+    double radius = 0; ///< size of the last matched cluster
+    int hits = 0; ///< number of scans the track was matched in
+    int misses = 0; ///< number of scans in a row the track was not matched
+    bool dynamic = false; ///< the track is moving or sits where the map is free
+  };
+
+  /// \brief A known free and occupied grid the clusters can disagree with
+  struct StaticMap
+  {
+    std::vector<int8_t> data; ///< row major cells, 0 free, 100 occupied, -1 unknown
+    unsigned int width = 0; ///< number of columns
+    unsigned int height = 0; ///< number of rows
+    double resolution = 0; ///< side length of a cell
+    double origin_x = 0; ///< x position of cell (0, 0) in the odometry frame
+    double origin_y = 0; ///< y position of cell (0, 0) in the odometry frame
+  };
+
+  /// \brief Separates moving clusters from static ones.
+  /// Clusters are moved into the odometry frame, so the motion of the robot does not look like motion of the world,
+  /// then matched to constant velocity Kalman tracks. A track is dynamic once it moves faster than a threshold,
+  /// or when its cluster lies in a cell the map knows is free.
+  class DynamicTracker
+  {
+  public:
+    /// \brief Set up the tracker
+    /// \param accel_noise - standard deviation of the unmodeled acceleration of a track (m/s^2)
+    /// \param meas_noise - standard deviation of the position of a cluster center (m)
+    /// \param gate - the max mahalonbis distance to match a cluster to a track
+    /// \param speed_threshold - the speed (m/s) above which a track is dynamic
+    /// \param min_hits - the number of matches before the speed of a track is trusted
+    /// \param max_misses - the number of scans in a row a track can go unmatched before it is dropped
+    DynamicTracker(double accel_noise, double meas_noise, double gate, double speed_threshold, int min_hits, int max_misses);
+
+    /// \brief Provide a map of the static world, clusters in free cells are dynamic
+    /// \param map - the map in the odometry frame
+    void setStaticMap(const StaticMap & map);
+
+    /// \brief Match the clusters of one scan to the tracks and update them
+    /// \param clusters - the clusters of the scan, in the robot frame
+    /// \param odom_pose - the pose of the robot in the odometry frame when the scan was taken
+    /// \param stamp - the time of the scan (s)
+    /// \returns true for each cluster that belongs to a dynamic track
+    std::vector<bool> update(const std::vector<Cluster> & clusters, const rigid2d::Transform2D & odom_pose, double stamp);
+
+    /// \brief Get every live track
+    /// \returns the tracks, dynamic or not
+    const std::vector<Track> & getTracks() const;
+
+  private:
+    /// \brief Move every track forward to a time
+    void predict(double dt);
+
+    /// \brief Check if a point sits in a free cell of the static map
+    bool inFreeSpace(const rigid2d::Vector2D & p) const;
+
+    double accel_noise = 0; // process noise
+    double meas_noise = 0; // sensor noise
+    double gate = 0; // association gate
+    double speed_threshold = 0; // speed of a dynamic track
+    int min_hits = 0; // matches before a track can be dynamic
+    int max_misses = 0; // misses before a track is dropped
+
+    StaticMap map; // static map, empty if none was given
+    std::vector<Track> tracks; // live tracks
+    int next_id = 0; // id of the next track
+    double last_stamp = -1; // time of the last scan, negative before the first
+  };
+
+}
+#endif
@@ -1,15 +1,18 @@
-#ifndef LANDMARK_INCLUDE_GUARD_HPP
-#define LANDMARK_INCLUDE_GUARD_HPP
+#ifndef EKF_SLAM_INCLUDE_GUARD_HPP
+#define EKF_SLAM_INCLUDE_GUARD_HPP
 /// \file
 /// \brief Library to contain SLAM class and supporting functions
 
 #include <eigen3/Eigen/Dense>
 #include <vector>
 #include <iostream>
+#include <unordered_map>
 
 #include "geometry_msgs/Point.h"
+#include "nuslam/TurtleMap.h"
 
 #include "rigid2d/rigid2d.hpp"
+#include "nuslam/jcbb.hpp"
 
 
 namespace ekf_slam
@@ -19,6 +22,42 @@ namespace ekf_slam
   ///
   double sampleNormalDistribution();
 
+  /// \brief The innovation of one landmark update
+  struct Innovation
+  {
+    int id = -1; ///< landmark id
+    double range = 0; ///< range error (m)
+    double bearing = 0; ///< bearing error (rad)
+    double nis = 0; ///< normalized innovation squared, chi squared with 2 dof when the filter is consistent
+  };
+
+  /// \brief One sequential landmark update, as much of it as a smoothing pass needs
+  ///
+  /// H only has the robot and one landmark columns, so those five are kept with the landmark index.
+  /// The gain is the one dense part, state_size x 2.
+  struct UpdateRecord
+  {
+    int index = -1; ///< state vector index of the landmark
+    Eigen::Matrix<double, 2, 5> H; ///< the columns (th, x, y, mx, my) of the measurement jacobian
+    Eigen::Matrix2d S_inv; ///< inverse innovation covarience
+    Eigen::Vector2d innovation; ///< measured minus expected range and bearing
+    Eigen::Vector2d z; ///< measured range and bearing
+    Eigen::MatrixX2d K; ///< kalman gain
+  };
+
+  /// \brief One prediction and the updates after it
+  ///
+  /// The motion jacobian G is the identity but for the heading column of the robot rows, so only
+  /// that column is kept. The posterior keeps the robot rows of the covarience, enough to smooth the
+  /// robot pose.
+  struct StepRecord
+  {
+    Eigen::Vector3d dupdate = Eigen::Vector3d::Zero(); ///< G - I in the heading column of the robot rows
+    std::vector<UpdateRecord> updates; ///< the landmark updates, in order
+    Eigen::Vector3d pose = Eigen::Vector3d::Zero(); ///< posterior robot state (th, x, y)
+    Eigen::MatrixXd P_robot; ///< posterior covarience rows of the robot, 3 x state_size, empty til the update
+  };
+
   class Slam
   {
   public:
@@ -36,14 +75,90 @@ namespace ekf_slam
     /// \param &map_data a reference to the landmarks observed by the robot
     void MeasurmentModelUpdate(nuslam::TurtleMap map_data);
 
+    /// \brief Switch between greedy nearest neighbor and JCBB data association
+    /// \param enable true to associate each scan jointly with JCBB
+    /// \param time_budget the max time (s) to spend on each JCBB search
+    void useJointCompatibility(bool enable, double time_budget=0.005);
+
+    /// \brief Set the mahalanobis distance gates of data association
+    /// \param min a distance below this matches a landmark
+    /// \param max a distance above this from every landmark makes a new one, between the two it is ignored
+    void setAssociationThresholds(double min, double max);
+
+    /// \brief Switch the random noise added to the predicted state and the expected measurements
+    /// \param enable false to leave it out, so the same inputs always give the same estimates
+    void injectNoise(bool enable);
+
+    /// \brief Keep the gains and jacobians of every step, for a smoothing pass
+    /// \param steps where each step is appended, or null to stop recording
+    void recordSteps(std::vector<StepRecord> * steps);
+
+    /// \brief Get the sensor noise model
+    Eigen::Matrix2d getSensorNoise() const;
+
     /// \brief Extract the robot state
     /// \returns a vector of the robot state (th, x, y)
     std::vector<double> getRobotState();
 
+    /// \brief Get the innovations of the last measurement update
+    /// \returns one innovation per matched observation
+    const std::vector<Innovation> & getInnovations() const;
+
     /// \brief Extract the landmark states
     /// \returns a vector of the points
     std::vector<geometry_msgs::Point> getLandmarkStates();
 
+    /// \brief Extract the full state vector
+    /// \returns the state vector in (th, x, y, m1x, m1y, ...) syntax
+    Eigen::VectorXd getStateVector() const;
+
+    /// \brief Extract the full covarience matrix
+    /// \returns the state_size x state_size covarience
+    Eigen::MatrixXd getCovariance() const;
+
+    /// \brief Check if a landmark slot in the state vector holds a landmark
+    /// \param i the landmark number (not the state vector index)
+    /// \returns true if the slot has been initialized
+    bool isLandmarkInitialized(int i) const;
+
+    /// \brief Get the number of landmarks created in the state vector
+    /// \returns the number of created landmarks
+    int getNumLandmarks() const;
+
+    /// \brief Check if every landmark slot in the state vector is in use
+    /// \returns true if no more landmarks can be added
+    bool isFull() const;
+
+    /// \brief Get the number of landmark ids that can be queried
+    /// \returns the number of landmark slots in the state vector
+    int getNumLandmarkIds() const;
+
+    /// \brief Get the estimated position of a landmark
+    /// \param id the landmark id
+    /// \param out [out] the x,y position of the landmark in the map frame
+    /// \returns false if the landmark has not been initialized
+    bool getLandmarkPosition(int id, Eigen::Vector2d & out) const;
+
+    /// \brief Get the 2x2 marginal covarience of a landmark
+    /// \param id the landmark id
+    /// \param out [out] the marginal covarience
+    /// \returns false if the landmark has not been initialized
+    bool getLandmarkMarginal(int id, Eigen::Matrix2d & out) const;
+
+    /// \brief Get the 2x2 cross covarience block between two landmarks
+    /// \param id1 the first landmark id (rows)
+    /// \param id2 the second landmark id (columns)
+    /// \param out [out] the cross covarience block
+    /// \returns false if either landmark has not been initialized
+    bool getLandmarkCrossCovariance(int id1, int id2, Eigen::Matrix2d & out) const;
+
+    /// \brief Get the covarience of the relative position between two landmarks (m2 - m1)
+    /// \param id1 the first landmark id
+    /// \param id2 the second landmark id
+    /// \param out [out] the covarience of the relative position
+    /// \returns false if either landmark has not been initialized
+    bool getRelativeCovariance(int id1, int id2, Eigen::Matrix2d & out) const;
+
   private:
     /// \brief Update the Covar based on the the motion model prediction
     /// \param dupdate a vetor containing the elements for the derivative of the motion model
@@ -75,6 +190,28 @@ namespace ekf_slam
     /// \returns the index of the matched landmark or -1 to indicate no match
     int associate_data(double x, double y);
 
+    /// \brief associate all landmarks of a scan at once using JCBB
+    /// \param map_data the landmarks observed by the robot
+    /// \returns the state vector index of the matched landmark for each observation, or -1 to indicate no match
+    std::vector<int> associate_jcbb(const nuslam::TurtleMap & map_data);
+
+    /// \brief associate a landmark by the id the detector read from it
+    /// \param id the id of the landmark
+    /// \param x the measured x location of the landmark
+    /// \param y the measured y location of the landmark
+    /// \returns the state vector index of the landmark with the id, or -1 if there is no room for a new one
+    int associate_id(int id, double x, double y);
+
+    /// \brief add a new landmark to the next open slot of the state vector
+    /// \param x the measured x location of the landmark
+    /// \param y the measured y location of the landmark
+    /// \returns the state vector index of the new landmark
+    int add_landmark(double x, double y);
+
+    /// \brief record that a landmark was seen from the current robot pose
+    /// \param index the state vector index of the landmark
+    void mark_seen(int index);
+
     /// \brief caclulate the mahalonbis distance between a landmark data point and an estimated landmark state
     /// \param data_x the x value of the incoming data
     /// \param data_y the y value of the incoming data
@@ -101,6 +238,7 @@ namespace ekf_slam
     int tot_landmarks = 0; // max allowable number of landmarks
     int created_landmarks = 0; // number of landmarks created in state vector
     int state_size = 0; // state vector size
+    std::unordered_map<int, int> landmark_ids; // detector id -> state vector index of the landmark
     double deadband_min = 100.; // mah: 3000, euc: 10 cm
     double deadband_max = 500.; // mah: 10000, euc: 20 cm
 
@@ -109,6 +247,14 @@ namespace ekf_slam
 
     Eigen::Matrix3d Qnoise; // motion noise model
     Eigen::Matrix2d Rnoise; // sensor noise model
+    bool inject_noise = true; // add sampled noise to the prediction and the expected measurements
+
+    std::vector<Innovation> innovations; // innovations of the last measurement update
+    std::vector<StepRecord> * steps = nullptr; // smoothing record, null when not recording
+
+    bool use_jcbb = false; // use JCBB instead of greedy data association
+    double jcbb_budget = 0.005; // max time (s) of each JCBB search
+    JCBB jcbb{deadband_min, jcbb_budget}; // joint compatibility search, 5 ms budget
   };
 
 }
@@ -0,0 +1,150 @@
+#ifndef EXECUTOR_INCLUDE_GUARD_HPP
+#define EXECUTOR_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Process wide work stealing task executor shared by the parallel parts of nuslam
+///
+/// Every worker owns a deque. A worker pushes and pops its own tasks at the back and
+/// steals from the front of the other deques when its own is empty. Threads that wait
+/// on a task group run queued tasks instead of blocking, so nested parallel loops do not deadlock.
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <exception>
+
+namespace executor
+{
+
+  /// \brief Settings for the executor
+  struct Options
+  {
+    unsigned int num_workers = 0; ///< number of worker threads, 0 to use one per core
+    bool pin_threads = false; ///< pin each worker to one cpu
+    std::vector<int> cpus; ///< cpus to pin the workers to, in order. Empty to use 0, 1, 2, ...
+    bool run_inline = false; ///< run every task on the calling thread, in order, for deterministic tests
+    std::function<void()> thread_start; ///< run first on each worker thread, such as to set up signal handling
+  };
+
+  class Executor;
+
+  /// \brief A set of tasks that can be waited on together
+  class TaskGroup
+  {
+  public:
+    /// \brief Create a group on an executor
+    /// \param exec the executor to run the tasks on
+    explicit TaskGroup(Executor & exec);
+
+    /// \brief Waits for the remaining tasks
+    ~TaskGroup();
+
+    /// \brief Queue a task in the group
+    /// \param task the work to do
+    void run(std::function<void()> task);
+
+    /// \brief Run queued tasks until every task of the group is done.
+    /// Rethrows the first exception thrown by a task of the group.
+    void wait();
+
+  private:
+    Executor & exec; // executor the tasks run on
+    std::atomic<int> pending{0}; // tasks queued but not finished
+    std::mutex error_lock; // guards error
+    std::exception_ptr error; // first exception thrown by a task
+  };
+
+  class Executor
+  {
+  public:
+    /// \brief Start the workers
+    /// \param options the number of workers, affinity, and inline mode
+    explicit Executor(const Options & options);
+
+    /// \brief Finish the queued tasks and join the workers
+    ~Executor();
+
+    Executor(const Executor &) = delete;
+    Executor & operator=(const Executor &) = delete;
+
+    /// \brief Get the executor shared by the whole process, started on first use
+    /// \returns the shared executor
+    static Executor & instance();
+
+    /// \brief Set the options of the shared executor. Replaces it if it already started,
+    /// so call it once at start up before any parallel work.
+    /// \param options the settings to use
+    static void configure(const Options & options);
+
+    /// \brief Queue a task. From a worker it goes on that worker's deque, otherwise the workers take turns.
+    /// \param task the work to do
+    void submit(std::function<void()> task);
+
+    /// \brief Queue a function and get a future for its result
+    /// \param f the function to call
+    /// \returns the future result of f
+    template <class F>
+    std::future<std::invoke_result_t<F>> async(F f)
+    {
+      auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(f));
+      std::future<std::invoke_result_t<F>> result = task->get_future();
+      submit([task]() { (*task)(); });
+      return result;
+    }
+
+    /// \brief Run a loop body over [begin, end) split into chunks, returning when every chunk is done.
+    /// The calling thread works on the chunks too.
+    /// \param begin the first index
+    /// \param end one past the last index
+    /// \param grain the max number of indices in a chunk, at least 1
+    /// \param body called with the [first, last) range of each chunk
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const std::function<void(std::size_t, std::size_t)> & body);
+
+    /// \brief Take one queued task and run it on the calling thread
+    /// \returns false if there was nothing to run
+    bool runOne();
+
+    /// \brief Get the number of worker threads
+    /// \returns 0 in inline mode
+    unsigned int numWorkers() const;
+
+    /// \brief Check if tasks run on the calling thread
+    /// \returns true in inline mode
+    bool isInline() const;
+
+  private:
+    struct Worker
+    {
+      std::deque<std::function<void()>> tasks; // own tasks at the back, stolen from the front
+      std::mutex lock; // guards tasks
+    };
+
+    /// \brief Main loop of a worker thread
+    void workerLoop(unsigned int id);
+
+    /// \brief Pop from a deque, back for the owner and front for a thief
+    bool pop(unsigned int id, bool steal, std::function<void()> & task);
+
+    /// \brief Find a task for a thread, own deque first then the others
+    /// \param id the worker id, or numWorkers() for a thread that is not a worker
+    bool find(unsigned int id, std::function<void()> & task);
+
+    Options options; // settings
+    std::vector<std::unique_ptr<Worker>> workers; // one deque per worker
+    std::vector<std::thread> threads; // one thread per worker
+    std::atomic<unsigned int> next_worker{0}; // round robin target for submits from outside
+    std::atomic<int> queued{0}; // tasks in the deques
+    std::atomic<bool> stopping{false}; // set when the workers should exit
+
+    std::mutex sleep_lock; // guards the sleep condition
+    std::condition_variable wake; // wakes idle workers when a task is queued
+  };
+
+}
+#endif
@@ -0,0 +1,248 @@
+#ifndef FAULT_REPLAY_INCLUDE_GUARD_HPP
+#define FAULT_REPLAY_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Replays a sensor log through the landmark detection and the EKF SLAM filter over a faulty link
+///
+/// A FaultInjector decides, from a seeded random profile, what happens to each message on its way
+/// from the robot: a scan may be lost, every message is delayed, the delay has bursts (the spikes of
+/// a busy WiFi link, a two state model that drops more scans while in a spike), a message may be held
+/// back behind the next one of its topic, and a joint state may be corrupted or repeated.
+///
+/// The replay walks the log in time order and hands each message to the pipeline once it arrives.
+/// Like the nodes, the pipeline keeps only the latest joint state and a queue of one scan, and each
+/// scan runs the cluster detection, circle fits and one filter update. The time of that work is added
+/// to a virtual clock, so a slow pipeline falls behind the log and its latency and superseded scans
+/// show up in the metrics. By default it is the measured wall time, so those metrics, and the scans
+/// the filter sees, depend on the machine and its load, such as other replays running in parallel.
+/// A fixed cost per scan makes them repeat exactly.
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <random>
+
+#include <eigen3/Eigen/Dense>
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/ekf_slam.hpp"
+
+namespace replay
+{
+
+  /// \brief The statistics of the link between the robot and the pipeline
+  struct FaultProfile
+  {
+    double drop = 0.0; ///< probability a scan is lost while the link is good
+    double spike_drop = 0.0; ///< probability a scan is lost during a delay spike
+    double latency = 0.002; ///< mean delay of every message (s)
+    double jitter = 0.0005; ///< standard deviation of the delay (s)
+    double spike_rate = 0.0; ///< mean number of delay spikes per second
+    double spike_length = 0.3; ///< mean length of a spike (s)
+    double spike_delay = 0.0; ///< mean extra delay of a message during a spike (s)
+    double reorder = 0.0; ///< probability a message is held back behind the next one of its topic
+    double reorder_delay = 0.05; ///< extra delay of a held back message (s)
+    double glitch = 0.0; ///< probability a joint state has one wheel jump
+    double glitch_size = 0.5; ///< the size of a jump (rad)
+    double stuck = 0.0; ///< probability a joint state repeats the previous one
+  };
+
+  /// \brief Get a named profile
+  /// \param name one of clean, wifi, congested, lossy, glitchy
+  /// \param profile [out] the profile
+  /// \returns false if the name is unknown
+  bool profileByName(const std::string & name, FaultProfile & profile);
+
+  /// \brief What the link did to a message
+  enum class Fault
+  {
+    None,
+    Dropped, ///< lost
+    Spike, ///< delayed by a spike
+    Reordered, ///< held back behind the next message of its topic
+    Glitch, ///< a wheel position jumped
+    Stuck, ///< the previous wheel positions were sent again
+  };
+
+  /// \brief A message once it has crossed the link
+  struct Delivery
+  {
+    int64_t stamp = 0; ///< the time it was sent (ns)
+    int64_t arrival = 0; ///< the time it arrived (ns), unset when dropped
+    Fault fault = Fault::None; ///< what happened to it
+    int wheel = 0; ///< the wheel of a glitch, 0 for left and 1 for right
+    double jump = 0.0; ///< the jump of a glitch (rad)
+  };
+
+  /// \brief Draws the fate of each message from a profile
+  class FaultInjector
+  {
+  public:
+    /// \brief Start the link in the good state
+    /// \param profile the statistics of the link
+    /// \param seed the seed of the random draws, the same seed gives the same faults
+    FaultInjector(const FaultProfile & profile, uint32_t seed);
+
+    /// \brief Send a message, in time order
+    /// \param stamp the time it is sent (ns)
+    /// \param scan true for a scan, which may be dropped
+    /// \param encoder true for a joint state, which may glitch
+    /// \returns what happened to it
+    Delivery send(int64_t stamp, bool scan, bool encoder);
+
+    /// \brief Check if the link is in a spike at the time of the last message
+    bool inSpike() const;
+
+  private:
+    /// \brief Draw an exponential number of a mean
+    double exponential(double mean);
+
+    /// \brief Move the spike process up to a time
+    void advance(int64_t stamp);
+
+    FaultProfile profile; // link statistics
+    std::mt19937 gen; // random numbers
+    std::uniform_real_distribution<double> uniform{0.0, 1.0}; // for the fault probabilities
+    int64_t spike_start = 0; // start of the current or next spike (ns)
+    int64_t spike_end = 0; // end of the current spike (ns)
+    bool started = false; // the spike process has a first spike drawn
+    bool spike = false; // the last message was sent during a spike
+  };
+
+  /// \brief The pipeline being replayed
+  struct PipelineParams
+  {
+    std::string scan_topic = "scan"; ///< sensor_msgs/LaserScan topic
+    std::string joint_topic = "joint_states"; ///< sensor_msgs/JointState topic
+    std::string left_wheel_joint = "left_wheel_axel"; ///< joint name of the left wheel
+    std::string right_wheel_joint = "right_wheel_axel"; ///< joint name of the right wheel
+    double wheel_base = 0.16; ///< distance between the wheels (m)
+    double wheel_radius = 0.033; ///< radius of the wheels (m)
+    double distance_threshold = 0.075; ///< range jump that splits two clusters (m)
+    double radius_threshold = 0.07; ///< largest radius of a landmark (m)
+    int num_landmarks = 12; ///< landmarks in the filter
+    Eigen::Matrix3d q = Eigen::Matrix3d::Identity() * 1e-5; ///< process noise
+    Eigen::Matrix2d r = Eigen::Matrix2d::Identity() * 1e-3; ///< measurement noise
+    double deadband_min = 100.0; ///< mahalanobis distance under which a measurement is a known landmark
+    double deadband_max = 500.0; ///< mahalanobis distance over which a measurement is a new landmark
+    double scan_cost = 0.0; ///< virtual time (s) charged for each scan, 0 to charge its measured wall time
+  };
+
+  /// \brief A message of a log, decoded into what the pipeline reads
+  struct DecodedMessage
+  {
+    int64_t stamp = 0; ///< time of the message (ns)
+    bool scan = false; ///< a scan, otherwise a joint state
+
+    std::vector<float> ranges; ///< scan beams
+    double angle_min = 0.0; ///< bearing of the first beam (rad)
+    double angle_increment = 0.0; ///< angle between beams (rad)
+    double range_min = 0.0; ///< smallest valid range (m)
+    double range_max = 0.0; ///< largest valid range (m)
+
+    double left = 0.0; ///< left wheel position (rad)
+    double right = 0.0; ///< right wheel position (rad)
+  };
+
+  /// \brief The scan and joint state messages of a log, in log order
+  ///
+  /// Decoding is the same for every replay of a log, so a decoded log can be shared read only by
+  /// many replays at once.
+  struct DecodedLog
+  {
+    std::vector<DecodedMessage> messages; ///< the messages
+    uint64_t scans = 0; ///< scans in the log
+    uint64_t joint_states = 0; ///< joint states in the log
+  };
+
+  /// \brief The pose of the filter after a scan
+  struct TrajectoryPoint
+  {
+    int64_t stamp = 0; ///< the stamp of the scan (ns)
+    rigid2d::Pose2D pose; ///< the robot pose
+  };
+
+  /// \brief The filter of a replay, kept for a smoothing pass
+  struct FilterRecord
+  {
+    std::vector<ekf_slam::StepRecord> steps; ///< one per processed scan
+    Eigen::VectorXd state; ///< the state vector at the end of the replay
+  };
+
+  /// \brief The results of a replay
+  struct ReplayMetrics
+  {
+    uint64_t scans = 0; ///< scans in the log
+    uint64_t scans_dropped = 0; ///< scans lost on the link
+    uint64_t scans_superseded = 0; ///< scans replaced in the queue before the pipeline got to them
+    uint64_t scans_processed = 0; ///< scans through the filter
+    uint64_t joint_states = 0; ///< joint states in the log
+    uint64_t glitches = 0; ///< joint states with a wheel jump
+    uint64_t stuck = 0; ///< joint states repeating the previous one
+    uint64_t spikes = 0; ///< messages sent during a delay spike
+    uint64_t reordered = 0; ///< messages that arrived after a later message of their topic
+
+    double latency_mean = 0.0; ///< from the stamp of a scan to the end of its update (s)
+    double latency_p50 = 0.0; ///< median latency (s)
+    double latency_p99 = 0.0; ///< 99th percentile latency (s)
+    double latency_max = 0.0; ///< worst latency (s)
+    double process_mean = 0.0; ///< wall time of the detection and update of one scan (s)
+    double throughput = 0.0; ///< scans the pipeline can process per second of wall time
+
+    uint64_t compared = 0; ///< poses compared with the reference
+    double position_rmse = 0.0; ///< position error against the reference (m)
+    double position_max = 0.0; ///< worst position error (m)
+    double heading_rmse = 0.0; ///< heading error against the reference (rad)
+
+    double nis_mean = 0.0; ///< mean normalized innovation squared of the updates, 2 when the filter is consistent
+  };
+
+  /// \brief Decode the scans and joint states of a log
+  /// \param log the open log
+  /// \param params the pipeline, for the topics and the wheel joints
+  /// \param decoded [out] the messages
+  /// \returns false if the log is missing the scan or joint topic or a wheel joint
+  bool decodeLog(const sensor_log::LogReader & log, const PipelineParams & params, DecodedLog & decoded);
+
+  /// \brief Replay a log through the pipeline over a faulty link
+  /// \param log the open log
+  /// \param params the pipeline
+  /// \param profile the link
+  /// \param seed the seed of the faults
+  /// \param reference the poses to compare against, such as a replay over a clean link, or null
+  /// \param trajectory [out] the pose after each processed scan, or null
+  /// \param record [out] the gains and jacobians of each processed scan and the final state, or null
+  /// \returns the metrics, all zero if the log is missing the scan or joint topic
+  ReplayMetrics replayLog(const sensor_log::LogReader & log, const PipelineParams & params,
+                          const FaultProfile & profile, uint32_t seed,
+                          const std::vector<TrajectoryPoint> * reference = nullptr,
+                          std::vector<TrajectoryPoint> * trajectory = nullptr,
+                          FilterRecord * record = nullptr);
+
+  /// \brief Replay a decoded log through the pipeline over a faulty link
+  ///
+  /// The same as replayLog, without decoding the log again. Replays of one decoded log share nothing
+  /// else and may run on different threads.
+  /// \param decoded the log, from decodeLog
+  /// \param params the pipeline
+  /// \param profile the link
+  /// \param seed the seed of the faults
+  /// \param reference the poses to compare against, or null
+  /// \param trajectory [out] the pose after each processed scan, or null
+  /// \param record [out] the gains and jacobians of each processed scan and the final state, or null
+  /// \returns the metrics
+  ReplayMetrics replayDecoded(const DecodedLog & decoded, const PipelineParams & params,
+                              const FaultProfile & profile, uint32_t seed,
+                              const std::vector<TrajectoryPoint> * reference = nullptr,
+                              std::vector<TrajectoryPoint> * trajectory = nullptr,
+                              FilterRecord * record = nullptr);
+
+  /// \brief Compare a trajectory with a reference, each pose against the reference pose at or just before it
+  /// \param reference the reference poses, in time order
+  /// \param trajectory the poses to check, in time order
+  /// \param metrics [out] the compared count and the error fields are filled
+  void compareTrajectories(const std::vector<TrajectoryPoint> & reference,
+                           const std::vector<TrajectoryPoint> & trajectory, ReplayMetrics & metrics);
+
+}
+#endif
@@ -0,0 +1,118 @@
+#ifndef FLEET_LOCALIZER_INCLUDE_GUARD_HPP
+#define FLEET_LOCALIZER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief EKF localization of many robots against one known landmark map, updated as a batch
+///
+/// Each robot only has the 3 pose states, so one filter is too small to keep a core busy. The
+/// states and covariences of every robot are kept as structure of arrays, and the robots that
+/// queued a scan are predicted and updated together. The trig and the association of each lane
+/// are done while gathering the batch, and the 3x3 covarience and 3x2 gain algebra runs branch
+/// free over the lanes so the compiler turns it into SIMD.
+
+#include <vector>
+#include <eigen3/Eigen/Dense>
+
+#include "nuslam/TurtleMap.h"
+#include "rigid2d/rigid2d.hpp"
+
+namespace ekf_slam
+{
+
+  /// \brief The settings shared by every robot of a fleet localizer
+  struct LocalizerParams
+  {
+    Eigen::Matrix3d q = Eigen::Matrix3d::Identity() * 1e-5; ///< motion noise on (th, x, y)
+    Eigen::Matrix2d r = Eigen::Matrix2d::Identity() * 1e-3; ///< measurement noise on (range, bearing)
+    double match_distance = 0.3; ///< max distance (m) from a measured landmark to the map landmark it matches
+    double nis_gate = 13.8; ///< updates with a larger normalized innovation squared are dropped
+    unsigned int grain = 256; ///< lanes per executor task
+  };
+
+  /// \brief Localization only EKFs for a fleet, sharing a known map of landmarks
+  class FleetLocalizer
+  {
+  public:
+    /// \brief create a localizer with no robots
+    /// \param map the known landmarks, in the map frame
+    /// \param params the noise, gates and batch size
+    FleetLocalizer(const std::vector<rigid2d::Vector2D> & map, const LocalizerParams & params);
+
+    /// \brief add a robot
+    /// \param pose the initial pose in the map frame
+    /// \param variance the initial variance of each pose state
+    /// \returns the id of the robot
+    int addRobot(const rigid2d::Pose2D & pose, double variance = 1e-4);
+
+    /// \brief queue the motion and the landmarks of one scan for the next batch. A robot queued
+    /// twice before a batch moves by the sum of the twists and keeps only the later landmarks.
+    /// \param robot the id of the robot
+    /// \param tw the body twist since the last queued scan
+    /// \param map_data the landmarks measured in the robot frame
+    void queue(int robot, const rigid2d::Twist2D & tw, const nuslam::TurtleMap & map_data);
+
+    /// \brief predict and update every queued robot, with the lanes split across the shared executor
+    /// \returns the number of robots updated
+    unsigned int update();
+
+    /// \brief get the number of robots
+    unsigned int size() const;
+
+    /// \brief get the pose of a robot
+    rigid2d::Pose2D pose(int robot) const;
+
+    /// \brief get the covarience of a robot, over (th, x, y)
+    Eigen::Matrix3d covariance(int robot) const;
+
+    /// \brief get the number of measurements that updated a robot in the last batch
+    unsigned int matched(int robot) const;
+
+    /// \brief get the mean normalized innovation squared of a robot in the last batch, 0 with no update
+    double meanNis(int robot) const;
+
+  private:
+    /// \brief Lanes of one step of a batch, as structure of arrays
+    struct Batch
+    {
+      std::vector<int> robot; // robot of each lane
+      std::vector<double> a, b, c, d; // prediction: the pose jacobian column, update: the H entries
+      std::vector<double> v0, v1; // update: the range and bearing innovation
+      std::vector<double> p00, p01, p02, p11, p12, p22; // covarience of each lane
+      std::vector<double> dth, dx, dy; // update: the change in the pose
+      std::vector<double> nis; // update: the normalized innovation squared
+
+      /// \brief size every array for a number of lanes
+      void resize(std::size_t lanes);
+    };
+
+    /// \brief predict the lanes [first, last) of the batch and match their queued landmarks
+    void predictLanes(std::size_t first, std::size_t last);
+
+    /// \brief apply the queued landmark of each lane in [first, last) at a position in its queue
+    void updateLanes(std::size_t round, std::size_t first, std::size_t last);
+
+    /// \brief find the map landmark nearest to a point, -1 past the match distance
+    /// \param px the x position in the map frame
+    /// \param py the y position in the map frame
+    int nearest(double px, double py) const;
+
+    LocalizerParams params; // settings
+    std::vector<rigid2d::Vector2D> landmarks; // known map
+
+    // pose and upper covarience of each robot
+    std::vector<double> th, x, y;
+    std::vector<double> p00, p01, p02, p11, p12, p22;
+
+    // queued work of each robot
+    std::vector<rigid2d::Twist2D> twists; // summed twist since the last batch
+    std::vector<std::vector<Eigen::Vector2d>> measured; // (range, bearing) of each queued landmark
+    std::vector<std::vector<int>> matches; // map landmark of each queued landmark, the unmatched are dropped after the prediction
+    std::vector<char> queued; // robot has work in the next batch
+    std::vector<unsigned int> updates; // updates in the last batch
+    std::vector<double> nis_sum; // summed nis in the last batch
+
+    std::vector<int> active; // robots in the current batch
+    Batch batch; // reused between batches
+  };
+
+}
+#endif
@@ -0,0 +1,95 @@
+#ifndef JCBB_INCLUDE_GUARD_HPP
+#define JCBB_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Joint Compatibility Branch and Bound (JCBB) data association
+///
+/// See: J. Neira and J. D. Tardos, Data Association in Stochastic Mapping
+/// Using the Joint Compatibility Test, IEEE Trans. Robotics and Automation (2001)
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <chrono>
+
+namespace ekf_slam
+{
+
+  /// \brief Approximate the inverse of the chi-square CDF using the Wilson-Hilferty transform
+  /// \param dof the degrees of freedom
+  /// \param z the standard normal quantile of the confidence level (2.326 for 99%)
+  /// \returns the chi-square value that bounds the confidence level
+  double chi2inv(int dof, double z);
+
+  /// \brief A possible pairing of an observation with a landmark
+  struct Pairing
+  {
+    int landmark = 0; ///< the landmark id (not the state vector index)
+    Eigen::Vector2d innovation = Eigen::Vector2d::Zero(); ///< actual minus expected measurement
+    Eigen::Matrix<double, 2, 3> Hr = Eigen::Matrix<double, 2, 3>::Zero(); ///< measurement jacobian of the robot state
+    Eigen::Matrix2d Hl = Eigen::Matrix2d::Zero(); ///< measurement jacobian of the landmark state
+    double distance = 0; ///< individual mahalonbis distance
+  };
+
+  class JCBB
+  {
+  public:
+    /// \brief Set up the search
+    /// \param individual_gate the mahalonbis distance gate used to pick candidate pairings.
+    ///        The joint gates are the chi-square bounds scaled to match it.
+    /// \param time_budget the max time to search, in seconds
+    JCBB(double individual_gate, double time_budget);
+
+    /// \brief Find the largest jointly compatible set of pairings
+    /// \param candidates the individually compatible pairings of each observation
+    /// \param sigma the predicted state covarience
+    /// \param R the sensor noise
+    /// \returns the landmark id paired with each observation, or -1 if unpaired
+    std::vector<int> associate(const std::vector<std::vector<Pairing>> & candidates, const Eigen::MatrixXd & sigma, const Eigen::Matrix2d & R);
+
+    /// \brief Check if the last search ran out of time and returned the best hypothesis found so far
+    /// \returns true if the search was cut short
+    bool timedOut() const;
+
+    /// \brief Get the number of hypotheses the last search visited
+    /// \returns the number of nodes expanded
+    int nodesVisited() const;
+
+  private:
+    /// \brief Depth first search over the observations
+    /// \param depth the position in the observation ordering
+    /// \param num_paired the number of pairings in the current hypothesis
+    void search(unsigned int depth, int num_paired);
+
+    /// \brief Extend the Cholesky factor of the joint innovation covarience by one pairing
+    /// \param p the pairing to add
+    /// \param k the number of pairings already in the factor
+    /// \returns the joint mahalonbis distance of the extended hypothesis, or a negative value if it is not positive definite
+    double extend(const Pairing & p, int k);
+
+    /// \brief Compute the innovation covarience block between two pairings of different observations
+    Eigen::Matrix2d crossCovariance(const Pairing & a, const Pairing & b) const;
+
+    double individual_gate = 0; // gate on a single pairing
+    double time_budget = 0; // max search time in seconds
+    std::chrono::steady_clock::time_point deadline; // time the current search must stop
+    bool timed_out = false; // the last search hit the deadline
+    int nodes = 0; // nodes visited by the last search
+
+    const std::vector<std::vector<Pairing>> * cands = nullptr; // candidates of the current search
+    const Eigen::MatrixXd * sig = nullptr; // state covarience of the current search
+    Eigen::Matrix2d Rnoise; // sensor noise
+
+    std::vector<int> order; // observations sorted by ambiguity
+    std::vector<double> joint_gates; // joint gate for each number of pairings
+    std::vector<int> hypothesis; // current pairing (index into candidates) of each observation, -1 for none
+    std::vector<int> best; // best hypothesis found
+    int best_paired = 0; // number of pairings in the best hypothesis
+    std::vector<const Pairing *> paired; // the pairings in the factor, in the order they were added
+    std::vector<bool> landmark_used; // landmark already in the hypothesis
+
+    Eigen::MatrixXd L; // lower Cholesky factor of the joint innovation covarience, grown in place
+    Eigen::VectorXd y; // L^-1 * joint innovation
+    std::vector<double> joint_dist; // joint mahalonbis distance at each number of pairings
+  };
+
+}
+#endif
@@ -0,0 +1,56 @@
+#ifndef LOG_MESSAGES_INCLUDE_GUARD_HPP
+#define LOG_MESSAGES_INCLUDE_GUARD_HPP
+/// \file
+/// \brief The sensor log schemas of the robot topics, and conversions between messages and log records
+///
+/// Header stamps are kept as a "stamp" scalar in seconds, and the frame id, which does not change
+/// over a topic, is kept in the topic meta. JointState keeps its joint names in the meta instead.
+
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/Twist.h>
+#include <sensor_msgs/JointState.h>
+#include <sensor_msgs/LaserScan.h>
+
+#include "nuturtlebot/SensorData.h"
+#include "nuslam/TurtleMap.h"
+#include "nuslam/sensor_log.hpp"
+
+namespace sensor_log
+{
+
+  /// \brief Make the schema of a topic from its first message
+  /// \param topic the topic name
+  /// \param msg the first message
+  /// \returns the schema
+  TopicSchema makeSchema(const std::string & topic, const sensor_msgs::LaserScan & msg);
+  TopicSchema makeSchema(const std::string & topic, const sensor_msgs::JointState & msg);
+  TopicSchema makeSchema(const std::string & topic, const nuslam::TurtleMap & msg);
+  TopicSchema makeSchema(const std::string & topic, const geometry_msgs::Twist & msg);
+  TopicSchema makeSchema(const std::string & topic, const nuturtlebot::SensorData & msg);
+
+  /// \brief Add a message to a log
+  /// \param log the open log
+  /// \param topic the topic id from the schema of the message type
+  /// \param stamp_ns the time the message was received (ns)
+  /// \param msg the message
+  /// \returns false if it could not be written
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const sensor_msgs::LaserScan & msg);
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const sensor_msgs::JointState & msg);
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const nuslam::TurtleMap & msg);
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const geometry_msgs::Twist & msg);
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const nuturtlebot::SensorData & msg);
+
+  /// \brief Rebuild a message from a log record
+  /// \param view the record
+  /// \param schema the schema of its topic
+  /// \param msg [out] the message
+  void readMessage(const MessageView & view, const TopicSchema & schema, sensor_msgs::LaserScan & msg);
+  void readMessage(const MessageView & view, const TopicSchema & schema, sensor_msgs::JointState & msg);
+  void readMessage(const MessageView & view, const TopicSchema & schema, nuslam::TurtleMap & msg);
+  void readMessage(const MessageView & view, const TopicSchema & schema, geometry_msgs::Twist & msg);
+  void readMessage(const MessageView & view, const TopicSchema & schema, nuturtlebot::SensorData & msg);
+
+}
+#endif
@@ -0,0 +1,218 @@
+#ifndef MAP_SNAPSHOT_INCLUDE_GUARD_HPP
+#define MAP_SNAPSHOT_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Immutable, versioned snapshots of the SLAM map for readers on other threads
+///
+/// One writer publishes snapshots and any number of registered readers use them.
+/// Reclamation is epoch based, like read-copy-update (RCU): a reader announces the epoch it
+/// started in, the writer swaps the current snapshot and frees an old one only once no reader
+/// could still be looking at it. A read is a load, a store and a load, so readers are wait free
+/// and never touch a reference count. Landmarks are stored in fixed size blocks that are shared
+/// between versions when none of their landmarks changed.
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace ekf_slam
+{
+
+  /// \brief A landmark in a snapshot
+  struct LandmarkEntry
+  {
+    int id = -1; ///< landmark id in the filter
+    double x = 0; ///< x position in the map frame
+    double y = 0; ///< y position in the map frame
+    double cov_xx = 0; ///< marginal covarience of x
+    double cov_xy = 0; ///< marginal covarience of x and y
+    double cov_yy = 0; ///< marginal covarience of y
+  };
+
+  /// \brief Number of landmarks in each shared block
+  constexpr int snapshot_block_size = 16;
+
+  /// \brief A fixed size, flat run of landmarks
+  struct SnapshotBlock
+  {
+    std::array<LandmarkEntry, snapshot_block_size> entries; ///< the landmarks, only the first count are valid
+    int count = 0; ///< number of valid entries
+  };
+
+  /// \brief An immutable view of the map at one version
+  class MapSnapshot
+  {
+  public:
+    /// \brief Get the version, which counts up by one with each publish
+    uint64_t version() const;
+
+    /// \brief Get the robot pose at this version
+    const rigid2d::Pose2D & robot() const;
+
+    /// \brief Get the number of landmarks
+    int size() const;
+
+    /// \brief Get a landmark
+    /// \param i the index, from 0 to size() - 1
+    /// \returns the landmark
+    const LandmarkEntry & landmark(int i) const;
+
+    /// \brief Get the number of blocks
+    int numBlocks() const;
+
+    /// \brief Check if a block is the same memory as the block of another snapshot
+    /// \param other the other snapshot
+    /// \param block the block index
+    /// \returns true if the block was shared instead of copied
+    bool sharesBlock(const MapSnapshot & other, int block) const;
+
+  private:
+    friend class SnapshotStore;
+
+    uint64_t ver = 0; // version
+    rigid2d::Pose2D pose; // robot pose
+    int count = 0; // number of landmarks
+    std::vector<std::shared_ptr<const SnapshotBlock>> blocks; // landmark blocks, shared between versions
+  };
+
+  /// \brief Holds the current snapshot and reclaims the old ones
+  class SnapshotStore
+  {
+  public:
+    class Reader;
+
+    /// \brief Keeps a snapshot alive while it is read
+    class ReadGuard
+    {
+    public:
+      /// \brief Ends the read
+      ~ReadGuard();
+
+      ReadGuard(const ReadGuard &) = delete;
+      ReadGuard & operator=(const ReadGuard &) = delete;
+
+      /// \brief Access the snapshot
+      const MapSnapshot * operator->() const;
+
+      /// \brief Access the snapshot
+      const MapSnapshot & operator*() const;
+
+    private:
+      friend class Reader;
+
+      ReadGuard(std::atomic<uint64_t> & slot, const MapSnapshot * snap);
+
+      std::atomic<uint64_t> & slot; // the reader slot, cleared when the read ends
+      const MapSnapshot * snap; // the snapshot being read
+    };
+
+    /// \brief A registered reader. Use one per thread, and one read at a time.
+    class Reader
+    {
+    public:
+      /// \brief Release the reader slot
+      ~Reader();
+
+      Reader(Reader && other);
+      Reader(const Reader &) = delete;
+      Reader & operator=(const Reader &) = delete;
+
+      /// \brief Start a read of the current snapshot, wait free
+      /// \returns a guard that keeps the snapshot alive until it goes out of scope
+      ReadGuard read();
+
+    private:
+      friend class SnapshotStore;
+
+      Reader(SnapshotStore * store, int slot);
+
+      SnapshotStore * store; // store being read, nullptr once moved from
+      int slot; // index of the reader slot
+    };
+
+    /// \brief Create a store holding an empty snapshot
+    /// \param max_readers the number of readers that can be registered at once
+    explicit SnapshotStore(int max_readers=32);
+
+    /// \brief Frees every snapshot. No reader may be in a read.
+    ~SnapshotStore();
+
+    SnapshotStore(const SnapshotStore &) = delete;
+    SnapshotStore & operator=(const SnapshotStore &) = delete;
+
+    /// \brief Register a reader
+    /// \returns the reader
+    /// \throws std::runtime_error if every reader slot is taken
+    Reader reader();
+
+    /// \brief Publish a new version, only from the writer thread.
+    /// A block is shared with the last version when none of its landmarks moved more than change_threshold.
+    /// \param landmarks the landmarks, in id order
+    /// \param robot the robot pose
+    /// \param change_threshold the largest change in a position or covarience that still counts as unchanged
+    void publish(const std::vector<LandmarkEntry> & landmarks, const rigid2d::Pose2D & robot, double change_threshold=0);
+
+    /// \brief Publish the landmarks of a filter
+    /// \param filter a Slam or SubmapSlam
+    /// \param change_threshold see publish()
+    template <class Filter>
+    void publishFrom(Filter & filter, double change_threshold=0)
+    {
+      scratch.clear();
+
+      Eigen::Vector2d pos;
+      Eigen::Matrix2d cov;
+      for(int id = 0; id < filter.getNumLandmarkIds(); id++)
+      {
+        if(!filter.getLandmarkPosition(id, pos) || !filter.getLandmarkMarginal(id, cov)) continue;
+
+        LandmarkEntry e;
+        e.id = id;
+        e.x = pos(0);
+        e.y = pos(1);
+        e.cov_xx = cov(0, 0);
+        e.cov_xy = cov(0, 1);
+        e.cov_yy = cov(1, 1);
+        scratch.push_back(e);
+      }
+
+      std::vector<double> state = filter.getRobotState();
+      publish(scratch, rigid2d::Pose2D(state.at(0), state.at(1), state.at(2)), change_threshold);
+    }
+
+    /// \brief Free the old snapshots that no reader can see any more, only from the writer thread
+    void reclaim();
+
+    /// \brief Get the number of old snapshots waiting for readers to finish
+    int numRetired() const;
+
+  private:
+    struct Retired
+    {
+      const MapSnapshot * snap; // the old snapshot
+      uint64_t epoch; // readers that started before this epoch may still see it
+    };
+
+    // one cache line per reader so readers do not slow each other down
+    struct alignas(64) Slot
+    {
+      std::atomic<uint64_t> epoch{0}; // epoch the reader started its read in, 0 if idle
+      std::atomic<bool> claimed{false}; // slot belongs to a reader
+    };
+
+    std::atomic<const MapSnapshot *> current; // the latest snapshot
+    std::atomic<uint64_t> epoch{1}; // counts up with each publish, 0 marks an idle reader slot
+    std::unique_ptr<Slot[]> slots; // one per reader
+    int max_readers = 0; // number of reader slots
+
+    std::vector<Retired> retired; // old snapshots not freed yet, writer only
+    std::vector<LandmarkEntry> scratch; // reused by publishFrom
+  };
+
+}
+#endif
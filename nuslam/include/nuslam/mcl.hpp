@@ -0,0 +1,190 @@
+#ifndef MCL_INCLUDE_GUARD_HPP
+#define MCL_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Monte Carlo localization against an occupancy grid with a likelihood field sensor model
+///
+/// The distance from every cell to the closest obstacle is found once per map and turned into
+/// the log likelihood of a beam ending in that cell. Scoring a particle is then one table lookup
+/// per beam. Beams are subsampled, their end points in the robot frame are found once per scan,
+/// and the particles are moved into the map frame and looked up in batches of structure of arrays
+/// buffers that the compiler turns into SIMD.
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace mcl
+{
+
+  /// \brief An occupancy grid, laid out like nav_msgs/OccupancyGrid
+  struct GridMap
+  {
+    std::vector<int8_t> data; ///< row major cells, 0 free, 100 occupied, -1 unknown
+    unsigned int width = 0; ///< number of columns
+    unsigned int height = 0; ///< number of rows
+    double resolution = 0; ///< side length of a cell (m)
+    double origin_x = 0; ///< x position of cell (0, 0) in the map frame
+    double origin_y = 0; ///< y position of cell (0, 0) in the map frame
+  };
+
+  /// \brief The log likelihood of a beam ending in each cell of a map
+  class LikelihoodField
+  {
+  public:
+    /// \brief Create an empty field, every lookup gives the likelihood of a random beam
+    LikelihoodField() = default;
+
+    /// \brief Precompute the field of a map
+    /// \param map the occupancy grid, cells at or above 50 are obstacles
+    /// \param sigma standard deviation (m) of a beam end point around the closest obstacle
+    /// \param max_dist distances are capped at this (m)
+    /// \param z_hit weight of the gaussian around the obstacles
+    /// \param z_rand weight of beams that land anywhere
+    LikelihoodField(const GridMap & map, double sigma, double max_dist, double z_hit=0.9, double z_rand=0.1);
+
+    /// \brief Look up a point
+    /// \param x x position in the map frame
+    /// \param y y position in the map frame
+    /// \returns the log likelihood of a beam ending at the point
+    float logLikelihood(double x, double y) const;
+
+    /// \brief Get the distance from a point to the closest obstacle
+    /// \param x x position in the map frame
+    /// \param y y position in the map frame
+    /// \returns the distance (m), capped at max_dist
+    double distance(double x, double y) const;
+
+    /// \brief Get the table, one row and one column of padding on each side of the map.
+    /// The padding holds the value of a beam that left the map.
+    const std::vector<float> & table() const;
+
+    unsigned int paddedWidth() const; ///< \brief the map width plus two
+    unsigned int paddedHeight() const; ///< \brief the map height plus two
+    double resolution() const; ///< \brief the cell size (m)
+    double originX() const; ///< \brief the x position of map cell (0, 0)
+    double originY() const; ///< \brief the y position of map cell (0, 0)
+
+    /// \brief Get the free cells of the map, as (x, y) centers in the map frame
+    const std::vector<rigid2d::Vector2D> & freeCells() const;
+
+  private:
+    /// \brief Index of the padded cell holding a point
+    unsigned int cellIndex(double x, double y) const;
+
+    std::vector<float> log_table; // log likelihood of each padded cell
+    std::vector<float> dist_table; // obstacle distance of each padded cell
+    std::vector<rigid2d::Vector2D> free_cells; // centers of the free cells
+    unsigned int width = 0; // padded width
+    unsigned int height = 0; // padded height
+    double res = 1; // cell size
+    double origin_x = 0; // map cell (0, 0) position
+    double origin_y = 0; // map cell (0, 0) position
+    float far_value = 0; // log likelihood off the map
+  };
+
+  /// \brief Settings for the particle filter
+  struct MclParams
+  {
+    int num_particles = 2000; ///< number of particles
+    int beam_step = 6; ///< use every beam_step-th beam of a scan
+    double alpha_rot_rot = 0.05; ///< rotation noise from rotation
+    double alpha_rot_trans = 0.01; ///< rotation noise from translation
+    double alpha_trans_trans = 0.05; ///< translation noise from translation
+    double alpha_trans_rot = 0.01; ///< translation noise from rotation
+    double beam_weight = 0.2; ///< scale on the summed log likelihood, below 1 treats the beams as correlated
+    double resample_ratio = 0.5; ///< resample when the effective number of particles drops below this fraction
+    double min_trans = 0.02; ///< distance (m) the robot moves before a scan is scored
+    double min_rot = 0.05; ///< rotation (rad) of the robot before a scan is scored
+  };
+
+  /// \brief A particle filter over (th, x, y) poses
+  class ParticleFilter
+  {
+  public:
+    /// \brief Set up the filter with every particle at the origin
+    /// \param params the number of particles, noise and update settings
+    /// \param seed the random seed
+    explicit ParticleFilter(const MclParams & params, unsigned int seed=0);
+
+    /// \brief Set the map
+    /// \param field the precomputed likelihood field
+    void setMap(const LikelihoodField & field);
+
+    /// \brief Spread the particles with a gaussian around a pose
+    /// \param pose the mean pose
+    /// \param sigma_xy standard deviation (m) of the position
+    /// \param sigma_th standard deviation (rad) of the heading
+    void initialize(const rigid2d::Pose2D & pose, double sigma_xy, double sigma_th);
+
+    /// \brief Spread the particles over the free cells of the map, for global localization
+    void initializeUniform();
+
+    /// \brief Move the particles by the change in odometry since the last call
+    /// \param odom_pose the odometry pose of the robot
+    void predict(const rigid2d::Pose2D & odom_pose);
+
+    /// \brief Set the beam angles. The cached trig is only recomputed when they change.
+    /// \param angle_min the angle of the first beam
+    /// \param angle_increment the angle between beams
+    /// \param num_beams the number of beams
+    void setBeams(double angle_min, double angle_increment, unsigned int num_beams);
+
+    /// \brief Weigh the particles by a scan and resample when the weights are uneven.
+    /// Skipped until the robot moved min_trans or min_rot since the last scored scan.
+    /// \param ranges the ranges of every beam, in the order of setBeams
+    /// \param range_min shorter ranges are left out
+    /// \param range_max longer ranges are left out
+    /// \returns true if the scan was scored
+    bool update(const std::vector<float> & ranges, double range_min, double range_max);
+
+    /// \brief Get the weighted mean pose
+    /// \returns the pose in the map frame
+    rigid2d::Pose2D estimate() const;
+
+    /// \brief Get the weighted covarience of the particles
+    /// \returns the covarience of (th, x, y)
+    std::vector<double> covariance() const;
+
+    /// \brief Get the number of particles
+    int size() const;
+
+    /// \brief Get a particle
+    /// \param i the index
+    /// \returns the pose of the particle
+    rigid2d::Pose2D particle(int i) const;
+
+    /// \brief Get the effective number of particles from the spread of the weights
+    double effectiveSize() const;
+
+  private:
+    static constexpr int batch_size = 64; // particles scored together
+
+    /// \brief Add the log likelihood of the beams to a batch of particles
+    void scoreBatch(int first, int count, const std::vector<float> & beam_x, const std::vector<float> & beam_y);
+
+    /// \brief Low variance resampling
+    void resample();
+
+    MclParams params; // settings
+    LikelihoodField field; // the map
+    std::mt19937 gen; // random numbers
+
+    // particles, structure of arrays
+    std::vector<double> xs, ys, ths; // poses
+    std::vector<double> weights; // normalized weights
+    std::vector<double> scores; // log likelihood of the last scan
+
+    std::vector<float> beam_cos, beam_sin; // trig of the used beams
+    std::vector<unsigned int> beam_index; // scan index of each used beam
+    double beam_min = 0, beam_inc = 0; // angles the trig was cached for
+    unsigned int beam_count = 0; // number of beams the trig was cached for
+
+    bool have_odom = false; // an odometry pose was seen
+    rigid2d::Pose2D last_odom; // odometry pose of the last predict
+    double moved_trans = 0, moved_rot = 0; // motion since the last scored scan
+  };
+
+}
+#endif
@@ -0,0 +1,131 @@
+#ifndef PLACE_RECOGNITION_INCLUDE_GUARD_HPP
+#define PLACE_RECOGNITION_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Finds keyframes that saw the same place, for loop closure without a search over every keyframe
+///
+/// Each scan is summarized by a scan context: a polar grid of rings and sectors around the robot
+/// that marks the cells holding a point. The fraction of each ring that is marked does not change
+/// when the robot turns, so these ring keys are stored in kd-trees. A query takes the nearest ring
+/// keys from the trees, then compares the full grids of those candidates at every sector shift to
+/// rank them and find the yaw between the scans.
+///
+/// The keys are split over static trees of 16, 32, 64, ... keys, at most one of each size, like the
+/// bits of a binary counter, and a tail of fewer than 16 keys. An add that fills the tail builds a
+/// tree of it and the trees below the first free size, so a key is rebuilt O(log n) times and a query
+/// searches O(log n) trees of O(log n) depth and a tail of constant size.
+
+#include <vector>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace place_recognition
+{
+
+  /// \brief Settings for the descriptors and the index
+  struct ContextParams
+  {
+    int num_rings = 20; ///< number of range bins
+    int num_sectors = 60; ///< number of bearing bins
+    double max_range = 3.5; ///< points further than this (m) are left out
+    int num_candidates = 10; ///< ring key neighbors compared in full for each query
+  };
+
+  /// \brief A scan context and its ring key
+  struct Descriptor
+  {
+    std::vector<float> cells; ///< 1 for each marked cell, ring major: cells[ring * num_sectors + sector]
+    std::vector<float> ring_key; ///< fraction of each ring that is marked
+  };
+
+  /// \brief Summarize a scan
+  /// \param points the scan points in the robot frame
+  /// \param params the grid size
+  /// \returns the descriptor
+  Descriptor makeDescriptor(const std::vector<rigid2d::Vector2D> & points, const ContextParams & params);
+
+  /// \brief A keyframe that may have seen the same place
+  struct Match
+  {
+    int id = -1; ///< keyframe id
+    double distance = 0; ///< mean squared difference of the grids at the best shift, 0 is identical
+    double yaw = 0; ///< rotation (rad) of the query scan frame relative to the keyframe
+  };
+
+  /// \brief Compare two descriptors at every sector shift
+  /// \param query the descriptor of the new scan
+  /// \param candidate the descriptor of a stored keyframe
+  /// \param params the grid size both were made with
+  /// \returns the distance and yaw at the best shift, with id left at -1
+  Match compare(const Descriptor & query, const Descriptor & candidate, const ContextParams & params);
+
+  /// \brief A static kd-tree over fixed length float keys
+  class KdTree
+  {
+  public:
+    /// \brief Build the tree, replacing its contents
+    /// \param keys the keys, dim floats each, one after another
+    /// \param ids the id of each key
+    /// \param dim the length of a key
+    void build(std::vector<float> keys, std::vector<int> ids, int dim);
+
+    /// \brief Find the nearest keys
+    /// \param query the key to search around
+    /// \param k the max number of neighbors
+    /// \param max_id only keys with an id below this are returned
+    /// \param out [out] (squared distance, id) of the neighbors, nearest first
+    void nearest(const float * query, int k, int max_id, std::vector<std::pair<float, int>> & out) const;
+
+    /// \brief Get the number of keys
+    /// \returns the number of keys
+    int size() const;
+
+  private:
+    /// \brief Order the keys in [lo, hi) into a subtree
+    void buildRange(int lo, int hi);
+
+    /// \brief Search the subtree of [lo, hi)
+    void search(int lo, int hi, const float * query, unsigned int k, int max_id, std::vector<std::pair<float, int>> & heap) const;
+
+    std::vector<float> keys; // the keys, in tree order
+    std::vector<int> ids; // id of each key, in tree order
+    std::vector<int> split; // split dimension of the node at each position
+    int dim = 0; // length of a key
+  };
+
+  /// \brief Descriptors of every keyframe, searchable by place
+  class PlaceIndex
+  {
+  public:
+    /// \brief Create an empty index
+    /// \param params the grid size and search settings
+    explicit PlaceIndex(const ContextParams & params);
+
+    /// \brief Add a keyframe
+    /// \param id the keyframe id, increasing with each add
+    /// \param points the scan of the keyframe, in its frame
+    void add(int id, const std::vector<rigid2d::Vector2D> & points);
+
+    /// \brief Find the keyframes that look most like a scan
+    /// \param points the scan, in the robot frame
+    /// \param k the max number of matches
+    /// \param max_id only keyframes with an id below this are returned
+    /// \returns the matches, best first
+    std::vector<Match> query(const std::vector<rigid2d::Vector2D> & points, int k, int max_id) const;
+
+    /// \brief Get the number of keyframes
+    /// \returns the number of keyframes
+    int size() const;
+
+  private:
+    ContextParams params; // settings
+    std::vector<Descriptor> descriptors; // by position of the add
+    std::vector<int> ids; // keyframe id of each descriptor
+
+    static constexpr int tail_size = 16; // keys searched one by one before they go in a tree, and the smallest tree
+    std::vector<KdTree> trees; // trees[l] holds the ring keys of tail_size << l descriptors, or none
+    int tree_size = 0; // number of descriptors in the trees, the oldest ones
+  };
+
+}
+#endif
@@ -0,0 +1,212 @@
+#ifndef POSE_GRAPH_INCLUDE_GUARD_HPP
+#define POSE_GRAPH_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Library for lidar pose graph SLAM that needs no landmarks
+///
+/// Keyframes are taken when the robot has moved far enough. Consecutive keyframes are tied
+/// together by odometry and by ICP scan matching, and keyframes that come back near each other
+/// are tied by loop closure scan matches. The graph is solved by sparse Levenberg-Marquardt
+/// with a block Cholesky factorization on the shared executor, off the calling thread.
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <map>
+#include <future>
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/place_recognition.hpp"
+
+namespace pose_graph
+{
+
+  /// \brief The result of aligning two scans
+  struct IcpResult
+  {
+    Eigen::Vector3d transform = Eigen::Vector3d::Zero(); ///< pose (th, x, y) of the source scan in the target scan frame
+    double rms = 0; ///< root mean square distance of the matched points from their target lines
+    int matches = 0; ///< number of matched points
+    bool converged = false; ///< the alignment stopped changing before the iteration limit
+  };
+
+  /// \brief Align a scan to another with point to line ICP. Each target point gets a line fit to
+  /// its neighbors, so walls sampled at different spots still line up.
+  /// \param source the points to move, in their own frame
+  /// \param target the points to align to, in their own frame
+  /// \param guess the starting pose (th, x, y) of the source frame in the target frame
+  /// \param max_dist the max distance (m) between matched points
+  /// \param iterations the max number of iterations
+  /// \returns the alignment and its quality
+  IcpResult icp(const std::vector<rigid2d::Vector2D> & source, const std::vector<rigid2d::Vector2D> & target,
+                const Eigen::Vector3d & guess, double max_dist, int iterations);
+
+  /// \brief A relative pose measurement between two nodes
+  struct Edge
+  {
+    int from = 0; ///< node the measurement is taken from
+    int to = 0; ///< node that is measured
+    Eigen::Vector3d measurement = Eigen::Vector3d::Zero(); ///< pose (th, x, y) of to in the frame of from
+    Eigen::Matrix3d information = Eigen::Matrix3d::Identity(); ///< inverse covarience of the measurement
+  };
+
+  /// \brief Cholesky factorization of a symmetric positive definite matrix made of 3x3 blocks.
+  /// Only the nonzero blocks are stored, column by column, and fill in is added as it appears.
+  class BlockCholesky
+  {
+  public:
+    /// \brief Factor a matrix
+    /// \param lower the blocks on and below the diagonal, lower.at(j)[i] is block (i, j) with i >= j
+    /// \returns false if the matrix is not positive definite
+    bool factor(std::vector<std::map<int, Eigen::Matrix3d>> lower);
+
+    /// \brief Solve A x = b with the factored matrix
+    /// \param b the right hand side, 3 entries per block
+    /// \returns x
+    Eigen::VectorXd solve(const Eigen::VectorXd & b) const;
+
+    /// \brief Get the number of stored blocks of the factor, including fill in
+    /// \returns the number of blocks
+    int numBlocks() const;
+
+  private:
+    std::vector<std::map<int, Eigen::Matrix3d>> L; // blocks of the lower factor, by column
+  };
+
+  class PoseGraph
+  {
+  public:
+    /// \brief Add a node
+    /// \param pose the starting estimate (th, x, y) of the node
+    /// \returns the node id
+    int addNode(const Eigen::Vector3d & pose);
+
+    /// \brief Add a measurement between two nodes
+    /// \param edge the measurement
+    void addEdge(const Edge & edge);
+
+    /// \brief Get the sum of the squared, information weighted errors of every edge
+    /// \returns the error
+    double error() const;
+
+    /// \brief Move the nodes to minimize the error with Levenberg-Marquardt. The first node is held fixed.
+    /// \param iterations the max number of iterations
+    /// \returns the error after the last iteration
+    double optimize(int iterations);
+
+    /// \brief Get the number of nodes
+    /// \returns the number of nodes
+    int numNodes() const;
+
+    /// \brief Get the estimate of a node
+    /// \param id the node id
+    /// \returns the pose (th, x, y)
+    const Eigen::Vector3d & getNode(int id) const;
+
+    /// \brief Get the estimate of every node
+    /// \returns the poses (th, x, y), by id
+    const std::vector<Eigen::Vector3d> & getNodes() const;
+
+    /// \brief Replace the estimate of a node
+    /// \param id the node id
+    /// \param pose the new pose (th, x, y)
+    void setNode(int id, const Eigen::Vector3d & pose);
+
+    /// \brief Get every edge
+    /// \returns the edges, in the order they were added
+    const std::vector<Edge> & getEdges() const;
+
+  private:
+    std::vector<Eigen::Vector3d> nodes; // node estimates (th, x, y)
+    std::vector<Edge> edges; // measurements
+  };
+
+  /// \brief Settings for GraphSlam
+  struct GraphParams
+  {
+    double keyframe_distance = 0.3; ///< distance (m) the robot moves before a new keyframe
+    double keyframe_angle = 0.35; ///< rotation (rad) of the robot before a new keyframe
+    double icp_max_dist = 0.3; ///< max distance (m) between matched scan points
+    int icp_iterations = 30; ///< max ICP iterations
+    double icp_max_rms = 0.05; ///< max rms error (m) of an accepted scan match
+    double icp_min_overlap = 0.5; ///< smallest fraction of the points that must match
+    double loop_radius = 1.0; ///< keyframes closer than this (m) are tried as loop closures, when place recognition is off
+    bool use_place_recognition = true; ///< find loop closure candidates by scan context instead of by distance
+    int place_candidates = 3; ///< max scan context matches tried with ICP for each keyframe
+    double place_max_distance = 0.15; ///< max scan context distance of a loop closure candidate
+    int loop_min_separation = 10; ///< keyframes this close in sequence are not tried as loop closures
+    double odom_sigma_xy = 0.05; ///< standard deviation (m) of an odometry edge
+    double odom_sigma_th = 0.05; ///< standard deviation (rad) of an odometry edge
+    double icp_sigma_xy = 0.02; ///< standard deviation (m) of a scan match edge
+    double icp_sigma_th = 0.01; ///< standard deviation (rad) of a scan match edge
+    int lm_iterations = 10; ///< max Levenberg-Marquardt iterations of each optimization
+    place_recognition::ContextParams context; ///< scan context grid and search settings
+  };
+
+  /// \brief Pose graph SLAM from odometry and laser scans
+  class GraphSlam
+  {
+  public:
+    /// \brief Set up an empty graph
+    /// \param params the keyframe, scan matching and noise settings
+    explicit GraphSlam(const GraphParams & params);
+
+    /// \brief Finish any optimization running in the background
+    ~GraphSlam();
+
+    /// \brief Add a scan. It becomes a keyframe if the robot moved far enough since the last one.
+    /// \param odom_pose the pose of the robot in the odometry frame when the scan was taken
+    /// \param points the scan points in the robot frame
+    /// \returns true if a keyframe was added
+    bool addScan(const rigid2d::Pose2D & odom_pose, const std::vector<rigid2d::Vector2D> & points);
+
+    /// \brief Move the robot without a scan
+    /// \param odom_pose the pose of the robot in the odometry frame
+    void addOdometry(const rigid2d::Pose2D & odom_pose);
+
+    /// \brief Extract the corrected robot state in the map frame
+    /// \returns a vector of the robot state (th, x, y)
+    std::vector<double> getRobotState();
+
+    /// \brief Get the number of keyframes
+    /// \returns the number of keyframes
+    int getNumKeyframes() const;
+
+    /// \brief Get the number of loop closure edges
+    /// \returns the number of loop closures
+    int getNumLoopClosures() const;
+
+    /// \brief Get the graph with the latest applied optimization
+    /// \returns the graph
+    const PoseGraph & getGraph() const;
+
+    /// \brief Block until the background optimization finishes and apply its result
+    ///
+    void waitForOptimize();
+
+  private:
+    /// \brief Add an edge between consecutive keyframes, and any loop closures of the new keyframe
+    void linkKeyframe(int id);
+
+    /// \brief Find old keyframes that may see the same place as a keyframe
+    /// \returns (keyframe id, ICP starting guess) pairs, most likely first
+    std::vector<std::pair<int, Eigen::Vector3d>> loopCandidates(int id) const;
+
+    /// \brief Queue an optimization of a copy of the graph on the shared executor
+    std::future<std::vector<Eigen::Vector3d>> startOptimize() const;
+
+    /// \brief Apply the result of a finished background optimization, if there is one
+    void pollOptimize();
+
+    GraphParams params; // settings
+    PoseGraph graph; // keyframe poses in the map frame and their edges
+    std::vector<std::vector<rigid2d::Vector2D>> scans; // scan of each keyframe, in the keyframe frame
+    std::vector<Eigen::Vector3d> keyframe_odom; // odometry pose (th, x, y) of each keyframe
+    Eigen::Vector3d last_odom = Eigen::Vector3d::Zero(); // latest odometry pose (th, x, y)
+    int loop_closures = 0; // number of loop closure edges
+    place_recognition::PlaceIndex places; // scan context of every keyframe
+
+    std::future<std::vector<Eigen::Vector3d>> pending; // the optimization running in the background
+    bool optimize_requested = false; // a loop closed while an optimization was running
+  };
+
+}
+#endif
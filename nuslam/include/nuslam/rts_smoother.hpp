@@ -0,0 +1,45 @@
+#ifndef RTS_SMOOTHER_INCLUDE_GUARD_HPP
+#define RTS_SMOOTHER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief An offline Rauch-Tung-Striebel smoothing pass over a recorded EKF SLAM run
+///
+/// The backward pass is the Bryson-Frazier form of the RTS smoother. Rather than a full covarience
+/// per step it runs an adjoint vector back through the recorded gains and jacobians, and only needs
+/// the robot rows of each posterior covarience to get the smoothed pose. Each step costs O(n) per
+/// landmark update against the O(n^3) prediction of the forward pass, and keeps O(n) numbers where
+/// a full covarience would be O(n^2).
+///
+/// Only the means are smoothed. The smoothed covarience is a difference of large terms while a new
+/// landmark still has its 1e6 prior, and is not worth its O(n^2) per update.
+///
+/// The landmarks are static, so their smoothed estimate is the final filter estimate. The map is
+/// refined instead by a few Gauss-Newton iterations of each landmark against its recorded
+/// measurements from the smoothed poses, which removes the error of linearizing about the early
+/// filtered poses.
+
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "nuslam/ekf_slam.hpp"
+
+namespace ekf_slam
+{
+
+  /// \brief Smooth the robot poses of a recorded run
+  /// \param steps the record of the forward pass, from Slam::recordSteps
+  /// \returns the smoothed robot state (th, x, y) of each step, a trailing step with no update is left out
+  std::vector<Eigen::Vector3d> smoothTrajectory(const std::vector<StepRecord> & steps);
+
+  /// \brief Refine the landmarks against their measurements from the smoothed poses
+  /// \param steps the record of the forward pass
+  /// \param poses the smoothed poses, one per step
+  /// \param state the state vector at the end of the run, the map to start from
+  /// \param r the sensor noise
+  /// \param iterations the Gauss-Newton iterations of each landmark
+  /// \returns the state vector with the refined landmarks and the last smoothed pose
+  Eigen::VectorXd refineLandmarks(const std::vector<StepRecord> & steps, const std::vector<Eigen::Vector3d> & poses,
+                                  const Eigen::VectorXd & state, const Eigen::Matrix2d & r, int iterations = 3);
+
+}
+#endif
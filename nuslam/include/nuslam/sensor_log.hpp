@@ -0,0 +1,246 @@
+#ifndef SENSOR_LOG_INCLUDE_GUARD_HPP
+#define SENSOR_LOG_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A chunked, time indexed binary log of sensor topics with a memory mapped reader
+///
+/// Each topic is a fixed set of scalar fields (stored as doubles) and variable length array fields
+/// (stored as floats, doubles or 32 bit ints). Messages are buffered per topic and written in chunks, one column
+/// after another: the stamps, each scalar, then the offsets and elements of each array. A chunk may
+/// be compressed with zlib. The index of every chunk and the topic table go at the end of the file.
+///
+/// The reader maps the file and reads uncompressed chunks in place, so opening a log only reads the
+/// index. Seeking to a time is a binary search over the chunks of a topic and then over the stamps
+/// of one chunk.
+///
+/// File layout, all sections 8 byte aligned:
+///   header | chunk | chunk | ... | topic table | chunk index | footer
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace sensor_log
+{
+
+  /// \brief Chunk compression
+  enum class Codec : uint32_t
+  {
+    None = 0, ///< stored as is, read in place
+    Zlib = 1, ///< deflate, decompressed when the chunk is first read
+  };
+
+  /// \brief The element type of an array field
+  enum class ElementType : uint32_t
+  {
+    Float32 = 0,
+    Float64 = 1,
+    Int32 = 2,
+  };
+
+  /// \brief The fields of a topic
+  struct TopicSchema
+  {
+    std::string name; ///< topic name
+    std::string type; ///< message type, such as sensor_msgs/LaserScan
+    std::string meta; ///< anything constant over the topic, such as joint names
+    std::vector<std::string> scalars; ///< names of the scalar fields
+    std::vector<std::string> arrays; ///< names of the array fields
+    std::vector<ElementType> array_types; ///< element type of each array field
+  };
+
+  /// \brief Settings for writing a log
+  struct WriterParams
+  {
+    unsigned int chunk_messages = 1024; ///< max messages in a chunk
+    unsigned int chunk_bytes = 1 << 20; ///< a chunk is written once its columns reach this size
+    Codec codec = Codec::None; ///< compression of every chunk
+    int level = 1; ///< zlib level, 1 is fast and still shrinks scans well
+  };
+
+  /// \brief Writes a log one message at a time
+  class LogWriter
+  {
+  public:
+    LogWriter();
+
+    /// \brief Close the log if it is open
+    ~LogWriter();
+
+    LogWriter(const LogWriter &) = delete;
+    LogWriter & operator=(const LogWriter &) = delete;
+
+    /// \brief Start a log, replacing any file at the path
+    /// \param path the file
+    /// \param params the chunk size and compression
+    /// \returns false if the file could not be created
+    bool open(const std::string & path, const WriterParams & params = WriterParams());
+
+    /// \brief Add a topic
+    /// \param schema the fields of every message of the topic
+    /// \returns the topic id used to write
+    int addTopic(const TopicSchema & schema);
+
+    /// \brief Add a message
+    /// \param topic the topic id
+    /// \param stamp_ns the time of the message (ns), not decreasing within a topic
+    /// \param scalars one value for each scalar field
+    /// \param arrays the values of each array field
+    /// \returns false if the message does not fit the schema, is out of order, or could not be written
+    bool write(int topic, int64_t stamp_ns, const std::vector<double> & scalars,
+               const std::vector<std::vector<double>> & arrays = {});
+
+    /// \brief Write the remaining chunks, the index and the footer
+    /// \returns false if anything could not be written
+    bool close();
+
+  private:
+    struct Buffer; // the unwritten messages of one topic
+
+    /// \brief Write the buffered messages of a topic as one chunk
+    bool flush(int topic);
+
+    WriterParams params; // settings
+    std::vector<TopicSchema> schemas; // by topic id
+    std::vector<std::unique_ptr<Buffer>> buffers; // by topic id
+    std::vector<char> index; // serialized index entries
+    uint64_t num_chunks = 0; // entries in index
+    int fd = -1; // the open file
+    uint64_t offset = 0; // bytes written
+    bool ok = true; // every write so far succeeded
+  };
+
+  /// \brief The values of an array field of one message
+  struct ArrayView
+  {
+    const void * data = nullptr; ///< the first element
+    uint32_t size = 0; ///< number of elements
+    ElementType type = ElementType::Float64; ///< type of the elements
+
+    /// \brief Get an element as a double
+    double at(uint32_t i) const;
+  };
+
+  struct ChunkColumns; // pointers to the columns of a loaded chunk
+
+  /// \brief One message, valid until the next call to next or seek on the cursor that produced it
+  struct MessageView
+  {
+    int topic = -1; ///< the topic id
+    int64_t stamp = 0; ///< the time of the message (ns)
+
+    /// \brief Get a scalar field
+    double scalar(int i) const;
+
+    /// \brief Get an array field
+    ArrayView array(int i) const;
+
+    const ChunkColumns * chunk = nullptr; ///< the chunk holding the message
+    uint32_t row = 0; ///< the position in the chunk
+  };
+
+  class LogReader;
+
+  /// \brief Walks the messages of some topics in time order, the reader must outlive it
+  class Cursor
+  {
+  public:
+    /// \brief Get the next message
+    /// \param out [out] the message
+    /// \returns false once every message before the end time was read
+    bool next(MessageView & out);
+
+    /// \brief Move every topic to the first message at or after a time
+    /// \param stamp_ns the time (ns)
+    void seek(int64_t stamp_ns);
+
+  private:
+    friend class LogReader;
+
+    /// \brief Where one topic is
+    struct Position
+    {
+      int topic = -1; // topic id
+      unsigned int entry = 0; // index entry of the current chunk, among the entries of the topic
+      uint32_t row = 0; // next row in the chunk
+      std::shared_ptr<const ChunkColumns> chunk; // the loaded chunk, null until needed
+    };
+
+    /// \brief Load the chunk a position is in, moving on past the end of a chunk
+    /// \returns false if the topic has no more messages
+    bool ready(Position & pos);
+
+    const LogReader * reader = nullptr; // the log
+    std::vector<Position> positions; // one per topic
+    int64_t end = 0; // messages at or after this are not returned
+  };
+
+  /// \brief Reads a log through a memory map
+  class LogReader
+  {
+  public:
+    LogReader();
+
+    /// \brief Unmap the file
+    ~LogReader();
+
+    LogReader(const LogReader &) = delete;
+    LogReader & operator=(const LogReader &) = delete;
+
+    /// \brief Map a log and read its index
+    /// \param path the file
+    /// \returns false if the file is missing or not a complete log
+    bool open(const std::string & path);
+
+    /// \brief Get the topics
+    const std::vector<TopicSchema> & topics() const;
+
+    /// \brief Find a topic by name
+    /// \returns the topic id or -1
+    int findTopic(const std::string & name) const;
+
+    /// \brief Get the number of messages of a topic
+    uint64_t count(int topic) const;
+
+    /// \brief Get the number of chunks of a topic
+    unsigned int numChunks(int topic) const;
+
+    /// \brief Get the time of the first message of any topic (ns)
+    int64_t startTime() const;
+
+    /// \brief Get the time of the last message of any topic (ns)
+    int64_t endTime() const;
+
+    /// \brief Start reading some topics
+    /// \param topics the topic ids, all of them if empty
+    /// \param begin the time (ns) of the first message to return
+    /// \param end messages at or after this time (ns) are not returned
+    /// \returns a cursor at the first message
+    Cursor read(const std::vector<int> & topics, int64_t begin, int64_t end) const;
+
+  private:
+    friend class Cursor;
+
+    /// \brief An entry of the chunk index
+    struct Entry
+    {
+      int64_t t_first = 0; // time of the first message
+      int64_t t_last = 0; // time of the last message
+      uint64_t offset = 0; // position of the chunk in the file
+      uint64_t stored_size = 0; // size in the file
+      uint64_t raw_size = 0; // size once decompressed
+      uint32_t count = 0; // number of messages
+      Codec codec = Codec::None; // compression
+    };
+
+    /// \brief Load a chunk, in place or decompressed
+    std::shared_ptr<const ChunkColumns> load(int topic, const Entry & entry) const;
+
+    std::vector<TopicSchema> schemas; // by topic id
+    std::vector<std::vector<Entry>> entries; // chunks of each topic, in time order
+    const char * map = nullptr; // the mapped file
+    uint64_t map_size = 0; // bytes mapped
+  };
+
+}
+#endif
@@ -0,0 +1,214 @@
+#ifndef SUBMAP_INCLUDE_GUARD_HPP
+#define SUBMAP_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Library for submap-joining SLAM built from a series of bounded local EKF filters
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Sparse>
+#include <vector>
+#include <map>
+#include <memory>
+#include <future>
+
+#include "geometry_msgs/Point.h"
+#include "nuslam/TurtleMap.h"
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/ekf_slam.hpp"
+
+namespace ekf_slam
+{
+
+  /// \brief A frozen local map. Everything is expressed relative to the pose
+  /// the robot had when the submap was started.
+  struct Submap
+  {
+    Eigen::Vector3d end_pose = Eigen::Vector3d::Zero(); ///< robot pose (th, x, y) when the submap was frozen
+    Eigen::Matrix3d end_covar = Eigen::Matrix3d::Identity(); ///< covarience of the end pose
+    std::vector<Eigen::Vector2d> landmarks; ///< landmark positions in the submap frame
+    std::vector<Eigen::Matrix2d> landmark_covars; ///< marginal covarience of each landmark
+  };
+
+  /// \brief The result of joining a list of frozen submaps
+  struct GlobalMap
+  {
+    std::vector<Eigen::Vector3d> origins; ///< global pose (th, x, y) of the start of each submap
+    std::vector<Eigen::Vector2d> landmarks; ///< global landmark positions
+    std::vector<std::vector<int>> associations; ///< global landmark index of each local landmark, per submap
+    std::shared_ptr<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>> information; ///< factored information matrix of the origins and landmarks
+  };
+
+  /// \brief Freeze the current state of a local filter into a submap
+  /// \param local the local filter
+  /// \returns the submap holding the end pose and landmark marginals of the filter
+  Submap freezeSubmap(const Slam & local);
+
+  /// \brief Join frozen submaps into one global map. The origins of the submaps
+  /// and the global landmarks are found with a sparse Gauss-Newton least squares
+  /// solve, where each submap contributes the relative pose to the next submap
+  /// and the local position of each of its landmarks. Cross correlations
+  /// inside a submap are dropped so the normal equations stay sparse.
+  /// \param submaps the frozen submaps, in the order they were created
+  /// \param gate the max distance (m) to associate a local landmark with a global one
+  /// \param iterations the number of Gauss-Newton iterations
+  /// \returns the joined global map
+  GlobalMap joinSubmaps(const std::vector<Submap> & submaps, double gate, int iterations);
+
+  /// \brief Recover the columns of the joined map covarience that belong to one
+  /// landmark. Only these columns are solved for from the factored information
+  /// matrix, the full covarience is never formed.
+  /// \param map the joined map
+  /// \param id the global landmark index
+  /// \param out [out] the two covarience columns of the landmark
+  /// \returns false if the map has no information matrix or the id does not exist
+  bool recoverCovarianceColumns(const GlobalMap & map, int id, Eigen::MatrixXd & out);
+
+  class SubmapSlam
+  {
+  public:
+    /// \brief Initialize submap-joining SLAM
+    /// \param submap_landmarks the max number of landmarks in each local filter
+    /// \param q_var the process noise
+    /// \param r_var the sensor noise
+    SubmapSlam(int submap_landmarks, Eigen::Matrix3d q_var, Eigen::Matrix2d r_var);
+
+    /// \brief Finish any join running in the background
+    ~SubmapSlam();
+
+    /// \brief Predict the current state of the robot using the motion model of the local filter.
+    /// \param tw a twist command the robot will follow
+    void MotionModelUpdate(rigid2d::Twist2D tw);
+
+    /// \brief Incorperate sensor information into the local filter. If the local
+    /// filter is full after the update, it is frozen and a new one is started.
+    /// \param map_data the landmarks observed by the robot
+    void MeasurmentModelUpdate(nuslam::TurtleMap map_data);
+
+    /// \brief Extract the robot state in the global frame
+    /// \returns a vector of the robot state (th, x, y)
+    std::vector<double> getRobotState();
+
+    /// \brief Get the innovations of the last measurement update of the local filter
+    /// \returns one innovation per matched observation, with local landmark ids
+    const std::vector<Innovation> & getInnovations() const;
+
+    /// \brief Extract the joined landmarks and the landmarks of the local filter in the global frame
+    /// \returns a vector of the points
+    std::vector<geometry_msgs::Point> getLandmarkStates();
+
+    /// \brief Get the number of landmark ids that can be queried. Ids follow the
+    /// order of getLandmarkStates and change when a join finishes.
+    /// \returns the number of landmark ids
+    int getNumLandmarkIds() const;
+
+    /// \brief Get the estimated position of a landmark in the global frame
+    /// \param id the landmark id
+    /// \param out [out] the x,y position of the landmark
+    /// \returns false if the id does not exist
+    bool getLandmarkPosition(int id, Eigen::Vector2d & out) const;
+
+    /// \brief Get the 2x2 marginal covarience of a landmark in the global frame.
+    /// Landmarks in the joined map are recovered lazily from the information matrix.
+    /// \param id the landmark id
+    /// \param out [out] the marginal covarience
+    /// \returns false if the id does not exist
+    bool getLandmarkMarginal(int id, Eigen::Matrix2d & out) const;
+
+    /// \brief Get the 2x2 cross covarience block between two landmarks. Landmarks
+    /// that are not both in the joined map or both in the local filter are treated as independent.
+    /// \param id1 the first landmark id (rows)
+    /// \param id2 the second landmark id (columns)
+    /// \param out [out] the cross covarience block
+    /// \returns false if either id does not exist
+    bool getLandmarkCrossCovariance(int id1, int id2, Eigen::Matrix2d & out) const;
+
+    /// \brief Get the covarience of the relative position between two landmarks (m2 - m1)
+    /// \param id1 the first landmark id
+    /// \param id2 the second landmark id
+    /// \param out [out] the covarience of the relative position
+    /// \returns false if either id does not exist
+    bool getRelativeCovariance(int id1, int id2, Eigen::Matrix2d & out) const;
+
+    /// \brief Get the number of frozen submaps
+    /// \returns the number of frozen submaps
+    int getNumSubmaps() const;
+
+    /// \brief Set the max distance to associate landmarks between submaps during a join
+    /// \param gate the distance threshold (m)
+    void setJoinGate(double gate);
+
+    /// \brief Switch the data association of every local filter between greedy nearest neighbor and JCBB
+    /// \param enable true to associate each scan jointly with JCBB
+    /// \param time_budget the max time (s) to spend on each JCBB search
+    void useJointCompatibility(bool enable, double time_budget=0.005);
+
+    /// \brief Set the mahalanobis distances that associate a measurement in every local filter
+    /// \param min under this a measurement is a known landmark
+    /// \param max over this a measurement is a new landmark
+    void setAssociationThresholds(double min, double max);
+
+    /// \brief Switch the random noise every local filter adds to its prediction and expected measurements
+    /// \param enable false to leave it out, so the same inputs always give the same estimates
+    void injectNoise(bool enable);
+
+    /// \brief Block until the background join finishes and apply its result
+    ///
+    void waitForJoin();
+
+  private:
+    /// \brief Freeze the local filter, start a new one, and schedule a join
+    ///
+    void startNewSubmap();
+
+    /// \brief Queue a join of the frozen submaps on the shared executor
+    /// \returns the future joined map
+    std::future<GlobalMap> startJoin() const;
+
+    /// \brief Apply the result of a finished background join, if there is one
+    ///
+    void pollJoin();
+
+    /// \brief Compute the global pose of the start of a submap
+    /// \param i the submap number (the local filter is number frozen.size())
+    /// \returns the transform from the global frame to the submap origin
+    rigid2d::Transform2D getOrigin(unsigned int i) const;
+
+    /// \brief Find where a landmark id is stored
+    /// \param id the landmark id
+    /// \param submap [out] the submap number holding the landmark, -1 for the joined map
+    /// \param index [out] the index of the landmark in the joined map or submap, or the slot in the local filter
+    /// \returns false if the id does not exist
+    bool locateLandmark(int id, int & submap, int & index) const;
+
+    /// \brief Get the covarience block between two landmarks of the joined map
+    /// \param j1 the first global landmark index (rows)
+    /// \param j2 the second global landmark index (columns)
+    /// \param out [out] the covarience block
+    /// \returns false if the block could not be recovered
+    bool getJoinedBlock(int j1, int j2, Eigen::Matrix2d & out) const;
+
+    Slam local; // the filter for the current submap
+    std::vector<Submap> frozen; // all frozen submaps
+    std::vector<Innovation> innovations; // innovations of the last update, kept when the local filter is replaced
+
+    GlobalMap joined; // result of the last join
+    mutable std::map<int, Eigen::MatrixXd> joined_columns; // covarience columns recovered from the last join
+    std::future<GlobalMap> pending_join; // the join running in the background
+    bool join_requested = false; // a submap was frozen while a join was running
+
+    int submap_landmarks = 0; // max landmarks in each local filter
+    double join_gate = 0.3; // association distance threshold between submaps, 30 cm
+    int join_iterations = 5; // gauss-newton iterations for each join
+
+    bool use_jcbb = false; // local filters use JCBB data association
+    double jcbb_time_budget = 0.005; // JCBB search time budget, 5 ms
+    double deadband_min = 100.0; // local filter association thresholds
+    double deadband_max = 500.0;
+
+    Eigen::Matrix3d Qnoise; // motion noise model
+    Eigen::Matrix2d Rnoise; // sensor noise model
+    bool inject_noise = true; // local filters add sampled noise
+  };
+
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef SYNTHETIC_SENSORS_INCLUDE_GUARD_HPP
+#define SYNTHETIC_SENSORS_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A simulated turtlebot driving a circle among cylinders, for sensor payloads without gazebo
+///
+/// The robot starts at the origin facing +x and drives a constant twist, so its pose, wheel angles
+/// and encoder ticks are closed form functions of time. Scans are cast against the cylinders and a
+/// round wall, and landmarks are the cylinders in range, both in the robot frame.
+
+#include <vector>
+#include <random>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+#include "rigid2d/diff_drive.hpp"
+#include "nuslam/TurtleMap.h"
+
+namespace synthetic
+{
+
+  /// \brief The arena, the robot and its sensors
+  struct ArenaParams
+  {
+    std::vector<rigid2d::Vector2D> landmarks; ///< cylinder centers in the world frame
+    double landmark_radius = 0.04; ///< cylinder radius (m)
+    double wall_radius = 2.5; ///< radius of the round wall around the origin (m)
+    rigid2d::Twist2D twist = rigid2d::Twist2D(0.2, 0.1, 0.0); ///< the constant body twist of the robot
+    double wheel_base = 0.16; ///< distance between the wheels (m)
+    double wheel_radius = 0.033; ///< wheel radius (m)
+    double encoder_ticks_per_rev = 4096; ///< encoder ticks per wheel turn
+    int num_beams = 360; ///< beams of a full turn scan, starting straight ahead
+    double range_min = 0.12; ///< shortest valid range (m)
+    double range_max = 3.5; ///< longest valid range (m)
+    double range_noise = 0.005; ///< standard deviation of the range noise (m)
+    double landmark_range = 1.5; ///< landmarks further than this are not reported (m)
+    uint32_t seed = 1; ///< seed of the range noise
+  };
+
+  /// \brief Make the default arena, a ring of cylinders around the circle the default twist drives
+  /// \param count the number of cylinders
+  /// \returns the settings with the cylinders filled in
+  ArenaParams ringArena(int count);
+
+  /// \brief A robot driving a constant twist through an arena
+  class SyntheticRobot
+  {
+  public:
+    /// \brief Create the robot at the origin
+    /// \param params the arena, robot and sensor settings
+    explicit SyntheticRobot(const ArenaParams & params);
+
+    /// \brief Get the pose of the robot
+    /// \param t the time since the start (s)
+    /// \returns the pose in the world frame
+    rigid2d::Pose2D pose(double t) const;
+
+    /// \brief Get the time the robot takes to drive its circle once, 0 if it drives straight
+    double period() const;
+
+    /// \brief Get the wheel angles
+    /// \param t the time since the start (s)
+    /// \returns the left and right wheel angles (rad)
+    rigid2d::WheelVelocities wheelAngles(double t) const;
+
+    /// \brief Get the encoder readings, as the gazebo plugin makes them
+    /// \param t the time since the start (s)
+    /// \param left [out] the left encoder ticks
+    /// \param right [out] the right encoder ticks
+    void encoders(double t, int32_t & left, int32_t & right) const;
+
+    /// \brief Cast a noisy scan
+    /// \param pose the pose of the robot
+    /// \param ranges [out] one range per beam, beam i at angle 2 pi i / num_beams
+    void scan(const rigid2d::Pose2D & pose, std::vector<float> & ranges);
+
+    /// \brief Find the landmarks in range
+    /// \param pose the pose of the robot
+    /// \param map [out] the centers and radii of the landmarks in the robot frame
+    void landmarks(const rigid2d::Pose2D & pose, nuslam::TurtleMap & map) const;
+
+    /// \brief Get the settings
+    const ArenaParams & params() const;
+
+  private:
+    ArenaParams arena; // settings
+    rigid2d::WheelVelocities wheel_rates; // wheel speeds of the twist (rad/s)
+    std::mt19937 gen; // range noise
+    std::normal_distribution<double> noise; // range noise
+  };
+
+}
+#endif
@@ -3,6 +3,7 @@
 ///
 /// PUBLISHES:
 ///   landmarks: (nuslam/TurtleMap) The groundtruth landmark information
+///   /diagnostics: (diagnostic_msgs/DiagnosticArray) the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///   gazebo/model_states (gazebo_msgs/ModelStates) The groundtruth position of all of the landmarks
 
@@ -21,6 +22,7 @@
 #include "nav_msgs/Path.h"
 
 #include "rigid2d/rigid2d.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 /// publishers for data
 ros::Publisher landmark_pub, gt_path_pub;
@@ -133,6 +135,7 @@ int main(int argc, char** argv)
   ros::init(argc, argv, "analysis");
   ros::NodeHandle n;
   ros::NodeHandle np("~");
+  rigid2d::TopicMonitor monitor(n);
 
   np.getParam("landmark_frame_id", landmark_frame_id);
   np.getParam("robot_name", robot_name);
@@ -146,7 +149,8 @@ int main(int argc, char** argv)
 
   landmark_pub = n.advertise<nuslam::TurtleMap>("landmark_data", 1);
   gt_path_pub = n.advertise<nav_msgs::Path>("groundtruth_path", 1);
-  ros::Subscriber sub_gazebo = n.subscribe("gazebo/model_states", 1, callback_gazebo_data);
+  ros::Subscriber sub_gazebo = monitor.subscribe<gazebo_msgs::ModelStates>(n, "gazebo/model_states",
+    [](const gazebo_msgs::ModelStates::ConstPtr & data) { callback_gazebo_data(*data); });
 
   ros::spin();
   return 0;
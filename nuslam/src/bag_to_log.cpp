@@ -0,0 +1,155 @@
+/// \file
+/// \brief Converts a rosbag into a chunked sensor log, for replay tools that need to open and seek quickly
+///
+/// USAGE:
+///     rosrun nuslam bag_to_log input.bag output.nlog [--zlib] [--chunk N]
+///     --zlib: compress each chunk that gets smaller
+///     --chunk N: the max messages in a chunk (default 1024)
+/// TOPICS:
+///     Every sensor_msgs/LaserScan, sensor_msgs/JointState, nuslam/TurtleMap, geometry_msgs/Twist and
+///     nuturtlebot/SensorData topic of the bag is converted, the rest are skipped. Messages are stamped
+///     with the time they were recorded. A nuslam/TurtleMap recorded before the message had ids is
+///     converted with empty ids.
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <topic_tools/shape_shifter.h>
+
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/log_messages.hpp"
+
+/// \brief Write a message read from the bag, adding its topic on the first message
+template<class T>
+void writeToLog(const rosbag::MessageInstance & m, const T & msg, sensor_log::LogWriter & log, std::map<std::string, int> & topics)
+{
+  auto it = topics.find(m.getTopic());
+  if(it == topics.end()) it = topics.emplace(m.getTopic(), log.addTopic(sensor_log::makeSchema(m.getTopic(), msg))).first;
+
+  if(!sensor_log::writeMessage(log, it->second, m.getTime().toNSec(), msg))
+  {
+    std::cerr << "BAG_TO_LOG: Could not write a message of " << m.getTopic() << "\n";
+  }
+}
+
+/// \brief Write a bag message of one type
+/// \returns true if the message had this type
+template<class T>
+bool convert(const rosbag::MessageInstance & m, sensor_log::LogWriter & log, std::map<std::string, int> & topics)
+{
+  typename T::ConstPtr msg = m.instantiate<T>();
+  if(!msg) return false;
+
+  writeToLog(m, *msg, log, topics);
+  return true;
+}
+
+/// \brief Write a nuslam/TurtleMap recorded before the ids field was added. Its md5 no longer matches,
+/// so it is read as raw bytes, which are the current layout without the trailing ids array.
+/// \returns true if the message was an older TurtleMap
+bool convertOldMap(const rosbag::MessageInstance & m, sensor_log::LogWriter & log, std::map<std::string, int> & topics)
+{
+  if(m.getDataType() != ros::message_traits::datatype<nuslam::TurtleMap>()) return false;
+
+  topic_tools::ShapeShifter::ConstPtr raw = m.instantiate<topic_tools::ShapeShifter>();
+  if(!raw) return false;
+
+  // four zero bytes are the length of an empty ids array
+  std::vector<uint8_t> buffer(raw->size() + 4, 0);
+  ros::serialization::OStream out(buffer.data(), raw->size());
+  raw->write(out);
+
+  nuslam::TurtleMap msg;
+  try
+  {
+    ros::serialization::IStream in(buffer.data(), buffer.size());
+    ros::serialization::deserialize(in, msg);
+    if(in.getLength() != 0) return false;
+  }
+  catch(ros::serialization::StreamOverrunException &)
+  {
+    return false;
+  }
+
+  writeToLog(m, msg, log, topics);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 3)
+  {
+    std::cerr << "usage: bag_to_log input.bag output.nlog [--zlib] [--chunk N]\n";
+    return 1;
+  }
+
+  sensor_log::WriterParams params;
+  for(int i = 3; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if(arg == "--zlib") params.codec = sensor_log::Codec::Zlib;
+    else if(arg == "--chunk" && i + 1 < argc) params.chunk_messages = std::max(1, std::atoi(argv[++i]));
+  }
+
+  rosbag::Bag bag;
+  try
+  {
+    bag.open(argv[1], rosbag::bagmode::Read);
+  }
+  catch(rosbag::BagException & e)
+  {
+    std::cerr << "BAG_TO_LOG: Could not open " << argv[1] << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  sensor_log::LogWriter log;
+  if(!log.open(argv[2], params))
+  {
+    std::cerr << "BAG_TO_LOG: Could not create " << argv[2] << "\n";
+    return 1;
+  }
+
+  std::map<std::string, int> topics;
+  unsigned long converted = 0, skipped = 0;
+
+  try
+  {
+    rosbag::View view(bag);
+    for(const rosbag::MessageInstance & m : view)
+    {
+      bool done = convert<sensor_msgs::LaserScan>(m, log, topics) ||
+                  convert<sensor_msgs::JointState>(m, log, topics) ||
+                  convert<nuslam::TurtleMap>(m, log, topics) ||
+                  convertOldMap(m, log, topics) ||
+                  convert<geometry_msgs::Twist>(m, log, topics) ||
+                  convert<nuturtlebot::SensorData>(m, log, topics);
+
+      if(done) converted++;
+      else skipped++;
+    }
+  }
+  catch(rosbag::BagException & e)
+  {
+    std::cerr << "BAG_TO_LOG: Could not read " << argv[1] << ": " << e.what() << "\n";
+    log.close();
+    return 1;
+  }
+
+  bag.close();
+
+  if(!log.close())
+  {
+    std::cerr << "BAG_TO_LOG: Could not finish " << argv[2] << "\n";
+    return 1;
+  }
+
+  std::cout << "BAG_TO_LOG: Converted " << converted << " messages on " << topics.size() << " topics, skipped "
+            << skipped << "\n";
+  return 0;
+}
@@ -0,0 +1,414 @@
+/// \file
+/// \brief Runs a public SLAM dataset through the headless filters and reports their step time, memory and error
+///
+/// USAGE:
+///     rosrun nuslam benchmark_datasets FORMAT PATH [--backend NAME]... [--robot N]... [--dt S] [--steps N]
+///                                      [--landmarks N] [--submap_landmarks N] [--unlabeled] [--q V] [--r V]
+///                                      [--deadband_min V] [--deadband_max V] [--threads N] [--csv steps.csv]
+///     FORMAT: rb for a range and bearing log such as Victoria Park, utias for a UTIAS multi-robot directory
+///     --backend NAME: ekf, submap or localizer, may be given more than once (default ekf and submap, and
+///                     localizer when the dataset has a landmark map)
+///     --robot N: run only robot N, counted from 1, may be given more than once (default every robot)
+///     --dt S: the step length of a UTIAS dataset (default 0.02)
+///     --steps N: stop each run after N steps, 0 for all (default 0)
+///     --landmarks N: the landmarks in the ekf state (default the labels in the dataset, or 100)
+///     --submap_landmarks N: the landmarks in each submap (default 50)
+///     --unlabeled: drop the landmark labels, so the filters must associate every measurement
+///     --q V, --r V: the motion and measurement noise variances (default 1e-5 and 1e-3)
+///     --deadband_min V, --deadband_max V: the association thresholds of the SLAM filters (default 100 and 500)
+///     --threads N: the executor threads of the submap joins and the localizer batches, 0 for one per core
+///     --csv steps.csv: write the time and pose of every step of every run
+/// The SLAM filters start at the origin, so their poses are moved onto the true start pose before they are
+/// compared with the ground truth. Every robot runs its own SLAM filter in turn, while the localizer runs
+/// every robot in one batch per step against the true landmark map. No filter samples noise into its
+/// estimate, so a run repeats exactly.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <ros/time.h>
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/datasets.hpp"
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/submap_slam.hpp"
+#include "nuslam/fleet_localizer.hpp"
+#include "nuslam/fault_replay.hpp"
+#include "nuslam/executor.hpp"
+
+/// \brief The results of one run
+struct RunResult
+{
+  std::string backend; ///< backend name
+  std::string robot; ///< robot name, or fleet
+  std::vector<double> step_times; ///< wall time of each step (s)
+  double rss_growth = 0.0; ///< resident memory added over the run (MB)
+  replay::ReplayMetrics error; ///< the trajectory error fields
+  bool has_truth = false; ///< the error was measured
+};
+
+/// \brief Get the resident memory of the process (MB), from /proc
+static double residentMegabytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  long pages = 0, resident = 0;
+  if(!(statm >> pages >> resident)) return 0.0;
+  return resident * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+/// \brief Get the peak resident memory of the process (MB)
+static double peakMegabytes()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+/// \brief Get a percentile of some samples
+/// \param samples the samples, sorted in place
+/// \param p the percentile, from 0 to 1
+static double percentile(std::vector<double> & samples, double p)
+{
+  if(samples.empty()) return 0.0;
+  std::sort(samples.begin(), samples.end());
+  return samples.at(std::min<std::size_t>(samples.size() - 1, p * samples.size()));
+}
+
+/// \brief Run one robot through a SLAM filter
+/// \param backend ekf or submap
+/// \param run the robot
+/// \param make creates the filter
+/// \param max_steps the most steps to run, 0 for all
+/// \param trajectory [out] the pose after each step, moved onto the start pose
+template<class Filter, class Make>
+static RunResult runSlam(const std::string & backend, const datasets::RobotRun & run, Make make, std::size_t max_steps,
+                         std::vector<replay::TrajectoryPoint> & trajectory)
+{
+  RunResult result;
+  result.backend = backend;
+  result.robot = run.name;
+
+  const double rss = residentMegabytes();
+  std::unique_ptr<Filter> filter = make();
+
+  const rigid2d::Transform2D T_start(run.start);
+  const std::size_t count = max_steps > 0 ? std::min(max_steps, run.steps.size()) : run.steps.size();
+  result.step_times.reserve(count);
+  trajectory.reserve(count);
+
+  for(std::size_t k = 0; k < count; k++)
+  {
+    const datasets::Step & step = run.steps.at(k);
+
+    auto start = std::chrono::steady_clock::now();
+    filter->MotionModelUpdate(step.odometry);
+    filter->MeasurmentModelUpdate(step.landmarks);
+    result.step_times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::vector<double> state = filter->getRobotState();
+    replay::TrajectoryPoint point;
+    point.stamp = step.stamp;
+    point.pose = (T_start * rigid2d::Transform2D(rigid2d::Pose2D(state.at(0), state.at(1), state.at(2)))).displacementRad();
+    trajectory.push_back(point);
+  }
+
+  result.rss_growth = residentMegabytes() - rss;
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 3)
+  {
+    std::cerr << "usage: benchmark_datasets rb|utias PATH [--backend NAME]... [--robot N]... [--dt S] [--steps N] "
+              << "[--landmarks N] [--submap_landmarks N] [--unlabeled] [--q V] [--r V] [--deadband_min V] "
+              << "[--deadband_max V] [--threads N] [--csv steps.csv]\n";
+    return 1;
+  }
+
+  // the filters stamp the landmarks they see
+  ros::Time::init();
+
+  const std::string format = argv[1], path = argv[2];
+  std::vector<std::string> backends;
+  std::set<int> robots;
+  double dt = 0.02;
+  std::size_t max_steps = 0;
+  int num_landmarks = 0;
+  int submap_landmarks = 50;
+  bool unlabeled = false;
+  double q = 1e-5, r = 1e-3;
+  double deadband_min = 100.0, deadband_max = 500.0;
+  unsigned int threads = 0;
+  std::string csv_path;
+  for(int i = 3; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if(arg == "--backend" && i + 1 < argc) backends.push_back(argv[++i]);
+    else if(arg == "--robot" && i + 1 < argc) robots.insert(std::atoi(argv[++i]));
+    else if(arg == "--dt" && i + 1 < argc) dt = std::atof(argv[++i]);
+    else if(arg == "--steps" && i + 1 < argc) max_steps = std::max(0, std::atoi(argv[++i]));
+    else if(arg == "--landmarks" && i + 1 < argc) num_landmarks = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--submap_landmarks" && i + 1 < argc) submap_landmarks = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--unlabeled") unlabeled = true;
+    else if(arg == "--q" && i + 1 < argc) q = std::atof(argv[++i]);
+    else if(arg == "--r" && i + 1 < argc) r = std::atof(argv[++i]);
+    else if(arg == "--deadband_min" && i + 1 < argc) deadband_min = std::atof(argv[++i]);
+    else if(arg == "--deadband_max" && i + 1 < argc) deadband_max = std::atof(argv[++i]);
+    else if(arg == "--threads" && i + 1 < argc) threads = std::max(0, std::atoi(argv[++i]));
+    else if(arg == "--csv" && i + 1 < argc) csv_path = argv[++i];
+    else
+    {
+      std::cerr << "BENCHMARK: Unknown option " << arg << "\n";
+      return 1;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  datasets::Dataset dataset;
+  bool loaded = false;
+  if(format == "rb") loaded = datasets::loadRangeBearingLog(path, dataset);
+  else if(format == "utias") loaded = datasets::loadUtias(path, dt, dataset);
+  else
+  {
+    std::cerr << "BENCHMARK: Unknown format " << format << ", use rb or utias\n";
+    return 1;
+  }
+  if(!loaded)
+  {
+    std::cerr << "BENCHMARK: Could not load a " << format << " dataset from " << path << "\n";
+    return 1;
+  }
+  double load = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // keep the chosen robots, in order
+  std::vector<datasets::RobotRun> runs;
+  for(std::size_t k = 0; k < dataset.robots.size(); k++)
+  {
+    if(robots.empty() || robots.count(k + 1)) runs.push_back(dataset.robots.at(k));
+  }
+  if(runs.empty())
+  {
+    std::cerr << "BENCHMARK: The dataset has " << dataset.robots.size() << " robots, none of them chosen\n";
+    return 1;
+  }
+
+  std::set<int> labels;
+  uint64_t steps = 0, measurements = 0;
+  for(auto & run : runs)
+  {
+    steps += run.steps.size();
+    for(auto & step : run.steps)
+    {
+      measurements += step.landmarks.centers.size();
+      for(int id : step.landmarks.ids)
+      {
+        if(id >= 0) labels.insert(id);
+      }
+      if(unlabeled) step.landmarks.ids.clear();
+    }
+  }
+  if(num_landmarks == 0) num_landmarks = labels.empty() ? 100 : labels.size();
+
+  if(backends.empty())
+  {
+    backends = {"ekf", "submap"};
+    if(!dataset.landmarks.empty()) backends.push_back("localizer");
+  }
+  for(auto & backend : backends)
+  {
+    if(backend != "ekf" && backend != "submap" && backend != "localizer")
+    {
+      std::cerr << "BENCHMARK: Unknown backend " << backend << ", use ekf, submap or localizer\n";
+      return 1;
+    }
+    if(backend == "localizer" && dataset.landmarks.empty())
+    {
+      std::cerr << "BENCHMARK: The localizer needs the landmark map, which a " << format << " dataset does not have\n";
+      return 1;
+    }
+  }
+
+  executor::Options options;
+  options.num_workers = threads;
+  executor::Executor::configure(options);
+
+  const Eigen::Matrix3d Q = Eigen::Matrix3d::Identity() * q;
+  const Eigen::Matrix2d R = Eigen::Matrix2d::Identity() * r;
+
+  std::ofstream csv;
+  if(!csv_path.empty())
+  {
+    csv.open(csv_path);
+    if(!csv)
+    {
+      std::cerr << "BENCHMARK: Could not write " << csv_path << "\n";
+      return 1;
+    }
+    csv << "backend,robot,step,stamp,seconds,th,x,y\n" << std::setprecision(9);
+  }
+
+  auto finish = [&](RunResult & result, const datasets::RobotRun & run, const std::vector<replay::TrajectoryPoint> & trajectory)
+  {
+    if(!run.truth.empty())
+    {
+      replay::compareTrajectories(run.truth, trajectory, result.error);
+      result.has_truth = result.error.compared > 0;
+    }
+
+    if(!csv) return;
+    for(std::size_t k = 0; k < trajectory.size(); k++)
+    {
+      const replay::TrajectoryPoint & point = trajectory.at(k);
+      csv << result.backend << "," << run.name << "," << k << "," << point.stamp * 1e-9 << ","
+          << (k < result.step_times.size() ? result.step_times.at(k) : 0.0) << ","
+          << point.pose.th << "," << point.pose.x << "," << point.pose.y << "\n";
+    }
+  };
+
+  std::vector<RunResult> results;
+  for(auto & backend : backends)
+  {
+    if(backend == "localizer")
+    {
+      ekf_slam::LocalizerParams params;
+      params.q = Q;
+      params.r = R;
+
+      RunResult result;
+      result.backend = backend;
+      result.robot = runs.size() == 1 ? runs.front().name : "fleet";
+      const double rss = residentMegabytes();
+
+      ekf_slam::FleetLocalizer fleet(dataset.landmarks, params);
+      std::size_t count = 0;
+      for(auto & run : runs)
+      {
+        fleet.addRobot(run.start);
+        count = std::max(count, run.steps.size());
+      }
+      if(max_steps > 0) count = std::min(count, max_steps);
+
+      std::vector<std::vector<replay::TrajectoryPoint>> trajectories(runs.size());
+      result.step_times.reserve(count);
+      for(std::size_t k = 0; k < count; k++)
+      {
+        // every robot with a step left moves in the same batch
+        auto begin = std::chrono::steady_clock::now();
+        for(std::size_t n = 0; n < runs.size(); n++)
+        {
+          if(k < runs.at(n).steps.size()) fleet.queue(n, runs.at(n).steps.at(k).odometry, runs.at(n).steps.at(k).landmarks);
+        }
+        fleet.update();
+        result.step_times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+
+        for(std::size_t n = 0; n < runs.size(); n++)
+        {
+          if(k >= runs.at(n).steps.size()) continue;
+          replay::TrajectoryPoint point;
+          point.stamp = runs.at(n).steps.at(k).stamp;
+          point.pose = fleet.pose(n);
+          trajectories.at(n).push_back(point);
+        }
+      }
+      result.rss_growth = residentMegabytes() - rss;
+
+      // one error over every robot, weighted by the poses compared
+      double position_sq = 0.0, heading_sq = 0.0;
+      for(std::size_t n = 0; n < runs.size(); n++)
+      {
+        RunResult one;
+        one.backend = backend;
+        one.step_times = result.step_times;
+        finish(one, runs.at(n), trajectories.at(n));
+        if(!one.has_truth) continue;
+
+        result.has_truth = true;
+        result.error.compared += one.error.compared;
+        result.error.position_max = std::max(result.error.position_max, one.error.position_max);
+        position_sq += one.error.position_rmse * one.error.position_rmse * one.error.compared;
+        heading_sq += one.error.heading_rmse * one.error.heading_rmse * one.error.compared;
+      }
+      if(result.error.compared > 0)
+      {
+        result.error.position_rmse = std::sqrt(position_sq / result.error.compared);
+        result.error.heading_rmse = std::sqrt(heading_sq / result.error.compared);
+      }
+
+      results.push_back(result);
+      continue;
+    }
+
+    for(auto & run : runs)
+    {
+      std::vector<replay::TrajectoryPoint> trajectory;
+      RunResult result;
+      if(backend == "ekf")
+      {
+        result = runSlam<ekf_slam::Slam>(backend, run, [&]()
+        {
+          std::unique_ptr<ekf_slam::Slam> filter(new ekf_slam::Slam(num_landmarks, Q, R));
+          filter->setAssociationThresholds(deadband_min, deadband_max);
+          filter->injectNoise(false);
+          return filter;
+        }, max_steps, trajectory);
+      }
+      else
+      {
+        result = runSlam<ekf_slam::SubmapSlam>(backend, run, [&]()
+        {
+          std::unique_ptr<ekf_slam::SubmapSlam> filter(new ekf_slam::SubmapSlam(submap_landmarks, Q, R));
+          filter->setAssociationThresholds(deadband_min, deadband_max);
+          filter->injectNoise(false);
+          return filter;
+        }, max_steps, trajectory);
+      }
+
+      finish(result, run, trajectory);
+      results.push_back(result);
+    }
+  }
+
+  std::cout << "dataset: " << dataset.name << ", robots: " << runs.size() << ", steps: " << steps
+            << ", measurements: " << measurements << ", labels: " << labels.size()
+            << ", map landmarks: " << dataset.landmarks.size() << "\n" << std::fixed << std::setprecision(2)
+            << "load: " << load << " s, ekf landmarks: " << num_landmarks << ", peak memory: " << peakMegabytes() << " MB\n\n";
+
+  std::cout << std::left << std::setw(11) << "backend" << std::setw(9) << "robot" << std::right << std::setw(8) << "steps"
+            << std::setw(10) << "ms mean" << std::setw(10) << "ms p50" << std::setw(10) << "ms p99" << std::setw(10) << "ms max"
+            << std::setw(10) << "rss MB" << std::setw(10) << "rmse m" << std::setw(10) << "max m" << std::setw(10) << "th rad" << "\n";
+
+  for(auto & result : results)
+  {
+    std::vector<double> & times = result.step_times;
+    double mean = times.empty() ? 0.0 : std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+    std::size_t count = times.size();
+    double p50 = percentile(times, 0.5), p99 = percentile(times, 0.99), max = times.empty() ? 0.0 : times.back();
+
+    std::cout << std::left << std::setw(11) << result.backend << std::setw(9) << result.robot << std::right
+              << std::setw(8) << count << std::setprecision(3) << std::setw(10) << mean * 1e3 << std::setw(10) << p50 * 1e3
+              << std::setw(10) << p99 * 1e3 << std::setw(10) << max * 1e3 << std::setprecision(1)
+              << std::setw(10) << result.rss_growth << std::setprecision(4);
+    if(result.has_truth)
+    {
+      std::cout << std::setw(10) << result.error.position_rmse << std::setw(10) << result.error.position_max
+                << std::setw(10) << result.error.heading_rmse << "\n";
+    }
+    else std::cout << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << "\n";
+  }
+
+  return 0;
+}
@@ -4,6 +4,7 @@
 /// PARAMETERS:
 /// PUBLISHES:
 ///     /visualization_marker_array (visualization_msgs::MarkerArray) markers
+///     /diagnostics: (diagnostic_msgs/DiagnosticArray) the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /landmark_data: (nuslam/TurtleMap) a list of centers and radii for cylindrical landmarks
 /// SERIVCES:
@@ -15,6 +16,7 @@
 #include "visualization_msgs/Marker.h"
 #include "nuslam/TurtleMap.h"
 #include "rigid2d/rigid2d.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 static std::vector<geometry_msgs::Point> centroids;
 static std::vector<double> radii;
@@ -35,7 +37,8 @@ int main(int argc, char** argv)
   ros::NodeHandle n;
 
   ros::NodeHandle pn("~");
-  ros::Subscriber sub_landmarks = n.subscribe<nuslam::TurtleMap>("landmark_data", 1, callback_landmark_data);
+  rigid2d::TopicMonitor monitor(n);
+  ros::Subscriber sub_landmarks = monitor.subscribe<nuslam::TurtleMap>(n, "landmark_data", callback_landmark_data);
   ros::Publisher pub_markers = n.advertise<visualization_msgs::MarkerArray>("visualization_marker_array", 1);
   // Publish the markers
 
@@ -5,13 +5,32 @@
 ///   distance_threshold: (double) Threshold to determine if a point is in a cluster
 ///   radius_threshold: (double) Threshold to determine if a cirlce fit is valid for an obstacle
 ///   frame_id: (string) The frame the Laser scan data is relative to
+///   track_dynamic: (bool) Track clusters and leave the moving ones out of landmark_data
+///   odom_frame_id: (string) The frame the dynamic objects are published in
+///   accel_noise: (double) Standard deviation of the acceleration of a tracked object (m/s^2)
+///   cluster_noise: (double) Standard deviation of the center of a cluster (m)
+///   track_gate: (double) Max mahalonbis distance to match a cluster to a track
+///   dynamic_speed: (double) Speed above which a track is dynamic (m/s)
+///   track_min_hits: (int) Number of matches before the speed of a track is trusted
+///   track_max_misses: (int) Number of scans a track can go unmatched before it is dropped
+///   executor_threads: (int) Number of worker threads for the circle fits, 0 for one per core
+///   pin_threads: (bool) Pin each worker thread to one cpu
+///   use_intensity: (bool) Find retro-reflective landmarks from the scan intensities instead of clustering every point
+///   intensity_threshold: (double) Smallest intensity of a beam on reflective tape
+///   max_band_gap: (int) Most dark beams between two tape bands of one landmark
+///   reflector_radius: (double) Radius of a reflective landmark, to place the center of a run too short to fit
 /// PUBLISHES:
 ///     /landmark_data: (nuslam/TurtleMap) a list of centers and radii for cylindrical landmarks
+///     /dynamic_objects: (nuslam/DynamicObjects) the tracked moving clusters in the odometry frame
+///     /diagnostics: (diagnostic_msgs/DiagnosticArray) the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /scan: (sensor_msgs/LaserScan) the raw laser data from the turtlebot
+///     /odom: (nav_msgs/Odometry) the pose of the robot, to remove its own motion from the clusters
+///     /map: (nav_msgs/OccupancyGrid) optional map in the odometry frame, clusters in free cells are dynamic
 /// SERIVCES:
 
 #include <vector>
+#include <memory>
 #include <Eigen/Dense>
 
 #include "ros/ros.h"
@@ -19,104 +38,173 @@
 #include "std_msgs/Header.h"
 #include "geometry_msgs/Point.h"
 #include "geometry_msgs/Point32.h"
+#include "geometry_msgs/Vector3.h"
+#include "nav_msgs/Odometry.h"
+#include "nav_msgs/OccupancyGrid.h"
 #include "nuslam/TurtleMap.h"
+#include "nuslam/DynamicObjects.h"
 #include "sensor_msgs/LaserScan.h"
 #include "sensor_msgs/PointCloud.h"
 
 #include "rigid2d/rigid2d.hpp"
+#include "rigid2d/topic_monitor.hpp"
 #include "nuslam/cylinder_detect.hpp"
+#include "nuslam/dynamic_tracker.hpp"
+#include "nuslam/executor.hpp"
+
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2/LinearMath/Matrix3x3.h>
 
 static double distance_threshold = 0;
 static double radius_threshold = 0;
 static std::string frame_id = "Did not Fill";
-static ros::Publisher pub_cmd, pub_pc;
+static std::string odom_frame_id = "odom";
+static ros::Publisher pub_cmd, pub_pc, pub_dynamic;
+
+static bool use_intensity = false;
+static double intensity_threshold = 0;
+static int max_band_gap = 2;
+static double reflector_radius = 0.04;
+
+static bool track_dynamic = true;
+static std::unique_ptr<tracker::DynamicTracker> dynamic_tracker;
+static rigid2d::Transform2D odom_pose;
+static int got_odom = 0;
 
 
-/// \brief converts a point in polar coordinates into cartesian coordinates
-/// \param r: the distange to the point
-/// \param theta: the angle to the point
-/// \return (rigid2d::Vector2D) x,y coordinates of the point
-rigid2d::Vector2D polar2cart(double r, double theta)
+/// \brief Callback function for the odometry subscriber
+void callback_odom(nav_msgs::Odometry::ConstPtr data)
 {
-  return rigid2d::Vector2D(r*std::cos(theta), r*std::sin(theta));
+  auto r = 0.0, p = 0.0, y = 0.0;
+  tf2::Quaternion quat_tf2(data->pose.pose.orientation.x, data->pose.pose.orientation.y, data->pose.pose.orientation.z, data->pose.pose.orientation.w);
+  tf2::Matrix3x3(quat_tf2).getRPY(r, p, y);
+
+  odom_pose = rigid2d::Transform2D(rigid2d::Vector2D(data->pose.pose.position.x, data->pose.pose.position.y), y);
+  got_odom = 1;
 }
 
 
-/// \brief Callback function for the sensor subscriber
-void callback_robotScan(sensor_msgs::LaserScan::ConstPtr data)
+/// \brief Callback function for the map subscriber
+void callback_map(nav_msgs::OccupancyGrid::ConstPtr data)
 {
-  ros::NodeHandle temp_n("~");
-  int plot_cluster = 0;
+  if(!dynamic_tracker) return;
 
-  temp_n.getParam("plot_cluster", plot_cluster);
+  tracker::StaticMap map;
+  map.data = data->data;
+  map.width = data->info.width;
+  map.height = data->info.height;
+  map.resolution = data->info.resolution;
+  map.origin_x = data->info.origin.position.x;
+  map.origin_y = data->info.origin.position.y;
 
-  std::vector<rigid2d::Vector2D> temp_points; // Temporary cluster of points
-  std::vector<std::vector<rigid2d::Vector2D>> buf_points_list; // list of all point clusters
-  std::vector<std::vector<rigid2d::Vector2D>> points_list; // list of all point clusters
-  std::vector<geometry_msgs::Point32> pc_points;
-  geometry_msgs::Point32 pc_point;
+  dynamic_tracker->setStaticMap(map);
+}
 
-  sensor_msgs::PointCloud pointcloud;
 
-  double cur_range = 0;
-  double cur_theta = 0;
+/// \brief Publish the dynamic tracks that were matched in the last scan
+void publishDynamic(const ros::Time & stamp)
+{
+  nuslam::DynamicObjects objects;
+  objects.header.frame_id = odom_frame_id;
+  objects.header.stamp = stamp;
 
-  double max_range = data->range_max;
-  double min_range = data->range_min;
+  for(auto & track : dynamic_tracker->getTracks())
+  {
+    if(!track.dynamic || track.misses > 0) continue;
 
-  // Loop through the data points in the returned array to find clusters
+    geometry_msgs::Point center;
+    center.x = track.state(0);
+    center.y = track.state(1);
 
-  // ROS_INFO_STREAM("Total scan points: " << data->ranges.size());
+    geometry_msgs::Vector3 vel;
+    vel.x = track.state(2);
+    vel.y = track.state(3);
 
-  for(unsigned int i = 0; i < data->ranges.size(); i++)
-  {
-    cur_range = data->ranges.at(i);
-    cur_theta = data->angle_min + (data->angle_increment * i);
+    objects.ids.push_back(track.id);
+    objects.centers.push_back(center);
+    objects.velocities.push_back(vel);
+    objects.radii.push_back(track.radius);
+  }
 
+  pub_dynamic.publish(objects);
+}
+
+
+/// \brief Publish the retro-reflective landmarks of a scan with their ids.
+/// One pass over the intensities finds them, and only their points are fit.
+void publishReflectors(const sensor_msgs::LaserScan & scan)
+{
+  std::vector<cylinder::Reflector> reflectors =
+    cylinder::find_reflectors(scan.ranges, scan.intensities, scan.angle_min, scan.angle_increment, scan.range_min,
+                              scan.range_max, intensity_threshold, distance_threshold, max_band_gap);
+
+  nuslam::TurtleMap cluster_data;
+  cluster_data.header.frame_id = frame_id;
+  cluster_data.header.stamp = scan.header.stamp;
 
-    // check if the point is valid valid point
-    if(cur_range < max_range && cur_range > min_range)
+  for(auto & reflector : reflectors)
+  {
+    geometry_msgs::Point center_point;
+    double radius = reflector_radius;
+
+    if(reflector.points.size() > 3)
     {
+      std::vector<double> circle_param = cylinder::fit_circles(reflector.points);
+      if(!(circle_param.at(2) < radius_threshold)) continue;
 
-      // if the current cluster is empty, add point to the list
-      if(temp_points.empty())
-      {
-        temp_points.push_back(polar2cart(cur_range, cur_theta));
-      }
-
-      // if the current point is within the distance threshold, add to the
-      // current point list
-      else if(std::fabs(cur_range - data->ranges.at(i-1)) <= distance_threshold)
-      {
-        temp_points.push_back(polar2cart(cur_range, cur_theta));
-      }
-
-      // if the current point is outside of the distance threshold, add current
-      // point a new cluster
-      else if(std::fabs(cur_range - data->ranges.at(i-1)) > distance_threshold)
-      {
-        buf_points_list.push_back(temp_points);
-        temp_points.clear();
-        temp_points.push_back(polar2cart(cur_range,cur_theta));
-      }
-      // Error Catching
-      else
-      {
-        ROS_ERROR_STREAM("Valid Point not assigned. Point ID " << i << " Point range " << cur_range << " Point bearing " << cur_theta);
-      }
+      center_point.x = circle_param.at(0);
+      center_point.y = circle_param.at(1);
+      radius = circle_param.at(2);
+    }
+    else
+    {
+      // too few beams to fit, the center is behind the middle of the run
+      rigid2d::Vector2D mid;
+      for(auto & point : reflector.points) mid += point;
+      mid.x /= reflector.points.size();
+      mid.y /= reflector.points.size();
+
+      double range = mid.length();
+      center_point.x = mid.x * (range + reflector_radius) / range;
+      center_point.y = mid.y * (range + reflector_radius) / range;
     }
-  }
 
-  // If last cluster merges with the first cluster, then combine the two point lists
-  if(std::fabs(data->ranges.at(0) - data->ranges.at(data->ranges.size()-1)) <= distance_threshold)
-  {
-    buf_points_list.at(0).insert(buf_points_list.at(0).end(), temp_points.begin(), temp_points.end());
+    cluster_data.centers.push_back(center_point);
+    cluster_data.radii.push_back(radius);
+    cluster_data.ids.push_back(reflector.id);
   }
-  else // Save final cluster
+
+  pub_cmd.publish(cluster_data);
+}
+
+
+/// \brief Callback function for the sensor subscriber
+void callback_robotScan(sensor_msgs::LaserScan::ConstPtr data)
+{
+  // the tape marks the landmarks, so nothing else in the scan needs a look
+  if(use_intensity && data->intensities.size() == data->ranges.size())
   {
-    buf_points_list.push_back(temp_points);
+    publishReflectors(*data);
+    return;
   }
 
+  ros::NodeHandle temp_n("~");
+  int plot_cluster = 0;
+
+  temp_n.getParam("plot_cluster", plot_cluster);
+
+  std::vector<rigid2d::Vector2D> temp_points; // Temporary cluster of points
+  std::vector<std::vector<rigid2d::Vector2D>> points_list; // list of all point clusters
+  std::vector<geometry_msgs::Point32> pc_points;
+  geometry_msgs::Point32 pc_point;
+
+  sensor_msgs::PointCloud pointcloud;
+
+  // Loop through the data points in the returned array to find clusters
+  std::vector<std::vector<rigid2d::Vector2D>> buf_points_list =
+    cylinder::cluster_scan(data->ranges, data->angle_min, data->angle_increment, data->range_min, data->range_max,
+                           distance_threshold);
+
   // Plot one cluster of data
   for(unsigned int buf_ctr = 0; buf_ctr < buf_points_list.at(plot_cluster).size()-1; buf_ctr++)
   {
@@ -159,10 +247,32 @@ void callback_robotScan(sensor_msgs::LaserScan::ConstPtr data)
   std::vector<double> radii;
   nuslam::TurtleMap cluster_data;
 
-  for(auto cluster : points_list)
+  // Find the clusters that move once the motion of the robot is removed, they are not landmarks
+  std::vector<bool> dynamic(points_list.size(), false);
+  if(dynamic_tracker && got_odom == 1)
   {
-    // Fit circle to a cluster
-    circle_param = cylinder::fit_circles(cluster);
+    std::vector<tracker::Cluster> summaries;
+    for(auto & cluster : points_list) summaries.push_back(tracker::summarize(cluster));
+
+    dynamic = dynamic_tracker->update(summaries, odom_pose, data->header.stamp.toSec());
+    publishDynamic(data->header.stamp);
+  }
+
+  // Fit the static clusters on the shared executor, each fit is independent
+  std::vector<std::vector<double>> fits(points_list.size());
+  executor::Executor::instance().parallelFor(0, points_list.size(), 4, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t k = first; k < last; k++)
+    {
+      if(!dynamic.at(k)) fits.at(k) = cylinder::fit_circles(points_list.at(k));
+    }
+  });
+
+  for(unsigned int k = 0; k < points_list.size(); k++)
+  {
+    if(dynamic.at(k)) continue;
+
+    circle_param = fits.at(k);
 
     // eliminate if radius is unreasonably large
     if(circle_param.at(2) < radius_threshold)
@@ -199,18 +309,71 @@ int main(int argc, char** argv)
   ros::init(argc, argv, "landmarks");
   ros::NodeHandle n;
   ros::NodeHandle pn("~");
+  rigid2d::TopicMonitor monitor(n);
 
-  ros::Subscriber sub_scan = n.subscribe("scan", 1, callback_robotScan);
-  pub_cmd = n.advertise<nuslam::TurtleMap>("landmark_data", 1);
-  pub_pc = n.advertise<sensor_msgs::PointCloud>("pointcloud_data", 12);
+  double accel_noise = 0.5, cluster_noise = 0.02, track_gate = 9.21, dynamic_speed = 0.15;
+  int track_min_hits = 3, track_max_misses = 3;
+  int executor_threads = 0;
+  bool pin_threads = false;
 
   pn.getParam("distance_threshold", distance_threshold);
   pn.getParam("radius_threshold", radius_threshold);
   pn.getParam("frame_id", frame_id);
+  pn.getParam("track_dynamic", track_dynamic);
+  pn.getParam("odom_frame_id", odom_frame_id);
+  pn.getParam("accel_noise", accel_noise);
+  pn.getParam("cluster_noise", cluster_noise);
+  pn.getParam("track_gate", track_gate);
+  pn.getParam("dynamic_speed", dynamic_speed);
+  pn.getParam("track_min_hits", track_min_hits);
+  pn.getParam("track_max_misses", track_max_misses);
+  pn.getParam("executor_threads", executor_threads);
+  pn.getParam("pin_threads", pin_threads);
+  pn.getParam("use_intensity", use_intensity);
+  pn.getParam("intensity_threshold", intensity_threshold);
+  pn.getParam("max_band_gap", max_band_gap);
+  pn.getParam("reflector_radius", reflector_radius);
 
   ROS_INFO_STREAM("LANDMARKS: Distance Threshold " << distance_threshold);
   ROS_INFO_STREAM("LANDMARKS: Radius Threshold " << radius_threshold);
   ROS_INFO_STREAM("LANDMARKS: Frame ID " << frame_id);
+  ROS_INFO_STREAM("LANDMARKS: Track Dynamic " << track_dynamic);
+  ROS_INFO_STREAM("LANDMARKS: Executor Threads " << executor_threads);
+  ROS_INFO_STREAM("LANDMARKS: Pin Threads " << pin_threads);
+  ROS_INFO_STREAM("LANDMARKS: Use Intensity " << use_intensity);
+
+  if(use_intensity)
+  {
+    ROS_INFO_STREAM("LANDMARKS: Intensity Threshold " << intensity_threshold);
+    ROS_INFO_STREAM("LANDMARKS: Max Band Gap " << max_band_gap);
+    ROS_INFO_STREAM("LANDMARKS: Reflector Radius " << reflector_radius);
+  }
+
+  // Start the workers now, so thread start up is not on the first scan
+  executor::Options exec_options;
+  exec_options.num_workers = executor_threads;
+  exec_options.pin_threads = pin_threads;
+  executor::Executor::configure(exec_options);
+
+  if(track_dynamic)
+  {
+    ROS_INFO_STREAM("LANDMARKS: Odom Frame ID " << odom_frame_id);
+    ROS_INFO_STREAM("LANDMARKS: Accel Noise " << accel_noise);
+    ROS_INFO_STREAM("LANDMARKS: Cluster Noise " << cluster_noise);
+    ROS_INFO_STREAM("LANDMARKS: Track Gate " << track_gate);
+    ROS_INFO_STREAM("LANDMARKS: Dynamic Speed " << dynamic_speed);
+    ROS_INFO_STREAM("LANDMARKS: Track Min Hits " << track_min_hits);
+    ROS_INFO_STREAM("LANDMARKS: Track Max Misses " << track_max_misses);
+
+    dynamic_tracker.reset(new tracker::DynamicTracker(accel_noise, cluster_noise, track_gate, dynamic_speed, track_min_hits, track_max_misses));
+  }
+
+  ros::Subscriber sub_scan = monitor.subscribe<sensor_msgs::LaserScan>(n, "scan", callback_robotScan);
+  ros::Subscriber sub_odom = monitor.subscribe<nav_msgs::Odometry>(n, "odom", callback_odom);
+  ros::Subscriber sub_map = n.subscribe("map", 1, callback_map);
+  pub_cmd = n.advertise<nuslam::TurtleMap>("landmark_data", 1);
+  pub_pc = n.advertise<sensor_msgs::PointCloud>("pointcloud_data", 12);
+  pub_dynamic = n.advertise<nuslam::DynamicObjects>("dynamic_objects", 1);
 
   ros::spin();
 }
@@ -0,0 +1,571 @@
+/// \file
+/// \brief This node floods the robot topics at set rates to find where the nodes that consume them saturate
+///
+/// Each generated topic carries a realistic payload, from a simulated robot driving a circle among cylinders
+/// or cycled from a sensor log. Every message with a header is stamped with its send time. The output topic
+/// of a consumer is its echo: the echo rate is how many inputs it keeps up with, and an echo that carries the
+/// stamp of an input through, like landmark_data from a scan, gives the end to end latency. An echo stamped
+/// by the consumer gives only its age on arrival. With a ramp factor the rates grow every step until each
+/// echo falls behind its input, and the last rate it kept up with is its saturation point.
+///
+/// PARAMETERS:
+///     sensor_data_rate (double) the rate to publish sensor_data at (Hz), 0 for none
+///     joint_states_rate (double) the rate to publish joint_states at (Hz), 0 for none
+///     scan_rate (double) the rate to publish scan at (Hz), 0 for none
+///     landmark_data_rate (double) the rate to publish landmark_data at (Hz), 0 for none
+///     cmd_vel_rate (double) the rate to publish cmd_vel at (Hz), 0 for none
+///     echo_topics (std::vector<std::string>) the output topic of each consumer, of any message type
+///     echo_sources (std::vector<std::string>) the generated topic that drives each echo topic
+///     log_file (std::string) cycle the payloads of a sensor log instead of simulating them, empty to simulate
+///     left_wheel_joint (std::string) the name of the left wheel joint
+///     right_wheel_joint (std::string) the name of the right wheel joint
+///     wheel_base (double) the distance between the two wheels of the diff drive robot
+///     wheel_radius (double) the radius of the wheels
+///     encoder_ticks_per_rev (double) the encoder ticks per wheel turn
+///     num_landmarks (int) the cylinders around the simulated robot
+///     num_beams (int) the beams of a simulated scan
+///     scans_per_lap (int) the distinct simulated scans cast over one lap of the circle
+///     frame_id (std::string) the frame of the scans and landmarks
+///     step_seconds (double) the time between reports, and the length of each ramp step (s)
+///     ramp_factor (double) the rates are multiplied by this after each step, 1 to hold them
+///     max_scale (double) the ramp stops once the rates are this many times the set rates
+///     saturation_ratio (double) an echo under this fraction of its input rate has fallen behind
+///     max_burst (int) the most messages of one topic sent at once to catch up, the rest are dropped
+/// PUBLISHES:
+///     /sensor_data (nuturtlebot/SensorData): encoder ticks, the input of turtle_interface
+///     /joint_states (sensor_msgs/JointState): wheel angles, the input of odometer and slam
+///     /scan (sensor_msgs/LaserScan): laser scans, the input of landmarks
+///     /landmark_data (nuslam/TurtleMap): landmarks in the robot frame, the input of slam
+///     /cmd_vel (geometry_msgs/Twist): body twists, the input of turtle_interface
+/// SUBSCRIBES:
+///     /<echo_topics> (any): the output of each consumer
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+#include <topic_tools/shape_shifter.h>
+
+#include <geometry_msgs/Twist.h>
+#include <sensor_msgs/JointState.h>
+#include <sensor_msgs/LaserScan.h>
+
+#include "nuturtlebot/SensorData.h"
+#include "nuslam/TurtleMap.h"
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/synthetic_sensors.hpp"
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/log_messages.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+/// \brief A topic the node publishes
+struct Source
+{
+  std::string topic; ///< topic name, also its name in a sensor log
+  double rate = 0; ///< set rate (Hz)
+  ros::Publisher pub; ///< publisher
+  Clock::duration period; ///< time between messages at the current scale
+  Clock::time_point next; ///< when the next message is due
+  uint64_t sent = 0; ///< messages sent
+  uint64_t step_sent = 0; ///< messages sent this step
+  uint64_t dropped = 0; ///< messages skipped to catch up
+  std::deque<int64_t> stamps; ///< stamps sent in the last few seconds (ns), guarded by stats_lock
+};
+
+/// \brief The output of a consumer
+struct Echo
+{
+  std::string topic; ///< topic name
+  int source = -1; ///< the source that drives it
+  ros::Subscriber sub; ///< subscriber
+  int has_header = -1; ///< the message type starts with a header, -1 until the first message
+  uint64_t step_received = 0; ///< messages received this step
+  std::vector<double> latency; ///< end to end latency of the echoes that carried a sent stamp this step (s)
+  std::vector<double> age; ///< age on arrival of the other stamped echoes this step (s)
+  bool saturated = false; ///< fell behind in a ramp step
+  double sustained = 0; ///< highest input rate kept up with (Hz)
+  double sustained_p99 = 0; ///< 99th percentile latency or age at that rate (s)
+};
+
+//Global Variables
+static std::vector<Source> sources;
+static std::vector<Echo> echoes;
+static std::mutex stats_lock;
+
+/// \brief Check if a message definition starts with a std_msgs/Header
+/// \param definition - the full text of the message definition
+/// \return true if the first field is the header
+bool startsWithHeader(const std::string & definition)
+{
+  std::istringstream lines(definition);
+  std::string line;
+  while(std::getline(lines, line))
+  {
+    line.erase(0, line.find_first_not_of(" \t"));
+    if(line.empty() || line.at(0) == '#') continue;
+    return line.compare(0, 13, "Header header") == 0 || line.compare(0, 23, "std_msgs/Header header") == 0;
+  }
+  return false;
+}
+
+/// \brief Callback for an echo topic, its stamp is at bytes 4 to 12 of a message that starts with a header
+///
+void callback_echo(int e, const topic_tools::ShapeShifter::ConstPtr & msg)
+{
+  ros::Time now = ros::Time::now();
+  Echo & echo = echoes.at(e);
+
+  if(echo.has_header < 0) echo.has_header = startsWithHeader(msg->getMessageDefinition()) ? 1 : 0;
+
+  int64_t stamp = -1;
+  if(echo.has_header == 1 && msg->size() >= 12)
+  {
+    std::vector<uint8_t> buffer(msg->size());
+    ros::serialization::OStream stream(buffer.data(), buffer.size());
+    msg->write(stream);
+
+    uint32_t secs = 0, nsecs = 0;
+    std::memcpy(&secs, buffer.data() + 4, 4);
+    std::memcpy(&nsecs, buffer.data() + 8, 4);
+    stamp = static_cast<int64_t>(secs) * 1000000000 + nsecs;
+  }
+
+  std::lock_guard<std::mutex> guard(stats_lock);
+  echo.step_received++;
+  if(stamp < 0) return;
+
+  double seconds = (now.toNSec() - stamp) * 1e-9;
+  const std::deque<int64_t> & sent = sources.at(echo.source).stamps;
+  if(std::binary_search(sent.begin(), sent.end(), stamp)) echo.latency.push_back(seconds);
+  else echo.age.push_back(seconds);
+}
+
+/// \brief Get a percentile of some samples
+/// \param samples - the samples, sorted in place
+/// \param p - the percentile, from 0 to 1
+/// \return the sample at the percentile, 0 with no samples
+double percentile(std::vector<double> & samples, double p)
+{
+  if(samples.empty()) return 0.0;
+  std::sort(samples.begin(), samples.end());
+  return samples.at(std::min<std::size_t>(samples.size() - 1, p * samples.size()));
+}
+
+/// \brief The payloads of each topic, simulated or read from a log
+struct Payloads
+{
+  std::unique_ptr<synthetic::SyntheticRobot> robot; ///< the simulated robot, null in replay
+  std::vector<sensor_msgs::LaserScan> scans; ///< the scans of one lap, or of the log
+  std::vector<nuslam::TurtleMap> landmarks; ///< the landmarks of one lap, or of the log
+  std::vector<sensor_msgs::JointState> joint_states; ///< log only
+  std::vector<nuturtlebot::SensorData> sensor_data; ///< log only
+  std::vector<geometry_msgs::Twist> cmd_vels; ///< log only
+  std::string left_wheel_joint; ///< joint name
+  std::string right_wheel_joint; ///< joint name
+};
+
+/// \brief Read every message of the generated topics from a sensor log
+/// \return false if the log could not be read or has none of the topics
+bool loadLog(const std::string & path, Payloads & payloads)
+{
+  sensor_log::LogReader log;
+  if(!log.open(path)) return false;
+
+  std::vector<int> topics;
+  for(auto & s : sources)
+  {
+    int id = log.findTopic(s.topic);
+    if(id >= 0) topics.push_back(id);
+  }
+  if(topics.empty()) return false;
+
+  sensor_log::Cursor cursor = log.read(topics, log.startTime(), log.endTime() + 1);
+  sensor_log::MessageView view;
+  while(cursor.next(view))
+  {
+    const sensor_log::TopicSchema & schema = log.topics().at(view.topic);
+    if(schema.name == "scan")
+    {
+      payloads.scans.emplace_back();
+      sensor_log::readMessage(view, schema, payloads.scans.back());
+    }
+    else if(schema.name == "landmark_data")
+    {
+      payloads.landmarks.emplace_back();
+      sensor_log::readMessage(view, schema, payloads.landmarks.back());
+    }
+    else if(schema.name == "joint_states")
+    {
+      payloads.joint_states.emplace_back();
+      sensor_log::readMessage(view, schema, payloads.joint_states.back());
+    }
+    else if(schema.name == "sensor_data")
+    {
+      payloads.sensor_data.emplace_back();
+      sensor_log::readMessage(view, schema, payloads.sensor_data.back());
+    }
+    else if(schema.name == "cmd_vel")
+    {
+      payloads.cmd_vels.emplace_back();
+      sensor_log::readMessage(view, schema, payloads.cmd_vels.back());
+    }
+  }
+  return true;
+}
+
+/// \brief Publish the next message of a source
+/// \param s - the source
+/// \param payloads - the payloads
+/// \param t - the time since the start (s)
+/// \param stamp - the send time
+/// \return true if the message has a header, and so carries the stamp
+bool publishNext(Source & s, Payloads & payloads, double t, const ros::Time & stamp)
+{
+  const uint64_t k = s.sent;
+  synthetic::SyntheticRobot * robot = payloads.robot.get();
+
+  // a lap of the circle has the same scans every time round
+  auto lapIndex = [&](std::size_t count)
+  {
+    double lap = robot->period() > 0 ? std::fmod(t / robot->period(), 1.0) : 0.0;
+    return std::min<std::size_t>(count - 1, lap * count);
+  };
+
+  if(s.topic == "sensor_data")
+  {
+    nuturtlebot::SensorData msg;
+    if(robot) robot->encoders(t, msg.left_encoder, msg.right_encoder);
+    else if(!payloads.sensor_data.empty()) msg = payloads.sensor_data.at(k % payloads.sensor_data.size());
+    s.pub.publish(msg);
+    return false;
+  }
+  if(s.topic == "cmd_vel")
+  {
+    geometry_msgs::Twist msg;
+    if(robot)
+    {
+      msg.angular.z = robot->params().twist.wz;
+      msg.linear.x = robot->params().twist.vx;
+    }
+    else if(!payloads.cmd_vels.empty()) msg = payloads.cmd_vels.at(k % payloads.cmd_vels.size());
+    s.pub.publish(msg);
+    return false;
+  }
+  if(s.topic == "joint_states")
+  {
+    sensor_msgs::JointState msg;
+    if(robot)
+    {
+      rigid2d::WheelVelocities angles = robot->wheelAngles(t);
+      msg.name = {payloads.left_wheel_joint, payloads.right_wheel_joint};
+      msg.position = {angles.ul, angles.ur};
+    }
+    else if(!payloads.joint_states.empty()) msg = payloads.joint_states.at(k % payloads.joint_states.size());
+    msg.header.stamp = stamp;
+    s.pub.publish(msg);
+    return true;
+  }
+  if(s.topic == "scan")
+  {
+    if(payloads.scans.empty()) return false;
+    sensor_msgs::LaserScan & msg = payloads.scans.at(robot ? lapIndex(payloads.scans.size()) : k % payloads.scans.size());
+    msg.header.stamp = stamp;
+    s.pub.publish(msg);
+    return true;
+  }
+
+  // landmark_data
+  if(payloads.landmarks.empty()) return false;
+  nuslam::TurtleMap & msg = payloads.landmarks.at(robot ? lapIndex(payloads.landmarks.size()) : k % payloads.landmarks.size());
+  msg.header.stamp = stamp;
+  s.pub.publish(msg);
+  return true;
+}
+
+/// \brief Main function for the load_generator node
+///
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "load_generator");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+
+  const std::vector<std::string> topics = {"sensor_data", "joint_states", "scan", "landmark_data", "cmd_vel"};
+  std::vector<std::string> echo_topics, echo_sources;
+  std::string log_file;
+  Payloads payloads;
+  payloads.left_wheel_joint = "left_wheel_axel";
+  payloads.right_wheel_joint = "right_wheel_axel";
+  synthetic::ArenaParams arena;
+  int num_landmarks = 8;
+  int scans_per_lap = 360;
+  std::string frame_id = "base_scan";
+  double step_seconds = 5.0;
+  double ramp_factor = 1.0;
+  double max_scale = 100.0;
+  double saturation_ratio = 0.9;
+  int max_burst = 100;
+
+  for(auto & topic : topics)
+  {
+    Source s;
+    s.topic = topic;
+    pn.getParam(topic + "_rate", s.rate);
+    sources.push_back(s);
+  }
+  pn.getParam("echo_topics", echo_topics);
+  pn.getParam("echo_sources", echo_sources);
+  pn.getParam("log_file", log_file);
+  pn.getParam("left_wheel_joint", payloads.left_wheel_joint);
+  pn.getParam("right_wheel_joint", payloads.right_wheel_joint);
+  n.getParam("/wheel_base", arena.wheel_base);
+  n.getParam("/wheel_radius", arena.wheel_radius);
+  n.getParam("/encoder_ticks_per_rev", arena.encoder_ticks_per_rev);
+  pn.getParam("num_landmarks", num_landmarks);
+  pn.getParam("num_beams", arena.num_beams);
+  pn.getParam("scans_per_lap", scans_per_lap);
+  pn.getParam("frame_id", frame_id);
+  pn.getParam("step_seconds", step_seconds);
+  pn.getParam("ramp_factor", ramp_factor);
+  pn.getParam("max_scale", max_scale);
+  pn.getParam("saturation_ratio", saturation_ratio);
+  pn.getParam("max_burst", max_burst);
+
+  for(auto & s : sources) ROS_INFO_STREAM("LOAD: Got " << s.topic << " rate: " << s.rate);
+  ROS_INFO_STREAM("LOAD: Got number of echo topics: " << echo_topics.size());
+  ROS_INFO_STREAM("LOAD: Got log file: " << log_file);
+  ROS_INFO_STREAM("LOAD: Got left wheel joint name: " << payloads.left_wheel_joint);
+  ROS_INFO_STREAM("LOAD: Got right wheel joint name: " << payloads.right_wheel_joint);
+  ROS_INFO_STREAM("LOAD: Got wheel base param: " << arena.wheel_base);
+  ROS_INFO_STREAM("LOAD: Got wheel radius param: " << arena.wheel_radius);
+  ROS_INFO_STREAM("LOAD: Got encoder ticks per rev: " << arena.encoder_ticks_per_rev);
+  ROS_INFO_STREAM("LOAD: Got number of landmarks: " << num_landmarks);
+  ROS_INFO_STREAM("LOAD: Got number of beams: " << arena.num_beams);
+  ROS_INFO_STREAM("LOAD: Got scans per lap: " << scans_per_lap);
+  ROS_INFO_STREAM("LOAD: Got frame id: " << frame_id);
+  ROS_INFO_STREAM("LOAD: Got step seconds: " << step_seconds);
+  ROS_INFO_STREAM("LOAD: Got ramp factor: " << ramp_factor);
+  ROS_INFO_STREAM("LOAD: Got max scale: " << max_scale);
+  ROS_INFO_STREAM("LOAD: Got saturation ratio: " << saturation_ratio);
+  ROS_INFO_STREAM("LOAD: Got max burst: " << max_burst);
+
+  if(echo_sources.size() != echo_topics.size())
+  {
+    ROS_ERROR_STREAM("LOAD: echo_sources must name the generated topic of each echo topic.");
+    return 1;
+  }
+
+  // Payloads are made before the clock starts, so the loop only stamps and publishes
+  if(!log_file.empty())
+  {
+    if(!loadLog(log_file, payloads))
+    {
+      ROS_ERROR_STREAM("LOAD: Could not read any generated topic from " << log_file);
+      return 1;
+    }
+    ROS_INFO_STREAM("LOAD: Cycling " << payloads.scans.size() << " scans, " << payloads.joint_states.size() << " joint states, "
+                    << payloads.landmarks.size() << " landmark sets, " << payloads.sensor_data.size() << " encoder readings and "
+                    << payloads.cmd_vels.size() << " twists");
+  }
+  else
+  {
+    synthetic::ArenaParams ring = synthetic::ringArena(num_landmarks);
+    arena.landmarks = ring.landmarks;
+    payloads.robot.reset(new synthetic::SyntheticRobot(arena));
+
+    for(int k = 0; k < std::max(1, scans_per_lap); k++)
+    {
+      rigid2d::Pose2D pose = payloads.robot->pose(payloads.robot->period() * k / std::max(1, scans_per_lap));
+
+      sensor_msgs::LaserScan scan;
+      scan.header.frame_id = frame_id;
+      scan.angle_min = 0.0;
+      scan.angle_increment = 2.0 * rigid2d::PI / arena.num_beams;
+      scan.angle_max = scan.angle_increment * (arena.num_beams - 1);
+      scan.range_min = arena.range_min;
+      scan.range_max = arena.range_max;
+      payloads.robot->scan(pose, scan.ranges);
+      scan.intensities.assign(scan.ranges.size(), 0.0f);
+      payloads.scans.push_back(scan);
+
+      nuslam::TurtleMap map;
+      map.header.frame_id = frame_id;
+      payloads.robot->landmarks(pose, map);
+      payloads.landmarks.push_back(map);
+    }
+  }
+
+  for(auto & s : sources)
+  {
+    if(s.rate <= 0) continue;
+    if(s.topic == "sensor_data") s.pub = n.advertise<nuturtlebot::SensorData>(s.topic, 1);
+    if(s.topic == "joint_states") s.pub = n.advertise<sensor_msgs::JointState>(s.topic, 1);
+    if(s.topic == "scan") s.pub = n.advertise<sensor_msgs::LaserScan>(s.topic, 1);
+    if(s.topic == "landmark_data") s.pub = n.advertise<nuslam::TurtleMap>(s.topic, 1);
+    if(s.topic == "cmd_vel") s.pub = n.advertise<geometry_msgs::Twist>(s.topic, 1);
+  }
+
+  echoes.resize(echo_topics.size());
+  for(unsigned int e = 0; e < echo_topics.size(); e++)
+  {
+    auto source = std::find(topics.begin(), topics.end(), echo_sources.at(e));
+    if(source == topics.end() || sources.at(source - topics.begin()).rate <= 0)
+    {
+      ROS_ERROR_STREAM("LOAD: The source " << echo_sources.at(e) << " of " << echo_topics.at(e) << " is not generated.");
+      return 1;
+    }
+
+    echoes.at(e).topic = echo_topics.at(e);
+    echoes.at(e).source = source - topics.begin();
+
+    boost::function<void(const topic_tools::ShapeShifter::ConstPtr &)> callback =
+      [e](const topic_tools::ShapeShifter::ConstPtr & msg) { callback_echo(e, msg); };
+    echoes.at(e).sub = n.subscribe<topic_tools::ShapeShifter>(echo_topics.at(e), 100, callback, ros::VoidConstPtr(),
+                                                               ros::TransportHints().tcpNoDelay());
+  }
+
+  // The echoes are counted on their own thread, so a slow consumer cannot hold up the sends
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+
+  // Give the consumers time to connect
+  ros::Duration(1.0).sleep();
+
+  double scale = 1.0;
+  auto setScale = [&](Clock::time_point now)
+  {
+    for(auto & s : sources)
+    {
+      if(s.rate <= 0) continue;
+      s.period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / (s.rate * scale)));
+      s.next = now;
+    }
+  };
+
+  const Clock::time_point start = Clock::now();
+  Clock::time_point step_start = start;
+  setScale(start);
+
+  while(ros::ok())
+  {
+    Clock::time_point now = Clock::now();
+    Clock::time_point wake = now + std::chrono::milliseconds(10);
+    double t = std::chrono::duration<double>(now - start).count();
+
+    for(auto & s : sources)
+    {
+      if(s.rate <= 0) continue;
+
+      for(int burst = 0; s.next <= now && burst < max_burst; burst++)
+      {
+        ros::Time stamp = ros::Time::now();
+        if(publishNext(s, payloads, t, stamp))
+        {
+          std::lock_guard<std::mutex> guard(stats_lock);
+          s.stamps.push_back(stamp.toNSec());
+        }
+        s.sent++;
+        s.step_sent++;
+        s.next += s.period;
+      }
+
+      // too far behind to catch up, skip ahead rather than flood
+      if(s.next <= now)
+      {
+        s.dropped += (now - s.next) / s.period + 1;
+        s.next = now + s.period;
+      }
+      wake = std::min(wake, s.next);
+    }
+
+    double step_time = std::chrono::duration<double>(now - step_start).count();
+    if(step_time >= step_seconds)
+    {
+      bool all_saturated = !echoes.empty();
+      std::ostringstream report;
+      report << "LOAD: scale " << scale;
+      for(auto & s : sources)
+      {
+        if(s.rate > 0) report << ", " << s.topic << " " << s.step_sent / step_time << " Hz";
+      }
+      ROS_INFO_STREAM(report.str());
+
+      std::lock_guard<std::mutex> guard(stats_lock);
+      for(auto & echo : echoes)
+      {
+        double in = sources.at(echo.source).step_sent / step_time;
+        double out = echo.step_received / step_time;
+        bool kept_up = out >= saturation_ratio * in;
+
+        std::vector<double> & samples = echo.latency.empty() ? echo.age : echo.latency;
+        double p50 = percentile(samples, 0.5), p99 = percentile(samples, 0.99);
+
+        ROS_INFO_STREAM("LOAD:   " << echo.topic << " " << out << " Hz of " << in << " Hz"
+                        << (samples.empty() ? "" : (echo.latency.empty() ? ", age p50 " : ", latency p50 "))
+                        << (samples.empty() ? "" : std::to_string(p50 * 1e3) + " ms p99 " + std::to_string(p99 * 1e3) + " ms")
+                        << (kept_up ? "" : ", behind"));
+
+        if(kept_up && !echo.saturated && in > echo.sustained)
+        {
+          echo.sustained = in;
+          echo.sustained_p99 = p99;
+        }
+        echo.saturated = echo.saturated || (ramp_factor > 1.0 && !kept_up);
+        all_saturated = all_saturated && echo.saturated;
+
+        echo.step_received = 0;
+        echo.latency.clear();
+        echo.age.clear();
+      }
+
+      // stamps older than a step can no longer be echoed
+      for(auto & s : sources)
+      {
+        int64_t oldest = ros::Time::now().toNSec() - static_cast<int64_t>(step_seconds * 1e9);
+        while(!s.stamps.empty() && s.stamps.front() < oldest) s.stamps.pop_front();
+        s.step_sent = 0;
+      }
+
+      step_start = now;
+      if(ramp_factor > 1.0)
+      {
+        if(all_saturated || scale * ramp_factor > max_scale) break;
+        scale *= ramp_factor;
+        setScale(now);
+      }
+    }
+
+    // sleep through long gaps, and spin through short ones where the sleep would overshoot
+    Clock::duration gap = wake - Clock::now();
+    if(gap > std::chrono::microseconds(200)) std::this_thread::sleep_until(wake - std::chrono::microseconds(100));
+    else if(gap > Clock::duration::zero()) std::this_thread::yield();
+  }
+
+  spinner.stop();
+
+  std::cout << "\nsaturation points:\n";
+  for(auto & echo : echoes)
+  {
+    std::cout << "  " << echo.topic << ": kept up with " << echo.sustained << " Hz of " << sources.at(echo.source).topic
+              << ", p99 " << echo.sustained_p99 * 1e3 << " ms" << (echo.saturated ? "" : " (never fell behind)") << "\n";
+  }
+  for(auto & s : sources)
+  {
+    if(s.rate > 0 && s.dropped > 0) std::cout << "  " << s.topic << ": " << s.dropped << " sends skipped, the generator fell behind\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,261 @@
+/// \file
+/// \brief This node localizes the robot on a known occupancy grid with a likelihood field particle filter
+///
+/// PARAMETERS:
+///   map_frame_id: (string) The frame of the map
+///   odom_frame_id: (string) The frame of the odometry
+///   num_particles: (int) Number of particles
+///   beam_step: (int) Use every beam_step-th beam of each scan
+///   sigma_hit: (double) Standard deviation of a beam end point around the closest obstacle (m)
+///   max_dist: (double) Obstacle distances in the likelihood field are capped at this (m)
+///   alpha_rot_rot: (double) Rotation noise from rotation
+///   alpha_rot_trans: (double) Rotation noise from translation
+///   alpha_trans_trans: (double) Translation noise from translation
+///   alpha_trans_rot: (double) Translation noise from rotation
+///   beam_weight: (double) Scale on the summed beam log likelihood
+///   min_trans: (double) Distance the robot moves before a scan is scored (m)
+///   min_rot: (double) Rotation of the robot before a scan is scored (rad)
+///   global_localization: (bool) Spread the particles over the whole map instead of around the initial pose
+///   initial_x: (double) x of the initial pose in the map frame
+///   initial_y: (double) y of the initial pose in the map frame
+///   initial_th: (double) heading of the initial pose in the map frame
+///   initial_sigma_xy: (double) Standard deviation of the initial position (m)
+///   initial_sigma_th: (double) Standard deviation of the initial heading (rad)
+///   publish_tf: (bool) Broadcast the map to odom transform
+/// PUBLISHES:
+///     /mcl_odom: (nav_msgs/Odometry) the localized pose in the map frame, with the odometry twist, for the controllers
+///     /particles: (geometry_msgs/PoseArray) every particle
+///     /diagnostics: (diagnostic_msgs/DiagnosticArray) the messages each subscriber lost or saw late
+/// SUBSCRIBES:
+///     /map: (nav_msgs/OccupancyGrid) the map to localize on
+///     /odom: (nav_msgs/Odometry) the odometry of the robot
+///     /scan: (sensor_msgs/LaserScan) the raw laser data from the turtlebot
+///     /initialpose: (geometry_msgs/PoseWithCovarianceStamped) resets the particles around a pose
+
+#include <vector>
+#include <memory>
+#include <cmath>
+
+#include "ros/ros.h"
+
+#include "geometry_msgs/PoseArray.h"
+#include "geometry_msgs/PoseWithCovarianceStamped.h"
+#include "geometry_msgs/TransformStamped.h"
+#include "nav_msgs/Odometry.h"
+#include "nav_msgs/OccupancyGrid.h"
+#include "sensor_msgs/LaserScan.h"
+
+#include <tf2_ros/transform_broadcaster.h>
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+
+#include "rigid2d/rigid2d.hpp"
+#include "rigid2d/topic_monitor.hpp"
+#include "nuslam/mcl.hpp"
+
+static std::string map_frame_id = "map";
+static std::string odom_frame_id = "odom";
+static double sigma_hit = 0.1;
+static double max_dist = 1.0;
+static bool global_localization = false;
+static bool publish_tf = true;
+
+static std::unique_ptr<mcl::ParticleFilter> filter;
+static std::unique_ptr<tf2_ros::TransformBroadcaster> broadcaster;
+static ros::Publisher pub_pose, pub_particles;
+
+static nav_msgs::Odometry cur_odom;
+static rigid2d::Pose2D odom_pose;
+static int got_odom = 0;
+static int got_map = 0;
+
+
+/// \brief Get the heading of a quaternion
+double getYaw(const geometry_msgs::Quaternion & q)
+{
+  auto r = 0.0, p = 0.0, y = 0.0;
+  tf2::Quaternion quat_tf2(q.x, q.y, q.z, q.w);
+  tf2::Matrix3x3(quat_tf2).getRPY(r, p, y);
+  return y;
+}
+
+
+/// \brief Callback function for the odometry subscriber
+void callback_odom(nav_msgs::Odometry::ConstPtr data)
+{
+  cur_odom = *data;
+  odom_pose = rigid2d::Pose2D(getYaw(data->pose.pose.orientation), data->pose.pose.position.x, data->pose.pose.position.y);
+  got_odom = 1;
+
+  filter->predict(odom_pose);
+}
+
+
+/// \brief Callback function for the map subscriber, precomputes the likelihood field
+void callback_map(nav_msgs::OccupancyGrid::ConstPtr data)
+{
+  mcl::GridMap map;
+  map.data = data->data;
+  map.width = data->info.width;
+  map.height = data->info.height;
+  map.resolution = data->info.resolution;
+  map.origin_x = data->info.origin.position.x;
+  map.origin_y = data->info.origin.position.y;
+
+  filter->setMap(mcl::LikelihoodField(map, sigma_hit, max_dist));
+  ROS_INFO_STREAM("MCL: Built likelihood field of a " << map.width << " by " << map.height << " map");
+
+  // a global start needs the free cells of the map
+  if(global_localization && !got_map) filter->initializeUniform();
+  got_map = 1;
+}
+
+
+/// \brief Callback function for the initial pose subscriber
+void callback_initial(geometry_msgs::PoseWithCovarianceStamped::ConstPtr data)
+{
+  rigid2d::Pose2D pose(getYaw(data->pose.pose.orientation), data->pose.pose.position.x, data->pose.pose.position.y);
+  double sigma_xy = std::sqrt(std::max(data->pose.covariance.at(0), 1e-4));
+  double sigma_th = std::sqrt(std::max(data->pose.covariance.at(35), 1e-4));
+
+  filter->initialize(pose, sigma_xy, sigma_th);
+  ROS_INFO_STREAM("MCL: Reset the particles around " << pose.x << ", " << pose.y << ", " << pose.th);
+}
+
+
+/// \brief Publish the estimate, the particles, and the map to odom transform
+void publishEstimate(const ros::Time & stamp)
+{
+  rigid2d::Pose2D est = filter->estimate();
+  std::vector<double> cov = filter->covariance();
+
+  tf2::Quaternion q;
+  q.setRPY(0, 0, est.th);
+
+  // the pose the controllers use in place of the odometry
+  nav_msgs::Odometry pose;
+  pose.header.stamp = stamp;
+  pose.header.frame_id = map_frame_id;
+  pose.child_frame_id = cur_odom.child_frame_id;
+  pose.pose.pose.position.x = est.x;
+  pose.pose.pose.position.y = est.y;
+  pose.pose.pose.orientation = tf2::toMsg(q);
+  pose.pose.covariance.at(0) = cov.at(4);
+  pose.pose.covariance.at(1) = cov.at(5);
+  pose.pose.covariance.at(6) = cov.at(7);
+  pose.pose.covariance.at(7) = cov.at(8);
+  pose.pose.covariance.at(35) = cov.at(0);
+  pose.twist = cur_odom.twist;
+  pub_pose.publish(pose);
+
+  geometry_msgs::PoseArray particles;
+  particles.header = pose.header;
+  for(int i = 0; i < filter->size(); i++)
+  {
+    rigid2d::Pose2D p = filter->particle(i);
+    tf2::Quaternion pq;
+    pq.setRPY(0, 0, p.th);
+
+    geometry_msgs::Pose particle;
+    particle.position.x = p.x;
+    particle.position.y = p.y;
+    particle.orientation = tf2::toMsg(pq);
+    particles.poses.push_back(particle);
+  }
+  pub_particles.publish(particles);
+
+  if(!publish_tf) return;
+
+  rigid2d::Transform2D T_mr(est);
+  rigid2d::Transform2D T_or(odom_pose);
+  rigid2d::Transform2D T_mo = T_mr * T_or.inv();
+
+  tf2::Quaternion q_mo;
+  q_mo.setRPY(0, 0, T_mo.displacementRad().th);
+
+  geometry_msgs::TransformStamped T_map_odom;
+  T_map_odom.header.stamp = stamp;
+  T_map_odom.header.frame_id = map_frame_id;
+  T_map_odom.child_frame_id = odom_frame_id;
+  T_map_odom.transform.translation.x = T_mo.displacementRad().x;
+  T_map_odom.transform.translation.y = T_mo.displacementRad().y;
+  T_map_odom.transform.translation.z = 0.0;
+  T_map_odom.transform.rotation = tf2::toMsg(q_mo);
+
+  broadcaster->sendTransform(T_map_odom);
+}
+
+
+/// \brief Callback function for the sensor subscriber
+void callback_scan(sensor_msgs::LaserScan::ConstPtr data)
+{
+  if(!got_map || !got_odom) return;
+
+  filter->setBeams(data->angle_min, data->angle_increment, data->ranges.size());
+  filter->update(data->ranges, data->range_min, data->range_max);
+
+  publishEstimate(data->header.stamp);
+}
+
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "mcl");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+  rigid2d::TopicMonitor monitor(n);
+
+  mcl::MclParams params;
+  rigid2d::Pose2D initial;
+  double initial_sigma_xy = 0.1, initial_sigma_th = 0.1;
+
+  pn.getParam("map_frame_id", map_frame_id);
+  pn.getParam("odom_frame_id", odom_frame_id);
+  pn.getParam("num_particles", params.num_particles);
+  pn.getParam("beam_step", params.beam_step);
+  pn.getParam("sigma_hit", sigma_hit);
+  pn.getParam("max_dist", max_dist);
+  pn.getParam("alpha_rot_rot", params.alpha_rot_rot);
+  pn.getParam("alpha_rot_trans", params.alpha_rot_trans);
+  pn.getParam("alpha_trans_trans", params.alpha_trans_trans);
+  pn.getParam("alpha_trans_rot", params.alpha_trans_rot);
+  pn.getParam("beam_weight", params.beam_weight);
+  pn.getParam("min_trans", params.min_trans);
+  pn.getParam("min_rot", params.min_rot);
+  pn.getParam("global_localization", global_localization);
+  pn.getParam("initial_x", initial.x);
+  pn.getParam("initial_y", initial.y);
+  pn.getParam("initial_th", initial.th);
+  pn.getParam("initial_sigma_xy", initial_sigma_xy);
+  pn.getParam("initial_sigma_th", initial_sigma_th);
+  pn.getParam("publish_tf", publish_tf);
+
+  ROS_INFO_STREAM("MCL: Map Frame ID " << map_frame_id);
+  ROS_INFO_STREAM("MCL: Odom Frame ID " << odom_frame_id);
+  ROS_INFO_STREAM("MCL: Num Particles " << params.num_particles);
+  ROS_INFO_STREAM("MCL: Beam Step " << params.beam_step);
+  ROS_INFO_STREAM("MCL: Sigma Hit " << sigma_hit);
+  ROS_INFO_STREAM("MCL: Max Dist " << max_dist);
+  ROS_INFO_STREAM("MCL: Alphas " << params.alpha_rot_rot << " " << params.alpha_rot_trans << " "
+                  << params.alpha_trans_trans << " " << params.alpha_trans_rot);
+  ROS_INFO_STREAM("MCL: Beam Weight " << params.beam_weight);
+  ROS_INFO_STREAM("MCL: Min Trans " << params.min_trans);
+  ROS_INFO_STREAM("MCL: Min Rot " << params.min_rot);
+  ROS_INFO_STREAM("MCL: Global Localization " << global_localization);
+  ROS_INFO_STREAM("MCL: Initial Pose " << initial.x << ", " << initial.y << ", " << initial.th);
+  ROS_INFO_STREAM("MCL: Publish TF " << publish_tf);
+
+  filter.reset(new mcl::ParticleFilter(params));
+  filter->initialize(initial, initial_sigma_xy, initial_sigma_th);
+  broadcaster.reset(new tf2_ros::TransformBroadcaster);
+
+  ros::Subscriber sub_map = n.subscribe("map", 1, callback_map);
+  ros::Subscriber sub_odom = monitor.subscribe<nav_msgs::Odometry>(n, "odom", callback_odom);
+  ros::Subscriber sub_scan = monitor.subscribe<sensor_msgs::LaserScan>(n, "scan", callback_scan);
+  ros::Subscriber sub_initial = n.subscribe("initialpose", 1, callback_initial);
+  pub_pose = n.advertise<nav_msgs::Odometry>("mcl_odom", 1);
+  pub_particles = n.advertise<geometry_msgs::PoseArray>("particles", 1);
+
+  ros::spin();
+}
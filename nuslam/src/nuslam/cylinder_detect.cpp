@@ -2,6 +2,8 @@
 #include <eigen3/Eigen/Dense>
 #include <vector>
 #include <iostream>
+#include <cmath>
+#include <algorithm>
 
 #include "rigid2d/rigid2d.hpp"
 #include "nuslam/cylinder_detect.hpp"
@@ -172,4 +174,155 @@ namespace cylinder
   }
 
   // Compute MSE Function
+
+  std::vector<std::vector<rigid2d::Vector2D>> cluster_scan(const std::vector<float> & ranges, double angle_min,
+                                                           double angle_increment, double range_min,
+                                                           double range_max, double distance_threshold)
+  {
+    std::vector<rigid2d::Vector2D> temp_points; // Temporary cluster of points
+    std::vector<std::vector<rigid2d::Vector2D>> points_list; // list of all point clusters
+
+    if(ranges.empty()) return points_list;
+
+    double cur_range = 0;
+    double cur_theta = 0;
+
+    // Loop through the data points in the returned array to find clusters
+    for(unsigned int i = 0; i < ranges.size(); i++)
+    {
+      cur_range = ranges.at(i);
+      cur_theta = angle_min + (angle_increment * i);
+
+      // skip the points out of the range of the sensor
+      if(!(cur_range < range_max && cur_range > range_min)) continue;
+
+      rigid2d::Vector2D point(cur_range*std::cos(cur_theta), cur_range*std::sin(cur_theta));
+
+      // if the current cluster is empty or the current point is within the distance
+      // threshold, add it to the current cluster
+      if(temp_points.empty() || std::fabs(cur_range - ranges.at(i-1)) <= distance_threshold)
+      {
+        temp_points.push_back(point);
+      }
+
+      // if the current point is outside of the distance threshold, start a new cluster
+      else
+      {
+        points_list.push_back(temp_points);
+        temp_points.clear();
+        temp_points.push_back(point);
+      }
+    }
+
+    // If last cluster merges with the first cluster, then combine the two point lists
+    if(!points_list.empty() && std::fabs(ranges.front() - ranges.back()) <= distance_threshold)
+    {
+      points_list.at(0).insert(points_list.at(0).end(), temp_points.begin(), temp_points.end());
+    }
+    else // Save final cluster
+    {
+      points_list.push_back(temp_points);
+    }
+
+    return points_list;
+  }
+
+  std::vector<Reflector> find_reflectors(const std::vector<float> & ranges, const std::vector<float> & intensities,
+                                         double angle_min, double angle_increment, double range_min,
+                                         double range_max, double intensity_threshold, double distance_threshold,
+                                         int max_gap)
+  {
+    std::vector<Reflector> reflectors;
+
+    const int n = std::min(ranges.size(), intensities.size());
+    if(n == 0) return reflectors;
+
+    auto valid = [&](int i) { return ranges[i] > range_min && ranges[i] < range_max; };
+    auto bright = [&](int i) { return valid(i) && intensities[i] >= intensity_threshold; };
+
+    // a full turn is walked from a dark beam, so no landmark straddles the start
+    const bool full_circle = angle_increment > 0 && (n + 0.5) * angle_increment >= 2.0 * rigid2d::PI;
+    int start = 0;
+    if(full_circle)
+    {
+      while(start < n && bright(start)) start++;
+      if(start == n) return reflectors;
+    }
+
+    // the beam at step j of the walk, -1 off the ends of a partial scan
+    auto beam = [&](int j)
+    {
+      if(full_circle) return ((start + j) % n + n) % n;
+      return j >= 0 && j < n ? j : -1;
+    };
+
+    // the dark side of the landmark next to a bright beam
+    auto dark_side = [&](int j, int edge)
+    {
+      int i = beam(j);
+      return i >= 0 && valid(i) && !bright(i) && std::fabs(ranges[i] - ranges[edge]) <= distance_threshold;
+    };
+
+    auto point = [&](int i)
+    {
+      double theta = angle_min + angle_increment * i;
+      return rigid2d::Vector2D(ranges[i] * std::cos(theta), ranges[i] * std::sin(theta));
+    };
+
+    Reflector cur;
+    int first = 0, last = 0; // walk steps of the first and last bright beams of cur
+    int gap = 0; // dark beams since the last bright beam
+    bool open = false;
+
+    auto close = [&]()
+    {
+      // the dark beams after the last band are not part of it
+      cur.points.resize(cur.points.size() - gap);
+      bool bounded = dark_side(first - 1, beam(first)) && dark_side(last + 1, beam(last));
+      cur.id = bounded ? cur.bands - 1 : -1;
+      reflectors.push_back(cur);
+      open = false;
+    };
+
+    for(int j = 0; j < n; j++)
+    {
+      int i = beam(j);
+
+      if(open)
+      {
+        // a dark or bright beam at about the same range is still on the landmark
+        int prev = beam(j - 1);
+        bool same = valid(i) && valid(prev) && std::fabs(ranges[i] - ranges[prev]) <= distance_threshold;
+
+        if(same && bright(i))
+        {
+          if(gap > 0) cur.bands++;
+          cur.points.push_back(point(i));
+          last = j;
+          gap = 0;
+          continue;
+        }
+        if(same && gap < max_gap)
+        {
+          cur.points.push_back(point(i));
+          gap++;
+          continue;
+        }
+        close();
+      }
+
+      if(bright(i))
+      {
+        cur = Reflector();
+        cur.points.push_back(point(i));
+        cur.bands = 1;
+        first = last = j;
+        gap = 0;
+        open = true;
+      }
+    }
+    if(open) close();
+
+    return reflectors;
+  }
 }
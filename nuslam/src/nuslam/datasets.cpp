@@ -0,0 +1,240 @@
+/// \file
+/// \brief Source file for the SLAM dataset loaders
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
+#include "nuslam/datasets.hpp"
+
+namespace datasets
+{
+
+  /// \brief Read the rows of a whitespace separated table, skipping comments and blank lines
+  /// \param path the file
+  /// \param columns the fewest numbers a row must have
+  /// \param rows [out] the rows
+  /// \returns false if the file could not be read or a row is too short
+  static bool readTable(const std::string & path, std::size_t columns, std::vector<std::vector<double>> & rows)
+  {
+    std::ifstream file(path);
+    if(!file) return false;
+
+    std::string line;
+    while(std::getline(file, line))
+    {
+      std::size_t first = line.find_first_not_of(" \t\r");
+      if(first == std::string::npos || line.at(first) == '#') continue;
+
+      std::istringstream stream(line);
+      std::vector<double> row;
+      double value = 0.0;
+      while(stream >> value) row.push_back(value);
+      if(row.size() < columns) return false;
+
+      rows.push_back(row);
+    }
+    return true;
+  }
+
+  /// \brief Add a landmark measured in the robot frame to a step
+  static void addLandmark(Step & step, int id, double x, double y)
+  {
+    geometry_msgs::Point center;
+    center.x = x;
+    center.y = y;
+    step.landmarks.centers.push_back(center);
+    step.landmarks.ids.push_back(id);
+  }
+
+  rigid2d::Twist2D arcTwist(double dx, double dy, double dth)
+  {
+    double chord = std::copysign(std::hypot(dx, dy), dx);
+    dth = rigid2d::normalize_angle(dth);
+
+    if(rigid2d::almost_equal(dth, 0.0, 1e-9)) return rigid2d::Twist2D(0.0, chord, 0.0);
+
+    // an arc turning by dth has a chord of 2 (v / w) sin(dth / 2)
+    return rigid2d::Twist2D(dth, chord * dth / (2.0 * std::sin(dth / 2.0)), 0.0);
+  }
+
+  bool loadRangeBearingLog(const std::string & path, Dataset & dataset)
+  {
+    std::ifstream file(path);
+    if(!file) return false;
+
+    dataset = Dataset();
+    dataset.name = path;
+    dataset.robots.resize(1);
+    RobotRun & run = dataset.robots.at(0);
+    run.name = "robot";
+
+    auto newStep = [&](const rigid2d::Twist2D & tw)
+    {
+      run.steps.emplace_back();
+      run.steps.back().stamp = static_cast<int64_t>(run.steps.size()) * 1000000000;
+      run.steps.back().odometry = tw;
+    };
+
+    std::string line;
+    while(std::getline(file, line))
+    {
+      std::istringstream stream(line);
+      std::string keyword;
+      if(!(stream >> keyword) || keyword.at(0) == '#') continue;
+
+      std::vector<double> values;
+      double value = 0.0;
+      while(stream >> value) values.push_back(value);
+
+      if(keyword == "ODOMETRY")
+      {
+        if(values.size() == 3)
+        {
+          double rot1 = values.at(0), trans = values.at(1), rot2 = values.at(2);
+          newStep(arcTwist(trans * std::cos(rot1), trans * std::sin(rot1), rot1 + rot2));
+        }
+        else if(values.size() >= 5) newStep(arcTwist(values.at(2), values.at(3), values.at(4)));
+        else return false;
+      }
+      else if(keyword == "SENSOR" || keyword == "LANDMARK")
+      {
+        // measurements before the first motion are taken standing still
+        if(run.steps.empty()) newStep(rigid2d::Twist2D());
+
+        if(keyword == "SENSOR" && values.size() >= 3)
+        {
+          double range = values.at(1), bearing = values.at(2);
+          addLandmark(run.steps.back(), static_cast<int>(values.at(0)), range * std::cos(bearing), range * std::sin(bearing));
+        }
+        else if(keyword == "LANDMARK" && values.size() >= 4)
+        {
+          addLandmark(run.steps.back(), static_cast<int>(values.at(1)), values.at(2), values.at(3));
+        }
+        else return false;
+      }
+    }
+
+    return !run.steps.empty();
+  }
+
+  bool loadUtias(const std::string & directory, double dt, Dataset & dataset)
+  {
+    if(dt <= 0.0) return false;
+
+    dataset = Dataset();
+    dataset.name = directory;
+    const std::string prefix = directory.empty() || directory.back() == '/' ? directory : directory + "/";
+
+    std::vector<std::vector<double>> barcodes, landmarks;
+    if(!readTable(prefix + "Barcodes.dat", 2, barcodes)) return false;
+    if(!readTable(prefix + "Landmark_Groundtruth.dat", 3, landmarks)) return false;
+
+    std::map<int, int> subject_of;
+    for(auto & row : barcodes) subject_of[static_cast<int>(row.at(1))] = static_cast<int>(row.at(0));
+
+    for(auto & row : landmarks)
+    {
+      dataset.landmark_ids.push_back(static_cast<int>(row.at(0)));
+      dataset.landmarks.emplace_back(row.at(1), row.at(2));
+    }
+
+    // the robots are numbered from 1 with no gaps
+    std::vector<std::vector<std::vector<double>>> odometry, measurements, truth;
+    for(int n = 1; ; n++)
+    {
+      const std::string robot = prefix + "Robot" + std::to_string(n);
+      std::vector<std::vector<double>> odo, meas, gt;
+      if(!readTable(robot + "_Odometry.dat", 3, odo)) break;
+      if(!readTable(robot + "_Measurement.dat", 4, meas) || !readTable(robot + "_Groundtruth.dat", 4, gt)) return false;
+      if(odo.empty() || gt.empty()) return false;
+
+      auto byTime = [](const std::vector<double> & a, const std::vector<double> & b) { return a.at(0) < b.at(0); };
+      std::stable_sort(odo.begin(), odo.end(), byTime);
+      std::stable_sort(meas.begin(), meas.end(), byTime);
+      std::stable_sort(gt.begin(), gt.end(), byTime);
+
+      odometry.push_back(odo);
+      measurements.push_back(meas);
+      truth.push_back(gt);
+    }
+    if(odometry.empty()) return false;
+
+    // every robot starts at the same time, once each has a velocity and a true pose
+    double t0 = 0.0;
+    for(std::size_t r = 0; r < odometry.size(); r++)
+    {
+      double first = std::max(odometry.at(r).front().at(0), truth.at(r).front().at(0));
+      t0 = r == 0 ? first : std::max(t0, first);
+    }
+
+    for(std::size_t r = 0; r < odometry.size(); r++)
+    {
+      const std::vector<std::vector<double>> & odo = odometry.at(r), & meas = measurements.at(r), & gt = truth.at(r);
+
+      RobotRun run;
+      run.name = "Robot" + std::to_string(r + 1);
+
+      for(auto & row : gt)
+      {
+        replay::TrajectoryPoint point;
+        point.stamp = std::llround(row.at(0) * 1e9);
+        point.pose = rigid2d::Pose2D(rigid2d::normalize_angle(row.at(3)), row.at(1), row.at(2));
+        run.truth.push_back(point);
+      }
+
+      auto before = std::upper_bound(gt.begin(), gt.end(), t0,
+                                     [](double t, const std::vector<double> & row) { return t < row.at(0); });
+      const std::vector<double> & start = *std::prev(before);
+      run.start = rigid2d::Pose2D(rigid2d::normalize_angle(start.at(3)), start.at(1), start.at(2));
+
+      const long count = std::max(0L, static_cast<long>(std::floor((odo.back().at(0) - t0) / dt)));
+      std::size_t o = 0, m = 0;
+      while(m < meas.size() && meas.at(m).at(0) < t0) m++;
+
+      for(long k = 0; k < count; k++)
+      {
+        const double begin = t0 + k * dt, end = begin + dt;
+
+        // each velocity holds until the next odometry line, compose the pieces inside the step
+        rigid2d::Transform2D motion;
+        double t = begin;
+        while(t < end)
+        {
+          while(o + 1 < odo.size() && odo.at(o + 1).at(0) <= t) o++;
+          double until = o + 1 < odo.size() ? std::min(end, odo.at(o + 1).at(0)) : end;
+          double h = until - t;
+          motion = motion.integrateTwist(rigid2d::Twist2D(odo.at(o).at(2) * h, odo.at(o).at(1) * h, 0.0));
+          t = until;
+        }
+
+        Step step;
+        step.stamp = std::llround(end * 1e9);
+        rigid2d::Pose2D delta = motion.displacementRad();
+        step.odometry = arcTwist(delta.x, delta.y, delta.th);
+
+        for(; m < meas.size() && meas.at(m).at(0) < end; m++)
+        {
+          auto subject = subject_of.find(static_cast<int>(meas.at(m).at(1)));
+          if(subject == subject_of.end()) continue;
+
+          // only the landmarks, the other robots move
+          if(std::find(dataset.landmark_ids.begin(), dataset.landmark_ids.end(), subject->second) == dataset.landmark_ids.end()) continue;
+
+          double range = meas.at(m).at(2), bearing = meas.at(m).at(3);
+          addLandmark(step, subject->second, range * std::cos(bearing), range * std::sin(bearing));
+        }
+
+        run.steps.push_back(step);
+      }
+
+      dataset.robots.push_back(run);
+    }
+
+    return true;
+  }
+
+}
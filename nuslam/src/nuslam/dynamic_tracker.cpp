@@ -0,0 +1,183 @@
+/// \file
+/// \brief Source file for the dynamic object tracker
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <cmath>
+
+#include "nuslam/dynamic_tracker.hpp"
+
+namespace tracker
+{
+
+  Cluster summarize(const std::vector<rigid2d::Vector2D> & points)
+  {
+    Cluster cluster;
+    if(points.empty()) return cluster;
+
+    for(auto & p : points) cluster.center += p;
+    cluster.center = cluster.center / static_cast<double>(points.size());
+    cluster.radius = 0.5 * points.front().distance(points.back());
+
+    return cluster;
+  }
+
+  DynamicTracker::DynamicTracker(double accel_noise, double meas_noise, double gate, double speed_threshold, int min_hits, int max_misses)
+  {
+    this->accel_noise = accel_noise;
+    this->meas_noise = meas_noise;
+    this->gate = gate;
+    this->speed_threshold = speed_threshold;
+    this->min_hits = min_hits;
+    this->max_misses = max_misses;
+  }
+
+  void DynamicTracker::setStaticMap(const StaticMap & map)
+  {
+    this->map = map;
+  }
+
+  const std::vector<Track> & DynamicTracker::getTracks() const
+  {
+    return tracks;
+  }
+
+  bool DynamicTracker::inFreeSpace(const rigid2d::Vector2D & p) const
+  {
+    if(map.data.empty()) return false;
+
+    int cx = std::floor((p.x - map.origin_x) / map.resolution);
+    int cy = std::floor((p.y - map.origin_y) / map.resolution);
+    if(cx < 0 || cy < 0 || cx >= static_cast<int>(map.width) || cy >= static_cast<int>(map.height)) return false;
+
+    return map.data.at(cy * map.width + cx) == 0;
+  }
+
+  void DynamicTracker::predict(double dt)
+  {
+    Eigen::Matrix4d F = Eigen::Matrix4d::Identity();
+    F(0, 2) = dt;
+    F(1, 3) = dt;
+
+    // white noise acceleration model
+    double q = accel_noise * accel_noise;
+    double dt2 = dt * dt;
+    Eigen::Matrix4d Q = Eigen::Matrix4d::Zero();
+    Q(0, 0) = Q(1, 1) = q * dt2 * dt2 / 4.0;
+    Q(0, 2) = Q(2, 0) = Q(1, 3) = Q(3, 1) = q * dt2 * dt / 2.0;
+    Q(2, 2) = Q(3, 3) = q * dt2;
+
+    for(auto & track : tracks)
+    {
+      track.state = F * track.state;
+      track.covariance = F * track.covariance * F.transpose() + Q;
+    }
+  }
+
+  std::vector<bool> DynamicTracker::update(const std::vector<Cluster> & clusters, const rigid2d::Transform2D & odom_pose, double stamp)
+  {
+    double dt = last_stamp < 0 ? 0 : std::max(stamp - last_stamp, 0.0);
+    last_stamp = stamp;
+
+    predict(dt);
+
+    // Cluster centers in the odometry frame, so only motion of the world is left
+    std::vector<Eigen::Vector2d> centers;
+    for(auto & c : clusters)
+    {
+      rigid2d::Vector2D p = odom_pose(c.center);
+      centers.push_back(Eigen::Vector2d(p.x, p.y));
+    }
+
+    Eigen::Matrix<double, 2, 4> H = Eigen::Matrix<double, 2, 4>::Zero();
+    H(0, 0) = 1;
+    H(1, 1) = 1;
+    Eigen::Matrix2d R = meas_noise * meas_noise * Eigen::Matrix2d::Identity();
+
+    // Mahalonbis distance of every cluster and track pair inside the gate
+    std::vector<std::tuple<double, int, int>> pairs;
+    for(unsigned int j = 0; j < tracks.size(); j++)
+    {
+      Eigen::Matrix2d S_inv = (H * tracks.at(j).covariance * H.transpose() + R).inverse();
+
+      for(unsigned int i = 0; i < centers.size(); i++)
+      {
+        Eigen::Vector2d innovation = centers.at(i) - tracks.at(j).state.head<2>();
+        double dist = innovation.transpose() * S_inv * innovation;
+        if(dist < gate) pairs.push_back(std::make_tuple(dist, i, j));
+      }
+    }
+
+    // Greedy nearest neighbor, closest pairs first
+    std::sort(pairs.begin(), pairs.end());
+
+    std::vector<int> cluster_track(clusters.size(), -1);
+    std::vector<bool> track_matched(tracks.size(), false);
+
+    for(auto & [dist, i, j] : pairs)
+    {
+      if(cluster_track.at(i) >= 0 || track_matched.at(j)) continue;
+
+      cluster_track.at(i) = j;
+      track_matched.at(j) = true;
+    }
+
+    // Kalman update of the matched tracks
+    for(unsigned int i = 0; i < clusters.size(); i++)
+    {
+      int j = cluster_track.at(i);
+      if(j < 0) continue;
+
+      Track & track = tracks.at(j);
+
+      Eigen::Matrix2d S = H * track.covariance * H.transpose() + R;
+      Eigen::Matrix<double, 4, 2> K = track.covariance * H.transpose() * S.inverse();
+
+      track.state += K * (centers.at(i) - track.state.head<2>());
+      track.covariance = (Eigen::Matrix4d::Identity() - K * H) * track.covariance;
+      track.radius = clusters.at(i).radius;
+      track.hits++;
+      track.misses = 0;
+    }
+
+    // Age the unmatched tracks and drop the stale ones
+    for(unsigned int j = 0; j < tracks.size(); j++)
+    {
+      if(!track_matched.at(j)) tracks.at(j).misses++;
+    }
+
+    // New tracks for the unmatched clusters, starting at rest with a loose velocity
+    for(unsigned int i = 0; i < clusters.size(); i++)
+    {
+      if(cluster_track.at(i) >= 0) continue;
+
+      Track track;
+      track.id = next_id++;
+      track.state << centers.at(i), 0, 0;
+      track.covariance = Eigen::Vector4d(meas_noise*meas_noise, meas_noise*meas_noise, 1.0, 1.0).asDiagonal();
+      track.radius = clusters.at(i).radius;
+      track.hits = 1;
+
+      cluster_track.at(i) = tracks.size();
+      tracks.push_back(track);
+    }
+
+    // A track stays dynamic once it is seen moving, so a person who stops does not become a landmark
+    std::vector<bool> dynamic(clusters.size(), false);
+    for(unsigned int i = 0; i < clusters.size(); i++)
+    {
+      Track & track = tracks.at(cluster_track.at(i));
+
+      double speed = track.state.tail<2>().norm();
+      if(track.hits >= min_hits && speed > speed_threshold) track.dynamic = true;
+      if(inFreeSpace(rigid2d::Vector2D(centers.at(i)(0), centers.at(i)(1)))) track.dynamic = true;
+
+      dynamic.at(i) = track.dynamic;
+    }
+
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [this](const Track & t) { return t.misses > max_misses; }), tracks.end());
+
+    return dynamic;
+  }
+}
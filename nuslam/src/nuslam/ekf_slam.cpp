@@ -12,6 +12,7 @@
 #include "geometry_msgs/Point.h"
 
 #include "nuslam/ekf_slam.hpp"
+#include "nuslam/jcbb.hpp"
 #include "rigid2d/rigid2d.hpp"
 
 namespace ekf_slam
@@ -19,9 +20,10 @@ namespace ekf_slam
 
   static std::mt19937 & get_random()
   {
-      // static variables inside a function are created once and persist for the remainder of the program
-      static std::random_device rd{};
-      static std::mt19937 mt{rd()};
+      // static variables inside a function are created once and persist for the remainder of the program,
+      // one per thread so filters on different threads do not race on the state
+      static thread_local std::random_device rd{};
+      static thread_local std::mt19937 mt{rd()};
       // we return a reference to the pseudo-random number genrator object. This is always the
       // same object every time get_random is called
       return mt;
@@ -74,7 +76,8 @@ namespace ekf_slam
   void Slam::MotionModelUpdate(rigid2d::Twist2D tw)
   {
 
-    Eigen::Vector3d noise = Slam::getStateNoise();
+    Eigen::Vector3d noise = Eigen::Vector3d::Zero();
+    if(inject_noise) noise = Slam::getStateNoise();
 
     Eigen::Vector3d update;
     Eigen::Vector3d dupdate;
@@ -115,6 +118,13 @@ namespace ekf_slam
     // Landmarks do not move so no need to update that part of the state matrix
 
     Slam::updateCovarPrediction(dupdate);
+
+    if(steps)
+    {
+      // the covarience only keeps the last of several predictions, so the record does too
+      if(steps->empty() || steps->back().P_robot.size() > 0) steps->emplace_back();
+      steps->back().dupdate = dupdate;
+    }
   }
 
   void Slam::updateCovarPrediction(Eigen::Vector3d dupdate)
@@ -172,6 +182,31 @@ namespace ekf_slam
     int data_size = map_data.centers.size();
 
     landmark_history.col(4).setZero(); // reset matched info
+    innovations.clear();
+
+    // an update with no prediction before it has G = I
+    if(steps && (steps->empty() || steps->back().P_robot.size() > 0)) steps->emplace_back();
+
+    // A landmark with an id read by the detector needs no search
+    const bool have_ids = static_cast<int>(map_data.ids.size()) == data_size;
+    auto has_id = [&](int i) { return have_ids && map_data.ids.at(i) >= 0; };
+
+    // Associate the rest of the scan jointly before any update
+    std::vector<int> jcbb_indices(data_size, -1);
+    if(use_jcbb)
+    {
+      nuslam::TurtleMap unlabeled;
+      std::vector<int> which;
+      for(int i = 0; i < data_size; i++)
+      {
+        if(has_id(i)) continue;
+        unlabeled.centers.push_back(map_data.centers.at(i));
+        which.push_back(i);
+      }
+
+      std::vector<int> found = associate_jcbb(unlabeled);
+      for(unsigned int k = 0; k < which.size(); k++) jcbb_indices.at(which.at(k)) = found.at(k);
+    }
 
     for(int i = 0; i < data_size; i++)
     {
@@ -180,7 +215,8 @@ namespace ekf_slam
 
       landmark_index = -1;
 
-      landmark_index = associate_data(cur_x, cur_y);
+      if(has_id(i)) landmark_index = associate_id(map_data.ids.at(i), cur_x, cur_y);
+      else landmark_index = use_jcbb ? jcbb_indices.at(i) : associate_data(cur_x, cur_y);
 
       // if the data correlates to a landmark process it
       if(landmark_index >=0)
@@ -189,7 +225,7 @@ namespace ekf_slam
         z_actual = cart2polar(cur_x, cur_y);
 
         // Compute the expected measurment
-        noise = Slam::getMeasurementNoise();
+        if(inject_noise) noise = Slam::getMeasurementNoise();
         z_expected = sensorModel(prev_state(landmark_index), prev_state(landmark_index + 1), noise);
 
         // Compute error
@@ -200,7 +236,27 @@ namespace ekf_slam
         Hi = getHMatrix(landmark_index);
 
         // Compute the Kalman Gain
-        Ki = sigma_bar * Hi.transpose() * ((Hi * sigma_bar * Hi.transpose() + Rnoise).inverse());
+        Eigen::Matrix2d S_inv = (Hi * sigma_bar * Hi.transpose() + Rnoise).inverse();
+        Ki = sigma_bar * Hi.transpose() * S_inv;
+
+        Innovation innov;
+        innov.id = (landmark_index - 3) / 2;
+        innov.range = z_diff(0);
+        innov.bearing = z_diff(1);
+        innov.nis = z_diff.dot(S_inv * z_diff);
+        innovations.push_back(innov);
+
+        if(steps)
+        {
+          UpdateRecord record;
+          record.index = landmark_index;
+          record.H << Hi.leftCols<3>(), Hi.block<2, 2>(0, landmark_index);
+          record.S_inv = S_inv;
+          record.innovation = z_diff;
+          record.z = z_actual;
+          record.K = Ki;
+          steps->back().updates.push_back(record);
+        }
 
         // Update the Posterior
         prev_state += Ki * z_diff;
@@ -216,6 +272,12 @@ namespace ekf_slam
     // Update Covarience
     sigma = sigma_bar;
 
+    if(steps)
+    {
+      steps->back().pose = prev_state.head<3>();
+      steps->back().P_robot = sigma.topRows(3);
+    }
+
     // remove false positive landmarks if possible
     // landmark_culling();
   }
@@ -249,10 +311,7 @@ namespace ekf_slam
           output_index = landmark_index;
 
           // Update history info
-          landmark_history(output_index, 1) = prev_state(1);
-          landmark_history(output_index, 2) = prev_state(2);
-          landmark_history(output_index, 3) = ros::Time::now().toSec();
-          landmark_history(output_index, 4) = 1;
+          mark_seen(output_index);
           break;
         }
       }
@@ -270,30 +329,147 @@ namespace ekf_slam
     // left in the state vector, add it.
     if(output_index == -1 && created_landmarks < tot_landmarks)
     {
-      // Find next open index
-      int j = 0;
-      while(output_index < 0 && j < tot_landmarks)
+      output_index = add_landmark(x, y);
+    }
+
+    return output_index;
+  }
+
+  int Slam::add_landmark(double x, double y)
+  {
+    int output_index = -1;
+
+    // Find next open index
+    int j = 0;
+    while(output_index < 0 && j < tot_landmarks)
+    {
+      if(landmark_history(3 + (2*j), 0) == 0) output_index = 3 + 2*j;
+      j++;
+    }
+
+    std::cout << "New Landmark! Setting index " << output_index << "\n";
+    prev_state(output_index) = x + prev_state(1);
+    prev_state(output_index+1) = y + prev_state(2);
+
+    // Update history info
+    landmark_history(output_index, 0) = 1;
+    mark_seen(output_index);
+    created_landmarks++;
+
+    return output_index;
+  }
+
+  void Slam::mark_seen(int index)
+  {
+    landmark_history(index, 1) = prev_state(1);
+    landmark_history(index, 2) = prev_state(2);
+    landmark_history(index, 3) = ros::Time::now().toSec();
+    landmark_history(index, 4) = 1;
+  }
+
+  std::vector<int> Slam::associate_jcbb(const nuslam::TurtleMap & map_data)
+  {
+    int data_size = map_data.centers.size();
+
+    std::vector<std::vector<Pairing>> candidates(data_size);
+    std::vector<double> min_dist(data_size, std::numeric_limits<double>::max());
+
+    Eigen::Vector2d noise = Eigen::Vector2d::Zero();
+
+    // Find the individually compatible landmarks of each observation
+    for(int i = 0; i < data_size; i++)
+    {
+      Eigen::Vector2d z = cart2polar(map_data.centers.at(i).x, map_data.centers.at(i).y);
+
+      for(int j = 0; j < tot_landmarks; j++)
+      {
+        int landmark_index = 3 + 2*j;
+        if(landmark_history(landmark_index, 0) == 0) continue;
+
+        Eigen::MatrixXd Hi = getHMatrix(landmark_index);
+
+        Pairing p;
+        p.landmark = j;
+        p.innovation = z - sensorModel(prev_state(landmark_index), prev_state(landmark_index + 1), noise);
+        p.innovation(1) = rigid2d::normalize_angle(p.innovation(1));
+        p.Hr = Hi.leftCols<3>();
+        p.Hl = Hi.block<2, 2>(0, landmark_index);
+
+        Eigen::Matrix2d psi = Hi * sigma_bar * Hi.transpose() + Rnoise;
+        p.distance = p.innovation.transpose() * psi.inverse() * p.innovation;
+
+        min_dist.at(i) = std::min(min_dist.at(i), p.distance);
+
+        if(p.distance < deadband_min) candidates.at(i).push_back(p);
+      }
+    }
+
+    std::vector<int> pairings = jcbb.associate(candidates, sigma_bar, Rnoise);
+
+    if(jcbb.timedOut())
+    {
+      std::cout << "JCBB hit the time budget after " << jcbb.nodesVisited() << " hypotheses, using the best found\n";
+    }
+
+    std::vector<int> output(data_size, -1);
+
+    for(int i = 0; i < data_size; i++)
+    {
+      if(pairings.at(i) >= 0)
+      {
+        output.at(i) = 3 + 2*pairings.at(i);
+        mark_seen(output.at(i));
+      }
+      // Unpaired and far from everything, so it is potentially a new landmark
+      else if(min_dist.at(i) > deadband_max && created_landmarks < tot_landmarks)
       {
-        if(landmark_history(3 + (2*j), 0) == 0) output_index = 3 + 2*j;
-        j++;
+        output.at(i) = add_landmark(map_data.centers.at(i).x, map_data.centers.at(i).y);
       }
+    }
+
+    return output;
+  }
+
+  int Slam::associate_id(int id, double x, double y)
+  {
+    auto found = landmark_ids.find(id);
+    if(found != landmark_ids.end())
+    {
+      mark_seen(found->second);
+      return found->second;
+    }
 
-      std::cout << "New Landmark! Setting index " << output_index << "\n";
-      prev_state(output_index) = x + prev_state(1);
-      prev_state(output_index+1) = y + prev_state(2);
-
-      // Update history info
-      landmark_history(output_index, 0) = 1;
-      landmark_history(output_index, 1) = prev_state(1);
-      landmark_history(output_index, 2) = prev_state(2);
-      landmark_history(output_index, 3) = ros::Time::now().toSec();
-      landmark_history(output_index, 4) = 1;
-      created_landmarks++;
+    // the first sighting with an id may be a landmark already seen without one
+    int output_index = associate_data(x, y);
+
+    // but not one with a different id, and the id settles a match left in the deadband
+    bool taken = false;
+    for(auto & known : landmark_ids) taken = taken || known.second == output_index;
+
+    if(output_index < 0 || taken)
+    {
+      if(created_landmarks >= tot_landmarks) return -1;
+      output_index = add_landmark(x, y);
     }
 
+    if(output_index >= 0) landmark_ids[id] = output_index;
     return output_index;
   }
 
+  void Slam::useJointCompatibility(bool enable, double time_budget)
+  {
+    use_jcbb = enable;
+    jcbb_budget = time_budget;
+    jcbb = JCBB(deadband_min, jcbb_budget);
+  }
+
+  void Slam::setAssociationThresholds(double min, double max)
+  {
+    deadband_min = min;
+    deadband_max = max;
+    jcbb = JCBB(deadband_min, jcbb_budget);
+  }
+
   double Slam::euclidean_distance(double data_x, double data_y, int id)
   {
 
@@ -375,6 +551,13 @@ namespace ekf_slam
 
           // decrement created landmarks
           created_landmarks--;
+
+          for(auto known = landmark_ids.begin(); known != landmark_ids.end(); ++known)
+          {
+            if(known->second != landmark_index) continue;
+            landmark_ids.erase(known);
+            break;
+          }
         }
       }
     }
@@ -443,11 +626,31 @@ namespace ekf_slam
     return noise;
   }
 
+  void Slam::injectNoise(bool enable)
+  {
+    inject_noise = enable;
+  }
+
+  void Slam::recordSteps(std::vector<StepRecord> * steps)
+  {
+    this->steps = steps;
+  }
+
+  Eigen::Matrix2d Slam::getSensorNoise() const
+  {
+    return Rnoise;
+  }
+
   std::vector<double> Slam::getRobotState()
   {
     return {prev_state(0), prev_state(1), prev_state(2)};
   }
 
+  const std::vector<Innovation> & Slam::getInnovations() const
+  {
+    return innovations;
+  }
+
   std::vector<geometry_msgs::Point> Slam::getLandmarkStates()
   {
     geometry_msgs::Point buf;
@@ -464,4 +667,67 @@ namespace ekf_slam
 
     return output;
   }
+
+  Eigen::VectorXd Slam::getStateVector() const
+  {
+    return prev_state;
+  }
+
+  Eigen::MatrixXd Slam::getCovariance() const
+  {
+    return sigma;
+  }
+
+  bool Slam::isLandmarkInitialized(int i) const
+  {
+    return landmark_history(3 + 2*i, 0) != 0;
+  }
+
+  int Slam::getNumLandmarks() const
+  {
+    return created_landmarks;
+  }
+
+  bool Slam::isFull() const
+  {
+    return created_landmarks >= tot_landmarks;
+  }
+
+  int Slam::getNumLandmarkIds() const
+  {
+    return tot_landmarks;
+  }
+
+  bool Slam::getLandmarkPosition(int id, Eigen::Vector2d & out) const
+  {
+    if(id < 0 || id >= tot_landmarks || !isLandmarkInitialized(id)) return false;
+
+    out = prev_state.segment<2>(3 + 2*id);
+    return true;
+  }
+
+  bool Slam::getLandmarkMarginal(int id, Eigen::Matrix2d & out) const
+  {
+    return getLandmarkCrossCovariance(id, id, out);
+  }
+
+  bool Slam::getLandmarkCrossCovariance(int id1, int id2, Eigen::Matrix2d & out) const
+  {
+    if(id1 < 0 || id1 >= tot_landmarks || !isLandmarkInitialized(id1)) return false;
+    if(id2 < 0 || id2 >= tot_landmarks || !isLandmarkInitialized(id2)) return false;
+
+    out = sigma.block<2, 2>(3 + 2*id1, 3 + 2*id2);
+    return true;
+  }
+
+  bool Slam::getRelativeCovariance(int id1, int id2, Eigen::Matrix2d & out) const
+  {
+    Eigen::Matrix2d P11, P22, P12;
+
+    if(!getLandmarkMarginal(id1, P11) || !getLandmarkMarginal(id2, P22)) return false;
+    getLandmarkCrossCovariance(id1, id2, P12);
+
+    out = P11 + P22 - P12 - P12.transpose();
+    return true;
+  }
 }
@@ -0,0 +1,264 @@
+/// \file
+/// \brief Source file for the work stealing executor
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "nuslam/executor.hpp"
+
+namespace executor
+{
+
+  // Executor the calling thread works for, and its worker id
+  static thread_local Executor * current_executor = nullptr;
+  static thread_local unsigned int current_worker = 0;
+
+  // The shared executor
+  static std::mutex shared_lock;
+  static std::unique_ptr<Executor> shared;
+  static Options shared_options;
+
+  /////////////// TaskGroup CLASS //////////////////////////
+  TaskGroup::TaskGroup(Executor & exec) : exec(exec)
+  {
+  }
+
+  TaskGroup::~TaskGroup()
+  {
+    while(pending > 0)
+    {
+      if(!exec.runOne()) std::this_thread::yield();
+    }
+  }
+
+  void TaskGroup::run(std::function<void()> task)
+  {
+    pending++;
+    exec.submit([this, task]()
+    {
+      try
+      {
+        task();
+      }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> guard(error_lock);
+        if(!error) error = std::current_exception();
+      }
+      pending--;
+    });
+  }
+
+  void TaskGroup::wait()
+  {
+    // help with the queued work instead of blocking a core
+    while(pending > 0)
+    {
+      if(!exec.runOne()) std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> guard(error_lock);
+    if(error)
+    {
+      std::exception_ptr e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  /////////////// Executor CLASS ///////////////////////////
+  Executor::Executor(const Options & options)
+  {
+    this->options = options;
+    if(options.run_inline) return;
+
+    unsigned int num = options.num_workers;
+    if(num == 0) num = std::max(1u, std::thread::hardware_concurrency());
+
+    for(unsigned int i = 0; i < num; i++) workers.emplace_back(new Worker);
+
+    for(unsigned int i = 0; i < num; i++)
+    {
+      threads.emplace_back(&Executor::workerLoop, this, i);
+
+      if(options.pin_threads)
+      {
+#ifdef __linux__
+        int cpu = options.cpus.empty() ? static_cast<int>(i % std::max(1u, std::thread::hardware_concurrency())) : options.cpus.at(i % options.cpus.size());
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        if(pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpu_set_t), &set) != 0)
+        {
+          std::cout << "Could not pin worker " << i << " to cpu " << cpu << "\n";
+        }
+#else
+        std::cout << "Pinning workers is only supported on linux\n";
+#endif
+      }
+    }
+  }
+
+  Executor::~Executor()
+  {
+    {
+      std::lock_guard<std::mutex> guard(sleep_lock);
+      stopping = true;
+    }
+    wake.notify_all();
+
+    for(auto & t : threads) t.join();
+  }
+
+  Executor & Executor::instance()
+  {
+    std::lock_guard<std::mutex> guard(shared_lock);
+    if(!shared) shared.reset(new Executor(shared_options));
+    return *shared;
+  }
+
+  void Executor::configure(const Options & options)
+  {
+    std::lock_guard<std::mutex> guard(shared_lock);
+    shared_options = options;
+    shared.reset(new Executor(shared_options));
+  }
+
+  void Executor::submit(std::function<void()> task)
+  {
+    if(options.run_inline)
+    {
+      task();
+      return;
+    }
+
+    unsigned int id = current_executor == this ? current_worker : next_worker++ % workers.size();
+
+    {
+      std::lock_guard<std::mutex> guard(workers.at(id)->lock);
+      workers.at(id)->tasks.push_back(std::move(task));
+    }
+
+    // take the sleep lock so a worker about to sleep can not miss the new task
+    {
+      std::lock_guard<std::mutex> guard(sleep_lock);
+      queued++;
+    }
+    wake.notify_one();
+  }
+
+  void Executor::parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const std::function<void(std::size_t, std::size_t)> & body)
+  {
+    if(end <= begin) return;
+    grain = std::max<std::size_t>(grain, 1);
+
+    // one chunk, or inline mode, runs on the caller in order
+    if(options.run_inline || end - begin <= grain)
+    {
+      for(std::size_t first = begin; first < end; first += grain) body(first, std::min(first + grain, end));
+      return;
+    }
+
+    TaskGroup group(*this);
+    for(std::size_t first = begin; first < end; first += grain)
+    {
+      std::size_t last = std::min(first + grain, end);
+      group.run([&body, first, last]() { body(first, last); });
+    }
+    group.wait();
+  }
+
+  bool Executor::pop(unsigned int id, bool steal, std::function<void()> & task)
+  {
+    Worker & w = *workers.at(id);
+    std::lock_guard<std::mutex> guard(w.lock);
+
+    if(w.tasks.empty()) return false;
+
+    if(steal)
+    {
+      task = std::move(w.tasks.front());
+      w.tasks.pop_front();
+    }
+    else
+    {
+      task = std::move(w.tasks.back());
+      w.tasks.pop_back();
+    }
+
+    queued--;
+    return true;
+  }
+
+  bool Executor::find(unsigned int id, std::function<void()> & task)
+  {
+    if(queued <= 0) return false;
+
+    unsigned int num = workers.size();
+    if(id < num && pop(id, false, task)) return true;
+
+    // steal, starting after this worker so thieves spread over the deques
+    for(unsigned int k = 1; k <= num; k++)
+    {
+      unsigned int victim = (id + k) % num;
+      if(victim != id && pop(victim, true, task)) return true;
+    }
+
+    return false;
+  }
+
+  bool Executor::runOne()
+  {
+    if(options.run_inline) return false;
+
+    unsigned int id = current_executor == this ? current_worker : workers.size();
+
+    std::function<void()> task;
+    if(!find(id, task)) return false;
+
+    task();
+    return true;
+  }
+
+  void Executor::workerLoop(unsigned int id)
+  {
+    current_executor = this;
+    current_worker = id;
+    if(options.thread_start) options.thread_start();
+
+    std::function<void()> task;
+
+    while(true)
+    {
+      if(find(id, task))
+      {
+        task();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> guard(sleep_lock);
+      wake.wait(guard, [this]() { return stopping || queued > 0; });
+
+      // finish the queued tasks before exiting
+      if(stopping && queued <= 0) return;
+    }
+  }
+
+  unsigned int Executor::numWorkers() const
+  {
+    return workers.size();
+  }
+
+  bool Executor::isInline() const
+  {
+    return options.run_inline;
+  }
+}
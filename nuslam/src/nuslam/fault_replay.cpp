@@ -0,0 +1,500 @@
+/// \file
+/// \brief Source file for the fault injecting log replay
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cmath>
+
+#include "rigid2d/diff_drive.hpp"
+#include "nuslam/fault_replay.hpp"
+#include "nuslam/cylinder_detect.hpp"
+#include "nuslam/ekf_slam.hpp"
+
+namespace replay
+{
+
+  bool profileByName(const std::string & name, FaultProfile & profile)
+  {
+    FaultProfile p;
+
+    if(name == "clean")
+    {
+      // wired, only the delay of the stack
+    }
+    else if(name == "wifi")
+    {
+      // a good link with the odd stall
+      p.latency = 0.005;
+      p.jitter = 0.002;
+      p.drop = 0.01;
+      p.spike_drop = 0.2;
+      p.spike_rate = 0.1;
+      p.spike_length = 0.3;
+      p.spike_delay = 0.1;
+      p.reorder = 0.01;
+    }
+    else if(name == "congested")
+    {
+      // a shared access point under load
+      p.latency = 0.02;
+      p.jitter = 0.01;
+      p.drop = 0.05;
+      p.spike_drop = 0.5;
+      p.spike_rate = 0.5;
+      p.spike_length = 0.5;
+      p.spike_delay = 0.3;
+      p.reorder = 0.05;
+    }
+    else if(name == "lossy")
+    {
+      // the edge of the range of the access point
+      p.latency = 0.01;
+      p.jitter = 0.005;
+      p.drop = 0.2;
+      p.spike_drop = 0.6;
+      p.spike_rate = 0.2;
+      p.spike_length = 1.0;
+      p.spike_delay = 0.2;
+    }
+    else if(name == "glitchy")
+    {
+      // a good link with a bad encoder cable
+      p.glitch = 0.02;
+      p.stuck = 0.05;
+    }
+    else
+    {
+      return false;
+    }
+
+    profile = p;
+    return true;
+  }
+
+  /////////////// FaultInjector CLASS ////////////////////
+  FaultInjector::FaultInjector(const FaultProfile & profile, uint32_t seed) : profile(profile), gen(seed)
+  {
+  }
+
+  double FaultInjector::exponential(double mean)
+  {
+    return -mean * std::log(1.0 - uniform(gen));
+  }
+
+  void FaultInjector::advance(int64_t stamp)
+  {
+    spike = false;
+    if(profile.spike_rate <= 0.0) return;
+
+    // spikes and the good periods between them both have exponential lengths
+    if(!started)
+    {
+      spike_start = stamp + static_cast<int64_t>(exponential(1.0 / profile.spike_rate) * 1e9);
+      spike_end = spike_start + static_cast<int64_t>(exponential(profile.spike_length) * 1e9);
+      started = true;
+    }
+
+    while(stamp >= spike_end)
+    {
+      spike_start = spike_end + static_cast<int64_t>(exponential(1.0 / profile.spike_rate) * 1e9);
+      spike_end = spike_start + static_cast<int64_t>(exponential(profile.spike_length) * 1e9);
+    }
+
+    spike = stamp >= spike_start;
+  }
+
+  bool FaultInjector::inSpike() const
+  {
+    return spike;
+  }
+
+  Delivery FaultInjector::send(int64_t stamp, bool scan, bool encoder)
+  {
+    Delivery d;
+    d.stamp = stamp;
+
+    advance(stamp);
+
+    if(scan && uniform(gen) < (spike ? profile.spike_drop : profile.drop))
+    {
+      d.fault = Fault::Dropped;
+      return d;
+    }
+
+    std::normal_distribution<double> normal(0.0, 1.0);
+    double delay = std::max(0.0, profile.latency + profile.jitter * normal(gen));
+
+    if(spike)
+    {
+      d.fault = Fault::Spike;
+      delay += exponential(profile.spike_delay);
+    }
+
+    if(uniform(gen) < profile.reorder)
+    {
+      d.fault = Fault::Reordered;
+      delay += profile.reorder_delay;
+    }
+
+    // a corrupt reading is the fault that matters to the pipeline, so it is the one reported
+    if(encoder && uniform(gen) < profile.glitch)
+    {
+      d.fault = Fault::Glitch;
+      d.wheel = uniform(gen) < 0.5 ? 0 : 1;
+      d.jump = uniform(gen) < 0.5 ? -profile.glitch_size : profile.glitch_size;
+    }
+    else if(encoder && uniform(gen) < profile.stuck)
+    {
+      d.fault = Fault::Stuck;
+    }
+
+    d.arrival = stamp + static_cast<int64_t>(delay * 1e9);
+    return d;
+  }
+
+  /////////////// REPLAY ///////////////////////////////////
+  namespace
+  {
+    /// \brief A message on its way through the link
+    struct Message
+    {
+      Delivery delivery; // what the link did
+      uint64_t index = 0; // position in the log, breaks arrival ties
+      const DecodedMessage * decoded = nullptr; // the message as logged, shared by every replay
+
+      // joint state fields, after any glitch
+      double left = 0.0;
+      double right = 0.0;
+    };
+
+    /// \brief Order a heap with the first arrival on top
+    bool arrivesLater(const Message & a, const Message & b)
+    {
+      if(a.delivery.arrival != b.delivery.arrival) return a.delivery.arrival > b.delivery.arrival;
+      return a.index > b.index;
+    }
+
+    /// \brief Get a percentile of sorted values
+    double percentile(const std::vector<double> & sorted, double p)
+    {
+      if(sorted.empty()) return 0.0;
+      std::size_t i = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+      return sorted.at(std::min(sorted.size() - 1, i > 0 ? i - 1 : 0));
+    }
+  }
+
+  bool decodeLog(const sensor_log::LogReader & log, const PipelineParams & params, DecodedLog & decoded)
+  {
+    decoded = DecodedLog();
+
+    int scan_topic = log.findTopic(params.scan_topic);
+    int joint_topic = log.findTopic(params.joint_topic);
+    if(scan_topic < 0 || joint_topic < 0) return false;
+
+    // the joint names are the meta of the JointState schema
+    int left_index = -1, right_index = -1;
+    std::istringstream names(log.topics().at(joint_topic).meta);
+    std::string name;
+    for(int i = 0; std::getline(names, name, ','); i++)
+    {
+      if(name == params.left_wheel_joint) left_index = i;
+      if(name == params.right_wheel_joint) right_index = i;
+    }
+    if(left_index < 0 || right_index < 0) return false;
+
+    sensor_log::Cursor cursor = log.read({scan_topic, joint_topic}, log.startTime(), log.endTime() + 1);
+    sensor_log::MessageView view;
+    while(cursor.next(view))
+    {
+      DecodedMessage m;
+      m.stamp = view.stamp;
+      m.scan = view.topic == scan_topic;
+
+      if(m.scan)
+      {
+        decoded.scans++;
+        m.angle_min = view.scalar(1);
+        m.angle_increment = view.scalar(3);
+        m.range_min = view.scalar(6);
+        m.range_max = view.scalar(7);
+
+        sensor_log::ArrayView ranges = view.array(0);
+        m.ranges.resize(ranges.size);
+        for(uint32_t i = 0; i < ranges.size; i++) m.ranges[i] = ranges.at(i);
+      }
+      else
+      {
+        decoded.joint_states++;
+        sensor_log::ArrayView position = view.array(0);
+        if(static_cast<int>(position.size) <= std::max(left_index, right_index)) continue;
+        m.left = position.at(left_index);
+        m.right = position.at(right_index);
+      }
+
+      decoded.messages.push_back(std::move(m));
+    }
+
+    return true;
+  }
+
+  ReplayMetrics replayLog(const sensor_log::LogReader & log, const PipelineParams & params,
+                          const FaultProfile & profile, uint32_t seed,
+                          const std::vector<TrajectoryPoint> * reference,
+                          std::vector<TrajectoryPoint> * trajectory,
+                          FilterRecord * record)
+  {
+    DecodedLog decoded;
+    if(!decodeLog(log, params, decoded)) return ReplayMetrics();
+    return replayDecoded(decoded, params, profile, seed, reference, trajectory, record);
+  }
+
+  ReplayMetrics replayDecoded(const DecodedLog & decoded, const PipelineParams & params,
+                              const FaultProfile & profile, uint32_t seed,
+                              const std::vector<TrajectoryPoint> * reference,
+                              std::vector<TrajectoryPoint> * trajectory,
+                              FilterRecord * record)
+  {
+    ReplayMetrics metrics;
+    metrics.scans = decoded.scans;
+    metrics.joint_states = decoded.joint_states;
+
+    FaultInjector link(profile, seed);
+
+    rigid2d::DiffDrive ekf_bot(rigid2d::Pose2D(0, 0, 0), params.wheel_base, params.wheel_radius);
+    ekf_slam::Slam robot(params.num_landmarks, params.q, params.r);
+    robot.setAssociationThresholds(params.deadband_min, params.deadband_max);
+    // the faults are the only random part, so a seed repeats the run
+    robot.injectNoise(false);
+    if(record)
+    {
+      record->steps.clear();
+      robot.recordSteps(&record->steps);
+    }
+
+    std::vector<TrajectoryPoint> poses;
+    std::vector<double> latencies;
+    double process_total = 0.0;
+    double nis_total = 0.0;
+    uint64_t nis_count = 0;
+
+    // the pipeline state
+    bool have_joints = false;
+    double left = 0.0, right = 0.0;
+    bool have_pending = false;
+    Message pending;
+    int64_t busy_until = std::numeric_limits<int64_t>::min();
+    int64_t last_stamp[2] = {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::min()};
+
+    // Run the detection and a filter update of a scan, once the pipeline is free
+    auto process = [&](const Message & m)
+    {
+      if(!have_joints) return;
+
+      const DecodedMessage & scan = *m.decoded;
+      int64_t start = std::max(busy_until, m.delivery.arrival);
+      auto wall_start = std::chrono::steady_clock::now();
+
+      std::vector<std::vector<rigid2d::Vector2D>> clusters =
+        cylinder::cluster_scan(scan.ranges, scan.angle_min, scan.angle_increment, scan.range_min, scan.range_max,
+                               params.distance_threshold);
+
+      nuslam::TurtleMap landmarks;
+      for(auto & cluster : clusters)
+      {
+        if(cluster.size() <= 3) continue;
+
+        std::vector<double> circle = cylinder::fit_circles(cluster);
+        if(!(circle.at(2) < params.radius_threshold)) continue;
+
+        geometry_msgs::Point center;
+        center.x = circle.at(0);
+        center.y = circle.at(1);
+        landmarks.centers.push_back(center);
+        landmarks.radii.push_back(circle.at(2));
+      }
+
+      // twist from the last update til now, as in the slam node
+      rigid2d::Twist2D tw = ekf_bot.wheelsToTwist(ekf_bot.updateOdometry(left, right));
+      robot.MotionModelUpdate(tw);
+      robot.MeasurmentModelUpdate(landmarks);
+
+      double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+      process_total += wall;
+      busy_until = start + static_cast<int64_t>((params.scan_cost > 0.0 ? params.scan_cost : wall) * 1e9);
+      latencies.push_back((busy_until - m.delivery.stamp) * 1e-9);
+      metrics.scans_processed++;
+
+      for(auto & innovation : robot.getInnovations())
+      {
+        nis_total += innovation.nis;
+        nis_count++;
+      }
+
+      std::vector<double> state = robot.getRobotState();
+      TrajectoryPoint point;
+      point.stamp = m.delivery.stamp;
+      point.pose = rigid2d::Pose2D(state.at(0), state.at(1), state.at(2));
+      poses.push_back(point);
+    };
+
+    // Hand an arrived message to the pipeline
+    auto deliver = [&](Message & m)
+    {
+      int64_t & last = last_stamp[m.decoded->scan ? 0 : 1];
+      if(m.delivery.stamp < last) metrics.reordered++;
+      else last = m.delivery.stamp;
+
+      // a queued scan starts as soon as the pipeline is free, which may be before this arrived
+      if(have_pending && busy_until <= m.delivery.arrival)
+      {
+        process(pending);
+        have_pending = false;
+      }
+
+      if(m.decoded->scan)
+      {
+        // a queue of one, the newest scan wins
+        if(have_pending) metrics.scans_superseded++;
+
+        if(busy_until <= m.delivery.arrival)
+        {
+          process(m);
+        }
+        else
+        {
+          pending = m;
+          have_pending = true;
+        }
+      }
+      else
+      {
+        left = m.left;
+        right = m.right;
+        have_joints = true;
+      }
+    };
+
+    std::vector<Message> in_flight;
+    bool have_sent = false;
+    double sent_left = 0.0, sent_right = 0.0;
+    uint64_t index = 0;
+
+    for(auto & logged : decoded.messages)
+    {
+      // nothing is delivered before it is sent, so every arrival up to now is final
+      while(!in_flight.empty() && in_flight.front().delivery.arrival <= logged.stamp)
+      {
+        std::pop_heap(in_flight.begin(), in_flight.end(), arrivesLater);
+        deliver(in_flight.back());
+        in_flight.pop_back();
+      }
+
+      Message m;
+      m.index = index++;
+      m.decoded = &logged;
+      m.left = logged.left;
+      m.right = logged.right;
+
+      m.delivery = link.send(logged.stamp, logged.scan, !logged.scan);
+      if(link.inSpike()) metrics.spikes++;
+
+      switch(m.delivery.fault)
+      {
+        case Fault::Dropped:
+          metrics.scans_dropped++;
+          continue;
+        case Fault::Glitch:
+          metrics.glitches++;
+          (m.delivery.wheel == 0 ? m.left : m.right) += m.delivery.jump;
+          break;
+        case Fault::Stuck:
+          metrics.stuck++;
+          if(have_sent)
+          {
+            m.left = sent_left;
+            m.right = sent_right;
+          }
+          break;
+        default:
+          break;
+      }
+
+      if(!logged.scan)
+      {
+        sent_left = m.left;
+        sent_right = m.right;
+        have_sent = true;
+      }
+
+      in_flight.push_back(m);
+      std::push_heap(in_flight.begin(), in_flight.end(), arrivesLater);
+    }
+
+    // the link empties after the end of the log
+    while(!in_flight.empty())
+    {
+      std::pop_heap(in_flight.begin(), in_flight.end(), arrivesLater);
+      deliver(in_flight.back());
+      in_flight.pop_back();
+    }
+    if(have_pending) process(pending);
+
+    if(!latencies.empty())
+    {
+      double sum = 0.0;
+      for(double l : latencies) sum += l;
+      metrics.latency_mean = sum / latencies.size();
+
+      std::sort(latencies.begin(), latencies.end());
+      metrics.latency_p50 = percentile(latencies, 0.5);
+      metrics.latency_p99 = percentile(latencies, 0.99);
+      metrics.latency_max = latencies.back();
+
+      metrics.process_mean = process_total / latencies.size();
+      if(process_total > 0.0) metrics.throughput = latencies.size() / process_total;
+    }
+    if(nis_count > 0) metrics.nis_mean = nis_total / nis_count;
+
+    if(reference) compareTrajectories(*reference, poses, metrics);
+    if(trajectory) *trajectory = std::move(poses);
+    if(record) record->state = robot.getStateVector();
+
+    return metrics;
+  }
+
+  void compareTrajectories(const std::vector<TrajectoryPoint> & reference,
+                           const std::vector<TrajectoryPoint> & trajectory, ReplayMetrics & metrics)
+  {
+    metrics.compared = 0;
+    metrics.position_rmse = 0.0;
+    metrics.position_max = 0.0;
+    metrics.heading_rmse = 0.0;
+
+    double position_sq = 0.0, heading_sq = 0.0;
+    for(auto & point : trajectory)
+    {
+      auto after = std::upper_bound(reference.begin(), reference.end(), point.stamp,
+                                    [](int64_t stamp, const TrajectoryPoint & p) { return stamp < p.stamp; });
+      if(after == reference.begin()) continue;
+      const rigid2d::Pose2D & ref = std::prev(after)->pose;
+
+      double error = std::hypot(point.pose.x - ref.x, point.pose.y - ref.y);
+      double heading = rigid2d::normalize_angle(point.pose.th - ref.th);
+
+      position_sq += error * error;
+      heading_sq += heading * heading;
+      metrics.position_max = std::max(metrics.position_max, error);
+      metrics.compared++;
+    }
+
+    if(metrics.compared > 0)
+    {
+      metrics.position_rmse = std::sqrt(position_sq / metrics.compared);
+      metrics.heading_rmse = std::sqrt(heading_sq / metrics.compared);
+    }
+  }
+
+}
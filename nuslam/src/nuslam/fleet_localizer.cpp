@@ -0,0 +1,359 @@
+/// \file
+/// \brief Source file for batched EKF localization of a fleet
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "nuslam/fleet_localizer.hpp"
+#include "nuslam/executor.hpp"
+
+namespace ekf_slam
+{
+
+  // P = G P G^T + Q for a batch of lanes, with G = I plus (0, a, b) in the first column. Branch free so it runs as SIMD.
+  static void predictKernel(const double * __restrict a, const double * __restrict b, int count,
+                            double q00, double q01, double q02, double q11, double q12, double q22,
+                            double * __restrict p00, double * __restrict p01, double * __restrict p02,
+                            double * __restrict p11, double * __restrict p12, double * __restrict p22)
+  {
+    for(int i = 0; i < count; i++)
+    {
+      // rows 1 and 2 of G P
+      double a10 = a[i] * p00[i] + p01[i], a11 = a[i] * p01[i] + p11[i], a12 = a[i] * p02[i] + p12[i];
+      double a20 = b[i] * p00[i] + p02[i], a22 = b[i] * p02[i] + p22[i];
+
+      double n01 = p00[i] * a[i] + p01[i];
+      double n02 = p00[i] * b[i] + p02[i];
+      double n11 = a10 * a[i] + a11;
+      double n12 = a10 * b[i] + a12;
+      double n22 = a20 * b[i] + a22;
+
+      p00[i] += q00;
+      p01[i] = n01 + q01;
+      p02[i] = n02 + q02;
+      p11[i] = n11 + q11;
+      p12[i] = n12 + q12;
+      p22[i] = n22 + q22;
+    }
+  }
+
+  // One range bearing update for a batch of lanes, with H = [[0, a, b], [-1, c, d]]. Branch free so it runs
+  // as SIMD, a lane past the gate gets a zero gain.
+  static void updateKernel(const double * __restrict a, const double * __restrict b, const double * __restrict c,
+                           const double * __restrict d, const double * __restrict v0, const double * __restrict v1,
+                           int count, double r00, double r01, double r11, double gate,
+                           double * __restrict p00, double * __restrict p01, double * __restrict p02,
+                           double * __restrict p11, double * __restrict p12, double * __restrict p22,
+                           double * __restrict dth, double * __restrict dx, double * __restrict dy,
+                           double * __restrict nis)
+  {
+    for(int i = 0; i < count; i++)
+    {
+      // P H^T, one column per measurement row
+      double u0 = p01[i] * a[i] + p02[i] * b[i];
+      double u1 = p11[i] * a[i] + p12[i] * b[i];
+      double u2 = p12[i] * a[i] + p22[i] * b[i];
+      double w0 = -p00[i] + p01[i] * c[i] + p02[i] * d[i];
+      double w1 = -p01[i] + p11[i] * c[i] + p12[i] * d[i];
+      double w2 = -p02[i] + p12[i] * c[i] + p22[i] * d[i];
+
+      // S = H P H^T + R, and its inverse
+      double s00 = a[i] * u1 + b[i] * u2 + r00;
+      double s01 = a[i] * w1 + b[i] * w2 + r01;
+      double s11 = -w0 + c[i] * w1 + d[i] * w2 + r11;
+      double inv_det = 1.0 / (s00 * s11 - s01 * s01);
+      double i00 = s11 * inv_det, i01 = -s01 * inv_det, i11 = s00 * inv_det;
+
+      double n = v0[i] * v0[i] * i00 + 2.0 * v0[i] * v1[i] * i01 + v1[i] * v1[i] * i11;
+      double keep = n < gate ? 1.0 : 0.0;
+      nis[i] = n;
+
+      // K = P H^T S^-1
+      double k00 = (u0 * i00 + w0 * i01) * keep, k01 = (u0 * i01 + w0 * i11) * keep;
+      double k10 = (u1 * i00 + w1 * i01) * keep, k11 = (u1 * i01 + w1 * i11) * keep;
+      double k20 = (u2 * i00 + w2 * i01) * keep, k21 = (u2 * i01 + w2 * i11) * keep;
+
+      dth[i] = k00 * v0[i] + k01 * v1[i];
+      dx[i] = k10 * v0[i] + k11 * v1[i];
+      dy[i] = k20 * v0[i] + k21 * v1[i];
+
+      // P = P - K H P, where H P is the transpose of P H^T
+      p00[i] -= k00 * u0 + k01 * w0;
+      p01[i] -= k00 * u1 + k01 * w1;
+      p02[i] -= k00 * u2 + k01 * w2;
+      p11[i] -= k10 * u1 + k11 * w1;
+      p12[i] -= k10 * u2 + k11 * w2;
+      p22[i] -= k20 * u2 + k21 * w2;
+    }
+  }
+
+  /////////////// FleetLocalizer CLASS ////////////////////
+  FleetLocalizer::FleetLocalizer(const std::vector<rigid2d::Vector2D> & map, const LocalizerParams & params)
+    : params(params), landmarks(map)
+  {
+  }
+
+  int FleetLocalizer::addRobot(const rigid2d::Pose2D & pose, double variance)
+  {
+    th.push_back(pose.th);
+    x.push_back(pose.x);
+    y.push_back(pose.y);
+
+    p00.push_back(variance);
+    p01.push_back(0.0);
+    p02.push_back(0.0);
+    p11.push_back(variance);
+    p12.push_back(0.0);
+    p22.push_back(variance);
+
+    twists.emplace_back(0.0, 0.0, 0.0);
+    measured.emplace_back();
+    matches.emplace_back();
+    queued.push_back(0);
+    updates.push_back(0);
+    nis_sum.push_back(0.0);
+
+    return th.size() - 1;
+  }
+
+  void FleetLocalizer::queue(int robot, const rigid2d::Twist2D & tw, const nuslam::TurtleMap & map_data)
+  {
+    rigid2d::Twist2D & sum = twists.at(robot);
+    sum.wz += tw.wz;
+    sum.vx += tw.vx;
+    sum.vy += tw.vy;
+
+    std::vector<Eigen::Vector2d> & z = measured.at(robot);
+    z.clear();
+    for(auto & center : map_data.centers) z.emplace_back(std::hypot(center.x, center.y), std::atan2(center.y, center.x));
+
+    queued.at(robot) = 1;
+  }
+
+  unsigned int FleetLocalizer::update()
+  {
+    active.clear();
+    for(unsigned int r = 0; r < queued.size(); r++)
+    {
+      if(queued.at(r)) active.push_back(r);
+      queued.at(r) = 0;
+    }
+    if(active.empty()) return 0;
+
+    executor::Executor & exec = executor::Executor::instance();
+    const std::size_t grain = std::max(1u, params.grain);
+
+    batch.resize(active.size());
+    for(std::size_t k = 0; k < active.size(); k++) batch.robot.at(k) = active.at(k);
+    exec.parallelFor(0, active.size(), grain, [this](std::size_t first, std::size_t last) { predictLanes(first, last); });
+
+    // each round applies one landmark of every robot that has one left, so a robot is in a round at most once
+    std::size_t rounds = 0;
+    for(int r : active) rounds = std::max(rounds, matches.at(r).size());
+
+    for(std::size_t round = 0; round < rounds; round++)
+    {
+      std::size_t lanes = 0;
+      for(int r : active) lanes += matches.at(r).size() > round;
+
+      batch.resize(lanes);
+      std::size_t k = 0;
+      for(int r : active)
+      {
+        if(matches.at(r).size() > round) batch.robot.at(k++) = r;
+      }
+
+      exec.parallelFor(0, lanes, grain, [this, round](std::size_t first, std::size_t last) { updateLanes(round, first, last); });
+    }
+
+    return active.size();
+  }
+
+  void FleetLocalizer::predictLanes(std::size_t first, std::size_t last)
+  {
+    // gather, with the same arc motion model as Slam::MotionModelUpdate
+    for(std::size_t k = first; k < last; k++)
+    {
+      int r = batch.robot[k];
+      const rigid2d::Twist2D & tw = twists[r];
+      double t = th[r];
+
+      if(rigid2d::almost_equal(tw.wz, 0.0, 1e-5))
+      {
+        batch.dth[k] = 0;
+        batch.dx[k] = tw.vx * std::cos(t);
+        batch.dy[k] = tw.vx * std::sin(t);
+        batch.a[k] = -tw.vx * std::sin(t);
+        batch.b[k] = tw.vx * std::cos(t);
+      }
+      else
+      {
+        double vel_ratio = tw.vx / tw.wz;
+        batch.dth[k] = tw.wz;
+        batch.dx[k] = -vel_ratio * std::sin(t) + vel_ratio * std::sin(t + tw.wz);
+        batch.dy[k] = vel_ratio * std::cos(t) - vel_ratio * std::cos(t + tw.wz);
+        batch.a[k] = -vel_ratio * std::cos(t) + vel_ratio * std::cos(t + tw.wz);
+        batch.b[k] = -vel_ratio * std::sin(t) + vel_ratio * std::sin(t + tw.wz);
+      }
+
+      batch.p00[k] = p00[r];
+      batch.p01[k] = p01[r];
+      batch.p02[k] = p02[r];
+      batch.p11[k] = p11[r];
+      batch.p12[k] = p12[r];
+      batch.p22[k] = p22[r];
+    }
+
+    const Eigen::Matrix3d & q = params.q;
+    predictKernel(&batch.a[first], &batch.b[first], last - first, q(0, 0), q(0, 1), q(0, 2), q(1, 1), q(1, 2), q(2, 2),
+                  &batch.p00[first], &batch.p01[first], &batch.p02[first],
+                  &batch.p11[first], &batch.p12[first], &batch.p22[first]);
+
+    // scatter, then match the landmarks from the predicted pose
+    for(std::size_t k = first; k < last; k++)
+    {
+      int r = batch.robot[k];
+      th[r] = rigid2d::normalize_angle(th[r] + batch.dth[k]);
+      x[r] += batch.dx[k];
+      y[r] += batch.dy[k];
+
+      p00[r] = batch.p00[k];
+      p01[r] = batch.p01[k];
+      p02[r] = batch.p02[k];
+      p11[r] = batch.p11[k];
+      p12[r] = batch.p12[k];
+      p22[r] = batch.p22[k];
+
+      twists[r] = rigid2d::Twist2D(0.0, 0.0, 0.0);
+      updates[r] = 0;
+      nis_sum[r] = 0.0;
+
+      std::vector<Eigen::Vector2d> & z = measured[r];
+      std::vector<int> & m = matches[r];
+      m.clear();
+
+      std::size_t kept = 0;
+      for(auto & zi : z)
+      {
+        int l = nearest(x[r] + zi(0) * std::cos(zi(1) + th[r]), y[r] + zi(0) * std::sin(zi(1) + th[r]));
+        if(l < 0) continue;
+
+        z[kept++] = zi;
+        m.push_back(l);
+      }
+      z.resize(kept);
+    }
+  }
+
+  void FleetLocalizer::updateLanes(std::size_t round, std::size_t first, std::size_t last)
+  {
+    // gather, with the same range bearing model as Slam::sensorModel and Slam::getHMatrix
+    for(std::size_t k = first; k < last; k++)
+    {
+      int r = batch.robot[k];
+      const rigid2d::Vector2D & l = landmarks[matches[r][round]];
+      const Eigen::Vector2d & z = measured[r][round];
+
+      double del_x = l.x - x[r];
+      double del_y = l.y - y[r];
+      double d = del_x * del_x + del_y * del_y;
+      double sqd = std::sqrt(d);
+
+      batch.a[k] = -del_x / sqd;
+      batch.b[k] = -del_y / sqd;
+      batch.c[k] = del_y / d;
+      batch.d[k] = -del_x / d;
+
+      batch.v0[k] = z(0) - sqd;
+      batch.v1[k] = rigid2d::normalize_angle(z(1) - rigid2d::normalize_angle(std::atan2(del_y, del_x) - th[r]));
+
+      batch.p00[k] = p00[r];
+      batch.p01[k] = p01[r];
+      batch.p02[k] = p02[r];
+      batch.p11[k] = p11[r];
+      batch.p12[k] = p12[r];
+      batch.p22[k] = p22[r];
+    }
+
+    const Eigen::Matrix2d & rn = params.r;
+    updateKernel(&batch.a[first], &batch.b[first], &batch.c[first], &batch.d[first], &batch.v0[first], &batch.v1[first],
+                 last - first, rn(0, 0), rn(0, 1), rn(1, 1), params.nis_gate,
+                 &batch.p00[first], &batch.p01[first], &batch.p02[first],
+                 &batch.p11[first], &batch.p12[first], &batch.p22[first],
+                 &batch.dth[first], &batch.dx[first], &batch.dy[first], &batch.nis[first]);
+
+    for(std::size_t k = first; k < last; k++)
+    {
+      int r = batch.robot[k];
+      th[r] = rigid2d::normalize_angle(th[r] + batch.dth[k]);
+      x[r] += batch.dx[k];
+      y[r] += batch.dy[k];
+
+      p00[r] = batch.p00[k];
+      p01[r] = batch.p01[k];
+      p02[r] = batch.p02[k];
+      p11[r] = batch.p11[k];
+      p12[r] = batch.p12[k];
+      p22[r] = batch.p22[k];
+
+      if(batch.nis[k] < params.nis_gate)
+      {
+        updates[r]++;
+        nis_sum[r] += batch.nis[k];
+      }
+    }
+  }
+
+  int FleetLocalizer::nearest(double px, double py) const
+  {
+    int best = -1;
+    double best_dist = params.match_distance * params.match_distance;
+    for(unsigned int l = 0; l < landmarks.size(); l++)
+    {
+      double dist = (landmarks[l].x - px) * (landmarks[l].x - px) + (landmarks[l].y - py) * (landmarks[l].y - py);
+      if(dist < best_dist)
+      {
+        best_dist = dist;
+        best = l;
+      }
+    }
+    return best;
+  }
+
+  unsigned int FleetLocalizer::size() const
+  {
+    return th.size();
+  }
+
+  rigid2d::Pose2D FleetLocalizer::pose(int robot) const
+  {
+    return rigid2d::Pose2D(th.at(robot), x.at(robot), y.at(robot));
+  }
+
+  Eigen::Matrix3d FleetLocalizer::covariance(int robot) const
+  {
+    Eigen::Matrix3d P;
+    P << p00.at(robot), p01.at(robot), p02.at(robot),
+         p01.at(robot), p11.at(robot), p12.at(robot),
+         p02.at(robot), p12.at(robot), p22.at(robot);
+    return P;
+  }
+
+  unsigned int FleetLocalizer::matched(int robot) const
+  {
+    return updates.at(robot);
+  }
+
+  double FleetLocalizer::meanNis(int robot) const
+  {
+    return updates.at(robot) > 0 ? nis_sum.at(robot) / updates.at(robot) : 0.0;
+  }
+
+  void FleetLocalizer::Batch::resize(std::size_t lanes)
+  {
+    for(auto * v : {&a, &b, &c, &d, &v0, &v1, &p00, &p01, &p02, &p11, &p12, &p22, &dth, &dx, &dy, &nis}) v->resize(lanes);
+    robot.resize(lanes);
+  }
+
+}
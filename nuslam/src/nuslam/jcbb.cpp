@@ -0,0 +1,193 @@
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "nuslam/jcbb.hpp"
+
+namespace ekf_slam
+{
+
+  double chi2inv(int dof, double z)
+  {
+    double k = static_cast<double>(dof);
+    double a = 2.0 / (9.0 * k);
+    return k * std::pow(1.0 - a + z * std::sqrt(a), 3);
+  }
+
+  JCBB::JCBB(double individual_gate, double time_budget)
+  {
+    this->individual_gate = individual_gate;
+    this->time_budget = time_budget;
+    Rnoise.setZero();
+  }
+
+  std::vector<int> JCBB::associate(const std::vector<std::vector<Pairing>> & candidates, const Eigen::MatrixXd & sigma, const Eigen::Matrix2d & R)
+  {
+    int num_obs = candidates.size();
+
+    cands = &candidates;
+    sig = &sigma;
+    Rnoise = R;
+
+    deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget));
+    timed_out = false;
+    nodes = 0;
+
+    // Try the least ambiguous observations first so the first hypotheses are good ones
+    order.resize(num_obs);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return candidates.at(a).size() < candidates.at(b).size(); });
+
+    // Scale the chi-square bounds so a single pairing uses the individual gate
+    double scale = individual_gate / chi2inv(2, 2.326);
+    joint_gates.resize(num_obs + 1);
+    for(int k = 1; k <= num_obs; k++) joint_gates.at(k) = scale * chi2inv(2*k, 2.326);
+
+    int num_landmarks = 0;
+    for(auto & cand : candidates)
+    {
+      for(auto & p : cand) num_landmarks = std::max(num_landmarks, p.landmark + 1);
+    }
+
+    hypothesis.assign(num_obs, -1);
+    best.assign(num_obs, -1);
+    best_paired = 0;
+    paired.clear();
+    landmark_used.assign(num_landmarks, false);
+
+    if(L.rows() < 2*num_obs)
+    {
+      L.resize(2*num_obs, 2*num_obs);
+      y.resize(2*num_obs);
+    }
+    joint_dist.assign(num_obs + 1, 0.0);
+
+    search(0, 0);
+
+    std::vector<int> output(num_obs, -1);
+    for(int i = 0; i < num_obs; i++)
+    {
+      if(best.at(i) >= 0) output.at(i) = candidates.at(i).at(best.at(i)).landmark;
+    }
+
+    return output;
+  }
+
+  void JCBB::search(unsigned int depth, int num_paired)
+  {
+    nodes++;
+
+    if(timed_out || std::chrono::steady_clock::now() > deadline)
+    {
+      timed_out = true;
+      return;
+    }
+
+    if(depth == order.size())
+    {
+      if(num_paired > best_paired)
+      {
+        best = hypothesis;
+        best_paired = num_paired;
+      }
+      return;
+    }
+
+    int obs = order.at(depth);
+    const std::vector<Pairing> & cand = cands->at(obs);
+
+    // Expand the most likely pairings first
+    std::vector<int> expand(cand.size());
+    std::iota(expand.begin(), expand.end(), 0);
+    std::sort(expand.begin(), expand.end(), [&](int a, int b) { return cand.at(a).distance < cand.at(b).distance; });
+
+    for(int c : expand)
+    {
+      const Pairing & p = cand.at(c);
+      if(landmark_used.at(p.landmark)) continue;
+
+      double dist = extend(p, num_paired);
+      if(dist < 0 || dist > joint_gates.at(num_paired + 1)) continue;
+
+      joint_dist.at(num_paired + 1) = dist;
+      paired.push_back(&p);
+      landmark_used.at(p.landmark) = true;
+      hypothesis.at(obs) = c;
+
+      search(depth + 1, num_paired + 1);
+
+      hypothesis.at(obs) = -1;
+      landmark_used.at(p.landmark) = false;
+      paired.pop_back();
+
+      if(timed_out) return;
+    }
+
+    // Leave this observation unpaired if the bound says it could still win
+    if(num_paired + static_cast<int>(order.size() - depth - 1) > best_paired)
+    {
+      search(depth + 1, num_paired);
+    }
+  }
+
+  double JCBB::extend(const Pairing & p, int k)
+  {
+    int n = 2*k;
+
+    // Innovation covarience of the new pairing with itself
+    Eigen::Matrix2d C = crossCovariance(p, p) + Rnoise;
+
+    // Covarience of the existing pairings with the new one, then solve for the new rows of L
+    Eigen::Matrix2d L22;
+    if(k > 0)
+    {
+      Eigen::MatrixXd B(n, 2);
+      for(int i = 0; i < k; i++) B.middleRows<2>(2*i) = crossCovariance(*paired.at(i), p);
+
+      Eigen::MatrixXd L21t = L.topLeftCorner(n, n).triangularView<Eigen::Lower>().solve(B);
+      L.block(n, 0, 2, n) = L21t.transpose();
+      C -= L21t.transpose() * L21t;
+    }
+
+    Eigen::LLT<Eigen::Matrix2d> llt(C);
+    if(llt.info() != Eigen::Success) return -1;
+
+    L22 = llt.matrixL();
+    L.block<2, 2>(n, n) = L22;
+
+    // extend y = L^-1 * innovation
+    Eigen::Vector2d rhs = p.innovation;
+    if(k > 0) rhs -= L.block(n, 0, 2, n) * y.head(n);
+
+    Eigen::Vector2d y2 = L22.triangularView<Eigen::Lower>().solve(rhs);
+    y.segment<2>(n) = y2;
+
+    return joint_dist.at(k) + y2.squaredNorm();
+  }
+
+  Eigen::Matrix2d JCBB::crossCovariance(const Pairing & a, const Pairing & b) const
+  {
+    int ia = 3 + 2*a.landmark;
+    int ib = 3 + 2*b.landmark;
+
+    const Eigen::MatrixXd & S = *sig;
+
+    return a.Hr * S.topLeftCorner<3, 3>() * b.Hr.transpose()
+         + a.Hr * S.block<3, 2>(0, ib) * b.Hl.transpose()
+         + a.Hl * S.block<2, 3>(ia, 0) * b.Hr.transpose()
+         + a.Hl * S.block<2, 2>(ia, ib) * b.Hl.transpose();
+  }
+
+  bool JCBB::timedOut() const
+  {
+    return timed_out;
+  }
+
+  int JCBB::nodesVisited() const
+  {
+    return nodes;
+  }
+}
@@ -0,0 +1,188 @@
+/// \file
+/// \brief Source file for the sensor log message conversions
+#include <sstream>
+
+#include "nuslam/log_messages.hpp"
+
+namespace sensor_log
+{
+
+  namespace
+  {
+    /// \brief Copy an array field into a vector
+    template<class T>
+    void copyArray(const ArrayView & view, std::vector<T> & out)
+    {
+      out.resize(view.size);
+      for(uint32_t i = 0; i < view.size; i++) out[i] = view.at(i);
+    }
+  }
+
+  /////////////// sensor_msgs/LaserScan ////////////////////
+  TopicSchema makeSchema(const std::string & topic, const sensor_msgs::LaserScan & msg)
+  {
+    TopicSchema s;
+    s.name = topic;
+    s.type = "sensor_msgs/LaserScan";
+    s.meta = msg.header.frame_id;
+    s.scalars = {"stamp", "angle_min", "angle_max", "angle_increment", "time_increment", "scan_time", "range_min", "range_max"};
+    s.arrays = {"ranges", "intensities"};
+    s.array_types = {ElementType::Float32, ElementType::Float32};
+    return s;
+  }
+
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const sensor_msgs::LaserScan & msg)
+  {
+    return log.write(topic, stamp_ns,
+                     {msg.header.stamp.toSec(), msg.angle_min, msg.angle_max, msg.angle_increment, msg.time_increment,
+                      msg.scan_time, msg.range_min, msg.range_max},
+                     {std::vector<double>(msg.ranges.begin(), msg.ranges.end()),
+                      std::vector<double>(msg.intensities.begin(), msg.intensities.end())});
+  }
+
+  void readMessage(const MessageView & view, const TopicSchema & schema, sensor_msgs::LaserScan & msg)
+  {
+    msg.header.stamp.fromSec(view.scalar(0));
+    msg.header.frame_id = schema.meta;
+    msg.angle_min = view.scalar(1);
+    msg.angle_max = view.scalar(2);
+    msg.angle_increment = view.scalar(3);
+    msg.time_increment = view.scalar(4);
+    msg.scan_time = view.scalar(5);
+    msg.range_min = view.scalar(6);
+    msg.range_max = view.scalar(7);
+
+    // the ranges are stored as floats, so they come back without a conversion
+    ArrayView ranges = view.array(0);
+    const float * r = static_cast<const float *>(ranges.data);
+    msg.ranges.assign(r, r + ranges.size);
+    copyArray(view.array(1), msg.intensities);
+  }
+
+  /////////////// sensor_msgs/JointState ///////////////////
+  TopicSchema makeSchema(const std::string & topic, const sensor_msgs::JointState & msg)
+  {
+    TopicSchema s;
+    s.name = topic;
+    s.type = "sensor_msgs/JointState";
+
+    std::ostringstream names;
+    for(unsigned int i = 0; i < msg.name.size(); i++) names << (i ? "," : "") << msg.name.at(i);
+    s.meta = names.str();
+
+    s.scalars = {"stamp"};
+    s.arrays = {"position", "velocity", "effort"};
+    s.array_types = {ElementType::Float64, ElementType::Float64, ElementType::Float64};
+    return s;
+  }
+
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const sensor_msgs::JointState & msg)
+  {
+    return log.write(topic, stamp_ns, {msg.header.stamp.toSec()}, {msg.position, msg.velocity, msg.effort});
+  }
+
+  void readMessage(const MessageView & view, const TopicSchema & schema, sensor_msgs::JointState & msg)
+  {
+    msg.header.stamp.fromSec(view.scalar(0));
+
+    msg.name.clear();
+    std::istringstream names(schema.meta);
+    std::string name;
+    while(std::getline(names, name, ',')) msg.name.push_back(name);
+
+    copyArray(view.array(0), msg.position);
+    copyArray(view.array(1), msg.velocity);
+    copyArray(view.array(2), msg.effort);
+  }
+
+  /////////////// nuslam/TurtleMap /////////////////////////
+  TopicSchema makeSchema(const std::string & topic, const nuslam::TurtleMap & msg)
+  {
+    TopicSchema s;
+    s.name = topic;
+    s.type = "nuslam/TurtleMap";
+    s.meta = msg.header.frame_id;
+    s.scalars = {"stamp"};
+    s.arrays = {"x", "y", "radii", "ids"};
+    s.array_types = {ElementType::Float64, ElementType::Float64, ElementType::Float64, ElementType::Int32};
+    return s;
+  }
+
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const nuslam::TurtleMap & msg)
+  {
+    std::vector<double> xs, ys;
+    for(auto & c : msg.centers)
+    {
+      xs.push_back(c.x);
+      ys.push_back(c.y);
+    }
+    std::vector<double> ids(msg.ids.begin(), msg.ids.end());
+    return log.write(topic, stamp_ns, {msg.header.stamp.toSec()}, {xs, ys, msg.radii, ids});
+  }
+
+  void readMessage(const MessageView & view, const TopicSchema & schema, nuslam::TurtleMap & msg)
+  {
+    msg.header.stamp.fromSec(view.scalar(0));
+    msg.header.frame_id = schema.meta;
+
+    ArrayView xs = view.array(0), ys = view.array(1);
+    msg.centers.resize(xs.size);
+    for(uint32_t i = 0; i < xs.size; i++)
+    {
+      msg.centers.at(i).x = xs.at(i);
+      msg.centers.at(i).y = ys.at(i);
+      msg.centers.at(i).z = 0;
+    }
+    copyArray(view.array(2), msg.radii);
+
+    // logs written before the maps had ids have no ids column
+    if(schema.arrays.size() > 3) copyArray(view.array(3), msg.ids);
+    else msg.ids.clear();
+  }
+
+  /////////////// geometry_msgs/Twist //////////////////////
+  TopicSchema makeSchema(const std::string & topic, const geometry_msgs::Twist &)
+  {
+    TopicSchema s;
+    s.name = topic;
+    s.type = "geometry_msgs/Twist";
+    s.scalars = {"linear_x", "linear_y", "linear_z", "angular_x", "angular_y", "angular_z"};
+    return s;
+  }
+
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const geometry_msgs::Twist & msg)
+  {
+    return log.write(topic, stamp_ns, {msg.linear.x, msg.linear.y, msg.linear.z, msg.angular.x, msg.angular.y, msg.angular.z});
+  }
+
+  void readMessage(const MessageView & view, const TopicSchema &, geometry_msgs::Twist & msg)
+  {
+    msg.linear.x = view.scalar(0);
+    msg.linear.y = view.scalar(1);
+    msg.linear.z = view.scalar(2);
+    msg.angular.x = view.scalar(3);
+    msg.angular.y = view.scalar(4);
+    msg.angular.z = view.scalar(5);
+  }
+
+  /////////////// nuturtlebot/SensorData ///////////////////
+  TopicSchema makeSchema(const std::string & topic, const nuturtlebot::SensorData &)
+  {
+    TopicSchema s;
+    s.name = topic;
+    s.type = "nuturtlebot/SensorData";
+    s.scalars = {"left_encoder", "right_encoder"};
+    return s;
+  }
+
+  bool writeMessage(LogWriter & log, int topic, int64_t stamp_ns, const nuturtlebot::SensorData & msg)
+  {
+    return log.write(topic, stamp_ns, {static_cast<double>(msg.left_encoder), static_cast<double>(msg.right_encoder)});
+  }
+
+  void readMessage(const MessageView & view, const TopicSchema &, nuturtlebot::SensorData & msg)
+  {
+    msg.left_encoder = view.scalar(0);
+    msg.right_encoder = view.scalar(1);
+  }
+}
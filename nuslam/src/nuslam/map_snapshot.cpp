@@ -0,0 +1,195 @@
+/// \file
+/// \brief Source file for the versioned map snapshots
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "nuslam/map_snapshot.hpp"
+
+namespace ekf_slam
+{
+
+  /// \brief Check if a landmark is unchanged between versions
+  static bool sameEntry(const LandmarkEntry & a, const LandmarkEntry & b, double threshold)
+  {
+    return a.id == b.id &&
+           std::fabs(a.x - b.x) <= threshold && std::fabs(a.y - b.y) <= threshold &&
+           std::fabs(a.cov_xx - b.cov_xx) <= threshold && std::fabs(a.cov_xy - b.cov_xy) <= threshold &&
+           std::fabs(a.cov_yy - b.cov_yy) <= threshold;
+  }
+
+  /////////////// MapSnapshot CLASS ////////////////////////
+  uint64_t MapSnapshot::version() const
+  {
+    return ver;
+  }
+
+  const rigid2d::Pose2D & MapSnapshot::robot() const
+  {
+    return pose;
+  }
+
+  int MapSnapshot::size() const
+  {
+    return count;
+  }
+
+  const LandmarkEntry & MapSnapshot::landmark(int i) const
+  {
+    if(i < 0 || i >= count) throw std::out_of_range("MapSnapshot::landmark index out of range");
+    return blocks[i / snapshot_block_size]->entries[i % snapshot_block_size];
+  }
+
+  int MapSnapshot::numBlocks() const
+  {
+    return blocks.size();
+  }
+
+  bool MapSnapshot::sharesBlock(const MapSnapshot & other, int block) const
+  {
+    if(block < 0 || block >= numBlocks() || block >= other.numBlocks()) return false;
+    return blocks[block] == other.blocks[block];
+  }
+
+  /////////////// ReadGuard CLASS //////////////////////////
+  SnapshotStore::ReadGuard::ReadGuard(std::atomic<uint64_t> & slot, const MapSnapshot * snap) : slot(slot), snap(snap)
+  {
+  }
+
+  SnapshotStore::ReadGuard::~ReadGuard()
+  {
+    slot.store(0);
+  }
+
+  const MapSnapshot * SnapshotStore::ReadGuard::operator->() const
+  {
+    return snap;
+  }
+
+  const MapSnapshot & SnapshotStore::ReadGuard::operator*() const
+  {
+    return *snap;
+  }
+
+  /////////////// Reader CLASS /////////////////////////////
+  SnapshotStore::Reader::Reader(SnapshotStore * store, int slot) : store(store), slot(slot)
+  {
+  }
+
+  SnapshotStore::Reader::Reader(Reader && other) : store(other.store), slot(other.slot)
+  {
+    other.store = nullptr;
+  }
+
+  SnapshotStore::Reader::~Reader()
+  {
+    if(store) store->slots[slot].claimed.store(false);
+  }
+
+  SnapshotStore::ReadGuard SnapshotStore::Reader::read()
+  {
+    Slot & s = store->slots[slot];
+
+    // Announce the epoch before loading the snapshot. The writer bumps the epoch after
+    // swapping the snapshot, so anything retired later than this epoch can not be the one loaded.
+    s.epoch.store(store->epoch.load());
+    return ReadGuard(s.epoch, store->current.load());
+  }
+
+  /////////////// SnapshotStore CLASS //////////////////////
+  SnapshotStore::SnapshotStore(int max_readers) : current(new MapSnapshot)
+  {
+    this->max_readers = std::max(max_readers, 1);
+    slots.reset(new Slot[this->max_readers]);
+  }
+
+  SnapshotStore::~SnapshotStore()
+  {
+    delete current.load();
+    for(auto & r : retired) delete r.snap;
+  }
+
+  SnapshotStore::Reader SnapshotStore::reader()
+  {
+    for(int i = 0; i < max_readers; i++)
+    {
+      bool expected = false;
+      if(slots[i].claimed.compare_exchange_strong(expected, true)) return Reader(this, i);
+    }
+
+    throw std::runtime_error("SnapshotStore has no free reader slots");
+  }
+
+  void SnapshotStore::publish(const std::vector<LandmarkEntry> & landmarks, const rigid2d::Pose2D & robot, double change_threshold)
+  {
+    const MapSnapshot * last = current.load();
+
+    MapSnapshot * snap = new MapSnapshot;
+    snap->ver = last->ver + 1;
+    snap->pose = robot;
+    snap->count = landmarks.size();
+
+    int num_blocks = (snap->count + snapshot_block_size - 1) / snapshot_block_size;
+    snap->blocks.reserve(num_blocks);
+
+    for(int b = 0; b < num_blocks; b++)
+    {
+      int first = b * snapshot_block_size;
+      int n = std::min(snapshot_block_size, snap->count - first);
+
+      // share the last version's block when none of its landmarks changed
+      if(b < last->numBlocks() && last->blocks[b]->count == n)
+      {
+        const SnapshotBlock & old = *last->blocks[b];
+
+        bool same = true;
+        for(int k = 0; k < n && same; k++) same = sameEntry(old.entries[k], landmarks[first + k], change_threshold);
+
+        if(same)
+        {
+          snap->blocks.push_back(last->blocks[b]);
+          continue;
+        }
+      }
+
+      auto block = std::make_shared<SnapshotBlock>();
+      std::copy(landmarks.begin() + first, landmarks.begin() + first + n, block->entries.begin());
+      block->count = n;
+      snap->blocks.push_back(block);
+    }
+
+    current.store(snap);
+
+    // readers that announce this new epoch or later can only see the new snapshot
+    uint64_t e = epoch.fetch_add(1) + 1;
+    retired.push_back(Retired{last, e});
+
+    reclaim();
+  }
+
+  void SnapshotStore::reclaim()
+  {
+    if(retired.empty()) return;
+
+    // the oldest epoch any reader is still reading in
+    uint64_t oldest = UINT64_MAX;
+    for(int i = 0; i < max_readers; i++)
+    {
+      uint64_t e = slots[i].epoch.load();
+      if(e != 0) oldest = std::min(oldest, e);
+    }
+
+    auto keep = std::remove_if(retired.begin(), retired.end(), [oldest](const Retired & r)
+    {
+      if(oldest < r.epoch) return false;
+      delete r.snap;
+      return true;
+    });
+    retired.erase(keep, retired.end());
+  }
+
+  int SnapshotStore::numRetired() const
+  {
+    return retired.size();
+  }
+}
@@ -0,0 +1,451 @@
+/// \file
+/// \brief Source file for likelihood field Monte Carlo localization
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+
+#include "nuslam/mcl.hpp"
+
+namespace mcl
+{
+
+  // Exact 1D squared distance transform (Felzenszwalb and Huttenlocher) of f, n samples apart by stride
+  static void distanceTransform1D(std::vector<double> & f, int n, int stride, int offset,
+                                  std::vector<double> & d, std::vector<int> & v, std::vector<double> & z)
+  {
+    const double inf = std::numeric_limits<double>::infinity();
+
+    int k = 0;
+    v.at(0) = 0;
+    z.at(0) = -inf;
+    z.at(1) = inf;
+
+    auto at = [&](int q) { return f.at(offset + q * stride); };
+
+    for(int q = 1; q < n; q++)
+    {
+      if(at(q) == inf) continue;
+      if(at(v.at(k)) == inf)
+      {
+        v.at(k) = q;
+        continue;
+      }
+
+      double s = ((at(q) + q*q) - (at(v.at(k)) + v.at(k)*v.at(k))) / (2.0*q - 2.0*v.at(k));
+      while(s <= z.at(k))
+      {
+        k--;
+        s = ((at(q) + q*q) - (at(v.at(k)) + v.at(k)*v.at(k))) / (2.0*q - 2.0*v.at(k));
+      }
+      k++;
+      v.at(k) = q;
+      z.at(k) = s;
+      z.at(k + 1) = inf;
+    }
+
+    if(at(v.at(0)) == inf)
+    {
+      for(int q = 0; q < n; q++) d.at(q) = inf;
+    }
+    else
+    {
+      k = 0;
+      for(int q = 0; q < n; q++)
+      {
+        while(z.at(k + 1) < q) k++;
+        d.at(q) = (q - v.at(k)) * (q - v.at(k)) + at(v.at(k));
+      }
+    }
+
+    for(int q = 0; q < n; q++) f.at(offset + q * stride) = d.at(q);
+  }
+
+  // Move a batch of particles' beam end points into padded cell indices. Branch free so it runs as SIMD.
+  static void beamCells(const float * __restrict px, const float * __restrict py, const float * __restrict pc,
+                        const float * __restrict ps, int count, float bx, float by,
+                        float inv_res, float max_u, float max_v, unsigned int width, unsigned int * __restrict cells)
+  {
+    for(int i = 0; i < count; i++)
+    {
+      float u = px[i] + pc[i] * bx - ps[i] * by;
+      float v = py[i] + ps[i] * bx + pc[i] * by;
+
+      // padded cell coordinates, clamped onto the border that holds the off map value
+      u = u * inv_res;
+      v = v * inv_res;
+      u = u < 0.0f ? 0.0f : (u > max_u ? max_u : u);
+      v = v < 0.0f ? 0.0f : (v > max_v ? max_v : v);
+
+      cells[i] = static_cast<unsigned int>(v) * width + static_cast<unsigned int>(u);
+    }
+  }
+
+  /////////////// LikelihoodField CLASS ////////////////////
+  LikelihoodField::LikelihoodField(const GridMap & map, double sigma, double max_dist, double z_hit, double z_rand)
+  {
+    width = map.width + 2;
+    height = map.height + 2;
+    res = map.resolution;
+    origin_x = map.origin_x;
+    origin_y = map.origin_y;
+
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // squared distance in cells to the closest obstacle, rows then columns
+    std::vector<double> f(width * height, inf);
+    for(unsigned int r = 0; r < map.height; r++)
+    {
+      for(unsigned int c = 0; c < map.width; c++)
+      {
+        int8_t cell = map.data.at(r * map.width + c);
+        if(cell >= 50) f.at((r + 1) * width + c + 1) = 0;
+        if(cell == 0) free_cells.emplace_back(origin_x + (c + 0.5) * res, origin_y + (r + 0.5) * res);
+      }
+    }
+
+    unsigned int longest = std::max(width, height);
+    std::vector<double> d(longest);
+    std::vector<int> v(longest);
+    std::vector<double> z(longest + 1);
+
+    for(unsigned int r = 0; r < height; r++) distanceTransform1D(f, width, 1, r * width, d, v, z);
+    for(unsigned int c = 0; c < width; c++) distanceTransform1D(f, height, width, c, d, v, z);
+
+    double norm = 1.0 / (std::sqrt(2.0 * rigid2d::PI) * sigma);
+    auto logLike = [=](double dist)
+    {
+      return static_cast<float>(std::log(z_hit * norm * std::exp(-0.5 * dist * dist / (sigma * sigma)) + z_rand));
+    };
+
+    far_value = logLike(max_dist);
+
+    log_table.assign(width * height, far_value);
+    dist_table.assign(width * height, max_dist);
+    for(unsigned int r = 1; r + 1 < height; r++)
+    {
+      for(unsigned int c = 1; c + 1 < width; c++)
+      {
+        double dist = std::min(std::sqrt(f.at(r * width + c)) * res, max_dist);
+        dist_table.at(r * width + c) = dist;
+        log_table.at(r * width + c) = logLike(dist);
+      }
+    }
+  }
+
+  unsigned int LikelihoodField::cellIndex(double x, double y) const
+  {
+    double u = std::min(std::max((x - origin_x) / res + 1.0, 0.0), width - 1.0);
+    double v = std::min(std::max((y - origin_y) / res + 1.0, 0.0), height - 1.0);
+    return static_cast<unsigned int>(v) * width + static_cast<unsigned int>(u);
+  }
+
+  float LikelihoodField::logLikelihood(double x, double y) const
+  {
+    if(log_table.empty()) return far_value;
+    return log_table.at(cellIndex(x, y));
+  }
+
+  double LikelihoodField::distance(double x, double y) const
+  {
+    if(dist_table.empty()) return 0;
+    return dist_table.at(cellIndex(x, y));
+  }
+
+  const std::vector<float> & LikelihoodField::table() const
+  {
+    return log_table;
+  }
+
+  unsigned int LikelihoodField::paddedWidth() const
+  {
+    return width;
+  }
+
+  unsigned int LikelihoodField::paddedHeight() const
+  {
+    return height;
+  }
+
+  double LikelihoodField::resolution() const
+  {
+    return res;
+  }
+
+  double LikelihoodField::originX() const
+  {
+    return origin_x;
+  }
+
+  double LikelihoodField::originY() const
+  {
+    return origin_y;
+  }
+
+  const std::vector<rigid2d::Vector2D> & LikelihoodField::freeCells() const
+  {
+    return free_cells;
+  }
+
+  /////////////// ParticleFilter CLASS /////////////////////
+  ParticleFilter::ParticleFilter(const MclParams & params, unsigned int seed) : params(params), gen(seed)
+  {
+    int n = std::max(params.num_particles, 1);
+    xs.assign(n, 0);
+    ys.assign(n, 0);
+    ths.assign(n, 0);
+    weights.assign(n, 1.0 / n);
+    scores.assign(n, 0);
+  }
+
+  void ParticleFilter::setMap(const LikelihoodField & field)
+  {
+    this->field = field;
+  }
+
+  void ParticleFilter::initialize(const rigid2d::Pose2D & pose, double sigma_xy, double sigma_th)
+  {
+    std::normal_distribution<double> noise(0, 1);
+    for(int i = 0; i < size(); i++)
+    {
+      xs.at(i) = pose.x + sigma_xy * noise(gen);
+      ys.at(i) = pose.y + sigma_xy * noise(gen);
+      ths.at(i) = rigid2d::normalize_angle(pose.th + sigma_th * noise(gen));
+    }
+    std::fill(weights.begin(), weights.end(), 1.0 / size());
+  }
+
+  void ParticleFilter::initializeUniform()
+  {
+    const std::vector<rigid2d::Vector2D> & cells = field.freeCells();
+    if(cells.empty()) return;
+
+    std::uniform_int_distribution<int> pick(0, cells.size() - 1);
+    std::uniform_real_distribution<double> jitter(-0.5, 0.5);
+    std::uniform_real_distribution<double> heading(-rigid2d::PI, rigid2d::PI);
+
+    for(int i = 0; i < size(); i++)
+    {
+      const rigid2d::Vector2D & c = cells.at(pick(gen));
+      xs.at(i) = c.x + jitter(gen) * field.resolution();
+      ys.at(i) = c.y + jitter(gen) * field.resolution();
+      ths.at(i) = heading(gen);
+    }
+    std::fill(weights.begin(), weights.end(), 1.0 / size());
+  }
+
+  void ParticleFilter::predict(const rigid2d::Pose2D & odom_pose)
+  {
+    if(!have_odom)
+    {
+      have_odom = true;
+      last_odom = odom_pose;
+      return;
+    }
+
+    // Odometry motion model: a rotation, a translation and a rotation, each with noise
+    double dx = odom_pose.x - last_odom.x;
+    double dy = odom_pose.y - last_odom.y;
+    double trans = std::sqrt(dx*dx + dy*dy);
+    double rot1 = trans < 1e-4 ? 0.0 : rigid2d::normalize_angle(std::atan2(dy, dx) - last_odom.th);
+    double rot2 = rigid2d::normalize_angle(odom_pose.th - last_odom.th - rot1);
+
+    // driving backwards is a small first rotation, not a half turn
+    double rot1_noise = std::min(std::fabs(rot1), std::fabs(rigid2d::normalize_angle(rot1 - rigid2d::PI)));
+    double rot2_noise = std::min(std::fabs(rot2), std::fabs(rigid2d::normalize_angle(rot2 - rigid2d::PI)));
+
+    last_odom = odom_pose;
+    moved_trans += trans;
+    moved_rot += std::fabs(rigid2d::normalize_angle(rot1 + rot2));
+
+    if(trans < 1e-6 && std::fabs(rot1 + rot2) < 1e-6) return;
+
+    double sd_rot1 = std::sqrt(params.alpha_rot_rot * rot1_noise * rot1_noise + params.alpha_rot_trans * trans * trans);
+    double sd_trans = std::sqrt(params.alpha_trans_trans * trans * trans +
+                                params.alpha_trans_rot * (rot1_noise * rot1_noise + rot2_noise * rot2_noise));
+    double sd_rot2 = std::sqrt(params.alpha_rot_rot * rot2_noise * rot2_noise + params.alpha_rot_trans * trans * trans);
+
+    std::normal_distribution<double> noise(0, 1);
+    for(int i = 0; i < size(); i++)
+    {
+      double r1 = rot1 - sd_rot1 * noise(gen);
+      double t = trans - sd_trans * noise(gen);
+      double r2 = rot2 - sd_rot2 * noise(gen);
+
+      xs[i] += t * std::cos(ths[i] + r1);
+      ys[i] += t * std::sin(ths[i] + r1);
+      ths[i] = rigid2d::normalize_angle(ths[i] + r1 + r2);
+    }
+  }
+
+  void ParticleFilter::setBeams(double angle_min, double angle_increment, unsigned int num_beams)
+  {
+    if(num_beams == beam_count && angle_min == beam_min && angle_increment == beam_inc) return;
+
+    beam_min = angle_min;
+    beam_inc = angle_increment;
+    beam_count = num_beams;
+
+    beam_cos.clear();
+    beam_sin.clear();
+    beam_index.clear();
+
+    unsigned int step = std::max(params.beam_step, 1);
+    for(unsigned int i = 0; i < num_beams; i += step)
+    {
+      double angle = angle_min + angle_increment * i;
+      beam_cos.push_back(std::cos(angle));
+      beam_sin.push_back(std::sin(angle));
+      beam_index.push_back(i);
+    }
+  }
+
+  void ParticleFilter::scoreBatch(int first, int count, const std::vector<float> & beam_x, const std::vector<float> & beam_y)
+  {
+    // particle poses relative to the padded map corner, in float for twice the SIMD width
+    float px[batch_size], py[batch_size], pc[batch_size], ps[batch_size], total[batch_size];
+    unsigned int cells[batch_size];
+
+    float corner_x = field.originX() - field.resolution();
+    float corner_y = field.originY() - field.resolution();
+    for(int i = 0; i < count; i++)
+    {
+      px[i] = xs[first + i] - corner_x;
+      py[i] = ys[first + i] - corner_y;
+      pc[i] = std::cos(ths[first + i]);
+      ps[i] = std::sin(ths[first + i]);
+      total[i] = 0;
+    }
+
+    const float * table = field.table().data();
+    float inv_res = 1.0 / field.resolution();
+    float max_u = field.paddedWidth() - 1;
+    float max_v = field.paddedHeight() - 1;
+
+    for(unsigned int b = 0; b < beam_x.size(); b++)
+    {
+      beamCells(px, py, pc, ps, count, beam_x[b], beam_y[b], inv_res, max_u, max_v, field.paddedWidth(), cells);
+      for(int i = 0; i < count; i++) total[i] += table[cells[i]];
+    }
+
+    for(int i = 0; i < count; i++) scores[first + i] = total[i];
+  }
+
+  bool ParticleFilter::update(const std::vector<float> & ranges, double range_min, double range_max)
+  {
+    if(field.table().empty()) return false;
+    if(moved_trans < params.min_trans && moved_rot < params.min_rot) return false;
+
+    moved_trans = 0;
+    moved_rot = 0;
+
+    // beam end points in the robot frame, the same for every particle
+    std::vector<float> beam_x, beam_y;
+    for(unsigned int b = 0; b < beam_index.size(); b++)
+    {
+      if(beam_index.at(b) >= ranges.size()) break;
+
+      float r = ranges.at(beam_index.at(b));
+      if(!std::isfinite(r) || r < range_min || r > range_max) continue;
+
+      beam_x.push_back(r * beam_cos.at(b));
+      beam_y.push_back(r * beam_sin.at(b));
+    }
+    if(beam_x.empty()) return false;
+
+    for(int first = 0; first < size(); first += batch_size) scoreBatch(first, std::min(batch_size, size() - first), beam_x, beam_y);
+
+    // weights from the log likelihoods, shifted by the best so exp does not underflow
+    double best = *std::max_element(scores.begin(), scores.end());
+    double sum = 0;
+    for(int i = 0; i < size(); i++)
+    {
+      weights[i] *= std::exp(params.beam_weight * (scores[i] - best));
+      sum += weights[i];
+    }
+
+    if(!(sum > 0)) std::fill(weights.begin(), weights.end(), 1.0 / size());
+    else for(auto & w : weights) w /= sum;
+
+    if(effectiveSize() < params.resample_ratio * size()) resample();
+
+    return true;
+  }
+
+  void ParticleFilter::resample()
+  {
+    int n = size();
+    std::vector<double> new_x(n), new_y(n), new_th(n);
+
+    // one random offset, then evenly spaced picks through the cumulative weights
+    std::uniform_real_distribution<double> start(0, 1.0 / n);
+    double r = start(gen);
+    double c = weights.at(0);
+    int i = 0;
+
+    for(int m = 0; m < n; m++)
+    {
+      double u = r + static_cast<double>(m) / n;
+      while(u > c && i < n - 1)
+      {
+        i++;
+        c += weights.at(i);
+      }
+      new_x.at(m) = xs.at(i);
+      new_y.at(m) = ys.at(i);
+      new_th.at(m) = ths.at(i);
+    }
+
+    xs.swap(new_x);
+    ys.swap(new_y);
+    ths.swap(new_th);
+    std::fill(weights.begin(), weights.end(), 1.0 / n);
+  }
+
+  rigid2d::Pose2D ParticleFilter::estimate() const
+  {
+    double x = 0, y = 0, c = 0, s = 0;
+    for(int i = 0; i < size(); i++)
+    {
+      x += weights[i] * xs[i];
+      y += weights[i] * ys[i];
+      c += weights[i] * std::cos(ths[i]);
+      s += weights[i] * std::sin(ths[i]);
+    }
+    return rigid2d::Pose2D(std::atan2(s, c), x, y);
+  }
+
+  std::vector<double> ParticleFilter::covariance() const
+  {
+    rigid2d::Pose2D mean = estimate();
+
+    std::vector<double> cov(9, 0.0);
+    for(int i = 0; i < size(); i++)
+    {
+      double d[3] = {rigid2d::normalize_angle(ths[i] - mean.th), xs[i] - mean.x, ys[i] - mean.y};
+      for(int r = 0; r < 3; r++)
+      {
+        for(int c = 0; c < 3; c++) cov[r*3 + c] += weights[i] * d[r] * d[c];
+      }
+    }
+    return cov;
+  }
+
+  int ParticleFilter::size() const
+  {
+    return xs.size();
+  }
+
+  rigid2d::Pose2D ParticleFilter::particle(int i) const
+  {
+    return rigid2d::Pose2D(ths.at(i), xs.at(i), ys.at(i));
+  }
+
+  double ParticleFilter::effectiveSize() const
+  {
+    double sq = 0;
+    for(auto w : weights) sq += w * w;
+    return sq > 0 ? 1.0 / sq : 0.0;
+  }
+}
@@ -0,0 +1,275 @@
+/// \file
+/// \brief Source file for scan context place recognition
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#include "nuslam/place_recognition.hpp"
+
+namespace place_recognition
+{
+
+  // Add the squared cell differences of one ring at every shift.
+  // query2 holds the query ring twice in a row, so a shift is a plain offset and the loop over the
+  // shifts runs on contiguous memory with no wrap around, which lets the compiler use SIMD.
+  static void ringShiftDistances(const float * __restrict query2, const float * __restrict ring, int num_sectors,
+                                 float * __restrict out)
+  {
+    for(int c = 0; c < num_sectors; c++)
+    {
+      const float cell = ring[c];
+      const float * shifted = query2 + c;
+      for(int s = 0; s < num_sectors; s++)
+      {
+        const float d = shifted[s] - cell;
+        out[s] += d * d;
+      }
+    }
+  }
+
+  Descriptor makeDescriptor(const std::vector<rigid2d::Vector2D> & points, const ContextParams & params)
+  {
+    Descriptor desc;
+    desc.cells.assign(params.num_rings * params.num_sectors, 0.0f);
+    desc.ring_key.assign(params.num_rings, 0.0f);
+
+    for(auto & p : points)
+    {
+      double range = std::sqrt(p.x*p.x + p.y*p.y);
+      if(range >= params.max_range) continue;
+
+      int ring = range / params.max_range * params.num_rings;
+      int sector = (std::atan2(p.y, p.x) + rigid2d::PI) / (2.0 * rigid2d::PI) * params.num_sectors;
+      sector = std::min(std::max(sector, 0), params.num_sectors - 1);
+
+      desc.cells.at(ring * params.num_sectors + sector) = 1.0f;
+    }
+
+    for(int r = 0; r < params.num_rings; r++)
+    {
+      const float * row = desc.cells.data() + r * params.num_sectors;
+      desc.ring_key.at(r) = std::accumulate(row, row + params.num_sectors, 0.0f) / params.num_sectors;
+    }
+
+    return desc;
+  }
+
+  Match compare(const Descriptor & query, const Descriptor & candidate, const ContextParams & params)
+  {
+    int S = params.num_sectors;
+
+    std::vector<float> query2(2 * S);
+    std::vector<float> totals(S, 0.0f);
+
+    for(int r = 0; r < params.num_rings; r++)
+    {
+      const float * row = query.cells.data() + r * S;
+      std::copy(row, row + S, query2.begin());
+      std::copy(row, row + S, query2.begin() + S);
+
+      ringShiftDistances(query2.data(), candidate.cells.data() + r * S, S, totals.data());
+    }
+
+    int best = std::min_element(totals.begin(), totals.end()) - totals.begin();
+
+    // query sector c + shift sees what the candidate saw in sector c, so the query frame is turned back by the shift
+    Match match;
+    match.distance = totals.at(best) / (params.num_rings * S);
+    match.yaw = rigid2d::normalize_angle(-2.0 * rigid2d::PI * best / S);
+    return match;
+  }
+
+  /////////////// KdTree CLASS /////////////////////////////
+  void KdTree::build(std::vector<float> keys, std::vector<int> ids, int dim)
+  {
+    this->keys = std::move(keys);
+    this->ids = std::move(ids);
+    this->dim = dim;
+    split.assign(this->ids.size(), 0);
+
+    buildRange(0, this->ids.size());
+  }
+
+  void KdTree::buildRange(int lo, int hi)
+  {
+    if(hi - lo <= 1) return;
+
+    // split on the dimension with the widest spread
+    int best_dim = 0;
+    float best_spread = -1;
+    for(int d = 0; d < dim; d++)
+    {
+      float low = keys.at(lo * dim + d), high = low;
+      for(int i = lo + 1; i < hi; i++)
+      {
+        low = std::min(low, keys[i * dim + d]);
+        high = std::max(high, keys[i * dim + d]);
+      }
+      if(high - low > best_spread)
+      {
+        best_spread = high - low;
+        best_dim = d;
+      }
+    }
+
+    // nth_element over positions, then move the keys to match
+    int mid = (lo + hi) / 2;
+    std::vector<int> order(hi - lo);
+    std::iota(order.begin(), order.end(), lo);
+    std::nth_element(order.begin(), order.begin() + (mid - lo), order.end(), [this, best_dim](int a, int b)
+    {
+      return keys[a * dim + best_dim] < keys[b * dim + best_dim];
+    });
+
+    std::vector<float> sorted_keys((hi - lo) * dim);
+    std::vector<int> sorted_ids(hi - lo);
+    for(int i = 0; i < hi - lo; i++)
+    {
+      std::copy(keys.begin() + order[i] * dim, keys.begin() + (order[i] + 1) * dim, sorted_keys.begin() + i * dim);
+      sorted_ids[i] = ids[order[i]];
+    }
+    std::copy(sorted_keys.begin(), sorted_keys.end(), keys.begin() + lo * dim);
+    std::copy(sorted_ids.begin(), sorted_ids.end(), ids.begin() + lo);
+
+    split.at(mid) = best_dim;
+
+    buildRange(lo, mid);
+    buildRange(mid + 1, hi);
+  }
+
+  void KdTree::nearest(const float * query, int k, int max_id, std::vector<std::pair<float, int>> & out) const
+  {
+    out.clear();
+    if(k <= 0 || ids.empty()) return;
+
+    search(0, ids.size(), query, k, max_id, out);
+    std::sort_heap(out.begin(), out.end());
+  }
+
+  void KdTree::search(int lo, int hi, const float * query, unsigned int k, int max_id, std::vector<std::pair<float, int>> & heap) const
+  {
+    if(hi <= lo) return;
+
+    int mid = (lo + hi) / 2;
+    const float * key = keys.data() + mid * dim;
+
+    if(ids[mid] < max_id)
+    {
+      float dist = 0;
+      for(int d = 0; d < dim; d++) dist += (key[d] - query[d]) * (key[d] - query[d]);
+
+      // max heap of the k best so far
+      if(heap.size() < k || dist < heap.front().first)
+      {
+        heap.emplace_back(dist, ids[mid]);
+        std::push_heap(heap.begin(), heap.end());
+        if(heap.size() > k)
+        {
+          std::pop_heap(heap.begin(), heap.end());
+          heap.pop_back();
+        }
+      }
+    }
+
+    if(hi - lo == 1) return;
+
+    float diff = query[split[mid]] - key[split[mid]];
+    bool left_first = diff < 0;
+
+    if(left_first) search(lo, mid, query, k, max_id, heap);
+    else search(mid + 1, hi, query, k, max_id, heap);
+
+    // the other side can only hold something closer if the split plane is within the worst distance
+    if(heap.size() < k || diff * diff < heap.front().first)
+    {
+      if(left_first) search(mid + 1, hi, query, k, max_id, heap);
+      else search(lo, mid, query, k, max_id, heap);
+    }
+  }
+
+  int KdTree::size() const
+  {
+    return ids.size();
+  }
+
+  /////////////// PlaceIndex CLASS /////////////////////////
+  PlaceIndex::PlaceIndex(const ContextParams & params) : params(params)
+  {
+  }
+
+  void PlaceIndex::add(int id, const std::vector<rigid2d::Vector2D> & points)
+  {
+    descriptors.push_back(makeDescriptor(points, params));
+    ids.push_back(id);
+
+    if(static_cast<int>(descriptors.size()) - tree_size < tail_size) return;
+
+    // The full trees below the first free size hold the newest indexed descriptors, merge them with the tail
+    unsigned int level = 0;
+    while(level < trees.size() && trees.at(level).size() > 0) level++;
+    if(level == trees.size()) trees.emplace_back();
+
+    int first = descriptors.size() - (tail_size << level);
+    std::vector<float> keys;
+    keys.reserve((descriptors.size() - first) * params.num_rings);
+    for(unsigned int i = first; i < descriptors.size(); i++)
+    {
+      keys.insert(keys.end(), descriptors.at(i).ring_key.begin(), descriptors.at(i).ring_key.end());
+    }
+
+    trees.at(level).build(std::move(keys), std::vector<int>(ids.begin() + first, ids.end()), params.num_rings);
+    for(unsigned int l = 0; l < level; l++) trees.at(l) = KdTree();
+    tree_size = descriptors.size();
+  }
+
+  std::vector<Match> PlaceIndex::query(const std::vector<rigid2d::Vector2D> & points, int k, int max_id) const
+  {
+    Descriptor desc = makeDescriptor(points, params);
+
+    // Nearest ring keys from each tree and the tail
+    std::vector<std::pair<float, int>> near, found;
+    for(auto & tree : trees)
+    {
+      tree.nearest(desc.ring_key.data(), params.num_candidates, max_id, found);
+      near.insert(near.end(), found.begin(), found.end());
+    }
+
+    for(unsigned int i = tree_size; i < descriptors.size(); i++)
+    {
+      if(ids.at(i) >= max_id) continue;
+
+      float dist = 0;
+      for(int d = 0; d < params.num_rings; d++)
+      {
+        float diff = descriptors.at(i).ring_key.at(d) - desc.ring_key.at(d);
+        dist += diff * diff;
+      }
+      near.emplace_back(dist, ids.at(i));
+    }
+
+    std::sort(near.begin(), near.end());
+    if(static_cast<int>(near.size()) > params.num_candidates) near.resize(params.num_candidates);
+
+    // Rank the candidates by their full grids. Ids increase with each add, so the position is found by search.
+    std::vector<Match> matches;
+    for(auto & [key_dist, id] : near)
+    {
+      int pos = std::lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+
+      Match match = compare(desc, descriptors.at(pos), params);
+      match.id = id;
+      matches.push_back(match);
+    }
+
+    std::sort(matches.begin(), matches.end(), [](const Match & a, const Match & b) { return a.distance < b.distance; });
+    if(static_cast<int>(matches.size()) > k) matches.resize(std::max(k, 0));
+
+    return matches;
+  }
+
+  int PlaceIndex::size() const
+  {
+    return descriptors.size();
+  }
+}
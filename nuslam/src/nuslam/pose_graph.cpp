@@ -0,0 +1,621 @@
+/// \file
+/// \brief Source file for lidar pose graph SLAM
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "nuslam/pose_graph.hpp"
+#include "nuslam/executor.hpp"
+
+namespace pose_graph
+{
+
+  // Convert a (th, x, y) vector into a transform
+  static rigid2d::Transform2D vec2transform(const Eigen::Vector3d & pose)
+  {
+    return rigid2d::Transform2D(rigid2d::Pose2D(pose(0), pose(1), pose(2)));
+  }
+
+  // Convert a transform into a (th, x, y) vector
+  static Eigen::Vector3d transform2vec(const rigid2d::Transform2D & T)
+  {
+    rigid2d::Pose2D pose = T.displacementRad();
+    return Eigen::Vector3d(pose.th, pose.x, pose.y);
+  }
+
+  // Pose of b in the frame of a
+  static Eigen::Vector3d relativePose(const Eigen::Vector3d & a, const Eigen::Vector3d & b)
+  {
+    return transform2vec(vec2transform(a).inv() * vec2transform(b));
+  }
+
+  // Error of an edge, and its jacobians with respect to the from and to nodes
+  static Eigen::Vector3d edgeError(const Edge & edge, const Eigen::Vector3d & xi, const Eigen::Vector3d & xj,
+                                   Eigen::Matrix3d * A=nullptr, Eigen::Matrix3d * B=nullptr)
+  {
+    double ci = std::cos(xi(0)), si = std::sin(xi(0));
+    double cz = std::cos(edge.measurement(0)), sz = std::sin(edge.measurement(0));
+
+    Eigen::Matrix2d Ri_T, Rz_T, dRi_T;
+    Ri_T << ci, si,
+            -si, ci;
+    Rz_T << cz, sz,
+            -sz, cz;
+    dRi_T << -si, ci,
+             -ci, -si;
+
+    Eigen::Vector2d dt = xj.tail<2>() - xi.tail<2>();
+
+    Eigen::Vector3d e;
+    e(0) = rigid2d::normalize_angle(xj(0) - xi(0) - edge.measurement(0));
+    e.tail<2>() = Rz_T * (Ri_T * dt - edge.measurement.tail<2>());
+
+    if(A && B)
+    {
+      A->setZero();
+      (*A)(0, 0) = -1;
+      A->block<2, 1>(1, 0) = Rz_T * dRi_T * dt;
+      A->block<2, 2>(1, 1) = -Rz_T * Ri_T;
+
+      B->setZero();
+      (*B)(0, 0) = 1;
+      B->block<2, 2>(1, 1) = Rz_T * Ri_T;
+    }
+
+    return e;
+  }
+
+  // Key of a grid cell
+  static uint64_t cellKey(int64_t cx, int64_t cy)
+  {
+    return (static_cast<uint64_t>(cx) << 32) ^ (static_cast<uint64_t>(cy) & 0xffffffff);
+  }
+
+  IcpResult icp(const std::vector<rigid2d::Vector2D> & source, const std::vector<rigid2d::Vector2D> & target,
+                const Eigen::Vector3d & guess, double max_dist, int iterations)
+  {
+    IcpResult result;
+    result.transform = guess;
+    if(source.empty() || target.empty() || max_dist <= 0) return result;
+
+    // Bucket the target points in cells as wide as the match distance, so a search looks at 9 cells
+    std::unordered_map<uint64_t, std::vector<int>> grid;
+    for(unsigned int k = 0; k < target.size(); k++)
+    {
+      grid[cellKey(std::floor(target.at(k).x / max_dist), std::floor(target.at(k).y / max_dist))].push_back(k);
+    }
+
+    auto forNeighbors = [&grid, max_dist](double x, double y, auto visit)
+    {
+      int64_t cx = std::floor(x / max_dist);
+      int64_t cy = std::floor(y / max_dist);
+      for(int64_t dx = -1; dx <= 1; dx++)
+      {
+        for(int64_t dy = -1; dy <= 1; dy++)
+        {
+          auto cell = grid.find(cellKey(cx + dx, cy + dy));
+          if(cell == grid.end()) continue;
+          for(int m : cell->second) visit(m);
+        }
+      }
+    };
+
+    // Surface normal of each target point from the spread of the points around it
+    double normal_dist2 = 0.25 * max_dist * max_dist;
+    std::vector<Eigen::Vector2d> normals(target.size(), Eigen::Vector2d::Zero());
+    for(unsigned int k = 0; k < target.size(); k++)
+    {
+      Eigen::Vector2d mean = Eigen::Vector2d::Zero();
+      Eigen::Matrix2d spread = Eigen::Matrix2d::Zero();
+      int count = 0;
+
+      forNeighbors(target.at(k).x, target.at(k).y, [&](int m)
+      {
+        Eigen::Vector2d d(target.at(m).x - target.at(k).x, target.at(m).y - target.at(k).y);
+        if(d.squaredNorm() > normal_dist2) return;
+        Eigen::Vector2d q(target.at(m).x, target.at(m).y);
+        mean += q;
+        spread += q * q.transpose();
+        count++;
+      });
+
+      if(count < 3) continue;
+
+      mean /= count;
+      spread = spread / count - mean * mean.transpose();
+
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> eig(spread);
+      normals.at(k) = eig.eigenvectors().col(0);
+    }
+
+    double max_dist2 = max_dist * max_dist;
+
+    for(int iter = 0; iter < iterations; iter++)
+    {
+      rigid2d::Transform2D T = vec2transform(result.transform);
+
+      // Point to line Gauss-Newton step over the closest target point of each moved source point
+      Eigen::Matrix3d H = 1e-9 * Eigen::Matrix3d::Identity();
+      Eigen::Vector3d g = Eigen::Vector3d::Zero();
+      double sq_sum = 0;
+      int matches = 0;
+
+      for(auto & src : source)
+      {
+        rigid2d::Vector2D p = T(src);
+
+        int best = -1;
+        double best_dist2 = max_dist2;
+        forNeighbors(p.x, p.y, [&](int m)
+        {
+          double ex = target.at(m).x - p.x, ey = target.at(m).y - p.y;
+          double d2 = ex*ex + ey*ey;
+          if(d2 < best_dist2)
+          {
+            best_dist2 = d2;
+            best = m;
+          }
+        });
+
+        if(best < 0 || normals.at(best).isZero()) continue;
+
+        const Eigen::Vector2d & n = normals.at(best);
+        double r = n(0) * (p.x - target.at(best).x) + n(1) * (p.y - target.at(best).y);
+
+        // derivative of the residual for a small rotation and translation applied after T
+        Eigen::Vector3d J(n(1) * p.x - n(0) * p.y, n(0), n(1));
+        H += J * J.transpose();
+        g += J * r;
+        sq_sum += r * r;
+        matches++;
+      }
+
+      result.matches = matches;
+      if(matches < 3) return result;
+      result.rms = std::sqrt(sq_sum / matches);
+
+      Eigen::Vector3d step = -H.ldlt().solve(g);
+      result.transform = transform2vec(vec2transform(step) * T);
+
+      if(step.norm() < 1e-6)
+      {
+        result.converged = true;
+        break;
+      }
+    }
+
+    return result;
+  }
+
+  /////////////// BlockCholesky CLASS //////////////////////
+  bool BlockCholesky::factor(std::vector<std::map<int, Eigen::Matrix3d>> lower)
+  {
+    L = std::move(lower);
+    int n = L.size();
+
+    // Right looking: finish column j, then subtract its outer product from the columns to its right
+    for(int j = 0; j < n; j++)
+    {
+      auto & col = L.at(j);
+
+      auto diag = col.find(j);
+      if(diag == col.end()) return false;
+
+      Eigen::LLT<Eigen::Matrix3d> llt(diag->second);
+      if(llt.info() != Eigen::Success) return false;
+
+      Eigen::Matrix3d Ljj = llt.matrixL();
+      diag->second = Ljj;
+
+      for(auto it = std::next(diag); it != col.end(); it++)
+      {
+        it->second = Ljj.triangularView<Eigen::Lower>().solve(it->second.transpose()).transpose();
+      }
+
+      for(auto it = std::next(diag); it != col.end(); it++)
+      {
+        for(auto jt = std::next(diag); jt != std::next(it); jt++)
+        {
+          // block (i, k) with i >= k, new blocks here are fill in
+          auto & block = L.at(jt->first).try_emplace(it->first, Eigen::Matrix3d::Zero()).first->second;
+          block.noalias() -= it->second * jt->second.transpose();
+        }
+      }
+    }
+
+    return true;
+  }
+
+  Eigen::VectorXd BlockCholesky::solve(const Eigen::VectorXd & b) const
+  {
+    int n = L.size();
+    Eigen::VectorXd x = b;
+
+    // L y = b
+    for(int j = 0; j < n; j++)
+    {
+      auto diag = L.at(j).find(j);
+      x.segment<3>(3*j) = diag->second.triangularView<Eigen::Lower>().solve(x.segment<3>(3*j));
+
+      for(auto it = std::next(diag); it != L.at(j).end(); it++)
+      {
+        x.segment<3>(3*it->first) -= it->second * x.segment<3>(3*j);
+      }
+    }
+
+    // L^T x = y
+    for(int j = n - 1; j >= 0; j--)
+    {
+      auto diag = L.at(j).find(j);
+      for(auto it = std::next(diag); it != L.at(j).end(); it++)
+      {
+        x.segment<3>(3*j) -= it->second.transpose() * x.segment<3>(3*it->first);
+      }
+
+      x.segment<3>(3*j) = diag->second.transpose().triangularView<Eigen::Upper>().solve(x.segment<3>(3*j));
+    }
+
+    return x;
+  }
+
+  int BlockCholesky::numBlocks() const
+  {
+    int count = 0;
+    for(auto & col : L) count += col.size();
+    return count;
+  }
+
+  /////////////// PoseGraph CLASS //////////////////////////
+  int PoseGraph::addNode(const Eigen::Vector3d & pose)
+  {
+    nodes.push_back(pose);
+    return nodes.size() - 1;
+  }
+
+  void PoseGraph::addEdge(const Edge & edge)
+  {
+    edges.push_back(edge);
+  }
+
+  double PoseGraph::error() const
+  {
+    double total = 0;
+    for(auto & edge : edges)
+    {
+      Eigen::Vector3d e = edgeError(edge, nodes.at(edge.from), nodes.at(edge.to));
+      total += e.transpose() * edge.information * e;
+    }
+    return total;
+  }
+
+  double PoseGraph::optimize(int iterations)
+  {
+    int n = nodes.size() - 1; // node 0 is fixed, so variable k is node k + 1
+    double current = error();
+    if(n <= 0 || edges.empty()) return current;
+
+    double lambda = 1e-4;
+
+    for(int iter = 0; iter < iterations; iter++)
+    {
+      // Normal equations, lower blocks only
+      std::vector<std::map<int, Eigen::Matrix3d>> H(n);
+      Eigen::VectorXd g = Eigen::VectorXd::Zero(3*n);
+
+      auto addBlock = [&H](int row, int col, const Eigen::Matrix3d & block)
+      {
+        auto & dst = H.at(col).try_emplace(row, Eigen::Matrix3d::Zero()).first->second;
+        dst += block;
+      };
+
+      for(int k = 0; k < n; k++) addBlock(k, k, Eigen::Matrix3d::Zero());
+
+      for(auto & edge : edges)
+      {
+        Eigen::Matrix3d A, B;
+        Eigen::Vector3d e = edgeError(edge, nodes.at(edge.from), nodes.at(edge.to), &A, &B);
+
+        int i = edge.from - 1, j = edge.to - 1;
+        const Eigen::Matrix3d & W = edge.information;
+
+        if(i >= 0)
+        {
+          addBlock(i, i, A.transpose() * W * A);
+          g.segment<3>(3*i) += A.transpose() * W * e;
+        }
+        if(j >= 0)
+        {
+          addBlock(j, j, B.transpose() * W * B);
+          g.segment<3>(3*j) += B.transpose() * W * e;
+        }
+        if(i >= 0 && j >= 0 && i != j)
+        {
+          if(i > j) addBlock(i, j, A.transpose() * W * B);
+          else addBlock(j, i, B.transpose() * W * A);
+        }
+      }
+
+      // Damp until a step lowers the error
+      bool improved = false;
+      while(!improved && lambda < 1e10)
+      {
+        std::vector<std::map<int, Eigen::Matrix3d>> damped = H;
+        for(int k = 0; k < n; k++)
+        {
+          Eigen::Matrix3d & d = damped.at(k).at(k);
+          d.diagonal() += lambda * (d.diagonal().array() + 1e-9).matrix();
+        }
+
+        BlockCholesky chol;
+        if(!chol.factor(std::move(damped)))
+        {
+          lambda *= 10;
+          continue;
+        }
+
+        Eigen::VectorXd dx = -chol.solve(g);
+
+        std::vector<Eigen::Vector3d> saved = nodes;
+        for(int k = 0; k < n; k++)
+        {
+          nodes.at(k + 1) += dx.segment<3>(3*k);
+          nodes.at(k + 1)(0) = rigid2d::normalize_angle(nodes.at(k + 1)(0));
+        }
+
+        double next = error();
+        if(next < current)
+        {
+          improved = true;
+          lambda = std::max(lambda / 10, 1e-9);
+
+          bool done = dx.norm() < 1e-8 || current - next < 1e-9 * current;
+          current = next;
+          if(done) return current;
+        }
+        else
+        {
+          nodes = saved;
+          lambda *= 10;
+        }
+      }
+
+      if(!improved) break;
+    }
+
+    return current;
+  }
+
+  int PoseGraph::numNodes() const
+  {
+    return nodes.size();
+  }
+
+  const Eigen::Vector3d & PoseGraph::getNode(int id) const
+  {
+    return nodes.at(id);
+  }
+
+  const std::vector<Eigen::Vector3d> & PoseGraph::getNodes() const
+  {
+    return nodes;
+  }
+
+  void PoseGraph::setNode(int id, const Eigen::Vector3d & pose)
+  {
+    nodes.at(id) = pose;
+  }
+
+  const std::vector<Edge> & PoseGraph::getEdges() const
+  {
+    return edges;
+  }
+
+  /////////////// GraphSlam CLASS //////////////////////////
+  GraphSlam::GraphSlam(const GraphParams & params) : params(params), places(params.context)
+  {
+  }
+
+  GraphSlam::~GraphSlam()
+  {
+    if(pending.valid()) pending.wait();
+  }
+
+  bool GraphSlam::addScan(const rigid2d::Pose2D & odom_pose, const std::vector<rigid2d::Vector2D> & points)
+  {
+    addOdometry(odom_pose);
+
+    // Keyframe once the robot has moved far enough from the last one
+    if(!keyframe_odom.empty())
+    {
+      Eigen::Vector3d delta = relativePose(keyframe_odom.back(), last_odom);
+      if(delta.tail<2>().norm() < params.keyframe_distance && std::fabs(delta(0)) < params.keyframe_angle) return false;
+    }
+
+    // The map frame starts on the odometry frame
+    Eigen::Vector3d estimate = last_odom;
+    if(graph.numNodes() > 0)
+    {
+      estimate = transform2vec(vec2transform(graph.getNode(graph.numNodes() - 1)) * vec2transform(relativePose(keyframe_odom.back(), last_odom)));
+    }
+
+    int id = graph.addNode(estimate);
+    scans.push_back(points);
+    keyframe_odom.push_back(last_odom);
+
+    if(id > 0) linkKeyframe(id);
+    if(params.use_place_recognition) places.add(id, points);
+
+    return true;
+  }
+
+  void GraphSlam::addOdometry(const rigid2d::Pose2D & odom_pose)
+  {
+    last_odom = Eigen::Vector3d(odom_pose.th, odom_pose.x, odom_pose.y);
+    pollOptimize();
+  }
+
+  void GraphSlam::linkKeyframe(int id)
+  {
+    Eigen::Matrix3d odom_info = Eigen::Vector3d(1.0 / std::pow(params.odom_sigma_th, 2), 1.0 / std::pow(params.odom_sigma_xy, 2),
+                                                1.0 / std::pow(params.odom_sigma_xy, 2)).asDiagonal();
+    Eigen::Matrix3d icp_info = Eigen::Vector3d(1.0 / std::pow(params.icp_sigma_th, 2), 1.0 / std::pow(params.icp_sigma_xy, 2),
+                                               1.0 / std::pow(params.icp_sigma_xy, 2)).asDiagonal();
+
+    auto accepted = [this, id](const IcpResult & match)
+    {
+      return match.converged && match.rms < params.icp_max_rms &&
+             match.matches >= params.icp_min_overlap * scans.at(id).size();
+    };
+
+    // Odometry edge to the last keyframe
+    Edge odom;
+    odom.from = id - 1;
+    odom.to = id;
+    odom.measurement = relativePose(keyframe_odom.at(id - 1), keyframe_odom.at(id));
+    odom.information = odom_info;
+    graph.addEdge(odom);
+
+    // Scan match edge to the last keyframe, which also refines the starting estimate of the new one
+    IcpResult match = icp(scans.at(id), scans.at(id - 1), odom.measurement, params.icp_max_dist, params.icp_iterations);
+    if(accepted(match))
+    {
+      Edge edge = odom;
+      edge.measurement = match.transform;
+      edge.information = icp_info;
+      graph.addEdge(edge);
+
+      graph.setNode(id, transform2vec(vec2transform(graph.getNode(id - 1)) * vec2transform(match.transform)));
+    }
+
+    // Loop closure with the most likely old keyframe that matches
+    for(auto & [k, guess] : loopCandidates(id))
+    {
+      IcpResult loop = icp(scans.at(id), scans.at(k), guess, params.icp_max_dist, params.icp_iterations);
+      if(!accepted(loop)) continue;
+
+      Edge edge;
+      edge.from = k;
+      edge.to = id;
+      edge.measurement = loop.transform;
+      edge.information = icp_info;
+      graph.addEdge(edge);
+      loop_closures++;
+
+      if(pending.valid())
+      {
+        optimize_requested = true;
+      }
+      else
+      {
+        pending = startOptimize();
+      }
+      break;
+    }
+  }
+
+  std::vector<std::pair<int, Eigen::Vector3d>> GraphSlam::loopCandidates(int id) const
+  {
+    std::vector<std::pair<int, Eigen::Vector3d>> candidates;
+    int max_id = id - params.loop_min_separation;
+    if(max_id <= 0) return candidates;
+
+    // Scan context does not care how far the estimate has drifted, the match gives the yaw and ICP the rest
+    if(params.use_place_recognition)
+    {
+      for(auto & match : places.query(scans.at(id), params.place_candidates, max_id))
+      {
+        if(match.distance < params.place_max_distance) candidates.emplace_back(match.id, Eigen::Vector3d(match.yaw, 0, 0));
+      }
+      return candidates;
+    }
+
+    // Otherwise try every old keyframe near the estimate, closest first
+    std::vector<std::pair<double, int>> near;
+    for(int k = 0; k < max_id; k++)
+    {
+      double dist = (graph.getNode(k).tail<2>() - graph.getNode(id).tail<2>()).norm();
+      if(dist < params.loop_radius) near.emplace_back(dist, k);
+    }
+    std::sort(near.begin(), near.end());
+
+    for(auto & [dist, k] : near) candidates.emplace_back(k, relativePose(graph.getNode(k), graph.getNode(id)));
+    return candidates;
+  }
+
+  std::future<std::vector<Eigen::Vector3d>> GraphSlam::startOptimize() const
+  {
+    // optimize a copy on the shared executor, keyframes keep coming in meanwhile
+    PoseGraph copy = graph;
+    int iterations = params.lm_iterations;
+
+    return executor::Executor::instance().async([copy, iterations]() mutable
+    {
+      copy.optimize(iterations);
+      return copy.getNodes();
+    });
+  }
+
+  void GraphSlam::pollOptimize()
+  {
+    if(!pending.valid()) return;
+
+    if(pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+    std::vector<Eigen::Vector3d> optimized = pending.get();
+    int n = optimized.size();
+
+    // Keyframes added during the optimization move with the last optimized one
+    rigid2d::Transform2D correction = vec2transform(optimized.back()) * vec2transform(graph.getNode(n - 1)).inv();
+    for(int k = n; k < graph.numNodes(); k++) graph.setNode(k, transform2vec(correction * vec2transform(graph.getNode(k))));
+    for(int k = 0; k < n; k++) graph.setNode(k, optimized.at(k));
+
+    if(optimize_requested)
+    {
+      optimize_requested = false;
+      pending = startOptimize();
+    }
+  }
+
+  void GraphSlam::waitForOptimize()
+  {
+    while(pending.valid())
+    {
+      pending.wait();
+      pollOptimize();
+    }
+  }
+
+  std::vector<double> GraphSlam::getRobotState()
+  {
+    pollOptimize();
+
+    Eigen::Vector3d pose = last_odom;
+    if(graph.numNodes() > 0)
+    {
+      // corrected pose of the last keyframe, plus the odometry since it
+      int last = graph.numNodes() - 1;
+      pose = transform2vec(vec2transform(graph.getNode(last)) * vec2transform(relativePose(keyframe_odom.at(last), last_odom)));
+    }
+
+    return {pose(0), pose(1), pose(2)};
+  }
+
+  int GraphSlam::getNumKeyframes() const
+  {
+    return graph.numNodes();
+  }
+
+  int GraphSlam::getNumLoopClosures() const
+  {
+    return loop_closures;
+  }
+
+  const PoseGraph & GraphSlam::getGraph() const
+  {
+    return graph;
+  }
+}
@@ -0,0 +1,106 @@
+/// \file
+/// \brief Source file for the RTS smoothing pass
+#include <vector>
+#include <cmath>
+
+#include <eigen3/Eigen/Dense>
+
+#include "rigid2d/rigid2d.hpp"
+#include "nuslam/rts_smoother.hpp"
+
+namespace ekf_slam
+{
+
+  /////////////// SMOOTHER /////////////////////////////
+  std::vector<Eigen::Vector3d> smoothTrajectory(const std::vector<StepRecord> & steps)
+  {
+    // a trailing prediction has no posterior to smooth
+    int num_steps = steps.size();
+    if(num_steps > 0 && steps.back().P_robot.size() == 0) num_steps--;
+
+    std::vector<Eigen::Vector3d> poses(num_steps);
+    if(num_steps == 0) return poses;
+
+    const int n = steps.front().P_robot.cols();
+
+    // the adjoint, zero after the last step
+    Eigen::VectorXd lambda = Eigen::VectorXd::Zero(n);
+
+    for(int k = num_steps - 1; k >= 0; k--)
+    {
+      const StepRecord & step = steps.at(k);
+
+      // x(k|n) = x(k|k) - P(k|k) lambda, only the robot rows are kept
+      Eigen::Vector3d & pose = poses.at(k);
+      pose = step.pose - step.P_robot * lambda;
+      pose(0) = rigid2d::normalize_angle(pose(0));
+
+      // back through the updates, lambda = -H' S^-1 y + (I - K H)' lambda
+      for(auto u = step.updates.rbegin(); u != step.updates.rend(); ++u)
+      {
+        // only the five columns of H touch lambda
+        Eigen::Matrix<double, 5, 1> dlambda = -u->H.transpose() * (u->S_inv * u->innovation + u->K.transpose() * lambda);
+        lambda.head<3>() += dlambda.head<3>();
+        lambda.segment<2>(u->index) += dlambda.tail<2>();
+      }
+
+      // back through the prediction, G = I + d e0'
+      lambda(0) += step.dupdate.dot(lambda.head<3>());
+    }
+
+    return poses;
+  }
+
+  Eigen::VectorXd refineLandmarks(const std::vector<StepRecord> & steps, const std::vector<Eigen::Vector3d> & poses,
+                                  const Eigen::VectorXd & state, const Eigen::Matrix2d & r, int iterations)
+  {
+    Eigen::VectorXd refined = state;
+    if(!poses.empty()) refined.head<3>() = poses.back();
+
+    const int n = state.size();
+    const Eigen::Matrix2d r_inv = r.inverse();
+
+    for(int it = 0; it < iterations; it++)
+    {
+      // normal equations of every landmark, linearized at the current map
+      std::vector<Eigen::Matrix2d> A(n, Eigen::Matrix2d::Zero());
+      std::vector<Eigen::Vector2d> b(n, Eigen::Vector2d::Zero());
+
+      for(unsigned int k = 0; k < poses.size() && k < steps.size(); k++)
+      {
+        const Eigen::Vector3d & pose = poses.at(k);
+
+        for(auto & u : steps.at(k).updates)
+        {
+          double x = refined(u.index) - pose(1);
+          double y = refined(u.index + 1) - pose(2);
+          double d = x*x + y*y;
+          if(d < 1e-12) continue;
+          double sqd = std::sqrt(d);
+
+          Eigen::Vector2d residual;
+          residual(0) = u.z(0) - sqd;
+          residual(1) = rigid2d::normalize_angle(u.z(1) - (std::atan2(y, x) - pose(0)));
+
+          // the landmark columns of H
+          Eigen::Matrix2d J;
+          J << x/sqd, y/sqd,
+               -y/d, x/d;
+
+          A.at(u.index) += J.transpose() * r_inv * J;
+          b.at(u.index) += J.transpose() * r_inv * residual;
+        }
+      }
+
+      for(int i = 3; i < n - 1; i += 2)
+      {
+        // never measured
+        if(A.at(i).isZero()) continue;
+        refined.segment<2>(i) += A.at(i).ldlt().solve(b.at(i));
+      }
+    }
+
+    return refined;
+  }
+
+}
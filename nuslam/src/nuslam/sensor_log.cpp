@@ -0,0 +1,667 @@
+/// \file
+/// \brief Source file for the chunked sensor log
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "nuslam/sensor_log.hpp"
+
+namespace sensor_log
+{
+
+  namespace
+  {
+    constexpr char file_magic[4] = {'N', 'U', 'L', 'G'};
+    constexpr uint32_t file_version = 1;
+
+    /// \brief The start of the file
+    struct FileHeader
+    {
+      char magic[4];
+      uint32_t version;
+      uint64_t reserved;
+    };
+
+    /// \brief The end of the file, points back at the topic table and the index
+    struct FileFooter
+    {
+      uint64_t topics_offset;
+      uint64_t index_offset;
+      uint64_t index_count;
+      char magic[4];
+      uint32_t version;
+    };
+
+    /// \brief One chunk in the index
+    struct IndexRecord
+    {
+      uint32_t topic;
+      uint32_t codec;
+      uint32_t count;
+      uint32_t reserved;
+      int64_t t_first;
+      int64_t t_last;
+      uint64_t offset;
+      uint64_t stored_size;
+      uint64_t raw_size;
+    };
+
+    uint64_t pad8(uint64_t n)
+    {
+      return (n + 7) & ~uint64_t(7);
+    }
+
+    size_t elementSize(ElementType type)
+    {
+      if(type == ElementType::Float32) return sizeof(float);
+      if(type == ElementType::Int32) return sizeof(int32_t);
+      return sizeof(double);
+    }
+
+    template<class T>
+    void appendPod(std::vector<char> & out, const T & value)
+    {
+      const char * bytes = reinterpret_cast<const char *>(&value);
+      out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void appendBytes(std::vector<char> & out, const void * data, size_t size)
+    {
+      const char * bytes = static_cast<const char *>(data);
+      out.insert(out.end(), bytes, bytes + size);
+      out.resize(pad8(out.size()), 0);
+    }
+
+    void appendString(std::vector<char> & out, const std::string & s)
+    {
+      appendPod(out, static_cast<uint32_t>(s.size()));
+      out.insert(out.end(), s.begin(), s.end());
+    }
+
+    /// \brief Bounds checked reads of the mapped file
+    struct Parser
+    {
+      const char * data;
+      uint64_t size;
+      uint64_t pos;
+
+      template<class T>
+      bool pod(T & value)
+      {
+        if(pos > size || size - pos < sizeof(T)) return false;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+      }
+
+      bool string(std::string & s)
+      {
+        uint32_t n = 0;
+        if(!pod(n) || size - pos < n) return false;
+        s.assign(data + pos, n);
+        pos += n;
+        return true;
+      }
+    };
+
+    /// \brief Write a whole buffer, retrying short writes
+    bool writeAll(int fd, const void * data, size_t size)
+    {
+      const char * bytes = static_cast<const char *>(data);
+      while(size > 0)
+      {
+        ssize_t n = ::write(fd, bytes, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        bytes += n;
+        size -= n;
+      }
+      return true;
+    }
+  }
+
+  /// \brief Pointers to the columns of a loaded chunk
+  struct ChunkColumns
+  {
+    std::vector<char> storage; // the decompressed chunk, empty when read in place
+    uint32_t count = 0; // number of messages
+    const int64_t * stamps = nullptr; // time of each message
+    std::vector<const double *> scalars; // each scalar column
+    std::vector<const uint32_t *> offsets; // count + 1 element offsets of each array column
+    std::vector<const char *> elements; // elements of each array column
+    std::vector<ElementType> types; // element type of each array column
+  };
+
+  /////////////// LogWriter CLASS //////////////////////////
+  struct LogWriter::Buffer
+  {
+    std::vector<int64_t> stamps; // time of each message
+    std::vector<std::vector<double>> scalars; // each scalar column
+    std::vector<std::vector<uint32_t>> offsets; // element offsets of each array column, starting at 0
+    std::vector<std::vector<char>> elements; // elements of each array column
+    size_t bytes = 0; // size of the columns
+  };
+
+  LogWriter::LogWriter() = default;
+
+  LogWriter::~LogWriter()
+  {
+    close();
+  }
+
+  bool LogWriter::open(const std::string & path, const WriterParams & params)
+  {
+    close();
+
+    this->params = params;
+    schemas.clear();
+    buffers.clear();
+    index.clear();
+    num_chunks = 0;
+    offset = 0;
+    ok = true;
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = file_version;
+
+    ok = writeAll(fd, &header, sizeof(header));
+    offset = sizeof(header);
+    return ok;
+  }
+
+  int LogWriter::addTopic(const TopicSchema & schema)
+  {
+    TopicSchema s = schema;
+    s.array_types.resize(s.arrays.size(), ElementType::Float64);
+    schemas.push_back(s);
+
+    std::unique_ptr<Buffer> buffer(new Buffer);
+    buffer->scalars.resize(s.scalars.size());
+    buffer->offsets.assign(s.arrays.size(), std::vector<uint32_t>{0});
+    buffer->elements.resize(s.arrays.size());
+    buffers.push_back(std::move(buffer));
+
+    return schemas.size() - 1;
+  }
+
+  bool LogWriter::write(int topic, int64_t stamp_ns, const std::vector<double> & scalars,
+                        const std::vector<std::vector<double>> & arrays)
+  {
+    if(fd < 0 || topic < 0 || topic >= static_cast<int>(schemas.size())) return false;
+
+    const TopicSchema & schema = schemas.at(topic);
+    Buffer & buf = *buffers.at(topic);
+    if(scalars.size() != schema.scalars.size() || arrays.size() != schema.arrays.size()) return false;
+    if(!buf.stamps.empty() && stamp_ns < buf.stamps.back()) return false;
+
+    buf.stamps.push_back(stamp_ns);
+    for(unsigned int i = 0; i < scalars.size(); i++) buf.scalars.at(i).push_back(scalars.at(i));
+    buf.bytes += sizeof(int64_t) + scalars.size() * sizeof(double);
+
+    for(unsigned int a = 0; a < arrays.size(); a++)
+    {
+      std::vector<char> & elements = buf.elements.at(a);
+      const std::vector<double> & values = arrays.at(a);
+
+      if(schema.array_types.at(a) == ElementType::Float32)
+      {
+        for(double v : values) appendPod(elements, static_cast<float>(v));
+      }
+      else if(schema.array_types.at(a) == ElementType::Int32)
+      {
+        for(double v : values) appendPod(elements, static_cast<int32_t>(v));
+      }
+      else
+      {
+        for(double v : values) appendPod(elements, v);
+      }
+
+      buf.offsets.at(a).push_back(buf.offsets.at(a).back() + values.size());
+      buf.bytes += sizeof(uint32_t) + values.size() * elementSize(schema.array_types.at(a));
+    }
+
+    if(buf.stamps.size() >= params.chunk_messages || buf.bytes >= params.chunk_bytes) return flush(topic);
+    return ok;
+  }
+
+  bool LogWriter::flush(int topic)
+  {
+    Buffer & buf = *buffers.at(topic);
+    if(buf.stamps.empty()) return ok;
+
+    // columns one after another
+    std::vector<char> raw;
+    raw.reserve(buf.bytes + 8 * (2 + buf.scalars.size() + 2 * buf.offsets.size()));
+    appendBytes(raw, buf.stamps.data(), buf.stamps.size() * sizeof(int64_t));
+    for(auto & col : buf.scalars) appendBytes(raw, col.data(), col.size() * sizeof(double));
+    for(unsigned int a = 0; a < buf.offsets.size(); a++)
+    {
+      appendBytes(raw, buf.offsets.at(a).data(), buf.offsets.at(a).size() * sizeof(uint32_t));
+      appendBytes(raw, buf.elements.at(a).data(), buf.elements.at(a).size());
+    }
+
+    // a chunk that does not shrink is stored as is, so it can still be read in place
+    Codec codec = Codec::None;
+    std::vector<char> packed;
+    if(params.codec == Codec::Zlib)
+    {
+      uLongf packed_size = compressBound(raw.size());
+      packed.resize(packed_size);
+      if(compress2(reinterpret_cast<Bytef *>(packed.data()), &packed_size, reinterpret_cast<const Bytef *>(raw.data()),
+                   raw.size(), params.level) == Z_OK && packed_size < raw.size())
+      {
+        packed.resize(packed_size);
+        codec = Codec::Zlib;
+      }
+    }
+    const std::vector<char> & stored = codec == Codec::None ? raw : packed;
+
+    // chunks start 8 byte aligned so their columns can be read in place
+    static const char zeros[8] = {0};
+    uint64_t padding = pad8(offset) - offset;
+    ok = ok && writeAll(fd, zeros, padding);
+    offset += padding;
+
+    IndexRecord rec;
+    std::memset(&rec, 0, sizeof(rec));
+    rec.topic = topic;
+    rec.codec = static_cast<uint32_t>(codec);
+    rec.count = buf.stamps.size();
+    rec.t_first = buf.stamps.front();
+    rec.t_last = buf.stamps.back();
+    rec.offset = offset;
+    rec.stored_size = stored.size();
+    rec.raw_size = raw.size();
+    appendPod(index, rec);
+    num_chunks++;
+
+    ok = ok && writeAll(fd, stored.data(), stored.size());
+    offset += stored.size();
+
+    buf.stamps.clear();
+    for(auto & col : buf.scalars) col.clear();
+    for(auto & col : buf.offsets) col.assign(1, 0);
+    for(auto & col : buf.elements) col.clear();
+    buf.bytes = 0;
+
+    return ok;
+  }
+
+  bool LogWriter::close()
+  {
+    if(fd < 0) return ok;
+
+    for(unsigned int t = 0; t < buffers.size(); t++) flush(t);
+
+    std::vector<char> tail;
+    tail.resize(pad8(offset) - offset, 0);
+    uint64_t topics_offset = offset + tail.size();
+
+    appendPod(tail, static_cast<uint32_t>(schemas.size()));
+    for(auto & s : schemas)
+    {
+      appendString(tail, s.name);
+      appendString(tail, s.type);
+      appendString(tail, s.meta);
+      appendPod(tail, static_cast<uint32_t>(s.scalars.size()));
+      for(auto & name : s.scalars) appendString(tail, name);
+      appendPod(tail, static_cast<uint32_t>(s.arrays.size()));
+      for(unsigned int a = 0; a < s.arrays.size(); a++)
+      {
+        appendPod(tail, static_cast<uint32_t>(s.array_types.at(a)));
+        appendString(tail, s.arrays.at(a));
+      }
+    }
+    tail.resize(pad8(tail.size()), 0);
+
+    FileFooter footer;
+    std::memset(&footer, 0, sizeof(footer));
+    footer.topics_offset = topics_offset;
+    footer.index_offset = offset + tail.size();
+    footer.index_count = num_chunks;
+    std::memcpy(footer.magic, file_magic, sizeof(file_magic));
+    footer.version = file_version;
+
+    tail.insert(tail.end(), index.begin(), index.end());
+    appendPod(tail, footer);
+
+    ok = ok && writeAll(fd, tail.data(), tail.size());
+    ok = (::close(fd) == 0) && ok;
+    fd = -1;
+    return ok;
+  }
+
+  /////////////// ArrayView and MessageView ////////////////
+  double ArrayView::at(uint32_t i) const
+  {
+    if(type == ElementType::Float32) return static_cast<const float *>(data)[i];
+    if(type == ElementType::Int32) return static_cast<const int32_t *>(data)[i];
+    return static_cast<const double *>(data)[i];
+  }
+
+  double MessageView::scalar(int i) const
+  {
+    return chunk->scalars.at(i)[row];
+  }
+
+  ArrayView MessageView::array(int i) const
+  {
+    const uint32_t * offsets = chunk->offsets.at(i);
+
+    ArrayView view;
+    view.type = chunk->types.at(i);
+    view.size = offsets[row + 1] - offsets[row];
+    view.data = chunk->elements.at(i) + offsets[row] * elementSize(view.type);
+    return view;
+  }
+
+  /////////////// Cursor CLASS /////////////////////////////
+  bool Cursor::ready(Position & pos)
+  {
+    const auto & entries = reader->entries.at(pos.topic);
+    while(pos.entry < entries.size())
+    {
+      if(!pos.chunk) pos.chunk = reader->load(pos.topic, entries.at(pos.entry));
+      if(pos.chunk && pos.row < pos.chunk->count) return true;
+
+      pos.entry++;
+      pos.row = 0;
+      pos.chunk.reset();
+    }
+    return false;
+  }
+
+  bool Cursor::next(MessageView & out)
+  {
+    Position * best = nullptr;
+    for(auto & pos : positions)
+    {
+      if(!ready(pos)) continue;
+      if(!best || pos.chunk->stamps[pos.row] < best->chunk->stamps[best->row]) best = &pos;
+    }
+
+    if(!best || best->chunk->stamps[best->row] >= end) return false;
+
+    out.topic = best->topic;
+    out.stamp = best->chunk->stamps[best->row];
+    out.chunk = best->chunk.get();
+    out.row = best->row;
+
+    best->row++;
+    return true;
+  }
+
+  void Cursor::seek(int64_t stamp_ns)
+  {
+    for(auto & pos : positions)
+    {
+      // stamps do not decrease within a topic, so neither do the chunk end times
+      const auto & entries = reader->entries.at(pos.topic);
+      auto it = std::lower_bound(entries.begin(), entries.end(), stamp_ns, [](const LogReader::Entry & e, int64_t t)
+      {
+        return e.t_last < t;
+      });
+
+      pos.entry = it - entries.begin();
+      pos.row = 0;
+      pos.chunk.reset();
+      if(!ready(pos)) continue;
+
+      const int64_t * stamps = pos.chunk->stamps;
+      pos.row = std::lower_bound(stamps, stamps + pos.chunk->count, stamp_ns) - stamps;
+    }
+  }
+
+  /////////////// LogReader CLASS //////////////////////////
+  LogReader::LogReader() = default;
+
+  LogReader::~LogReader()
+  {
+    if(map) munmap(const_cast<char *>(map), map_size);
+  }
+
+  bool LogReader::open(const std::string & path)
+  {
+    if(map) munmap(const_cast<char *>(map), map_size);
+    map = nullptr;
+    map_size = 0;
+    schemas.clear();
+    entries.clear();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader) + sizeof(FileFooter)))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void * mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED) return false;
+
+    map = static_cast<const char *>(mapped);
+    map_size = st.st_size;
+
+    FileHeader header;
+    FileFooter footer;
+    std::memcpy(&header, map, sizeof(header));
+    std::memcpy(&footer, map + map_size - sizeof(footer), sizeof(footer));
+
+    bool valid = std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0 && header.version == file_version &&
+                 std::memcmp(footer.magic, file_magic, sizeof(file_magic)) == 0 && footer.version == file_version &&
+                 footer.topics_offset <= footer.index_offset &&
+                 footer.index_offset <= map_size - sizeof(footer) &&
+                 footer.index_count <= (map_size - sizeof(footer) - footer.index_offset) / sizeof(IndexRecord);
+
+    // topic table
+    Parser parser{map, footer.index_offset, footer.topics_offset};
+    uint32_t num_topics = 0;
+    valid = valid && parser.pod(num_topics);
+    for(uint32_t t = 0; valid && t < num_topics; t++)
+    {
+      TopicSchema s;
+      uint32_t n = 0;
+      valid = parser.string(s.name) && parser.string(s.type) && parser.string(s.meta) && parser.pod(n);
+      for(uint32_t i = 0; valid && i < n; i++)
+      {
+        s.scalars.emplace_back();
+        valid = parser.string(s.scalars.back());
+      }
+      valid = valid && parser.pod(n);
+      for(uint32_t i = 0; valid && i < n; i++)
+      {
+        uint32_t type = 0;
+        s.arrays.emplace_back();
+        valid = parser.pod(type) && parser.string(s.arrays.back()) && type <= 2;
+        s.array_types.push_back(static_cast<ElementType>(type));
+      }
+      schemas.push_back(s);
+    }
+    entries.resize(schemas.size());
+
+    // chunk index
+    for(uint64_t i = 0; valid && i < footer.index_count; i++)
+    {
+      IndexRecord rec;
+      std::memcpy(&rec, map + footer.index_offset + i * sizeof(IndexRecord), sizeof(rec));
+
+      valid = rec.topic < schemas.size() && rec.codec <= 1 && rec.offset % 8 == 0 &&
+              rec.offset <= footer.topics_offset && rec.stored_size <= footer.topics_offset - rec.offset;
+      if(!valid) break;
+
+      Entry e;
+      e.t_first = rec.t_first;
+      e.t_last = rec.t_last;
+      e.offset = rec.offset;
+      e.stored_size = rec.stored_size;
+      e.raw_size = rec.raw_size;
+      e.count = rec.count;
+      e.codec = static_cast<Codec>(rec.codec);
+      entries.at(rec.topic).push_back(e);
+    }
+
+    if(!valid)
+    {
+      munmap(const_cast<char *>(map), map_size);
+      map = nullptr;
+      map_size = 0;
+      schemas.clear();
+      entries.clear();
+      return false;
+    }
+
+    // chunks of a topic are written in time order
+    for(auto & topic_entries : entries)
+    {
+      std::stable_sort(topic_entries.begin(), topic_entries.end(), [](const Entry & a, const Entry & b)
+      {
+        return a.t_first < b.t_first;
+      });
+    }
+
+    return true;
+  }
+
+  std::shared_ptr<const ChunkColumns> LogReader::load(int topic, const Entry & entry) const
+  {
+    std::shared_ptr<ChunkColumns> chunk(new ChunkColumns);
+    const char * data = map + entry.offset;
+    uint64_t size = entry.stored_size;
+
+    if(entry.codec == Codec::Zlib)
+    {
+      chunk->storage.resize(entry.raw_size);
+      uLongf raw_size = entry.raw_size;
+      if(uncompress(reinterpret_cast<Bytef *>(chunk->storage.data()), &raw_size, reinterpret_cast<const Bytef *>(data),
+                    entry.stored_size) != Z_OK || raw_size != entry.raw_size) return nullptr;
+
+      data = chunk->storage.data();
+      size = raw_size;
+    }
+
+    const TopicSchema & schema = schemas.at(topic);
+    uint64_t count = entry.count;
+    uint64_t pos = 0;
+
+    // take the next column, if it fits
+    auto column = [&](uint64_t bytes) -> const char *
+    {
+      if(bytes > size || pos > size - bytes) return nullptr;
+      const char * col = data + pos;
+      pos += pad8(bytes);
+      return col;
+    };
+
+    chunk->count = entry.count;
+    chunk->stamps = reinterpret_cast<const int64_t *>(column(count * sizeof(int64_t)));
+    if(!chunk->stamps) return nullptr;
+
+    for(unsigned int i = 0; i < schema.scalars.size(); i++)
+    {
+      chunk->scalars.push_back(reinterpret_cast<const double *>(column(count * sizeof(double))));
+      if(!chunk->scalars.back()) return nullptr;
+    }
+
+    for(unsigned int a = 0; a < schema.arrays.size(); a++)
+    {
+      const uint32_t * offsets = reinterpret_cast<const uint32_t *>(column((count + 1) * sizeof(uint32_t)));
+      if(!offsets || !std::is_sorted(offsets, offsets + count + 1)) return nullptr;
+
+      const char * elements = column(uint64_t(offsets[count]) * elementSize(schema.array_types.at(a)));
+      if(!elements) return nullptr;
+
+      chunk->offsets.push_back(offsets);
+      chunk->elements.push_back(elements);
+      chunk->types.push_back(schema.array_types.at(a));
+    }
+
+    return chunk;
+  }
+
+  const std::vector<TopicSchema> & LogReader::topics() const
+  {
+    return schemas;
+  }
+
+  int LogReader::findTopic(const std::string & name) const
+  {
+    for(unsigned int t = 0; t < schemas.size(); t++)
+    {
+      if(schemas.at(t).name == name) return t;
+    }
+    return -1;
+  }
+
+  uint64_t LogReader::count(int topic) const
+  {
+    uint64_t n = 0;
+    for(auto & e : entries.at(topic)) n += e.count;
+    return n;
+  }
+
+  unsigned int LogReader::numChunks(int topic) const
+  {
+    return entries.at(topic).size();
+  }
+
+  int64_t LogReader::startTime() const
+  {
+    int64_t t = std::numeric_limits<int64_t>::max();
+    for(auto & topic_entries : entries)
+    {
+      if(!topic_entries.empty()) t = std::min(t, topic_entries.front().t_first);
+    }
+    return t == std::numeric_limits<int64_t>::max() ? 0 : t;
+  }
+
+  int64_t LogReader::endTime() const
+  {
+    int64_t t = std::numeric_limits<int64_t>::min();
+    for(auto & topic_entries : entries)
+    {
+      if(!topic_entries.empty()) t = std::max(t, topic_entries.back().t_last);
+    }
+    return t == std::numeric_limits<int64_t>::min() ? 0 : t;
+  }
+
+  Cursor LogReader::read(const std::vector<int> & topics, int64_t begin, int64_t end) const
+  {
+    Cursor cursor;
+    cursor.reader = this;
+    cursor.end = end;
+
+    std::vector<int> ids = topics;
+    if(ids.empty())
+    {
+      for(unsigned int t = 0; t < schemas.size(); t++) ids.push_back(t);
+    }
+
+    for(int t : ids)
+    {
+      if(t < 0 || t >= static_cast<int>(schemas.size())) continue;
+
+      Cursor::Position pos;
+      pos.topic = t;
+      cursor.positions.push_back(pos);
+    }
+
+    cursor.seek(begin);
+    return cursor;
+  }
+}
@@ -0,0 +1,575 @@
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Sparse>
+#include <vector>
+#include <iostream>
+#include <limits>
+#include <cmath>
+#include <future>
+#include <chrono>
+#include <memory>
+
+#include "nuslam/TurtleMap.h"
+#include "geometry_msgs/Point.h"
+
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/submap_slam.hpp"
+#include "nuslam/executor.hpp"
+#include "rigid2d/rigid2d.hpp"
+
+namespace ekf_slam
+{
+
+  // Convert a (th, x, y) vector into a transform
+  static rigid2d::Transform2D vec2transform(const Eigen::Vector3d & pose)
+  {
+    return rigid2d::Transform2D(rigid2d::Pose2D(pose(0), pose(1), pose(2)));
+  }
+
+  // Convert a transform into a (th, x, y) vector
+  static Eigen::Vector3d transform2vec(const rigid2d::Transform2D & T)
+  {
+    rigid2d::Pose2D pose = T.displacementRad();
+    return Eigen::Vector3d(pose.th, pose.x, pose.y);
+  }
+
+  // Add a whitened residual block to the sparse jacobian. cols holds the
+  // first column of each variable block, -1 for a fixed variable
+  static void addResidual(std::vector<Eigen::Triplet<double>> & J, std::vector<double> & r,
+                          const Eigen::MatrixXd & U, const Eigen::VectorXd & res,
+                          const std::vector<Eigen::MatrixXd> & blocks, const std::vector<int> & cols)
+  {
+    int row = r.size();
+
+    Eigen::VectorXd wres = U * res;
+    for(int i = 0; i < wres.size(); i++) r.push_back(wres(i));
+
+    for(unsigned int b = 0; b < blocks.size(); b++)
+    {
+      if(cols.at(b) < 0) continue;
+
+      Eigen::MatrixXd wblock = U * blocks.at(b);
+      for(int i = 0; i < wblock.rows(); i++)
+      {
+        for(int j = 0; j < wblock.cols(); j++)
+        {
+          J.emplace_back(row + i, cols.at(b) + j, wblock(i, j));
+        }
+      }
+    }
+  }
+
+  Submap freezeSubmap(const Slam & local)
+  {
+    Submap output;
+
+    Eigen::VectorXd state = local.getStateVector();
+    Eigen::MatrixXd covar = local.getCovariance();
+
+    output.end_pose = state.head<3>();
+    output.end_covar = covar.topLeftCorner<3, 3>();
+
+    int num_slots = (state.size() - 3) / 2;
+    for(int i = 0; i < num_slots; i++)
+    {
+      if(!local.isLandmarkInitialized(i)) continue;
+
+      output.landmarks.push_back(state.segment<2>(3 + 2*i));
+      output.landmark_covars.push_back(covar.block<2, 2>(3 + 2*i, 3 + 2*i));
+    }
+
+    return output;
+  }
+
+  GlobalMap joinSubmaps(const std::vector<Submap> & submaps, double gate, int iterations)
+  {
+    GlobalMap output;
+
+    int num_submaps = submaps.size();
+    if(num_submaps == 0) return output;
+
+    // Initial guess for each origin by chaining the submap end poses
+    rigid2d::Transform2D T_origin;
+    for(int k = 0; k < num_submaps; k++)
+    {
+      output.origins.push_back(transform2vec(T_origin));
+      T_origin *= vec2transform(submaps.at(k).end_pose);
+    }
+
+    // Associate local landmarks to global ones with a nearest neighbor search
+    for(int k = 0; k < num_submaps; k++)
+    {
+      rigid2d::Transform2D T_gk = vec2transform(output.origins.at(k));
+      std::vector<int> assoc;
+      std::vector<bool> used(output.landmarks.size(), false);
+
+      for(auto landmark : submaps.at(k).landmarks)
+      {
+        rigid2d::Vector2D g = T_gk(rigid2d::Vector2D(landmark(0), landmark(1)));
+
+        int best = -1;
+        double best_dist = gate;
+        for(unsigned int j = 0; j < output.landmarks.size(); j++)
+        {
+          if(used.at(j)) continue;
+
+          double dist = std::hypot(output.landmarks.at(j)(0) - g.x, output.landmarks.at(j)(1) - g.y);
+          if(dist < best_dist)
+          {
+            best = j;
+            best_dist = dist;
+          }
+        }
+
+        if(best < 0)
+        {
+          best = output.landmarks.size();
+          output.landmarks.push_back(Eigen::Vector2d(g.x, g.y));
+          used.push_back(false);
+        }
+
+        used.at(best) = true;
+        assoc.push_back(best);
+      }
+
+      output.associations.push_back(assoc);
+    }
+
+    // The first origin is fixed, everything else is solved for
+    int num_vars = 3*(num_submaps - 1) + 2*output.landmarks.size();
+    if(num_vars == 0) return output;
+
+    auto origin_col = [](int k) { return k == 0 ? -1 : 3*(k - 1); };
+    int landmark_col0 = 3*(num_submaps - 1);
+
+    for(int it = 0; it < iterations; it++)
+    {
+      std::vector<Eigen::Triplet<double>> triplets;
+      std::vector<double> residuals;
+
+      for(int k = 0; k < num_submaps; k++)
+      {
+        const Submap & sub = submaps.at(k);
+        const Eigen::Vector3d & X1 = output.origins.at(k);
+        double c = std::cos(X1(0)), s = std::sin(X1(0));
+
+        Eigen::Matrix2d RT;
+        RT << c, s,
+              -s, c;
+
+        // Relative pose constraint to the next submap
+        if(k + 1 < num_submaps)
+        {
+          const Eigen::Vector3d & X2 = output.origins.at(k + 1);
+          Eigen::Vector2d p = RT * (X2.tail<2>() - X1.tail<2>());
+
+          Eigen::Vector3d res;
+          res(0) = rigid2d::normalize_angle(sub.end_pose(0) - (X2(0) - X1(0)));
+          res.tail<2>() = sub.end_pose.tail<2>() - p;
+
+          Eigen::MatrixXd J1 = Eigen::MatrixXd::Zero(3, 3);
+          J1(0, 0) = -1;
+          J1(1, 0) = p(1);
+          J1(2, 0) = -p(0);
+          J1.bottomRightCorner(2, 2) = -RT;
+
+          Eigen::MatrixXd J2 = Eigen::MatrixXd::Zero(3, 3);
+          J2(0, 0) = 1;
+          J2.bottomRightCorner(2, 2) = RT;
+
+          Eigen::Matrix3d info = (sub.end_covar + Eigen::Matrix3d::Identity() * 1e-9).inverse();
+          Eigen::MatrixXd U = info.llt().matrixU();
+
+          addResidual(triplets, residuals, U, res, {J1, J2}, {origin_col(k), origin_col(k + 1)});
+        }
+
+        // Landmark constraints
+        for(unsigned int m = 0; m < sub.landmarks.size(); m++)
+        {
+          int j = output.associations.at(k).at(m);
+          Eigen::Vector2d h = RT * (output.landmarks.at(j) - X1.tail<2>());
+
+          Eigen::Vector2d res = sub.landmarks.at(m) - h;
+
+          Eigen::MatrixXd Jx = Eigen::MatrixXd::Zero(2, 3);
+          Jx(0, 0) = h(1);
+          Jx(1, 0) = -h(0);
+          Jx.rightCols(2) = -RT;
+
+          Eigen::MatrixXd Jl = RT;
+
+          Eigen::Matrix2d info = (sub.landmark_covars.at(m) + Eigen::Matrix2d::Identity() * 1e-9).inverse();
+          Eigen::MatrixXd U = info.llt().matrixU();
+
+          addResidual(triplets, residuals, U, res, {Jx, Jl}, {origin_col(k), landmark_col0 + 2*j});
+        }
+      }
+
+      // Solve the normal equations
+      Eigen::SparseMatrix<double> J(residuals.size(), num_vars);
+      J.setFromTriplets(triplets.begin(), triplets.end());
+
+      Eigen::VectorXd r = Eigen::Map<Eigen::VectorXd>(residuals.data(), residuals.size());
+
+      Eigen::SparseMatrix<double> H = J.transpose() * J;
+      Eigen::VectorXd b = J.transpose() * r;
+
+      auto solver = std::make_shared<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>>(H);
+      if(solver->info() != Eigen::Success)
+      {
+        std::cout << "Submap join failed to factor the normal equations\n";
+        break;
+      }
+
+      // keep the factorization so covarience entries can be recovered on request
+      output.information = solver;
+
+      Eigen::VectorXd dx = solver->solve(b);
+
+      for(int k = 1; k < num_submaps; k++)
+      {
+        output.origins.at(k) += dx.segment<3>(origin_col(k));
+        output.origins.at(k)(0) = rigid2d::normalize_angle(output.origins.at(k)(0));
+      }
+
+      for(unsigned int j = 0; j < output.landmarks.size(); j++)
+      {
+        output.landmarks.at(j) += dx.segment<2>(landmark_col0 + 2*j);
+      }
+
+      if(dx.lpNorm<Eigen::Infinity>() < 1e-9) break;
+    }
+
+    return output;
+  }
+
+  bool recoverCovarianceColumns(const GlobalMap & map, int id, Eigen::MatrixXd & out)
+  {
+    if(!map.information || id < 0 || id >= static_cast<int>(map.landmarks.size())) return false;
+
+    int col = 3*(map.origins.size() - 1) + 2*id;
+    int num_vars = map.information->rows();
+
+    Eigen::MatrixXd unit = Eigen::MatrixXd::Zero(num_vars, 2);
+    unit(col, 0) = 1;
+    unit(col + 1, 1) = 1;
+
+    out = map.information->solve(unit);
+    return true;
+  }
+
+  /////////////// SubmapSlam CLASS /////////////////////////
+  SubmapSlam::SubmapSlam(int submap_landmarks, Eigen::Matrix3d q_var, Eigen::Matrix2d r_var) : local(submap_landmarks, q_var, r_var)
+  {
+    this->submap_landmarks = submap_landmarks;
+    Qnoise = q_var;
+    Rnoise = r_var;
+  }
+
+  SubmapSlam::~SubmapSlam()
+  {
+    if(pending_join.valid()) pending_join.wait();
+  }
+
+  void SubmapSlam::MotionModelUpdate(rigid2d::Twist2D tw)
+  {
+    pollJoin();
+    local.MotionModelUpdate(tw);
+  }
+
+  void SubmapSlam::MeasurmentModelUpdate(nuslam::TurtleMap map_data)
+  {
+    local.MeasurmentModelUpdate(map_data);
+    innovations = local.getInnovations();
+
+    if(local.isFull()) startNewSubmap();
+  }
+
+  const std::vector<Innovation> & SubmapSlam::getInnovations() const
+  {
+    return innovations;
+  }
+
+  void SubmapSlam::startNewSubmap()
+  {
+    frozen.push_back(freezeSubmap(local));
+
+    // The new filter starts at the origin of its own frame
+    local = Slam(submap_landmarks, Qnoise, Rnoise);
+    local.useJointCompatibility(use_jcbb, jcbb_time_budget);
+    local.setAssociationThresholds(deadband_min, deadband_max);
+    local.injectNoise(inject_noise);
+
+    std::cout << "Froze submap " << frozen.size() - 1 << "\n";
+
+    if(pending_join.valid())
+    {
+      join_requested = true;
+    }
+    else
+    {
+      pending_join = startJoin();
+    }
+  }
+
+  std::future<GlobalMap> SubmapSlam::startJoin() const
+  {
+    // run on the shared executor so the join does not start a thread of its own
+    std::vector<Submap> submaps = frozen;
+    double gate = join_gate;
+    int iterations = join_iterations;
+
+    return executor::Executor::instance().async([submaps, gate, iterations]() { return joinSubmaps(submaps, gate, iterations); });
+  }
+
+  void SubmapSlam::pollJoin()
+  {
+    if(!pending_join.valid()) return;
+
+    if(pending_join.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+    joined = pending_join.get();
+    joined_columns.clear();
+
+    // Submaps were frozen while the last join was running, join again
+    if(join_requested)
+    {
+      join_requested = false;
+      pending_join = startJoin();
+    }
+  }
+
+  void SubmapSlam::waitForJoin()
+  {
+    while(pending_join.valid())
+    {
+      pending_join.wait();
+      pollJoin();
+    }
+  }
+
+  rigid2d::Transform2D SubmapSlam::getOrigin(unsigned int i) const
+  {
+    rigid2d::Transform2D T_origin;
+    unsigned int k = 0;
+
+    // start from the latest origin that has been joined
+    if(!joined.origins.empty())
+    {
+      k = std::min(i, static_cast<unsigned int>(joined.origins.size() - 1));
+      T_origin = vec2transform(joined.origins.at(k));
+    }
+
+    for(; k < i; k++)
+    {
+      T_origin *= vec2transform(frozen.at(k).end_pose);
+    }
+
+    return T_origin;
+  }
+
+  std::vector<double> SubmapSlam::getRobotState()
+  {
+    std::vector<double> local_pose = local.getRobotState();
+
+    rigid2d::Transform2D T_gr = getOrigin(frozen.size()) * rigid2d::Transform2D(rigid2d::Pose2D(local_pose.at(0), local_pose.at(1), local_pose.at(2)));
+
+    rigid2d::Pose2D pose = T_gr.displacementRad();
+
+    return {pose.th, pose.x, pose.y};
+  }
+
+  std::vector<geometry_msgs::Point> SubmapSlam::getLandmarkStates()
+  {
+    geometry_msgs::Point buf;
+    Eigen::Vector2d landmark;
+
+    std::vector<geometry_msgs::Point> output;
+
+    int num_ids = getNumLandmarkIds();
+    for(int id = 0; id < num_ids; id++)
+    {
+      getLandmarkPosition(id, landmark);
+
+      buf.x = landmark(0) + 0.05; // added value to offset state because base_scan is offset from base_link
+      buf.y = landmark(1);
+
+      output.push_back(buf);
+    }
+
+    return output;
+  }
+
+  int SubmapSlam::getNumLandmarkIds() const
+  {
+    int num_ids = joined.landmarks.size();
+
+    for(unsigned int k = joined.associations.size(); k < frozen.size(); k++)
+    {
+      num_ids += frozen.at(k).landmarks.size();
+    }
+
+    return num_ids + local.getNumLandmarks();
+  }
+
+  bool SubmapSlam::locateLandmark(int id, int & submap, int & index) const
+  {
+    if(id < 0) return false;
+
+    // landmarks from the last join
+    if(id < static_cast<int>(joined.landmarks.size()))
+    {
+      submap = -1;
+      index = id;
+      return true;
+    }
+    id -= joined.landmarks.size();
+
+    // landmarks from frozen submaps that have not been joined yet
+    for(unsigned int k = joined.associations.size(); k < frozen.size(); k++)
+    {
+      if(id < static_cast<int>(frozen.at(k).landmarks.size()))
+      {
+        submap = k;
+        index = id;
+        return true;
+      }
+      id -= frozen.at(k).landmarks.size();
+    }
+
+    // landmarks in the local filter
+    for(int i = 0; i < submap_landmarks; i++)
+    {
+      if(!local.isLandmarkInitialized(i)) continue;
+
+      if(id == 0)
+      {
+        submap = frozen.size();
+        index = i;
+        return true;
+      }
+      id--;
+    }
+
+    return false;
+  }
+
+  bool SubmapSlam::getLandmarkPosition(int id, Eigen::Vector2d & out) const
+  {
+    int submap = 0, index = 0;
+    if(!locateLandmark(id, submap, index)) return false;
+
+    if(submap < 0)
+    {
+      out = joined.landmarks.at(index);
+      return true;
+    }
+
+    Eigen::Vector2d landmark;
+    if(submap < static_cast<int>(frozen.size()))
+    {
+      landmark = frozen.at(submap).landmarks.at(index);
+    }
+    else
+    {
+      local.getLandmarkPosition(index, landmark);
+    }
+
+    rigid2d::Vector2D g = getOrigin(submap)(rigid2d::Vector2D(landmark(0), landmark(1)));
+    out << g.x, g.y;
+
+    return true;
+  }
+
+  bool SubmapSlam::getJoinedBlock(int j1, int j2, Eigen::Matrix2d & out) const
+  {
+    auto cols = joined_columns.find(j2);
+    if(cols == joined_columns.end())
+    {
+      Eigen::MatrixXd buf;
+      if(!recoverCovarianceColumns(joined, j2, buf)) return false;
+
+      cols = joined_columns.emplace(j2, buf).first;
+    }
+
+    out = cols->second.block<2, 2>(3*(joined.origins.size() - 1) + 2*j1, 0);
+    return true;
+  }
+
+  bool SubmapSlam::getLandmarkMarginal(int id, Eigen::Matrix2d & out) const
+  {
+    return getLandmarkCrossCovariance(id, id, out);
+  }
+
+  bool SubmapSlam::getLandmarkCrossCovariance(int id1, int id2, Eigen::Matrix2d & out) const
+  {
+    int submap1 = 0, index1 = 0, submap2 = 0, index2 = 0;
+    if(!locateLandmark(id1, submap1, index1) || !locateLandmark(id2, submap2, index2)) return false;
+
+    out.setZero();
+
+    if(submap1 != submap2) return true; // treated as independent
+
+    if(submap1 < 0) return getJoinedBlock(index1, index2, out);
+
+    // rotate the submap frame covarience into the global frame
+    Eigen::Matrix2d local_covar;
+    if(submap1 < static_cast<int>(frozen.size()))
+    {
+      if(index1 != index2) return true; // only marginals are kept for frozen submaps
+      local_covar = frozen.at(submap1).landmark_covars.at(index1);
+    }
+    else
+    {
+      local.getLandmarkCrossCovariance(index1, index2, local_covar);
+    }
+
+    double th = getOrigin(submap1).displacementRad().th;
+    Eigen::Matrix2d R;
+    R << std::cos(th), -std::sin(th),
+         std::sin(th), std::cos(th);
+
+    out = R * local_covar * R.transpose();
+    return true;
+  }
+
+  bool SubmapSlam::getRelativeCovariance(int id1, int id2, Eigen::Matrix2d & out) const
+  {
+    Eigen::Matrix2d P11, P22, P12;
+
+    if(!getLandmarkMarginal(id1, P11) || !getLandmarkMarginal(id2, P22)) return false;
+    getLandmarkCrossCovariance(id1, id2, P12);
+
+    out = P11 + P22 - P12 - P12.transpose();
+    return true;
+  }
+
+  int SubmapSlam::getNumSubmaps() const
+  {
+    return frozen.size();
+  }
+
+  void SubmapSlam::setJoinGate(double gate)
+  {
+    join_gate = gate;
+  }
+
+  void SubmapSlam::useJointCompatibility(bool enable, double time_budget)
+  {
+    use_jcbb = enable;
+    jcbb_time_budget = time_budget;
+    local.useJointCompatibility(enable, time_budget);
+  }
+
+  void SubmapSlam::setAssociationThresholds(double min, double max)
+  {
+    deadband_min = min;
+    deadband_max = max;
+    local.setAssociationThresholds(min, max);
+  }
+
+  void SubmapSlam::injectNoise(bool enable)
+  {
+    inject_noise = enable;
+    local.injectNoise(enable);
+  }
+}
@@ -0,0 +1,117 @@
+/// \file
+/// \brief Source file for the simulated turtlebot sensors
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "nuslam/synthetic_sensors.hpp"
+
+namespace synthetic
+{
+
+  ArenaParams ringArena(int count)
+  {
+    ArenaParams params;
+
+    // the default twist drives a 0.5m circle around (0, 0.5), the cylinders sit 1m from its center
+    double radius = params.twist.vx / params.twist.wz;
+    for(int k = 0; k < count; k++)
+    {
+      double a = 2.0 * rigid2d::PI * (k + 0.5) / count;
+      params.landmarks.emplace_back(std::cos(a), radius + std::sin(a));
+    }
+    return params;
+  }
+
+  SyntheticRobot::SyntheticRobot(const ArenaParams & params) : arena(params), gen(params.seed), noise(0.0, params.range_noise)
+  {
+    rigid2d::DiffDrive bot(rigid2d::Pose2D(0, 0, 0), arena.wheel_base, arena.wheel_radius);
+    wheel_rates = bot.twistToWheels(arena.twist);
+  }
+
+  rigid2d::Pose2D SyntheticRobot::pose(double t) const
+  {
+    const rigid2d::Twist2D & tw = arena.twist;
+    if(rigid2d::almost_equal(tw.wz, 0.0, 1e-9)) return rigid2d::Pose2D(0.0, tw.vx * t, tw.vy * t);
+
+    double th = tw.wz * t;
+    double x = (tw.vx * std::sin(th) + tw.vy * (std::cos(th) - 1.0)) / tw.wz;
+    double y = (tw.vx * (1.0 - std::cos(th)) + tw.vy * std::sin(th)) / tw.wz;
+    return rigid2d::Pose2D(rigid2d::normalize_angle(th), x, y);
+  }
+
+  double SyntheticRobot::period() const
+  {
+    return rigid2d::almost_equal(arena.twist.wz, 0.0, 1e-9) ? 0.0 : 2.0 * rigid2d::PI / std::fabs(arena.twist.wz);
+  }
+
+  rigid2d::WheelVelocities SyntheticRobot::wheelAngles(double t) const
+  {
+    return rigid2d::WheelVelocities(wheel_rates.ul * t, wheel_rates.ur * t);
+  }
+
+  void SyntheticRobot::encoders(double t, int32_t & left, int32_t & right) const
+  {
+    rigid2d::WheelVelocities angles = wheelAngles(t);
+    double rad2enc = arena.encoder_ticks_per_rev / (2.0 * rigid2d::PI);
+    left = rad2enc * angles.ul;
+    right = rad2enc * angles.ur;
+  }
+
+  void SyntheticRobot::scan(const rigid2d::Pose2D & pose, std::vector<float> & ranges)
+  {
+    ranges.resize(arena.num_beams);
+
+    const double r2 = arena.landmark_radius * arena.landmark_radius;
+    const double p2 = pose.x * pose.x + pose.y * pose.y;
+
+    for(int i = 0; i < arena.num_beams; i++)
+    {
+      double a = pose.th + 2.0 * rigid2d::PI * i / arena.num_beams;
+      double dx = std::cos(a), dy = std::sin(a);
+
+      // the wall, from inside it
+      double b = pose.x * dx + pose.y * dy;
+      double best = -b + std::sqrt(std::max(0.0, b * b - (p2 - arena.wall_radius * arena.wall_radius)));
+
+      for(auto & l : arena.landmarks)
+      {
+        double mx = l.x - pose.x, my = l.y - pose.y;
+        double along = mx * dx + my * dy;
+        double off2 = mx * mx + my * my - along * along;
+        if(along <= 0.0 || off2 >= r2) continue;
+
+        best = std::min(best, along - std::sqrt(r2 - off2));
+      }
+
+      // no return reads as 0, like the turtlebot lidar
+      double range = best + noise(gen);
+      ranges.at(i) = range < arena.range_min || range > arena.range_max ? 0.0f : static_cast<float>(range);
+    }
+  }
+
+  void SyntheticRobot::landmarks(const rigid2d::Pose2D & pose, nuslam::TurtleMap & map) const
+  {
+    map.centers.clear();
+    map.radii.clear();
+
+    rigid2d::Transform2D T_rw = rigid2d::Transform2D(pose).inv();
+    for(auto & l : arena.landmarks)
+    {
+      rigid2d::Vector2D c = T_rw(l);
+      if(c.length() > arena.landmark_range) continue;
+
+      geometry_msgs::Point center;
+      center.x = c.x;
+      center.y = c.y;
+      map.centers.push_back(center);
+      map.radii.push_back(arena.landmark_radius);
+    }
+  }
+
+  const ArenaParams & SyntheticRobot::params() const
+  {
+    return arena;
+  }
+
+}
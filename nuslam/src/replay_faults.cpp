@@ -0,0 +1,99 @@
+/// \file
+/// \brief Replays a sensor log through the landmarks and slam pipeline over faulty links and prints the metrics
+///
+/// USAGE:
+///     rosrun nuslam replay_faults input.nlog [--profile NAME]... [--seed N] [--runs N] [--scan_cost S]
+///     --profile NAME: a link profile, clean, wifi, congested, lossy or glitchy (default all of them)
+///     --seed N: the seed of the first run (default 1)
+///     --runs N: the runs of each profile, each with the next seed (default 1)
+///     --scan_cost S: the time (s) the pipeline takes for each scan, 0 for the measured time, which makes the
+///                    latency and superseded scans depend on the load of the machine (default 0)
+/// The errors of every profile are against a replay over the clean link with the first seed.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+#include <ros/time.h>
+
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/fault_replay.hpp"
+
+int main(int argc, char** argv)
+{
+  if(argc < 2)
+  {
+    std::cerr << "usage: replay_faults input.nlog [--profile NAME]... [--seed N] [--runs N] [--scan_cost S]\n";
+    return 1;
+  }
+
+  // the filter stamps the landmarks it sees
+  ros::Time::init();
+
+  replay::PipelineParams params;
+  std::vector<std::string> profiles;
+  uint32_t seed = 1;
+  int runs = 1;
+  for(int i = 2; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if(arg == "--profile" && i + 1 < argc) profiles.push_back(argv[++i]);
+    else if(arg == "--seed" && i + 1 < argc) seed = std::strtoul(argv[++i], nullptr, 10);
+    else if(arg == "--runs" && i + 1 < argc) runs = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--scan_cost" && i + 1 < argc) params.scan_cost = std::max(0.0, std::atof(argv[++i]));
+  }
+  if(profiles.empty()) profiles = {"clean", "wifi", "congested", "lossy", "glitchy"};
+
+  sensor_log::LogReader log;
+  if(!log.open(argv[1]))
+  {
+    std::cerr << "REPLAY_FAULTS: Could not open " << argv[1] << "\n";
+    return 1;
+  }
+
+  replay::FaultProfile clean;
+  replay::profileByName("clean", clean);
+
+  std::vector<replay::TrajectoryPoint> reference;
+  replay::ReplayMetrics base = replay::replayLog(log, params, clean, seed, nullptr, &reference);
+  if(base.scans == 0)
+  {
+    std::cerr << "REPLAY_FAULTS: No " << params.scan_topic << " scans with " << params.joint_topic << " odometry in the log\n";
+    return 1;
+  }
+
+  std::cout << std::left << std::setw(10) << "profile" << std::right << std::setw(6) << "seed"
+            << std::setw(8) << "drop" << std::setw(8) << "super" << std::setw(8) << "reord" << std::setw(8) << "glitch"
+            << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms"
+            << std::setw(10) << "scans/s" << std::setw(10) << "rmse m" << std::setw(10) << "max m"
+            << std::setw(10) << "th rad" << "\n";
+  std::cout << std::fixed;
+
+  for(auto & name : profiles)
+  {
+    replay::FaultProfile profile;
+    if(!replay::profileByName(name, profile))
+    {
+      std::cerr << "REPLAY_FAULTS: Unknown profile " << name << "\n";
+      continue;
+    }
+
+    for(int run = 0; run < runs; run++)
+    {
+      replay::ReplayMetrics m = replay::replayLog(log, params, profile, seed + run, &reference);
+
+      std::cout << std::left << std::setw(10) << name << std::right << std::setw(6) << seed + run
+                << std::setw(8) << m.scans_dropped << std::setw(8) << m.scans_superseded
+                << std::setw(8) << m.reordered << std::setw(8) << m.glitches + m.stuck
+                << std::setprecision(2) << std::setw(10) << m.latency_p50 * 1e3 << std::setw(10) << m.latency_p99 * 1e3
+                << std::setw(10) << m.latency_max * 1e3 << std::setprecision(0) << std::setw(10) << m.throughput
+                << std::setprecision(4) << std::setw(10) << m.position_rmse << std::setw(10) << m.position_max
+                << std::setw(10) << m.heading_rmse << "\n";
+    }
+  }
+
+  return 0;
+}
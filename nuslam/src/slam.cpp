@@ -11,15 +11,49 @@
 ///     frequency (double) the frequency to publish joint states at
 ///     num_landmarks (int) the number of landmarks allowed in the state vector
 ///     map_frame_id (std::string) the name of the map frame
+///     submap_landmarks (int) if > 0, use submap-joining SLAM with this many landmarks per submap
+///     join_gate (double) the max distance to associate landmarks between submaps
+///     use_jcbb (bool) associate each scan jointly with JCBB instead of greedy nearest neighbor
+///     jcbb_time_budget (double) the max time (s) to spend on each JCBB search
+///     q_var (double) the variance of the motion noise on each of the robot states
+///     r_var (double) the variance of the sensor noise on the range and the bearing
+///     deadband_min (double) the mahalanobis distance under which a measurement is a known landmark
+///     deadband_max (double) the mahalanobis distance over which a measurement is a new landmark
+///     ellipse_threshold (double) the change in a landmark estimate required to republish its covarience ellipse
+///     executor_threads (int) the number of worker threads shared by the background work, 0 for one per core
+///     pin_threads (bool) pin each worker thread to one cpu
+///     use_pose_graph (bool) run lidar pose graph SLAM on the scans instead of landmark EKF SLAM
+///     keyframe_distance (double) the distance (m) the robot moves before a new pose graph keyframe
+///     keyframe_angle (double) the rotation (rad) of the robot before a new pose graph keyframe
+///     icp_max_dist (double) the max distance (m) between matched scan points
+///     icp_max_rms (double) the max rms error (m) of an accepted scan match
+///     loop_radius (double) keyframes closer than this (m) are tried as loop closures, without place recognition
+///     use_place_recognition (bool) find loop closure candidates with a scan context index instead of by distance
+///     loop_min_separation (int) keyframes this close in sequence are not tried as loop closures
+///     snapshot_threshold (double) the change in a landmark estimate below which a map snapshot block is shared with the last version
+///     nis_threshold (double) the flight recorder is dumped when the mean normalized innovation squared of a scan is above this
+///     tf_rate (double) the rate to broadcast the map to odom transform to tf (Hz), 0 for every update
+///     lockstep (bool) ack each joint state to the gazebo plugin, once the odometry and any filter update are out
+///     recorder_seconds (double) the seconds of history the flight recorder keeps
+///     recorder_directory (std::string) where the flight recorder dumps are written
 /// PUBLISHES:
 ///     /odom_path (nav_msgs/Path): The path of the robot following purely odometry
 ///     /slam_path (nav_msgs/Path): The path of the robot following slam estimate
 ///     /slam_landmark_data (nuslam/TurtleMap): landmark state estimate from slam
+///     /slam_landmark_covariance (visualization_msgs/MarkerArray): 3 sigma covarience ellipses of landmarks that changed
+///     /lockstep_ack (std_msgs/UInt64): The joint states handled, in lockstep only
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /joint_states (sensor_msgs/JointState): Retrieves the calculated wheel velocities and change in wheel position
 ///     /landmark_data (nuslam/TurtleMap): landmark position and size information
+///     /scan (sensor_msgs/LaserScan): raw laser data, only used for pose graph SLAM
+/// SERVICES:
+///     ~dump_recorder (std_srvs/Trigger): writes the flight recorder to disk, the message is the file
 
 #include <iostream>
+#include <memory>
+#include <cmath>
+#include <chrono>
 
 #include <ros/ros.h>
 
@@ -32,22 +66,124 @@
 #include <nav_msgs/Odometry.h>
 #include <nav_msgs/Path.h>
 #include <sensor_msgs/JointState.h>
+#include <sensor_msgs/LaserScan.h>
+#include <std_srvs/Trigger.h>
+#include <visualization_msgs/MarkerArray.h>
 
 #include "nuslam/TurtleMap.h"
 
 #include "rigid2d/SetPose.h"
 #include "rigid2d/rigid2d.hpp"
 #include "rigid2d/diff_drive.hpp"
+#include "rigid2d/flight_recorder.hpp"
+#include "rigid2d/frame_tree.hpp"
+#include "rigid2d/tf_bridge.hpp"
+#include "rigid2d/lockstep.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 #include "nuslam/ekf_slam.hpp"
+#include "nuslam/submap_slam.hpp"
+#include "nuslam/executor.hpp"
+#include "nuslam/map_snapshot.hpp"
+#include "nuslam/pose_graph.hpp"
 
 //Global Variables
 static sensor_msgs::JointState cur_js;
 static nuslam::TurtleMap cur_landmarks;
 static int got_odom_data = 0;
 static int got_slam_data = 0;
+static int got_scan_data = 0;
+static std::vector<rigid2d::Vector2D> cur_scan;
 static rigid2d::DiffDrive bot;
 
+static std::unique_ptr<flight_recorder::Recorder> recorder;
+static std::string recorder_directory = "/tmp";
+
+/// \brief The landmark estimate used for the last published covarience ellipse
+struct EllipseState
+{
+  bool valid = false; ///< an ellipse was published for this landmark id
+  Eigen::Vector2d mean = Eigen::Vector2d::Zero(); ///< landmark position
+  Eigen::Matrix2d covar = Eigen::Matrix2d::Zero(); ///< landmark marginal covarience
+};
+
+/// \brief Add a covarience ellipse marker for each landmark that changed since it was last published
+/// \param snap the map snapshot to draw
+/// \param published [in/out] the last published estimate for each landmark id, valid for the ids drawn
+/// \param threshold the change in position (m) or relative change in covarience needed to republish
+/// \param frame_id the frame of the markers
+/// \param markers [out] the markers to publish
+void addChangedEllipses(const ekf_slam::MapSnapshot & snap, std::vector<EllipseState> & published, double threshold,
+                        std::string frame_id, visualization_msgs::MarkerArray & markers)
+{
+  visualization_msgs::Marker marker;
+  marker.header.frame_id = frame_id;
+  marker.header.stamp = ros::Time::now();
+  marker.ns = "landmark_covariance";
+  marker.type = visualization_msgs::Marker::CYLINDER;
+  marker.color.r = 1.0;
+  marker.color.g = 0.5;
+  marker.color.b = 0.0;
+  marker.color.a = 0.4;
+
+  // snapshot landmarks are in id order
+  int num_ids = snap.size() > 0 ? snap.landmark(snap.size() - 1).id + 1 : 0;
+
+  std::vector<bool> present(num_ids, false);
+  for(int i = 0; i < snap.size(); i++) present.at(snap.landmark(i).id) = true;
+
+  // remove the ellipse of every drawn id missing from the snapshot, ids can be dropped from the middle
+  for(unsigned int id = 0; id < published.size(); id++)
+  {
+    if(!published.at(id).valid || (id < present.size() && present.at(id))) continue;
+
+    published.at(id).valid = false;
+    marker.id = id;
+    marker.action = visualization_msgs::Marker::DELETE;
+    markers.markers.push_back(marker);
+  }
+  published.resize(num_ids);
+
+  Eigen::Vector2d mean;
+  Eigen::Matrix2d covar;
+
+  for(int i = 0; i < snap.size(); i++)
+  {
+    const ekf_slam::LandmarkEntry & l = snap.landmark(i);
+    mean << l.x, l.y;
+    covar << l.cov_xx, l.cov_xy,
+             l.cov_xy, l.cov_yy;
+
+    EllipseState & last = published.at(l.id);
+    if(last.valid && (mean - last.mean).norm() < threshold && (covar - last.covar).norm() < threshold * last.covar.norm()) continue;
+
+    last.valid = true;
+    last.mean = mean;
+    last.covar = covar;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> eig(covar);
+    Eigen::Vector2d axes = eig.eigenvalues().cwiseMax(0).cwiseSqrt() * 3.0;
+    double yaw = std::atan2(eig.eigenvectors()(1, 1), eig.eigenvectors()(0, 1));
+
+    marker.id = l.id;
+    marker.action = visualization_msgs::Marker::ADD;
+
+    marker.pose.position.x = mean(0) + 0.05; // same base_scan offset as the published landmark states
+    marker.pose.position.y = mean(1);
+    marker.pose.position.z = 0.01;
+    marker.pose.orientation.x = 0;
+    marker.pose.orientation.y = 0;
+    marker.pose.orientation.z = std::sin(yaw/2.);
+    marker.pose.orientation.w = std::cos(yaw/2.);
+
+    marker.scale.x = 2.0 * axes(1);
+    marker.scale.y = 2.0 * axes(0);
+    marker.scale.z = 0.01;
+
+    markers.markers.push_back(marker);
+  }
+}
+
 /// \brief Use to search through the all joint names and return the index of the desired joint
 /// \param joints - a vector of all the joint names
 /// \param target - the desire joint name to find
@@ -74,6 +210,40 @@ void callback_landmarks(const nuslam::TurtleMap::ConstPtr data)
 {
     cur_landmarks = *data;
     got_slam_data = 1;
+
+    uint64_t stamp = data->header.stamp.toNSec();
+    for(unsigned int i = 0; i < data->centers.size(); i++)
+    {
+        double radius = i < data->radii.size() ? data->radii.at(i) : 0.0;
+        recorder->record(flight_recorder::Channel::Landmark, stamp, {data->centers.at(i).x, data->centers.at(i).y, radius}, i);
+    }
+}
+
+/// \brief Service to write the flight recorder to disk
+///
+bool callback_dump(std_srvs::Trigger::Request &, std_srvs::Trigger::Response & res)
+{
+    res.message = flight_recorder::dumpPath(recorder_directory, "slam", "service");
+    res.success = recorder->dump(res.message.c_str());
+
+    ROS_INFO_STREAM("SLAM: Dumped flight recorder to " << res.message);
+    return true;
+}
+
+/// \brief Callback for the laser scan, converts the ranges to points in the robot frame
+///
+void callback_scan(const sensor_msgs::LaserScan::ConstPtr data)
+{
+    cur_scan.clear();
+    for(unsigned int i = 0; i < data->ranges.size(); i++)
+    {
+        double range = data->ranges.at(i);
+        if(!std::isfinite(range) || range < data->range_min || range > data->range_max) continue;
+
+        double theta = data->angle_min + data->angle_increment * i;
+        cur_scan.push_back(rigid2d::Vector2D(range * std::cos(theta), range * std::sin(theta)));
+    }
+    got_scan_data = 1;
 }
 
 /// \brief Main function for the odometer node
@@ -85,9 +255,22 @@ int main(int argc, char** argv)
 
     ros::NodeHandle n;
     ros::NodeHandle pn("~");
+    rigid2d::TopicMonitor monitor(n);
+
+    // The recorder is filled by the callbacks, so it is set up before they can run
+    flight_recorder::RecorderParams recorder_params;
+    n.getParam("/recorder_seconds", recorder_params.seconds);
+    n.getParam("/recorder_directory", recorder_directory);
+
+    recorder.reset(new flight_recorder::Recorder("slam", recorder_params));
+    flight_recorder::installCrashHandler(*recorder, recorder_directory);
+    ros::ServiceServer dump_srv = pn.advertiseService("dump_recorder", callback_dump);
+
+    ROS_INFO_STREAM("SLAM: Got recorder seconds: " << recorder_params.seconds);
+    ROS_INFO_STREAM("SLAM: Got recorder directory: " << recorder_directory);
 
 // ODOMETRY INITIALIZAIONS /////////////////////////////////////////////////////
-    ros::Subscriber joint_sub = n.subscribe<sensor_msgs::JointState>("joint_states", 1, callback_joints);
+    ros::Subscriber joint_sub = monitor.subscribe<sensor_msgs::JointState>(n, "joint_states", callback_joints);
     ros::Publisher odom_path_pub = n.advertise<nav_msgs::Path>("odom_path", 1);
 
     std::string odom_frame_id, base_frame_id, left_wheel_joint, right_wheel_joint;
@@ -134,34 +317,120 @@ int main(int argc, char** argv)
     nav_msgs::Path odom_path;
 
 // SLAM INITIALIZAIONS /////////////////////////////////////////////////////////
-    ros::Subscriber landmark_sub = n.subscribe<nuslam::TurtleMap>("landmark_data", 1, callback_landmarks);
+    ros::Subscriber landmark_sub = monitor.subscribe<nuslam::TurtleMap>(n, "landmark_data", callback_landmarks);
 
     ros::Publisher slam_path_pub = n.advertise<nav_msgs::Path>("slam_path", 1);
     ros::Publisher slam_landmark_pub = n.advertise<nuslam::TurtleMap>("slam_landmark_data", 1);
-
-    tf2_ros::TransformBroadcaster Tmo_br;
+    ros::Publisher slam_covar_pub = n.advertise<visualization_msgs::MarkerArray>("slam_landmark_covariance", 1);
 
     int num_landmarks = 0;
+    int submap_landmarks = 0;
+    double join_gate = 0.3;
+    double ellipse_threshold = 1e-3;
+    bool use_jcbb = false;
+    double jcbb_time_budget = 0.005;
+    double q_var = 1e-5;
+    double r_var = 1e-3;
+    double deadband_min = 100.0;
+    double deadband_max = 500.0;
+    int executor_threads = 0;
+    bool pin_threads = false;
+    double snapshot_threshold = 0;
+    double nis_threshold = 13.8; // chi squared 2 dof, 99.9%
+    double tf_rate = 0;
+    bool use_pose_graph = false;
+    pose_graph::GraphParams graph_params;
     std::string map_frame_id;
 
     pn.getParam("num_landmarks", num_landmarks);
     pn.getParam("map_frame_id", map_frame_id);
+    pn.getParam("submap_landmarks", submap_landmarks);
+    pn.getParam("join_gate", join_gate);
+    pn.getParam("ellipse_threshold", ellipse_threshold);
+    pn.getParam("use_jcbb", use_jcbb);
+    pn.getParam("jcbb_time_budget", jcbb_time_budget);
+    pn.getParam("q_var", q_var);
+    pn.getParam("r_var", r_var);
+    pn.getParam("deadband_min", deadband_min);
+    pn.getParam("deadband_max", deadband_max);
+    pn.getParam("executor_threads", executor_threads);
+    pn.getParam("pin_threads", pin_threads);
+    pn.getParam("snapshot_threshold", snapshot_threshold);
+    pn.getParam("nis_threshold", nis_threshold);
+    pn.getParam("tf_rate", tf_rate);
+    pn.getParam("use_pose_graph", use_pose_graph);
+    pn.getParam("keyframe_distance", graph_params.keyframe_distance);
+    pn.getParam("keyframe_angle", graph_params.keyframe_angle);
+    pn.getParam("icp_max_dist", graph_params.icp_max_dist);
+    pn.getParam("icp_max_rms", graph_params.icp_max_rms);
+    pn.getParam("loop_radius", graph_params.loop_radius);
+    pn.getParam("loop_min_separation", graph_params.loop_min_separation);
+    pn.getParam("use_place_recognition", graph_params.use_place_recognition);
 
     Eigen::Matrix3d Qnoise;
 
-    // all 1e-5
-    Qnoise << 1e-5, 0, 0,
-              0, 1e-5, 0,
-              0, 0, 1e-5;
+    // 1e-5 by default
+    Qnoise << q_var, 0, 0,
+              0, q_var, 0,
+              0, 0, q_var;
 
     Eigen::Matrix2d Rnoise;
-    Rnoise << 1e-3, 0,
-              0, 1e-3;
+    Rnoise << r_var, 0,
+              0, r_var;
 
     ROS_INFO_STREAM("SLAM: Got number of landmarks: " << num_landmarks);
     ROS_INFO_STREAM("SLAM: Got map frame id: " << map_frame_id);
+    ROS_INFO_STREAM("SLAM: Got submap landmarks: " << submap_landmarks);
+    ROS_INFO_STREAM("SLAM: Got join gate: " << join_gate);
+    ROS_INFO_STREAM("SLAM: Got use jcbb: " << use_jcbb);
+    ROS_INFO_STREAM("SLAM: Got jcbb time budget: " << jcbb_time_budget);
+    ROS_INFO_STREAM("SLAM: Got q var: " << q_var);
+    ROS_INFO_STREAM("SLAM: Got r var: " << r_var);
+    ROS_INFO_STREAM("SLAM: Got deadband min: " << deadband_min);
+    ROS_INFO_STREAM("SLAM: Got deadband max: " << deadband_max);
+    ROS_INFO_STREAM("SLAM: Got executor threads: " << executor_threads);
+    ROS_INFO_STREAM("SLAM: Got pin threads: " << pin_threads);
+    ROS_INFO_STREAM("SLAM: Got snapshot threshold: " << snapshot_threshold);
+    ROS_INFO_STREAM("SLAM: Got nis threshold: " << nis_threshold);
+    ROS_INFO_STREAM("SLAM: Got tf rate: " << tf_rate);
+    ROS_INFO_STREAM("SLAM: Got use pose graph: " << use_pose_graph);
+    ROS_INFO_STREAM("SLAM: Got keyframe distance: " << graph_params.keyframe_distance);
+    ROS_INFO_STREAM("SLAM: Got keyframe angle: " << graph_params.keyframe_angle);
+    ROS_INFO_STREAM("SLAM: Got icp max dist: " << graph_params.icp_max_dist);
+    ROS_INFO_STREAM("SLAM: Got icp max rms: " << graph_params.icp_max_rms);
+    ROS_INFO_STREAM("SLAM: Got loop radius: " << graph_params.loop_radius);
+    ROS_INFO_STREAM("SLAM: Got loop min separation: " << graph_params.loop_min_separation);
+    ROS_INFO_STREAM("SLAM: Got use place recognition: " << graph_params.use_place_recognition);
+
+    // Start the shared workers now, so thread start up is not on the hot path
+    executor::Options exec_options;
+    exec_options.num_workers = executor_threads;
+    exec_options.pin_threads = pin_threads;
+    exec_options.thread_start = flight_recorder::installAltStack; // the crash handler covers the workers too
+    executor::Executor::configure(exec_options);
 
     ekf_slam::Slam robot(num_landmarks, Qnoise, Rnoise);
+    robot.useJointCompatibility(use_jcbb, jcbb_time_budget);
+    robot.setAssociationThresholds(deadband_min, deadband_max);
+
+    // Bound the per scan cost for long missions by using a series of small filters
+    std::unique_ptr<ekf_slam::SubmapSlam> submap_robot;
+    if(submap_landmarks > 0)
+    {
+      submap_robot.reset(new ekf_slam::SubmapSlam(submap_landmarks, Qnoise, Rnoise));
+      submap_robot->setJoinGate(join_gate);
+      submap_robot->useJointCompatibility(use_jcbb, jcbb_time_budget);
+      submap_robot->setAssociationThresholds(deadband_min, deadband_max);
+    }
+
+    // Scan matching replaces the landmarks in arenas without cylinders
+    std::unique_ptr<pose_graph::GraphSlam> graph_robot;
+    ros::Subscriber scan_sub;
+    if(use_pose_graph)
+    {
+      graph_robot.reset(new pose_graph::GraphSlam(graph_params));
+      scan_sub = monitor.subscribe<sensor_msgs::LaserScan>(n, "scan", callback_scan);
+    }
 
     rigid2d::DiffDrive ekf_bot(rigid2d::Pose2D(0,0,0), wheel_base, wheel_radius);
     rigid2d::WheelVelocities ekf_cmd;
@@ -176,8 +445,28 @@ int main(int argc, char** argv)
 
     nuslam::TurtleMap est_landmarks;
 
+    // Versioned copies of the map for readers off the filter thread
+    ekf_slam::SnapshotStore snapshots;
+    ekf_slam::SnapshotStore::Reader snapshot_reader = snapshots.reader();
+
+    std::vector<EllipseState> published_ellipses;
+    visualization_msgs::MarkerArray ellipses;
+
     std::vector<double> radii(num_landmarks, 0.01);
 
+    // map -> odom -> base, only the map to odom edge is broadcast, the odometer sends the other
+    rigid2d::FrameTree frames;
+    int odom_frame = frames.addFrame(odom_frame_id, map_frame_id);
+    int base_frame = frames.addFrame(base_frame_id, odom_frame_id);
+    rigid2d::TfBridge tf_bridge(frames, tf_rate);
+    tf_bridge.add(odom_frame);
+
+    rigid2d::Lockstep lockstep(n);
+    ROS_INFO_STREAM("SLAM: Got lockstep: " << lockstep.enabled());
+
+    // an inconsistent filter stays inconsistent, so only dump once per recorder window
+    ros::Time last_dump(0);
+
     while(ros::ok())
     {
 
@@ -197,6 +486,9 @@ int main(int argc, char** argv)
 
         // Get info to fill out the message and transform
         pos = bot.pose();
+
+        recorder->record(flight_recorder::Channel::Encoder, cur_js.header.stamp.toNSec(),
+                         {cur_js.position[lw_i], cur_js.position[rw_i], pos.th, pos.x, pos.y});
         q.setRPY(0, 0, pos.th);
         q_geo = tf2::toMsg(q);
 
@@ -218,18 +510,104 @@ int main(int argc, char** argv)
         odom_path_pub.publish(odom_path);
 
 /////// SLAM CALCULATIONS //////////////////////////////////////////////////////
-        if(got_slam_data == 1)
+        if(graph_robot)
+        {
+          // Keyframes come from the scans, the pose follows the odometry between them
+          auto start = std::chrono::steady_clock::now();
+          bool keyframe = false;
+          if(got_scan_data == 1)
+          {
+            keyframe = graph_robot->addScan(pos, cur_scan);
+            got_scan_data = 0;
+          }
+          else
+          {
+            graph_robot->addOdometry(pos);
+          }
+
+          slam_pose = graph_robot->getRobotState();
+
+          // tag 1: pose graph update
+          recorder->record(flight_recorder::Channel::Timing, ros::Time::now().toNSec(),
+                           {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()}, 1);
+
+          slam_pose2d.x = slam_pose.at(1);
+          slam_pose2d.y = slam_pose.at(2);
+          slam_pose2d.th = slam_pose.at(0);
+
+          if(keyframe)
+          {
+            slam_point.header.frame_id = map_frame_id;
+            slam_point.header.stamp = ros::Time::now();
+
+            slam_point.pose.position.x = slam_pose.at(1);
+            slam_point.pose.position.y = slam_pose.at(2);
+            slam_point.pose.position.z = 0;
+
+            q.setRPY(0, 0, slam_pose.at(0));
+            slam_point.pose.orientation = tf2::toMsg(q);
+
+            slam_points.push_back(slam_point);
+
+            slam_path.header.stamp = ros::Time::now();
+            slam_path.header.frame_id = map_frame_id;
+            slam_path.poses = slam_points;
+
+            slam_path_pub.publish(slam_path);
+          }
+        }
+        else if(got_slam_data == 1)
         {
           // Get twist from the last SLAM update til now
           rigid2d::WheelVelocities ekf_cmd = ekf_bot.updateOdometry(cur_js.position[lw_i], cur_js.position[rw_i]);
           rigid2d::Twist2D ekf_tw = ekf_bot.wheelsToTwist(ekf_cmd);
 
           // update SLAM state
-          robot.MotionModelUpdate(ekf_tw);
-          robot.MeasurmentModelUpdate(cur_landmarks);
-
-          // Publish SLAM Path Message
-          slam_pose = robot.getRobotState(); // returns robot state vector in (th, x, y) syntax
+          auto start = std::chrono::steady_clock::now();
+          if(submap_robot)
+          {
+            submap_robot->MotionModelUpdate(ekf_tw);
+            submap_robot->MeasurmentModelUpdate(cur_landmarks);
+            snapshots.publishFrom(*submap_robot, snapshot_threshold);
+
+            slam_pose = submap_robot->getRobotState();
+          }
+          else
+          {
+            robot.MotionModelUpdate(ekf_tw);
+            robot.MeasurmentModelUpdate(cur_landmarks);
+            snapshots.publishFrom(robot, snapshot_threshold);
+
+            // Publish SLAM Path Message
+            slam_pose = robot.getRobotState(); // returns robot state vector in (th, x, y) syntax
+          }
+
+          uint64_t stamp = ros::Time::now().toNSec();
+
+          // tag 0: EKF update
+          recorder->record(flight_recorder::Channel::Timing, stamp,
+                           {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()}, 0);
+
+          const std::vector<ekf_slam::Innovation> & innovations = submap_robot ? submap_robot->getInnovations() : robot.getInnovations();
+          double mean_nis = 0;
+          for(auto & innov : innovations)
+          {
+            recorder->record(flight_recorder::Channel::Innovation, stamp, {innov.range, innov.bearing, innov.nis}, innov.id);
+            mean_nis += innov.nis / innovations.size();
+          }
+
+          // Keep the lead up to a filter inconsistency
+          bool finite = std::isfinite(slam_pose.at(0)) && std::isfinite(slam_pose.at(1)) && std::isfinite(slam_pose.at(2));
+          if((!finite || mean_nis > nis_threshold) && (ros::Time::now() - last_dump).toSec() > recorder_params.seconds)
+          {
+            recorder->record(flight_recorder::Channel::Event, stamp, {mean_nis, finite ? 1.0 : 0.0});
+
+            std::string path = flight_recorder::dumpPath(recorder_directory, "slam", "nis");
+            recorder->dump(path.c_str());
+            last_dump = ros::Time::now();
+
+            ROS_WARN_STREAM("SLAM: Filter inconsistent (mean nis " << mean_nis << "), dumped flight recorder to " << path);
+          }
 
           slam_pose2d.x = slam_pose.at(1);
           slam_pose2d.y = slam_pose.at(2);
@@ -260,41 +638,32 @@ int main(int argc, char** argv)
           est_landmarks.header.frame_id = "map";
 
 
-          est_landmarks.centers = robot.getLandmarkStates();
-          est_landmarks.radii = std::vector<double>(radii.size(), 0.01);
+          est_landmarks.centers = submap_robot ? submap_robot->getLandmarkStates() : robot.getLandmarkStates();
+          est_landmarks.radii = std::vector<double>(est_landmarks.centers.size(), 0.01);
 
           slam_landmark_pub.publish(est_landmarks);
 
+          // Only send ellipses that changed, rviz keeps the rest
+          ellipses.markers.clear();
+          {
+            ekf_slam::SnapshotStore::ReadGuard snap = snapshot_reader.read();
+            addChangedEllipses(*snap, published_ellipses, ellipse_threshold, map_frame_id, ellipses);
+          }
+
+          if(!ellipses.markers.empty()) slam_covar_pub.publish(ellipses);
+
           got_slam_data = 0;
         }
 
         // Broadcast Map to Odom Frame
-
         rigid2d::Transform2D T_or(pos);
         rigid2d::Transform2D T_mr(slam_pose2d);
 
-        rigid2d::Transform2D T_mo = T_mr * T_or.inv();
-
-        tf2::Quaternion q;
-        q.setRPY(0,0,T_mo.displacementRad().th);
-
-        geometry_msgs::TransformStamped T_map_odom;
-
-        T_map_odom.header.stamp = ros::Time::now();
-        T_map_odom.header.frame_id = map_frame_id;
-
-        T_map_odom.child_frame_id = odom_frame_id;
-
-        T_map_odom.transform.translation.x = T_mo.displacement().x;
-        T_map_odom.transform.translation.y = T_mo.displacement().y;
-        T_map_odom.transform.translation.z = 0.0;
-
-        T_map_odom.transform.rotation.x = q.x();
-        T_map_odom.transform.rotation.y = q.y();
-        T_map_odom.transform.rotation.z = q.z();
-        T_map_odom.transform.rotation.w = q.w();
-
-        Tmo_br.sendTransform(T_map_odom);
+        ros::Time frame_stamp = ros::Time::now();
+        frames.setTransform(base_frame, frame_stamp.toNSec(), T_or);
+        frames.setTransform(odom_frame, frame_stamp.toNSec(), T_mr * T_or.inv());
+        tf_bridge.update(frame_stamp);
+        lockstep.ack(cur_js.header.stamp);
 
         got_odom_data = 0;
       }
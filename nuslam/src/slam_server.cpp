@@ -0,0 +1,403 @@
+/// \file
+/// \brief This node hosts the filters of a whole fleet in one process, on the shared executor
+///
+/// Every robot keeps its own topics under its namespace. Robots that build a map run their own EKF SLAM
+/// filter, and the filters of a tick are spread over the executor workers. Robots that only localize on a
+/// known landmark map share one fleet localizer, which updates all of them as one batch.
+///
+/// PARAMETERS:
+///     robot_names (std::vector<std::string>) the namespace of each robot
+///     localize_robots (std::vector<std::string>) the robots that only localize on the known map, the rest run EKF SLAM
+///     map_landmarks (std::vector<double>) the known landmarks in the map frame, as x0, y0, x1, y1, ...
+///     initial_poses (std::vector<double>) the pose of each localizing robot in the map frame, as th0, x0, y0, ... empty for the origin
+///     left_wheel_joint (std::string) the name of the left wheel joint
+///     right_wheel_joint (std::string) the name of the right wheel joint
+///     odom_frame_id (std::string) the name of the odometer frame of each robot, under its namespace
+///     map_frame_id (std::string) the name of the map frame, under the namespace of each SLAM robot
+///     wheel_base (double) the distance between the two wheels of the diff drive robot
+///     wheel_radius (double) the radius of the wheels
+///     frequency (double) the frequency to run the filters at
+///     num_landmarks (int) the number of landmarks allowed in the state vector of each SLAM robot
+///     use_jcbb (bool) associate each scan jointly with JCBB instead of greedy nearest neighbor
+///     jcbb_time_budget (double) the max time (s) to spend on each JCBB search
+///     q_var (double) the variance of the motion noise on each of the robot states
+///     r_var (double) the variance of the sensor noise on the range and the bearing
+///     deadband_min (double) the mahalanobis distance under which a measurement is a known landmark
+///     deadband_max (double) the mahalanobis distance over which a measurement is a new landmark
+///     match_distance (double) the max distance (m) from a landmark seen by a localizing robot to the map landmark it matches
+///     nis_gate (double) the normalized innovation squared over which a localizing update is dropped
+///     batch_grain (int) the localizing robots in each executor task
+///     executor_threads (int) the number of worker threads shared by the filters, 0 for one per core
+///     pin_threads (bool) pin each worker thread to one cpu
+///     tf_rate (double) the rate to broadcast the map to odom transforms to tf (Hz), 0 for every tick
+/// PUBLISHES:
+///     /<robot>/slam_pose (geometry_msgs/PoseWithCovarianceStamped): the pose estimate of each robot after each update
+///     /<robot>/slam_landmark_data (nuslam/TurtleMap): landmark state estimate, SLAM robots only
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
+/// SUBSCRIBES:
+///     /<robot>/joint_states (sensor_msgs/JointState): the wheel positions of each robot
+///     /<robot>/landmark_data (nuslam/TurtleMap): landmark position and size information of each robot
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <algorithm>
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <sensor_msgs/JointState.h>
+
+#include <tf2/LinearMath/Quaternion.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+
+#include "nuslam/TurtleMap.h"
+
+#include "rigid2d/rigid2d.hpp"
+#include "rigid2d/diff_drive.hpp"
+#include "rigid2d/frame_tree.hpp"
+#include "rigid2d/tf_bridge.hpp"
+#include "rigid2d/topic_monitor.hpp"
+
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/fleet_localizer.hpp"
+#include "nuslam/executor.hpp"
+
+/// \brief One robot hosted by the server
+struct Tenant
+{
+  std::string name; ///< namespace of the robot
+  rigid2d::DiffDrive odom; ///< odometry since start up
+  rigid2d::DiffDrive ekf_bot; ///< odometry since the last filter update
+  sensor_msgs::JointState joints; ///< newest joint states
+  nuslam::TurtleMap landmarks; ///< newest landmarks
+  int got_joints = 0; ///< new joint states since the last tick
+  int got_landmarks = 0; ///< new landmarks since the last filter update
+  int updated = 0; ///< the filter ran this tick
+
+  std::unique_ptr<ekf_slam::Slam> slam; ///< the filter of a SLAM robot, null for a localizing robot
+  int localizer_id = -1; ///< the id in the fleet localizer of a localizing robot
+  rigid2d::Twist2D twist; ///< the odometry twist of this tick's filter update
+  rigid2d::Pose2D estimate; ///< the newest pose estimate in the map frame
+  Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero(); ///< the covarience of the estimate over (th, x, y)
+  std::string map_frame; ///< the frame of the estimate
+
+  ros::Subscriber joint_sub; ///< joint states subscriber
+  ros::Subscriber landmark_sub; ///< landmark subscriber
+  ros::Publisher pose_pub; ///< pose estimate publisher
+  ros::Publisher landmark_pub; ///< landmark estimate publisher, SLAM robots only
+  int odom_frame = -1; ///< the odometer frame of the robot in the frame tree
+};
+
+//Global Variables
+static std::vector<std::unique_ptr<Tenant>> tenants;
+
+/// \brief Use to search through the all joint names and return the index of the desired joint
+/// \param joints - a vector of all the joint names
+/// \param target - the desire joint name to find
+/// \return the index of the desired joint name
+int findJointIndex(const std::vector<std::string> & joints, const std::string & target)
+{
+    return std::distance(joints.begin(), std::find(joints.begin(), joints.end(), target));
+}
+
+/// \brief Fill a pose message from an estimate
+/// \param t - the robot
+/// \param stamp - the time of the estimate
+/// \return the pose with the covarience of (x, y, yaw) in its 6x6 layout
+geometry_msgs::PoseWithCovarianceStamped toPoseMsg(const Tenant & t, const ros::Time & stamp)
+{
+    geometry_msgs::PoseWithCovarianceStamped msg;
+    msg.header.stamp = stamp;
+    msg.header.frame_id = t.map_frame;
+
+    msg.pose.pose.position.x = t.estimate.x;
+    msg.pose.pose.position.y = t.estimate.y;
+
+    tf2::Quaternion q;
+    q.setRPY(0, 0, t.estimate.th);
+    msg.pose.pose.orientation = tf2::toMsg(q);
+
+    // (th, x, y) to the (x, y, z, roll, pitch, yaw) rows of the message
+    const int rows[3] = {5, 0, 1};
+    for(int i = 0; i < 3; i++)
+    {
+      for(int j = 0; j < 3; j++) msg.pose.covariance.at(rows[i] * 6 + rows[j]) = t.covariance(i, j);
+    }
+    return msg;
+}
+
+/// \brief Main function for the slam_server node
+///
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "slam_server");
+
+    ros::NodeHandle n;
+    ros::NodeHandle pn("~");
+    rigid2d::TopicMonitor monitor(n);
+
+    std::vector<std::string> robot_names, localize_robots;
+    std::vector<double> map_landmarks, initial_poses;
+    std::string left_wheel_joint, right_wheel_joint;
+    std::string odom_frame_id = "odom", map_frame_id = "map";
+    double wheel_base = 0, wheel_radius = 0, frequency = 0;
+    int num_landmarks = 12;
+    bool use_jcbb = false;
+    double jcbb_time_budget = 0.005;
+    double q_var = 1e-5;
+    double r_var = 1e-3;
+    double deadband_min = 100.0;
+    double deadband_max = 500.0;
+    int batch_grain = 256;
+    int executor_threads = 0;
+    bool pin_threads = false;
+    double tf_rate = 0;
+    ekf_slam::LocalizerParams localizer_params;
+
+    pn.getParam("robot_names", robot_names);
+    pn.getParam("localize_robots", localize_robots);
+    pn.getParam("map_landmarks", map_landmarks);
+    pn.getParam("initial_poses", initial_poses);
+    pn.getParam("left_wheel_joint", left_wheel_joint);
+    pn.getParam("right_wheel_joint", right_wheel_joint);
+    pn.getParam("odom_frame_id", odom_frame_id);
+    pn.getParam("map_frame_id", map_frame_id);
+    n.getParam("/wheel_base", wheel_base);
+    n.getParam("/wheel_radius", wheel_radius);
+    n.getParam("/frequency", frequency);
+    pn.getParam("num_landmarks", num_landmarks);
+    pn.getParam("use_jcbb", use_jcbb);
+    pn.getParam("jcbb_time_budget", jcbb_time_budget);
+    pn.getParam("q_var", q_var);
+    pn.getParam("r_var", r_var);
+    pn.getParam("deadband_min", deadband_min);
+    pn.getParam("deadband_max", deadband_max);
+    pn.getParam("match_distance", localizer_params.match_distance);
+    pn.getParam("nis_gate", localizer_params.nis_gate);
+    pn.getParam("batch_grain", batch_grain);
+    pn.getParam("executor_threads", executor_threads);
+    pn.getParam("pin_threads", pin_threads);
+    pn.getParam("tf_rate", tf_rate);
+
+    ROS_INFO_STREAM("SLAM_SERVER: Got number of robots: " << robot_names.size());
+    ROS_INFO_STREAM("SLAM_SERVER: Got number of localizing robots: " << localize_robots.size());
+    ROS_INFO_STREAM("SLAM_SERVER: Got number of map landmarks: " << map_landmarks.size() / 2);
+    ROS_INFO_STREAM("SLAM_SERVER: Got left wheel joint name: " << left_wheel_joint);
+    ROS_INFO_STREAM("SLAM_SERVER: Got right wheel joint name: " << right_wheel_joint);
+    ROS_INFO_STREAM("SLAM_SERVER: Got odom frame id: " << odom_frame_id);
+    ROS_INFO_STREAM("SLAM_SERVER: Got map frame id: " << map_frame_id);
+    ROS_INFO_STREAM("SLAM_SERVER: Got wheel base param: " << wheel_base);
+    ROS_INFO_STREAM("SLAM_SERVER: Got wheel radius param: " << wheel_radius);
+    ROS_INFO_STREAM("SLAM_SERVER: Got frequency param: " << frequency);
+    ROS_INFO_STREAM("SLAM_SERVER: Got number of landmarks: " << num_landmarks);
+    ROS_INFO_STREAM("SLAM_SERVER: Got use jcbb: " << use_jcbb);
+    ROS_INFO_STREAM("SLAM_SERVER: Got jcbb time budget: " << jcbb_time_budget);
+    ROS_INFO_STREAM("SLAM_SERVER: Got q var: " << q_var);
+    ROS_INFO_STREAM("SLAM_SERVER: Got r var: " << r_var);
+    ROS_INFO_STREAM("SLAM_SERVER: Got deadband min: " << deadband_min);
+    ROS_INFO_STREAM("SLAM_SERVER: Got deadband max: " << deadband_max);
+    ROS_INFO_STREAM("SLAM_SERVER: Got match distance: " << localizer_params.match_distance);
+    ROS_INFO_STREAM("SLAM_SERVER: Got nis gate: " << localizer_params.nis_gate);
+    ROS_INFO_STREAM("SLAM_SERVER: Got batch grain: " << batch_grain);
+    ROS_INFO_STREAM("SLAM_SERVER: Got executor threads: " << executor_threads);
+    ROS_INFO_STREAM("SLAM_SERVER: Got pin threads: " << pin_threads);
+    ROS_INFO_STREAM("SLAM_SERVER: Got tf rate: " << tf_rate);
+
+    if(map_landmarks.size() % 2 != 0)
+    {
+      ROS_ERROR_STREAM("SLAM_SERVER: map_landmarks must hold an x and y for each landmark.");
+      return 1;
+    }
+    if(!initial_poses.empty() && initial_poses.size() != 3 * localize_robots.size())
+    {
+      ROS_ERROR_STREAM("SLAM_SERVER: initial_poses must hold a th, x and y for each localizing robot.");
+      return 1;
+    }
+    if(!localize_robots.empty() && map_landmarks.empty())
+    {
+      ROS_WARN_STREAM("SLAM_SERVER: No map landmarks, the localizing robots will follow odometry only.");
+    }
+
+    // Start the shared workers now, so thread start up is not on the hot path
+    executor::Options exec_options;
+    exec_options.num_workers = executor_threads;
+    exec_options.pin_threads = pin_threads;
+    executor::Executor::configure(exec_options);
+    executor::Executor & exec = executor::Executor::instance();
+
+    Eigen::Matrix3d Qnoise = Eigen::Matrix3d::Identity() * q_var;
+    Eigen::Matrix2d Rnoise = Eigen::Matrix2d::Identity() * r_var;
+
+    std::vector<rigid2d::Vector2D> known_map;
+    for(unsigned int i = 0; i + 1 < map_landmarks.size(); i += 2) known_map.emplace_back(map_landmarks.at(i), map_landmarks.at(i + 1));
+
+    localizer_params.q = Qnoise;
+    localizer_params.r = Rnoise;
+    localizer_params.grain = std::max(1, batch_grain);
+    ekf_slam::FleetLocalizer localizer(known_map, localizer_params);
+
+    // map -> <robot>/odom, the odometer of each robot sends the rest
+    rigid2d::FrameTree frames;
+    rigid2d::TfBridge tf_bridge(frames, tf_rate);
+
+    for(auto & name : robot_names)
+    {
+      std::unique_ptr<Tenant> t(new Tenant());
+      t->name = name;
+      t->odom = rigid2d::DiffDrive(rigid2d::Pose2D(0, 0, 0), wheel_base, wheel_radius);
+      t->ekf_bot = t->odom;
+
+      auto localizing = std::find(localize_robots.begin(), localize_robots.end(), name);
+      if(localizing != localize_robots.end())
+      {
+        // every localizing robot shares the known map and its frame
+        unsigned int k = localizing - localize_robots.begin();
+        if(!initial_poses.empty()) t->estimate = rigid2d::Pose2D(initial_poses.at(3*k), initial_poses.at(3*k + 1), initial_poses.at(3*k + 2));
+        t->localizer_id = localizer.addRobot(t->estimate);
+        t->covariance = localizer.covariance(t->localizer_id);
+        t->map_frame = map_frame_id;
+      }
+      else
+      {
+        // a SLAM robot builds its own map, in its own frame
+        t->slam.reset(new ekf_slam::Slam(num_landmarks, Qnoise, Rnoise));
+        t->slam->useJointCompatibility(use_jcbb, jcbb_time_budget);
+        t->slam->setAssociationThresholds(deadband_min, deadband_max);
+        t->map_frame = name + "/" + map_frame_id;
+        t->landmark_pub = n.advertise<nuslam::TurtleMap>(name + "/slam_landmark_data", 1);
+      }
+
+      Tenant * tp = t.get();
+      boost::function<void(const sensor_msgs::JointState::ConstPtr &)> callback_joints =
+        [tp](const sensor_msgs::JointState::ConstPtr & data) { tp->joints = *data; tp->got_joints = 1; };
+      boost::function<void(const nuslam::TurtleMap::ConstPtr &)> callback_landmarks =
+        [tp](const nuslam::TurtleMap::ConstPtr & data) { tp->landmarks = *data; tp->got_landmarks = 1; };
+
+      t->joint_sub = monitor.subscribe<sensor_msgs::JointState>(n, name + "/joint_states", callback_joints);
+      t->landmark_sub = monitor.subscribe<nuslam::TurtleMap>(n, name + "/landmark_data", callback_landmarks);
+      t->pose_pub = n.advertise<geometry_msgs::PoseWithCovarianceStamped>(name + "/slam_pose", 1);
+
+      t->odom_frame = frames.addFrame(name + "/" + odom_frame_id, t->map_frame);
+      tf_bridge.add(t->odom_frame);
+
+      tenants.push_back(std::move(t));
+    }
+
+    std::vector<Tenant *> slam_work;
+
+    ros::Rate r(frequency);
+
+    while(ros::ok())
+    {
+      ros::spinOnce();
+
+      // Odometry of every robot, and the filter work of this tick
+      slam_work.clear();
+      unsigned int localizing = 0;
+      for(auto & t : tenants)
+      {
+        t->updated = 0;
+        if(t->got_joints == 0) continue;
+
+        int lw_i = findJointIndex(t->joints.name, left_wheel_joint);
+        int rw_i = findJointIndex(t->joints.name, right_wheel_joint);
+        if(lw_i >= static_cast<int>(t->joints.position.size()) || rw_i >= static_cast<int>(t->joints.position.size())) continue;
+
+        double left = t->joints.position.at(lw_i), right = t->joints.position.at(rw_i);
+        t->odom.updateOdometry(left, right);
+
+        if(t->got_landmarks == 1)
+        {
+          t->twist = t->ekf_bot.wheelsToTwist(t->ekf_bot.updateOdometry(left, right));
+          t->updated = 1;
+          t->got_landmarks = 0;
+
+          if(t->slam)
+          {
+            slam_work.push_back(t.get());
+          }
+          else
+          {
+            localizer.queue(t->localizer_id, t->twist, t->landmarks);
+            localizing++;
+          }
+        }
+      }
+
+      // The localizer batch runs next to the SLAM filters, each filter is one task
+      auto start = std::chrono::steady_clock::now();
+      std::future<unsigned int> batch;
+      if(localizing > 0) batch = exec.async([&localizer]() { return localizer.update(); });
+
+      exec.parallelFor(0, slam_work.size(), 1, [&slam_work](std::size_t first, std::size_t last)
+      {
+        for(std::size_t k = first; k < last; k++)
+        {
+          Tenant & t = *slam_work.at(k);
+          t.slam->MotionModelUpdate(t.twist);
+          t.slam->MeasurmentModelUpdate(t.landmarks);
+
+          std::vector<double> state = t.slam->getRobotState();
+          t.estimate = rigid2d::Pose2D(state.at(0), state.at(1), state.at(2));
+          t.covariance = t.slam->getCovariance().topLeftCorner<3, 3>();
+        }
+      });
+
+      if(batch.valid())
+      {
+        // help out with the batch instead of blocking a core
+        while(batch.wait_for(std::chrono::seconds(0)) != std::future_status::ready) exec.runOne();
+        batch.get();
+      }
+
+      if(!slam_work.empty() || localizing > 0)
+      {
+        ROS_DEBUG_STREAM("SLAM_SERVER: Updated " << slam_work.size() << " SLAM and " << localizing << " localizing robots in "
+                         << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3 << " ms");
+      }
+
+      // Publish, and move each map to odom transform
+      ros::Time now = ros::Time::now();
+      for(auto & t : tenants)
+      {
+        if(t->got_joints == 0) continue;
+
+        if(t->updated == 1)
+        {
+          if(t->localizer_id >= 0)
+          {
+            t->estimate = localizer.pose(t->localizer_id);
+            t->covariance = localizer.covariance(t->localizer_id);
+          }
+
+          t->pose_pub.publish(toPoseMsg(*t, now));
+
+          if(t->slam)
+          {
+            nuslam::TurtleMap est_landmarks;
+            est_landmarks.header.stamp = now;
+            est_landmarks.header.frame_id = t->map_frame;
+            est_landmarks.centers = t->slam->getLandmarkStates();
+            est_landmarks.radii = std::vector<double>(est_landmarks.centers.size(), 0.01);
+            t->landmark_pub.publish(est_landmarks);
+          }
+        }
+
+        rigid2d::Transform2D T_or(t->odom.pose());
+        rigid2d::Transform2D T_mr(t->estimate);
+        frames.setTransform(t->odom_frame, now.toNSec(), T_mr * T_or.inv());
+
+        t->got_joints = 0;
+      }
+      tf_bridge.update(now);
+
+      r.sleep();
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/// \file
+/// \brief Replays a sensor log through the landmarks and slam pipeline, then smooths the run offline
+///
+/// USAGE:
+///     rosrun nuslam smooth_log input.nlog output_prefix [--landmarks N]
+///     --landmarks N: the landmarks in the filter (default 12)
+/// Writes output_prefix_trajectory.csv with the filtered and smoothed pose of each scan, and
+/// output_prefix_map.csv with the filtered and refined position of each landmark.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+#include <ros/time.h>
+
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/fault_replay.hpp"
+#include "nuslam/rts_smoother.hpp"
+
+int main(int argc, char** argv)
+{
+  if(argc < 3)
+  {
+    std::cerr << "usage: smooth_log input.nlog output_prefix [--landmarks N]\n";
+    return 1;
+  }
+
+  // the filter stamps the landmarks it sees
+  ros::Time::init();
+
+  replay::PipelineParams params;
+  for(int i = 3; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if(arg == "--landmarks" && i + 1 < argc) params.num_landmarks = std::max(1, std::atoi(argv[++i]));
+  }
+  std::string prefix = argv[2];
+
+  sensor_log::LogReader log;
+  if(!log.open(argv[1]))
+  {
+    std::cerr << "SMOOTH_LOG: Could not open " << argv[1] << "\n";
+    return 1;
+  }
+
+  // a perfect link, so every scan is processed in log order
+  replay::FaultProfile offline;
+  offline.latency = 0.0;
+  offline.jitter = 0.0;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<replay::TrajectoryPoint> filtered;
+  replay::FilterRecord record;
+  replay::ReplayMetrics metrics = replay::replayLog(log, params, offline, 1, nullptr, &filtered, &record);
+  double forward = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if(metrics.scans_processed == 0)
+  {
+    std::cerr << "SMOOTH_LOG: No " << params.scan_topic << " scans with " << params.joint_topic << " odometry in the log\n";
+    return 1;
+  }
+
+  start = std::chrono::steady_clock::now();
+  std::vector<Eigen::Vector3d> smoothed = ekf_slam::smoothTrajectory(record.steps);
+  Eigen::VectorXd refined = ekf_slam::refineLandmarks(record.steps, smoothed, record.state, params.r);
+  double backward = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // what the record holds, against a full covarience per step
+  std::size_t doubles = 0, updates = 0;
+  for(auto & step : record.steps)
+  {
+    doubles += 6 + step.P_robot.size();
+    for(auto & u : step.updates) doubles += 18 + u.K.size();
+    updates += step.updates.size();
+  }
+  const std::size_t n = record.state.size();
+
+  std::ofstream trajectory(prefix + "_trajectory.csv");
+  trajectory << "stamp,th,x,y,smoothed_th,smoothed_x,smoothed_y\n" << std::setprecision(9);
+  double correction = 0.0;
+  for(std::size_t k = 0; k < smoothed.size() && k < filtered.size(); k++)
+  {
+    const rigid2d::Pose2D & f = filtered.at(k).pose;
+    const Eigen::Vector3d & s = smoothed.at(k);
+    trajectory << filtered.at(k).stamp * 1e-9 << "," << f.th << "," << f.x << "," << f.y << ","
+               << s(0) << "," << s(1) << "," << s(2) << "\n";
+    correction += std::hypot(s(1) - f.x, s(2) - f.y);
+  }
+
+  std::ofstream map(prefix + "_map.csv");
+  map << "id,x,y,refined_x,refined_y\n" << std::setprecision(9);
+  double shift = 0.0;
+  int landmarks = 0;
+  for(std::size_t i = 3; i + 1 < n; i += 2)
+  {
+    // an empty slot stays at zero
+    if(record.state(i) == 0.0 && record.state(i + 1) == 0.0) continue;
+    map << (i - 3) / 2 << "," << record.state(i) << "," << record.state(i + 1) << ","
+        << refined(i) << "," << refined(i + 1) << "\n";
+    shift += std::hypot(refined(i) - record.state(i), refined(i + 1) - record.state(i + 1));
+    landmarks++;
+  }
+
+  std::cout << std::fixed << std::setprecision(3)
+            << "scans: " << smoothed.size() << ", updates: " << updates << ", landmarks: " << landmarks << "\n"
+            << "forward: " << forward << " s, backward: " << backward << " s\n"
+            << "record: " << doubles * sizeof(double) / 1024.0 << " KiB, full covariences: "
+            << smoothed.size() * n * n * sizeof(double) / 1024.0 << " KiB\n"
+            << "mean pose correction: " << correction / std::max<std::size_t>(1, smoothed.size()) << " m, "
+            << "mean landmark shift: " << shift / std::max(1, landmarks) << " m\n";
+
+  return 0;
+}
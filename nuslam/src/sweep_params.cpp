@@ -0,0 +1,289 @@
+/// \file
+/// \brief Replays a sensor log through the landmarks and slam pipeline for a grid of parameters in parallel and ranks them
+///
+/// USAGE:
+///     rosrun nuslam sweep_params input.nlog [--reference traj.csv] [--grid NAME=V1,V2,...]... [--threads N] [--top K] [--landmarks N]
+///                              [--scan_cost S]
+///     --reference traj.csv: the true trajectory, with a stamp (s), th, x, y header. The smoothed columns of a
+///                           smooth_log trajectory are used when present. Default is the smoothed replay of the
+///                           default parameters, which only ranks how well a configuration agrees with it
+///     --grid NAME=V1,V2,...: the values of one parameter, replacing its default values. NAME is one of
+///                            deadband_min, deadband_max, q, r, distance_threshold or radius_threshold
+///     --threads N: the worker threads, 0 for one per core (default 0)
+///     --top K: the configurations to print (default 10)
+///     --landmarks N: the landmarks in the filter (default 12)
+///     --scan_cost S: the time (s) the pipeline takes for each scan, 0 for the measured time (default 0). The
+///                    measured time grows with the threads sharing the machine, and with it the scans superseded
+///                    in a run, so a fixed cost keeps the ranking the same for any thread count
+/// The log is decoded once and shared by every run. The configurations are ranked by position error against
+/// the reference, then by the mean time to process a scan.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include <ros/time.h>
+
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/fault_replay.hpp"
+#include "nuslam/rts_smoother.hpp"
+#include "nuslam/executor.hpp"
+
+/// \brief Split a comma separated line
+static std::vector<std::string> split(const std::string & line)
+{
+  std::vector<std::string> fields;
+  std::istringstream stream(line);
+  std::string field;
+  while(std::getline(stream, field, ',')) fields.push_back(field);
+  return fields;
+}
+
+/// \brief Read a trajectory csv, the smoothed columns if there are any
+/// \returns false if the file could not be read or is missing a column
+static bool readReference(const std::string & path, std::vector<replay::TrajectoryPoint> & reference)
+{
+  std::ifstream file(path);
+  std::string line;
+  if(!file || !std::getline(file, line)) return false;
+
+  std::vector<std::string> header = split(line);
+  auto column = [&](const std::string & name)
+  {
+    auto it = std::find(header.begin(), header.end(), name);
+    return it == header.end() ? -1 : static_cast<int>(it - header.begin());
+  };
+
+  int stamp = column("stamp");
+  int th = column("smoothed_th"), x = column("smoothed_x"), y = column("smoothed_y");
+  if(th < 0 || x < 0 || y < 0)
+  {
+    th = column("th");
+    x = column("x");
+    y = column("y");
+  }
+  if(stamp < 0 || th < 0 || x < 0 || y < 0) return false;
+
+  const std::size_t width = std::max({stamp, th, x, y}) + 1;
+  while(std::getline(file, line))
+  {
+    std::vector<std::string> fields = split(line);
+    if(fields.size() < width) continue;
+
+    replay::TrajectoryPoint point;
+    point.stamp = std::llround(std::atof(fields.at(stamp).c_str()) * 1e9);
+    point.pose = rigid2d::Pose2D(std::atof(fields.at(th).c_str()), std::atof(fields.at(x).c_str()),
+                                 std::atof(fields.at(y).c_str()));
+    reference.push_back(point);
+  }
+
+  std::sort(reference.begin(), reference.end(),
+            [](const replay::TrajectoryPoint & a, const replay::TrajectoryPoint & b) { return a.stamp < b.stamp; });
+  return !reference.empty();
+}
+
+/// \brief Set one swept parameter
+/// \returns false for an unknown name
+static bool setParam(replay::PipelineParams & params, const std::string & name, double value)
+{
+  if(name == "deadband_min") params.deadband_min = value;
+  else if(name == "deadband_max") params.deadband_max = value;
+  else if(name == "q") params.q = Eigen::Matrix3d::Identity() * value;
+  else if(name == "r") params.r = Eigen::Matrix2d::Identity() * value;
+  else if(name == "distance_threshold") params.distance_threshold = value;
+  else if(name == "radius_threshold") params.radius_threshold = value;
+  else return false;
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  if(argc < 2)
+  {
+    std::cerr << "usage: sweep_params input.nlog [--reference traj.csv] [--grid NAME=V1,V2,...]... "
+              << "[--threads N] [--top K] [--landmarks N] [--scan_cost S]\n";
+    return 1;
+  }
+
+  // the filter stamps the landmarks it sees
+  ros::Time::init();
+
+  // in order, so the table columns stay put
+  std::vector<std::pair<std::string, std::vector<double>>> grid = {
+    {"deadband_min", {50, 100, 200}},
+    {"deadband_max", {300, 500, 1000}},
+    {"q", {1e-6, 1e-5, 1e-4}},
+    {"r", {1e-4, 1e-3, 1e-2}},
+    {"distance_threshold", {0.05, 0.075, 0.1}},
+    {"radius_threshold", {0.05, 0.07, 0.1}}};
+
+  replay::PipelineParams base;
+  std::string reference_path;
+  unsigned int threads = 0;
+  std::size_t top = 10;
+  for(int i = 2; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if(arg == "--reference" && i + 1 < argc) reference_path = argv[++i];
+    else if(arg == "--threads" && i + 1 < argc) threads = std::max(0, std::atoi(argv[++i]));
+    else if(arg == "--top" && i + 1 < argc) top = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--landmarks" && i + 1 < argc) base.num_landmarks = std::max(1, std::atoi(argv[++i]));
+    else if(arg == "--scan_cost" && i + 1 < argc) base.scan_cost = std::max(0.0, std::atof(argv[++i]));
+    else if(arg == "--grid" && i + 1 < argc)
+    {
+      std::string spec = argv[++i];
+      std::size_t eq = spec.find('=');
+      std::string name = spec.substr(0, eq);
+      auto dim = std::find_if(grid.begin(), grid.end(), [&](const auto & d) { return d.first == name; });
+      if(eq == std::string::npos || dim == grid.end())
+      {
+        std::cerr << "SWEEP_PARAMS: Unknown grid " << spec << "\n";
+        return 1;
+      }
+
+      dim->second.clear();
+      for(auto & value : split(spec.substr(eq + 1))) dim->second.push_back(std::atof(value.c_str()));
+      if(dim->second.empty())
+      {
+        std::cerr << "SWEEP_PARAMS: No values for " << name << "\n";
+        return 1;
+      }
+    }
+  }
+
+  sensor_log::LogReader log;
+  if(!log.open(argv[1]))
+  {
+    std::cerr << "SWEEP_PARAMS: Could not open " << argv[1] << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  replay::DecodedLog decoded;
+  if(!replay::decodeLog(log, base, decoded) || decoded.scans == 0)
+  {
+    std::cerr << "SWEEP_PARAMS: No " << base.scan_topic << " scans with " << base.joint_topic << " odometry in the log\n";
+    return 1;
+  }
+  double decode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // a perfect link, so every run sees every scan in log order
+  replay::FaultProfile offline;
+  offline.latency = 0.0;
+  offline.jitter = 0.0;
+
+  std::vector<replay::TrajectoryPoint> reference;
+  if(!reference_path.empty())
+  {
+    if(!readReference(reference_path, reference))
+    {
+      std::cerr << "SWEEP_PARAMS: Could not read a trajectory from " << reference_path << "\n";
+      return 1;
+    }
+  }
+  else
+  {
+    std::cerr << "SWEEP_PARAMS: No reference, ranking against the smoothed replay of the default parameters\n";
+
+    std::vector<replay::TrajectoryPoint> filtered;
+    replay::FilterRecord record;
+    replay::replayDecoded(decoded, base, offline, 1, nullptr, &filtered, &record);
+
+    std::vector<Eigen::Vector3d> smoothed = ekf_slam::smoothTrajectory(record.steps);
+    for(std::size_t k = 0; k < smoothed.size() && k < filtered.size(); k++)
+    {
+      replay::TrajectoryPoint point;
+      point.stamp = filtered.at(k).stamp;
+      point.pose = rigid2d::Pose2D(smoothed.at(k)(0), smoothed.at(k)(1), smoothed.at(k)(2));
+      reference.push_back(point);
+    }
+  }
+
+  // every combination of the grid, except for an empty deadband
+  std::vector<std::vector<double>> configs(1);
+  for(auto & dim : grid)
+  {
+    std::vector<std::vector<double>> next;
+    for(auto & config : configs)
+    {
+      for(double value : dim.second)
+      {
+        next.push_back(config);
+        next.back().push_back(value);
+      }
+    }
+    configs.swap(next);
+  }
+  configs.erase(std::remove_if(configs.begin(), configs.end(),
+                               [](const std::vector<double> & c) { return c.at(0) >= c.at(1); }),
+                configs.end());
+  if(configs.empty())
+  {
+    std::cerr << "SWEEP_PARAMS: Every deadband_min is at or above every deadband_max\n";
+    return 1;
+  }
+
+  executor::Options options;
+  options.num_workers = threads;
+  executor::Executor::configure(options);
+
+  // each run writes only its own slot
+  std::vector<replay::ReplayMetrics> results(configs.size());
+  start = std::chrono::steady_clock::now();
+  executor::Executor::instance().parallelFor(0, configs.size(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t c = first; c < last; c++)
+    {
+      replay::PipelineParams params = base;
+      for(std::size_t d = 0; d < grid.size(); d++) setParam(params, grid.at(d).first, configs.at(c).at(d));
+      results.at(c) = replay::replayDecoded(decoded, params, offline, 1, &reference);
+    }
+  });
+  double sweep = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // a run that lost the robot compares nothing, and goes last
+  std::vector<std::size_t> order(configs.size());
+  for(std::size_t c = 0; c < order.size(); c++) order.at(c) = c;
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+  {
+    const replay::ReplayMetrics & ma = results.at(a), & mb = results.at(b);
+    if((ma.compared == 0) != (mb.compared == 0)) return mb.compared == 0;
+    if(ma.position_rmse != mb.position_rmse) return ma.position_rmse < mb.position_rmse;
+    return ma.process_mean < mb.process_mean;
+  });
+
+  double serial = 0.0;
+  for(auto & m : results) serial += m.process_mean * m.scans_processed;
+
+  std::cout << "configurations: " << configs.size() << ", scans: " << decoded.scans
+            << ", reference poses: " << reference.size() << "\n" << std::fixed << std::setprecision(2)
+            << "decode: " << decode << " s, sweep: " << sweep << " s, pipeline time: " << serial << " s\n\n";
+
+  auto width = [](const std::string & name) { return std::max<int>(name.size() + 2, 10); };
+  std::cout << std::left << std::setw(6) << "rank";
+  for(auto & dim : grid) std::cout << std::setw(width(dim.first)) << dim.first;
+  std::cout << std::right << std::setw(10) << "rmse m" << std::setw(10) << "max m" << std::setw(10) << "th rad"
+            << std::setw(8) << "nis" << std::setw(10) << "ms/scan" << "\n";
+
+  for(std::size_t k = 0; k < top && k < order.size(); k++)
+  {
+    const std::vector<double> & config = configs.at(order.at(k));
+    const replay::ReplayMetrics & m = results.at(order.at(k));
+
+    std::cout << std::left << std::setw(6) << k + 1 << std::defaultfloat << std::setprecision(6);
+    for(std::size_t d = 0; d < grid.size(); d++) std::cout << std::setw(width(grid.at(d).first)) << config.at(d);
+    std::cout << std::right << std::fixed << std::setprecision(4)
+              << std::setw(10) << m.position_rmse << std::setw(10) << m.position_max << std::setw(10) << m.heading_rmse
+              << std::setprecision(2) << std::setw(8) << m.nis_mean << std::setprecision(3)
+              << std::setw(10) << m.process_mean * 1e3 << "\n";
+  }
+
+  return 0;
+}
@@ -5,9 +5,36 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <numeric>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+#include <sys/stat.h>
+
+#include <ros/time.h>
 
 #include "rigid2d/rigid2d.hpp"
 #include "nuslam/cylinder_detect.hpp"
+#include "nuslam/submap_slam.hpp"
+#include "nuslam/jcbb.hpp"
+#include "nuslam/dynamic_tracker.hpp"
+#include "nuslam/executor.hpp"
+#include "nuslam/map_snapshot.hpp"
+#include "nuslam/pose_graph.hpp"
+#include "nuslam/place_recognition.hpp"
+#include "nuslam/mcl.hpp"
+#include "nuslam/sensor_log.hpp"
+#include "nuslam/fault_replay.hpp"
+#include "nuslam/ekf_slam.hpp"
+#include "nuslam/rts_smoother.hpp"
+#include "nuslam/fleet_localizer.hpp"
+#include "nuslam/synthetic_sensors.hpp"
+#include "nuslam/datasets.hpp"
 
 TEST(Landmark, CircleTest1)
 {
@@ -31,3 +58,1641 @@ TEST(Landmark, CircleTest2)
   ASSERT_NEAR(circle_vals.at(1), -22.15212, 1e-4);
   ASSERT_NEAR(circle_vals.at(2), 22.17979, 1e-4);
 }
+
+TEST(Submap, JoinTwoSubmaps)
+{
+  // Robot drives 1m forward and turns 90 deg between the submaps. Landmark
+  // (2, 0) is seen in both, (0, 1) only in the first and (1, 1) only in the second.
+  ekf_slam::Submap first, second;
+
+  first.end_pose << rigid2d::PI/2, 1, 0;
+  first.end_covar = Eigen::Matrix3d::Identity() * 1e-2;
+  first.landmarks = {Eigen::Vector2d(2, 0), Eigen::Vector2d(0, 1)};
+  first.landmark_covars = {Eigen::Matrix2d::Identity() * 1e-4, Eigen::Matrix2d::Identity() * 1e-4};
+
+  second.landmarks = {Eigen::Vector2d(0, -1), Eigen::Vector2d(1, 0)};
+  second.landmark_covars = {Eigen::Matrix2d::Identity() * 1e-4, Eigen::Matrix2d::Identity() * 1e-4};
+
+  ekf_slam::GlobalMap joined = ekf_slam::joinSubmaps({first, second}, 0.3, 5);
+
+  ASSERT_EQ(joined.landmarks.size(), 3u);
+  ASSERT_EQ(joined.associations.at(1).at(0), 0);
+
+  ASSERT_NEAR(joined.origins.at(1)(0), rigid2d::PI/2, 1e-4);
+  ASSERT_NEAR(joined.origins.at(1)(1), 1, 1e-4);
+  ASSERT_NEAR(joined.origins.at(1)(2), 0, 1e-4);
+
+  ASSERT_NEAR(joined.landmarks.at(2)(0), 1, 1e-4);
+  ASSERT_NEAR(joined.landmarks.at(2)(1), 1, 1e-4);
+}
+
+TEST(Submap, RecoverLandmarkCovariance)
+{
+  ekf_slam::Submap first;
+  first.landmarks = {Eigen::Vector2d(1, 0)};
+  first.landmark_covars = {Eigen::Matrix2d::Identity() * 4e-2};
+
+  ekf_slam::GlobalMap joined = ekf_slam::joinSubmaps({first}, 0.3, 1);
+
+  Eigen::MatrixXd cols;
+  ASSERT_TRUE(ekf_slam::recoverCovarianceColumns(joined, 0, cols));
+  ASSERT_FALSE(ekf_slam::recoverCovarianceColumns(joined, 1, cols));
+
+  // with a single submap the landmark covarience is the local one
+  ASSERT_NEAR(cols(0, 0), 4e-2, 1e-6);
+  ASSERT_NEAR(cols(1, 1), 4e-2, 1e-6);
+  ASSERT_NEAR(cols(0, 1), 0, 1e-6);
+}
+
+TEST(Association, ChiSquareBound)
+{
+  ASSERT_NEAR(ekf_slam::chi2inv(2, 2.326), 9.21, 0.1);
+  ASSERT_NEAR(ekf_slam::chi2inv(10, 2.326), 23.21, 0.1);
+}
+
+TEST(Association, JCBBCloseLandmarks)
+{
+  // Two landmarks 0.3m apart. The robot is 0.3m off in y, so every observation
+  // is shifted onto the neighbouring landmark and greedy matching pairs them wrong.
+  Eigen::MatrixXd sigma = Eigen::MatrixXd::Identity(7, 7) * 1e-4;
+  sigma(1, 1) = 0.1;
+  sigma(2, 2) = 0.1;
+
+  Eigen::Matrix2d R = Eigen::Matrix2d::Identity() * 1e-4;
+
+  auto pairing = [](int landmark, double innovation_y)
+  {
+    ekf_slam::Pairing p;
+    p.landmark = landmark;
+    p.innovation << 0, innovation_y;
+    p.Hr << 0, -1, 0,
+            0, 0, -1;
+    p.Hl = Eigen::Matrix2d::Identity();
+    p.distance = innovation_y * innovation_y / 0.1;
+    return p;
+  };
+
+  std::vector<std::vector<ekf_slam::Pairing>> candidates = {{pairing(0, 0.3), pairing(1, 0.0)},
+                                                            {pairing(0, 0.6), pairing(1, 0.3)}};
+
+  ekf_slam::JCBB jcbb(9.21, 1.0);
+  std::vector<int> pairs = jcbb.associate(candidates, sigma, R);
+
+  ASSERT_FALSE(jcbb.timedOut());
+  ASSERT_EQ(pairs.at(0), 0);
+  ASSERT_EQ(pairs.at(1), 1);
+}
+
+TEST(Tracker, MovingClusterIsDynamic)
+{
+  tracker::DynamicTracker tracker(0.5, 0.02, 9.21, 0.15, 3, 2);
+
+  // The robot drives forward at 0.2 m/s past a cylinder at (2, 1) while a person walks across at (1, y)
+  std::vector<bool> dynamic;
+  for(int k = 0; k < 20; k++)
+  {
+    double t = 0.2 * k;
+    rigid2d::Transform2D odom_pose(rigid2d::Vector2D(0.2 * t, 0), 0);
+    rigid2d::Transform2D robot_odom = odom_pose.inv();
+
+    tracker::Cluster cylinder, person;
+    cylinder.center = robot_odom(rigid2d::Vector2D(2.0, 1.0));
+    cylinder.radius = 0.05;
+    person.center = robot_odom(rigid2d::Vector2D(1.0, -1.0 + 0.5 * t));
+    person.radius = 0.15;
+
+    dynamic = tracker.update({cylinder, person}, odom_pose, t);
+  }
+
+  // The cylinder only moves in the robot frame, the person moves in the world
+  ASSERT_FALSE(dynamic.at(0));
+  ASSERT_TRUE(dynamic.at(1));
+  ASSERT_EQ(tracker.getTracks().size(), 2u);
+}
+
+TEST(Tracker, FreeSpaceIsDynamic)
+{
+  tracker::DynamicTracker tracker(0.5, 0.02, 9.21, 0.15, 3, 2);
+
+  // A 4x4 map of 0.5 m cells, free except the cell at (1.25, 1.25)
+  tracker::StaticMap map;
+  map.width = 4;
+  map.height = 4;
+  map.resolution = 0.5;
+  map.data.assign(16, 0);
+  map.data.at(2*4 + 2) = 100;
+  tracker.setStaticMap(map);
+
+  tracker::Cluster wall, stranger;
+  wall.center = rigid2d::Vector2D(1.25, 1.25);
+  stranger.center = rigid2d::Vector2D(0.25, 1.75);
+
+  std::vector<bool> dynamic = tracker.update({wall, stranger}, rigid2d::Transform2D(), 0);
+
+  ASSERT_FALSE(dynamic.at(0));
+  ASSERT_TRUE(dynamic.at(1));
+}
+
+TEST(Executor, ParallelFor)
+{
+  executor::Options options;
+  options.num_workers = 4;
+  executor::Executor exec(options);
+
+  std::vector<double> values(100000, 0);
+  exec.parallelFor(0, values.size(), 1000, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t i = first; i < last; i++) values.at(i) = i;
+  });
+
+  ASSERT_EQ(exec.numWorkers(), 4u);
+  ASSERT_DOUBLE_EQ(std::accumulate(values.begin(), values.end(), 0.0), 99999.0 * 100000.0 / 2.0);
+}
+
+TEST(Executor, NestedAndAsync)
+{
+  executor::Options options;
+  options.num_workers = 2;
+  executor::Executor exec(options);
+
+  // more outer chunks than workers, each waiting on an inner loop, must not deadlock
+  std::atomic<int> count{0};
+  exec.parallelFor(0, 16, 1, [&](std::size_t, std::size_t)
+  {
+    exec.parallelFor(0, 100, 10, [&](std::size_t first, std::size_t last) { count += last - first; });
+  });
+
+  std::future<int> answer = exec.async([]() { return 42; });
+
+  ASSERT_EQ(count.load(), 1600);
+  ASSERT_EQ(answer.get(), 42);
+}
+
+TEST(Executor, InlineIsOrdered)
+{
+  executor::Options options;
+  options.run_inline = true;
+  executor::Executor exec(options);
+
+  std::vector<std::size_t> order;
+  exec.parallelFor(0, 10, 3, [&](std::size_t first, std::size_t) { order.push_back(first); });
+
+  ASSERT_TRUE(exec.isInline());
+  ASSERT_EQ(exec.numWorkers(), 0u);
+  ASSERT_EQ(order, std::vector<std::size_t>({0, 3, 6, 9}));
+}
+
+TEST(Snapshot, BlocksShared)
+{
+  ekf_slam::SnapshotStore store;
+  ekf_slam::SnapshotStore::Reader reader = store.reader();
+
+  std::vector<ekf_slam::LandmarkEntry> landmarks(40);
+  for(int i = 0; i < 40; i++)
+  {
+    landmarks.at(i).id = i;
+    landmarks.at(i).x = i;
+  }
+
+  store.publish(landmarks, rigid2d::Pose2D(0, 0, 0));
+  ekf_slam::SnapshotStore::ReadGuard first = reader.read();
+
+  // move one landmark in the second block
+  landmarks.at(20).x += 1.0;
+  store.publish(landmarks, rigid2d::Pose2D(0, 1, 0));
+
+  ekf_slam::SnapshotStore::Reader other = store.reader();
+  ekf_slam::SnapshotStore::ReadGuard second = other.read();
+
+  ASSERT_EQ(first->version(), 1u);
+  ASSERT_EQ(second->version(), 2u);
+  ASSERT_EQ(second->size(), 40);
+  ASSERT_EQ(second->numBlocks(), 3);
+  ASSERT_TRUE(second->sharesBlock(*first, 0));
+  ASSERT_FALSE(second->sharesBlock(*first, 1));
+  ASSERT_TRUE(second->sharesBlock(*first, 2));
+  ASSERT_DOUBLE_EQ(first->landmark(20).x, 20.0);
+  ASSERT_DOUBLE_EQ(second->landmark(20).x, 21.0);
+  ASSERT_DOUBLE_EQ(second->robot().x, 1.0);
+}
+
+TEST(Snapshot, ReaderDefersReclaim)
+{
+  ekf_slam::SnapshotStore store;
+  ekf_slam::SnapshotStore::Reader reader = store.reader();
+
+  std::vector<ekf_slam::LandmarkEntry> landmarks(1);
+  store.publish(landmarks, rigid2d::Pose2D());
+  ASSERT_EQ(store.numRetired(), 0);
+
+  {
+    ekf_slam::SnapshotStore::ReadGuard snap = reader.read();
+
+    // the old version stays alive while it is read
+    store.publish(landmarks, rigid2d::Pose2D());
+    store.publish(landmarks, rigid2d::Pose2D());
+    ASSERT_EQ(store.numRetired(), 2);
+    ASSERT_EQ(snap->version(), 1u);
+  }
+
+  store.reclaim();
+  ASSERT_EQ(store.numRetired(), 0);
+}
+
+TEST(Snapshot, ConcurrentReaders)
+{
+  ekf_slam::SnapshotStore store(4);
+
+  std::atomic<bool> done{false};
+  std::atomic<bool> consistent{true};
+
+  // every landmark of a version holds the version number, so a torn read would show
+  auto read = [&]()
+  {
+    ekf_slam::SnapshotStore::Reader reader = store.reader();
+    while(!done)
+    {
+      ekf_slam::SnapshotStore::ReadGuard snap = reader.read();
+      for(int i = 0; i < snap->size(); i++)
+      {
+        if(snap->landmark(i).x != static_cast<double>(snap->version())) consistent = false;
+      }
+    }
+  };
+
+  std::vector<std::thread> readers;
+  for(int i = 0; i < 3; i++) readers.emplace_back(read);
+
+  std::vector<ekf_slam::LandmarkEntry> landmarks(50);
+  for(int v = 1; v <= 2000; v++)
+  {
+    for(auto & l : landmarks) l.x = v;
+    store.publish(landmarks, rigid2d::Pose2D());
+  }
+
+  done = true;
+  for(auto & t : readers) t.join();
+
+  ASSERT_TRUE(consistent.load());
+  store.reclaim();
+  ASSERT_EQ(store.numRetired(), 0);
+}
+
+TEST(PoseGraph, BlockCholeskySolves)
+{
+  // block tridiagonal with a loop closure block in the corner, which causes fill in
+  int n = 6;
+  Eigen::MatrixXd A = Eigen::MatrixXd::Zero(3*n, 3*n);
+  for(int k = 0; k < n; k++)
+  {
+    A.block<3, 3>(3*k, 3*k) = 10 * Eigen::Matrix3d::Identity();
+    if(k > 0) A.block<3, 3>(3*k, 3*(k-1)) = A.block<3, 3>(3*(k-1), 3*k) = -Eigen::Matrix3d::Ones();
+  }
+  A.block<3, 3>(3*(n-1), 0) = Eigen::Matrix3d::Constant(0.5);
+  A.block<3, 3>(0, 3*(n-1)) = Eigen::Matrix3d::Constant(0.5);
+
+  std::vector<std::map<int, Eigen::Matrix3d>> lower(n);
+  for(int j = 0; j < n; j++)
+  {
+    for(int i = j; i < n; i++)
+    {
+      if(!A.block<3, 3>(3*i, 3*j).isZero()) lower.at(j)[i] = A.block<3, 3>(3*i, 3*j);
+    }
+  }
+
+  pose_graph::BlockCholesky chol;
+  ASSERT_TRUE(chol.factor(lower));
+
+  Eigen::VectorXd b = Eigen::VectorXd::LinSpaced(3*n, 1, 3*n);
+  Eigen::VectorXd x = chol.solve(b);
+
+  ASSERT_LT((A * x - b).norm(), 1e-9);
+  ASSERT_GT(chol.numBlocks(), 2*n);
+}
+
+TEST(PoseGraph, LoopClosureRemovesDrift)
+{
+  // Drive around a 2 m square with odometry that under reports each turn
+  pose_graph::PoseGraph graph;
+  std::vector<Eigen::Vector3d> truth;
+
+  Eigen::Vector3d pose(0, 0, 0), odom(0, 0, 0);
+  graph.addNode(odom);
+  truth.push_back(pose);
+
+  for(int k = 1; k <= 16; k++)
+  {
+    double turn = k % 4 == 0 ? rigid2d::PI / 2 : 0;
+    Eigen::Vector3d step(turn, 0.5, 0);
+
+    auto move = [](const Eigen::Vector3d & p, const Eigen::Vector3d & d)
+    {
+      return Eigen::Vector3d(rigid2d::normalize_angle(p(0) + d(0)),
+                             p(1) + std::cos(p(0))*d(1) - std::sin(p(0))*d(2),
+                             p(2) + std::sin(p(0))*d(1) + std::cos(p(0))*d(2));
+    };
+
+    Eigen::Vector3d measured = step;
+    if(turn != 0) measured(0) -= 0.05;
+
+    pose = move(pose, step);
+    odom = move(odom, measured);
+    truth.push_back(pose);
+    graph.addNode(odom);
+
+    pose_graph::Edge edge;
+    edge.from = k - 1;
+    edge.to = k;
+    edge.measurement = measured;
+    edge.information = Eigen::Vector3d(100, 400, 400).asDiagonal();
+    graph.addEdge(edge);
+  }
+
+  // Back at the start: the last node is the first node
+  pose_graph::Edge loop;
+  loop.from = 0;
+  loop.to = 16;
+  loop.measurement = Eigen::Vector3d::Zero();
+  loop.information = 1e4 * Eigen::Matrix3d::Identity();
+  graph.addEdge(loop);
+
+  double before = graph.error();
+  double after = graph.optimize(20);
+
+  ASSERT_LT(after, 0.1 * before);
+  ASSERT_LT(graph.getNode(16).tail<2>().norm(), 0.05);
+  ASSERT_NEAR(rigid2d::normalize_angle(graph.getNode(16)(0)), 0, 0.02);
+}
+
+TEST(PoseGraph, IcpAlignsScans)
+{
+  // Points on the walls of a 4 m by 3 m room
+  std::vector<rigid2d::Vector2D> room;
+  for(double s = -2; s < 2; s += 0.05)
+  {
+    room.push_back(rigid2d::Vector2D(s, -1.5));
+    room.push_back(rigid2d::Vector2D(s, 1.5));
+  }
+  for(double s = -1.5; s < 1.5; s += 0.05)
+  {
+    room.push_back(rigid2d::Vector2D(-2, s));
+    room.push_back(rigid2d::Vector2D(2, s));
+  }
+
+  // The same room seen from a robot moved by (0.1 rad, 0.15 m, -0.1 m)
+  rigid2d::Transform2D T_moved(rigid2d::Pose2D(0.1, 0.15, -0.1));
+  std::vector<rigid2d::Vector2D> seen;
+  for(auto & p : room) seen.push_back(T_moved.inv()(p));
+
+  pose_graph::IcpResult match = pose_graph::icp(seen, room, Eigen::Vector3d::Zero(), 0.3, 50);
+
+  ASSERT_TRUE(match.converged);
+  ASSERT_LT(match.rms, 0.01);
+  ASSERT_NEAR(match.transform(0), 0.1, 1e-3);
+  ASSERT_NEAR(match.transform(1), 0.15, 1e-3);
+  ASSERT_NEAR(match.transform(2), -0.1, 1e-3);
+}
+
+TEST(PoseGraph, GraphSlamClosesLoop)
+{
+  // An L shaped room, so no two spots look alike
+  std::vector<rigid2d::Vector2D> room;
+  for(double s = 0; s < 4; s += 0.04) room.push_back(rigid2d::Vector2D(s - 2, -1.5));
+  for(double s = 0; s < 3; s += 0.04) room.push_back(rigid2d::Vector2D(2, s - 1.5));
+  for(double s = 0; s < 2; s += 0.04) room.push_back(rigid2d::Vector2D(2 - s, 1.5));
+  for(double s = 0; s < 1.5; s += 0.04) room.push_back(rigid2d::Vector2D(0, 1.5 - s));
+  for(double s = 0; s < 2; s += 0.04) room.push_back(rigid2d::Vector2D(-s, 0));
+  for(double s = 0; s < 1.5; s += 0.04) room.push_back(rigid2d::Vector2D(-2, -s));
+
+  pose_graph::GraphParams params;
+  params.loop_min_separation = 5;
+  pose_graph::GraphSlam slam(params);
+
+  // Drive twice around a circle while the odometry heading drifts
+  rigid2d::Pose2D truth, odom;
+  for(int k = 0; k <= 400; k++)
+  {
+    double a = 4 * rigid2d::PI * k / 400.0;
+    truth = rigid2d::Pose2D(rigid2d::normalize_angle(a + rigid2d::PI / 2), 0.8 * std::cos(a) - 0.6, 0.8 * std::sin(a) - 0.7);
+
+    double drift = 0.0005 * k;
+    odom = rigid2d::Pose2D(rigid2d::normalize_angle(truth.th + drift), truth.x + 0.3 * drift, truth.y);
+
+    rigid2d::Transform2D T_robot(truth);
+    std::vector<rigid2d::Vector2D> scan;
+    for(auto & p : room) scan.push_back(T_robot.inv()(p));
+
+    slam.addScan(odom, scan);
+  }
+  slam.waitForOptimize();
+
+  std::vector<double> state = slam.getRobotState();
+  rigid2d::Transform2D T_err = rigid2d::Transform2D(truth).inv() * rigid2d::Transform2D(rigid2d::Pose2D(state.at(0), state.at(1), state.at(2)));
+
+  ASSERT_GT(slam.getNumKeyframes(), 10);
+  ASSERT_GT(slam.getNumLoopClosures(), 0);
+  ASSERT_LT(std::fabs(T_err.displacementRad().th), 0.02);
+  ASSERT_LT(std::hypot(T_err.displacementRad().x, T_err.displacementRad().y), 0.05);
+}
+
+TEST(PlaceRecognition, KdTreeMatchesBruteForce)
+{
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> uniform(0, 1);
+
+  int dim = 5, n = 500;
+  std::vector<float> keys(n * dim);
+  for(auto & k : keys) k = uniform(gen);
+
+  std::vector<int> ids(n);
+  std::iota(ids.begin(), ids.end(), 0);
+
+  place_recognition::KdTree tree;
+  tree.build(keys, ids, dim);
+
+  for(int q = 0; q < 20; q++)
+  {
+    std::vector<float> query(dim);
+    for(auto & v : query) v = uniform(gen);
+
+    std::vector<std::pair<float, int>> expected;
+    for(int i = 0; i < n / 2; i++)
+    {
+      float dist = 0;
+      for(int d = 0; d < dim; d++) dist += (keys[i*dim + d] - query[d]) * (keys[i*dim + d] - query[d]);
+      expected.emplace_back(dist, i);
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(4);
+
+    std::vector<std::pair<float, int>> found;
+    tree.nearest(query.data(), 4, n / 2, found);
+
+    ASSERT_EQ(found, expected);
+  }
+}
+
+TEST(PlaceRecognition, FindsRevisitAndYaw)
+{
+  // Random clutter, seen from a grid of keyframe poses
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> uniform(-6, 6);
+  std::vector<rigid2d::Vector2D> world;
+  for(int i = 0; i < 3000; i++) world.push_back(rigid2d::Vector2D(uniform(gen), uniform(gen)));
+
+  auto scanFrom = [&world](const rigid2d::Pose2D & pose)
+  {
+    rigid2d::Transform2D T_inv = rigid2d::Transform2D(pose).inv();
+    std::vector<rigid2d::Vector2D> scan;
+    for(auto & p : world) scan.push_back(T_inv(p));
+    return scan;
+  };
+
+  place_recognition::ContextParams params;
+  place_recognition::PlaceIndex index(params);
+
+  int id = 0;
+  for(double x = -3; x <= 3; x += 0.5)
+  {
+    for(double y = -3; y <= 3; y += 0.5) index.add(id++, scanFrom(rigid2d::Pose2D(0, x, y)));
+  }
+
+  // Back at keyframe (x 1, y -0.5) turned by a bit more than a quarter turn
+  int expected = 8 * 13 + 5;
+  double turn = rigid2d::PI / 2 + 0.2;
+  std::vector<place_recognition::Match> matches = index.query(scanFrom(rigid2d::Pose2D(turn, 1.0, -0.5)), 3, id);
+
+  ASSERT_EQ(index.size(), 169);
+  ASSERT_FALSE(matches.empty());
+  ASSERT_EQ(matches.front().id, expected);
+  ASSERT_NEAR(rigid2d::normalize_angle(matches.front().yaw - turn), 0, 2 * rigid2d::PI / params.num_sectors);
+
+  // Keyframes at or after max_id are never returned
+  for(auto & m : index.query(scanFrom(rigid2d::Pose2D(turn, 1.0, -0.5)), 3, expected)) ASSERT_LT(m.id, expected);
+}
+
+TEST(PlaceRecognition, EveryKeyframeIsFoundAsTheIndexGrows)
+{
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<double> uniform(-6, 6);
+
+  place_recognition::ContextParams params;
+  place_recognition::PlaceIndex index(params);
+
+  // Each keyframe sees its own clutter, so the scan it was added with only matches itself, whether
+  // it sits in the tail or in any of the trees
+  std::vector<std::vector<rigid2d::Vector2D>> scans;
+  for(int id = 0; id < 200; id++)
+  {
+    std::vector<rigid2d::Vector2D> scan;
+    for(int i = 0; i < 300; i++) scan.push_back(rigid2d::Vector2D(uniform(gen), uniform(gen)));
+    index.add(id, scan);
+    scans.push_back(scan);
+
+    if(id % 37 != 0 && id != 199) continue;
+    for(int old = 0; old <= id; old++)
+    {
+      std::vector<place_recognition::Match> matches = index.query(scans.at(old), 1, id + 1);
+      ASSERT_FALSE(matches.empty());
+      ASSERT_EQ(matches.front().id, old);
+    }
+  }
+}
+
+/// \brief A 6 m by 4 m room with a wall sticking in from the side and a box, 5 cm cells
+static mcl::GridMap testRoom()
+{
+  mcl::GridMap map;
+  map.width = 120;
+  map.height = 80;
+  map.resolution = 0.05;
+  map.origin_x = -3;
+  map.origin_y = -2;
+  map.data.assign(map.width * map.height, 0);
+
+  for(unsigned int r = 0; r < map.height; r++)
+  {
+    for(unsigned int c = 0; c < map.width; c++)
+    {
+      bool wall = r == 0 || c == 0 || r == map.height - 1 || c == map.width - 1;
+      bool spur = c == 40 && r < 45;
+      bool box = c >= 85 && c < 95 && r >= 50 && r < 60;
+      if(wall || spur || box) map.data.at(r * map.width + c) = 100;
+    }
+  }
+  return map;
+}
+
+/// \brief Cast the beams of a scan through a grid
+static std::vector<float> castScan(const mcl::GridMap & map, const rigid2d::Pose2D & pose, int num_beams, double max_range)
+{
+  std::vector<float> ranges(num_beams, std::numeric_limits<float>::infinity());
+  for(int b = 0; b < num_beams; b++)
+  {
+    double angle = pose.th + 2 * rigid2d::PI * b / num_beams;
+    for(double r = 0; r < max_range; r += 0.01)
+    {
+      int c = std::floor((pose.x + r * std::cos(angle) - map.origin_x) / map.resolution);
+      int row = std::floor((pose.y + r * std::sin(angle) - map.origin_y) / map.resolution);
+      if(c < 0 || row < 0 || c >= static_cast<int>(map.width) || row >= static_cast<int>(map.height)) break;
+      if(map.data.at(row * map.width + c) >= 50)
+      {
+        ranges.at(b) = r;
+        break;
+      }
+    }
+  }
+  return ranges;
+}
+
+TEST(Mcl, DistanceTransformIsExact)
+{
+  mcl::GridMap map = testRoom();
+  mcl::LikelihoodField field(map, 0.1, 10.0);
+
+  std::vector<std::pair<double, double>> obstacles;
+  for(unsigned int r = 0; r < map.height; r++)
+  {
+    for(unsigned int c = 0; c < map.width; c++)
+    {
+      if(map.data.at(r * map.width + c) >= 50) obstacles.emplace_back(c, r);
+    }
+  }
+
+  for(unsigned int r = 3; r < map.height; r += 7)
+  {
+    for(unsigned int c = 5; c < map.width; c += 11)
+    {
+      double best = 1e9;
+      for(auto & [oc, orow] : obstacles) best = std::min(best, std::hypot(oc - c, orow - r));
+
+      double x = map.origin_x + (c + 0.5) * map.resolution;
+      double y = map.origin_y + (r + 0.5) * map.resolution;
+      ASSERT_NEAR(field.distance(x, y), best * map.resolution, 1e-6);
+    }
+  }
+}
+
+TEST(Mcl, TracksAndRecoversFromOffset)
+{
+  mcl::GridMap map = testRoom();
+  mcl::MclParams params;
+  params.num_particles = 1000;
+  params.beam_step = 4;
+
+  mcl::ParticleFilter filter(params, 5);
+  filter.setMap(mcl::LikelihoodField(map, 0.1, 1.0));
+  filter.setBeams(0, 2 * rigid2d::PI / 360, 360);
+
+  // start 20 cm and 0.15 rad off
+  rigid2d::Pose2D truth(0, -1.5, -1.0);
+  filter.initialize(rigid2d::Pose2D(0.15, -1.3, -0.9), 0.25, 0.2);
+  filter.predict(truth);
+
+  // drive right along the bottom of the room, the odometry is the true motion
+  for(int k = 0; k < 60; k++)
+  {
+    truth = rigid2d::Pose2D(0.01 * k, -1.5 + 0.05 * k, -1.0 + 0.005 * k);
+    filter.predict(truth);
+    filter.update(castScan(map, truth, 360, 3.5), 0.12, 3.5);
+  }
+
+  rigid2d::Pose2D est = filter.estimate();
+  ASSERT_NEAR(est.x, truth.x, 0.05);
+  ASSERT_NEAR(est.y, truth.y, 0.05);
+  ASSERT_NEAR(rigid2d::normalize_angle(est.th - truth.th), 0, 0.03);
+}
+
+TEST(Mcl, ThousandsOfParticlesConverge)
+{
+  mcl::GridMap map = testRoom();
+  mcl::MclParams params;
+  params.num_particles = 5000;
+  params.beam_step = 6;
+
+  mcl::ParticleFilter filter(params, 1);
+  filter.setMap(mcl::LikelihoodField(map, 0.1, 1.0));
+  filter.setBeams(0, 2 * rigid2d::PI / 360, 360);
+
+  // start with the particles spread half a meter and half a radian around a guess 40 cm off,
+  // then drive right along the bottom of the room
+  rigid2d::Pose2D truth(0, -1.5, -1.0);
+  filter.initialize(rigid2d::Pose2D(0.3, -1.2, -0.7), 0.5, 0.5);
+  filter.predict(truth);
+  for(int k = 0; k < 60; k++)
+  {
+    truth = rigid2d::Pose2D(0.01 * k, -1.5 + 0.05 * k, -1.0 + 0.005 * k);
+    filter.predict(truth);
+    filter.update(castScan(map, truth, 360, 3.5), 0.12, 3.5);
+  }
+
+  rigid2d::Pose2D est = filter.estimate();
+  ASSERT_NEAR(est.x, truth.x, 0.05);
+  ASSERT_NEAR(est.y, truth.y, 0.05);
+  ASSERT_NEAR(rigid2d::normalize_angle(est.th - truth.th), 0, 0.03);
+  ASSERT_LT(filter.covariance().at(4), 0.01);
+}
+
+TEST(SensorLog, RoundTripsColumnsInTimeOrder)
+{
+  std::string path = "/tmp/nuslam_test_roundtrip.nlog";
+
+  sensor_log::TopicSchema scan;
+  scan.name = "scan";
+  scan.scalars = {"angle_min"};
+  scan.arrays = {"ranges"};
+  scan.array_types = {sensor_log::ElementType::Float32};
+
+  sensor_log::TopicSchema cmd;
+  cmd.name = "cmd_vel";
+  cmd.scalars = {"linear_x", "angular_z"};
+
+  sensor_log::WriterParams params;
+  params.chunk_messages = 7;
+
+  sensor_log::LogWriter writer;
+  ASSERT_TRUE(writer.open(path, params));
+  int scan_id = writer.addTopic(scan);
+  int cmd_id = writer.addTopic(cmd);
+
+  // scans every 10 ns with i ranges, commands every 3 ns
+  for(int t = 0; t < 300; t++)
+  {
+    if(t % 10 == 0)
+    {
+      ASSERT_TRUE(writer.write(scan_id, t, {0.1 * t}, {std::vector<double>(t / 10, 0.5 * t)}));
+    }
+    if(t % 3 == 0)
+    {
+      ASSERT_TRUE(writer.write(cmd_id, t, {0.01 * t, -0.01 * t}));
+    }
+  }
+  ASSERT_FALSE(writer.write(cmd_id, 5, {0, 0}));
+  ASSERT_TRUE(writer.close());
+
+  sensor_log::LogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(reader.findTopic("cmd_vel"), cmd_id);
+  ASSERT_EQ(reader.count(scan_id), 30u);
+  ASSERT_EQ(reader.count(cmd_id), 100u);
+  ASSERT_EQ(reader.numChunks(cmd_id), 15u);
+  ASSERT_EQ(reader.topics().at(scan_id).array_types.at(0), sensor_log::ElementType::Float32);
+
+  sensor_log::Cursor cursor = reader.read({}, reader.startTime(), reader.endTime() + 1);
+  sensor_log::MessageView msg;
+  int64_t last = -1;
+  int scans = 0, cmds = 0;
+  while(cursor.next(msg))
+  {
+    ASSERT_GE(msg.stamp, last);
+    last = msg.stamp;
+
+    if(msg.topic == scan_id)
+    {
+      sensor_log::ArrayView ranges = msg.array(0);
+      ASSERT_DOUBLE_EQ(msg.scalar(0), 0.1 * msg.stamp);
+      ASSERT_EQ(ranges.size, msg.stamp / 10);
+      for(uint32_t i = 0; i < ranges.size; i++) ASSERT_FLOAT_EQ(ranges.at(i), 0.5 * msg.stamp);
+      scans++;
+    }
+    else
+    {
+      ASSERT_DOUBLE_EQ(msg.scalar(1), -0.01 * msg.stamp);
+      cmds++;
+    }
+  }
+  ASSERT_EQ(scans, 30);
+  ASSERT_EQ(cmds, 100);
+
+  std::remove(path.c_str());
+}
+
+TEST(SensorLog, KeepsIntegerColumnsExact)
+{
+  std::string path = "/tmp/nuslam_test_ints.nlog";
+
+  // the ids of a landmark map, -1 for a landmark without one
+  sensor_log::TopicSchema map;
+  map.name = "landmark_data";
+  map.arrays = {"radii", "ids"};
+  map.array_types = {sensor_log::ElementType::Float64, sensor_log::ElementType::Int32};
+
+  sensor_log::LogWriter writer;
+  ASSERT_TRUE(writer.open(path, sensor_log::WriterParams()));
+  int id = writer.addTopic(map);
+  ASSERT_TRUE(writer.write(id, 1, {}, {{0.04, 0.04, 0.05}, {7, -1, 2147483647}}));
+  ASSERT_TRUE(writer.write(id, 2, {}, {{}, {}}));
+  ASSERT_TRUE(writer.close());
+
+  sensor_log::LogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(reader.topics().at(id).array_types.at(1), sensor_log::ElementType::Int32);
+
+  sensor_log::Cursor cursor = reader.read({}, reader.startTime(), reader.endTime() + 1);
+  sensor_log::MessageView msg;
+  ASSERT_TRUE(cursor.next(msg));
+  sensor_log::ArrayView ids = msg.array(1);
+  ASSERT_EQ(ids.size, 3u);
+  ASSERT_EQ(ids.at(0), 7);
+  ASSERT_EQ(ids.at(1), -1);
+  ASSERT_EQ(ids.at(2), 2147483647);
+  ASSERT_DOUBLE_EQ(msg.array(0).at(2), 0.05);
+
+  ASSERT_TRUE(cursor.next(msg));
+  ASSERT_EQ(msg.array(1).size, 0u);
+  ASSERT_FALSE(cursor.next(msg));
+
+  std::remove(path.c_str());
+}
+
+TEST(SensorLog, SeeksByTimeWithAndWithoutCompression)
+{
+  for(sensor_log::Codec codec : {sensor_log::Codec::None, sensor_log::Codec::Zlib})
+  {
+    std::string path = "/tmp/nuslam_test_seek.nlog";
+
+    sensor_log::TopicSchema enc;
+    enc.name = "sensor_data";
+    enc.scalars = {"left_encoder", "right_encoder"};
+
+    sensor_log::WriterParams params;
+    params.codec = codec;
+
+    sensor_log::LogWriter writer;
+    ASSERT_TRUE(writer.open(path, params));
+    int id = writer.addTopic(enc);
+
+    // 200 Hz encoders for 10 minutes, with a repeated stamp
+    const int n = 120000;
+    for(int i = 0; i < n; i++) ASSERT_TRUE(writer.write(id, 5000000LL * (i - (i == 501)), {double(i), double(2 * i)}));
+    ASSERT_TRUE(writer.close());
+
+    sensor_log::LogReader reader;
+    ASSERT_TRUE(reader.open(path));
+    ASSERT_EQ(reader.count(id), static_cast<uint64_t>(n));
+
+    std::mt19937 gen(3);
+    std::uniform_int_distribution<int64_t> when(0, 5000000LL * n);
+    for(int k = 0; k < 200; k++)
+    {
+      int64_t t = when(gen);
+      int64_t first = (t + 5000000LL - 1) / 5000000LL;
+
+      sensor_log::Cursor cursor = reader.read({id}, t, t + 20000000LL);
+      sensor_log::MessageView msg;
+      int got = 0;
+      while(cursor.next(msg))
+      {
+        // stamp 500 is written twice, by messages 500 and 501
+        if(got == 0 && first != 500 && first < n)
+        {
+          ASSERT_EQ(msg.scalar(0), first);
+        }
+        ASSERT_GE(msg.stamp, t);
+        ASSERT_LT(msg.stamp, t + 20000000LL);
+        ASSERT_EQ(msg.scalar(1), 2 * msg.scalar(0));
+        got++;
+      }
+      ASSERT_LE(got, 4);
+    }
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(codec == sensor_log::Codec::Zlib)
+    {
+      ASSERT_LT(file.tellg(), n * 24 / 2);
+    }
+    else
+    {
+      ASSERT_GT(file.tellg(), n * 24);
+    }
+
+    std::remove(path.c_str());
+  }
+}
+
+TEST(SensorLog, RejectsATruncatedLog)
+{
+  std::string path = "/tmp/nuslam_test_truncated.nlog";
+
+  sensor_log::TopicSchema enc;
+  enc.name = "sensor_data";
+  enc.scalars = {"left_encoder"};
+
+  sensor_log::LogWriter writer;
+  ASSERT_TRUE(writer.open(path));
+  int id = writer.addTopic(enc);
+  for(int i = 0; i < 5000; i++) writer.write(id, i, {double(i)});
+  ASSERT_TRUE(writer.close());
+
+  std::ifstream in(path, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), bytes.size() / 2);
+  out.close();
+
+  sensor_log::LogReader reader;
+  ASSERT_FALSE(reader.open(path));
+
+  std::remove(path.c_str());
+}
+
+TEST(FaultReplay, InjectorFollowsTheProfile)
+{
+  replay::FaultProfile profile;
+  profile.drop = 0.1;
+  profile.latency = 0.01;
+  profile.jitter = 0.0;
+
+  replay::FaultInjector link(profile, 7), same(profile, 7);
+  int dropped = 0;
+  for(int i = 0; i < 100000; i++)
+  {
+    replay::Delivery d = link.send(i * 1000000LL, true, false);
+    ASSERT_EQ(d.fault, same.send(i * 1000000LL, true, false).fault);
+    if(d.fault == replay::Fault::Dropped) dropped++;
+    else ASSERT_EQ(d.arrival, d.stamp + 10000000LL);
+  }
+  ASSERT_NEAR(dropped / 100000.0, 0.1, 0.005);
+
+  // a spike a second lasting 0.25 s on average covers a fifth of the time
+  profile.drop = 0.0;
+  profile.spike_rate = 1.0;
+  profile.spike_length = 0.25;
+  profile.spike_delay = 0.1;
+  profile.glitch = 0.05;
+
+  replay::FaultInjector spiky(profile, 11);
+  int spikes = 0, glitches = 0;
+  for(int i = 0; i < 200000; i++)
+  {
+    replay::Delivery d = spiky.send(i * 10000000LL, false, true);
+    if(spiky.inSpike()) spikes++;
+    if(d.fault == replay::Fault::Glitch) glitches++;
+    ASSERT_GE(d.arrival, d.stamp);
+  }
+  ASSERT_NEAR(spikes / 200000.0, 0.2, 0.02);
+  ASSERT_NEAR(glitches / 200000.0, 0.05, 0.005);
+
+  ASSERT_TRUE(replay::profileByName("congested", profile));
+  ASSERT_FALSE(replay::profileByName("carrier pigeon", profile));
+}
+
+TEST(FaultReplay, FaultsDegradeTheReplay)
+{
+  ros::Time::init();
+  std::string path = "/tmp/nuslam_test_replay.nlog";
+
+  sensor_log::TopicSchema scan;
+  scan.name = "scan";
+  scan.scalars = {"stamp", "angle_min", "angle_max", "angle_increment", "time_increment", "scan_time", "range_min", "range_max"};
+  scan.arrays = {"ranges", "intensities"};
+  scan.array_types = {sensor_log::ElementType::Float32, sensor_log::ElementType::Float32};
+
+  sensor_log::TopicSchema joints;
+  joints.name = "joint_states";
+  joints.meta = "left_wheel_axel,right_wheel_axel";
+  joints.scalars = {"stamp"};
+  joints.arrays = {"position", "velocity", "effort"};
+
+  sensor_log::LogWriter writer;
+  ASSERT_TRUE(writer.open(path));
+  int scan_id = writer.addTopic(scan);
+  int joint_id = writer.addTopic(joints);
+
+  // drive a slow arc among four landmarks, joint states at 50 Hz and scans at 5 Hz for 30 s
+  const double v = 0.05, w = 0.05, base = 0.16, radius = 0.033, cyl = 0.04;
+  const std::vector<rigid2d::Vector2D> landmarks = {{0.8, 0.2}, {0.2, 0.9}, {-0.6, 0.5}, {0.5, -0.6}};
+  const double inc = 2.0 * rigid2d::PI / 360.0;
+  for(int k = 0; k <= 1500; k++)
+  {
+    double t = k * 0.02;
+    int64_t stamp = static_cast<int64_t>(k) * 20000000LL;
+    double th = w * t, x = v / w * std::sin(th), y = v / w * (1.0 - std::cos(th));
+
+    std::vector<double> position = {(v - w * base / 2.0) / radius * t, (v + w * base / 2.0) / radius * t};
+    ASSERT_TRUE(writer.write(joint_id, stamp, {t}, {position, {}, {}}));
+
+    if(k % 10 != 0) continue;
+
+    std::vector<double> ranges(360, 0.0);
+    for(int b = 0; b < 360; b++)
+    {
+      double dx = std::cos(th + b * inc), dy = std::sin(th + b * inc);
+      for(auto & l : landmarks)
+      {
+        // the nearest hit of the beam on the cylinder
+        double px = l.x - x, py = l.y - y;
+        double along = px * dx + py * dy, off = px * dy - py * dx;
+        if(along <= 0 || std::fabs(off) >= cyl) continue;
+        double r = along - std::sqrt(cyl * cyl - off * off);
+        if(ranges[b] == 0.0 || r < ranges[b]) ranges[b] = r;
+      }
+    }
+    // scans land between joint states, so each one has odometry to go with it
+    ASSERT_TRUE(writer.write(scan_id, stamp + 10000000LL, {t, 0.0, 2.0 * rigid2d::PI - inc, inc, 0.0, 0.2, 0.12, 3.5}, {ranges, {}}));
+  }
+  ASSERT_TRUE(writer.close());
+
+  sensor_log::LogReader reader;
+  ASSERT_TRUE(reader.open(path));
+
+  replay::PipelineParams params;
+  params.num_landmarks = 4;
+
+  replay::FaultProfile clean;
+  ASSERT_TRUE(replay::profileByName("clean", clean));
+  std::vector<replay::TrajectoryPoint> reference;
+  replay::ReplayMetrics base_metrics = replay::replayLog(reader, params, clean, 1, nullptr, &reference);
+
+  ASSERT_EQ(base_metrics.scans, 151u);
+  ASSERT_EQ(base_metrics.joint_states, 1501u);
+  ASSERT_EQ(base_metrics.scans_dropped, 0u);
+  ASSERT_EQ(base_metrics.reordered, 0u);
+  ASSERT_EQ(base_metrics.scans_processed + base_metrics.scans_superseded, 151u);
+  ASSERT_EQ(reference.size(), base_metrics.scans_processed);
+  ASSERT_GE(base_metrics.latency_p50, 0.001);
+  ASSERT_GT(base_metrics.throughput, 0.0);
+
+  // the filter follows the arc
+  double th = w * 30.0;
+  ASSERT_NEAR(reference.back().pose.x, v / w * std::sin(th), 0.05);
+  ASSERT_NEAR(reference.back().pose.y, v / w * (1.0 - std::cos(th)), 0.05);
+
+  replay::FaultProfile congested;
+  ASSERT_TRUE(replay::profileByName("congested", congested));
+  congested.glitch = 0.05;
+  replay::ReplayMetrics metrics = replay::replayLog(reader, params, congested, 3, &reference);
+
+  ASSERT_GT(metrics.scans_dropped, 0u);
+  ASSERT_GT(metrics.reordered, 0u);
+  ASSERT_GT(metrics.glitches, 0u);
+  ASSERT_GT(metrics.latency_p99, base_metrics.latency_p99);
+  ASSERT_LE(metrics.scans_processed + metrics.scans_superseded + metrics.scans_dropped, 151u);
+  ASSERT_GT(metrics.compared, 0u);
+  ASSERT_TRUE(std::isfinite(metrics.position_rmse));
+  ASSERT_GE(metrics.position_max, metrics.position_rmse);
+
+  // one decoded log, replayed with two association gates at once, and the first again
+  replay::DecodedLog decoded;
+  ASSERT_TRUE(replay::decodeLog(reader, params, decoded));
+  ASSERT_EQ(decoded.scans, 151u);
+  ASSERT_EQ(decoded.messages.size(), 1652u);
+
+  replay::FaultProfile offline;
+  offline.latency = 0.0;
+  offline.jitter = 0.0;
+  std::vector<replay::ReplayMetrics> runs(3);
+  std::vector<std::vector<replay::TrajectoryPoint>> trajectories(3);
+  std::vector<std::thread> threads;
+  for(int i = 0; i < 3; i++)
+  {
+    threads.emplace_back([&, i]()
+    {
+      replay::PipelineParams gated = params;
+      gated.deadband_min = i == 1 ? 50.0 : 100.0;
+      gated.scan_cost = 0.002;
+      runs.at(i) = replay::replayDecoded(decoded, gated, offline, 1, &reference, &trajectories.at(i));
+    });
+  }
+  for(auto & t : threads) t.join();
+
+  // a run on another thread with the same seed gives the same estimates
+  ASSERT_EQ(trajectories.at(2).size(), trajectories.at(0).size());
+  for(unsigned int k = 0; k < trajectories.at(0).size(); k++)
+  {
+    ASSERT_EQ(trajectories.at(2).at(k).pose.x, trajectories.at(0).at(k).pose.x);
+    ASSERT_EQ(trajectories.at(2).at(k).pose.y, trajectories.at(0).at(k).pose.y);
+    ASSERT_EQ(trajectories.at(2).at(k).pose.th, trajectories.at(0).at(k).pose.th);
+  }
+  ASSERT_EQ(runs.at(2).position_rmse, runs.at(0).position_rmse);
+  ASSERT_EQ(runs.at(2).nis_mean, runs.at(0).nis_mean);
+  ASSERT_EQ(runs.at(2).latency_p99, runs.at(0).latency_p99);
+  ASSERT_NEAR(runs.at(0).latency_max, 0.002, 1e-9);
+
+  for(auto & run : runs)
+  {
+    ASSERT_EQ(run.scans_processed, 151u);
+    ASSERT_GT(run.compared, 0u);
+    ASSERT_LT(run.position_rmse, 0.05);
+    ASSERT_GT(run.nis_mean, 0.0);
+  }
+
+  // a pipeline that takes two and a half scan periods falls behind, and a queued scan is replaced by the next
+  replay::PipelineParams slow = params;
+  slow.scan_cost = 0.5;
+  replay::ReplayMetrics behind = replay::replayDecoded(decoded, slow, offline, 1, &reference);
+  ASSERT_EQ(behind.scans_processed + behind.scans_superseded, 151u);
+  ASSERT_GT(behind.scans_superseded, 0u);
+  ASSERT_EQ(behind.scans_superseded, replay::replayDecoded(decoded, slow, offline, 1, &reference).scans_superseded);
+
+  std::remove(path.c_str());
+}
+
+// Drive the filter around a loop among six landmarks with noisy odometry and measurements
+static void runLoop(ekf_slam::Slam & slam, std::vector<ekf_slam::StepRecord> & steps,
+                    std::vector<Eigen::Vector3d> & truth, std::vector<Eigen::VectorXd> & states,
+                    std::vector<Eigen::MatrixXd> & covariances)
+{
+  ros::Time::init();
+  const std::vector<rigid2d::Vector2D> landmarks = {{1.0, 0.3}, {0.4, 1.2}, {-0.5, 1.0},
+                                                    {-1.0, 0.1}, {-0.3, -0.9}, {0.7, -0.8}};
+  std::mt19937 gen(3);
+  std::normal_distribution<double> odom(0.0, 0.01), range(0.0, 0.01), bearing(0.0, 0.01);
+
+  slam.recordSteps(&steps);
+  Eigen::Vector3d pose(0.0, 0.0, 0.0);
+  for(int k = 0; k < 150; k++)
+  {
+    rigid2d::Twist2D tw;
+    tw.wz = 0.06;
+    tw.vx = 0.05;
+
+    // the true motion, on the same arc model as the filter
+    double th = pose(0);
+    pose(1) += tw.vx / tw.wz * (std::sin(th + tw.wz) - std::sin(th));
+    pose(2) += tw.vx / tw.wz * (std::cos(th) - std::cos(th + tw.wz));
+    pose(0) = rigid2d::normalize_angle(th + tw.wz);
+    truth.push_back(pose);
+
+    rigid2d::Twist2D measured = tw;
+    measured.vx += odom(gen) * 0.2;
+    measured.wz += odom(gen);
+    slam.MotionModelUpdate(measured);
+
+    nuslam::TurtleMap seen;
+    for(auto & l : landmarks)
+    {
+      double dx = l.x - pose(1), dy = l.y - pose(2);
+      double r = std::sqrt(dx*dx + dy*dy) + range(gen);
+      double b = std::atan2(dy, dx) - pose(0) + bearing(gen);
+      if(r > 1.5) continue;
+
+      geometry_msgs::Point c;
+      c.x = r * std::cos(b);
+      c.y = r * std::sin(b);
+      seen.centers.push_back(c);
+      seen.radii.push_back(0.04);
+    }
+    slam.MeasurmentModelUpdate(seen);
+
+    states.push_back(slam.getStateVector());
+    covariances.push_back(slam.getCovariance());
+  }
+}
+
+TEST(Smoother, MatchesFullCovarianceRts)
+{
+  Eigen::Matrix3d q = Eigen::Matrix3d::Identity() * 1e-5;
+  Eigen::Matrix2d r = Eigen::Matrix2d::Identity() * 1e-4;
+  ekf_slam::Slam slam(6, q, r);
+
+  std::vector<ekf_slam::StepRecord> steps;
+  std::vector<Eigen::Vector3d> truth;
+  std::vector<Eigen::VectorXd> states;
+  std::vector<Eigen::MatrixXd> covariances;
+  runLoop(slam, steps, truth, states, covariances);
+
+  std::vector<Eigen::Vector3d> smoothed = ekf_slam::smoothTrajectory(steps);
+  ASSERT_EQ(smoothed.size(), states.size());
+
+  // the classic RTS pass with a full covarience per step, priors rebuilt from the recorded updates
+  const int n = states.front().size();
+  Eigen::MatrixXd Q = Eigen::MatrixXd::Zero(n, n);
+  Q.topLeftCorner<3, 3>() = q;
+
+  Eigen::VectorXd x_s = states.back();
+  for(int k = states.size() - 2; k >= 0; k--)
+  {
+    const ekf_slam::StepRecord & next = steps.at(k + 1);
+    Eigen::MatrixXd G = Eigen::MatrixXd::Identity(n, n);
+    G.block<3, 1>(0, 0) += next.dupdate;
+
+    Eigen::VectorXd prior = states.at(k + 1);
+    for(auto & u : next.updates) prior -= u.K * u.innovation;
+    Eigen::MatrixXd P_prior = G * covariances.at(k) * G.transpose() + Q;
+
+    Eigen::MatrixXd C = covariances.at(k) * G.transpose() * P_prior.inverse();
+    Eigen::VectorXd dx = x_s - prior;
+    dx(0) = rigid2d::normalize_angle(dx(0));
+    x_s = states.at(k) + C * dx;
+
+    ASSERT_NEAR(rigid2d::normalize_angle(smoothed.at(k)(0) - x_s(0)), 0.0, 1e-6);
+    ASSERT_NEAR(smoothed.at(k)(1), x_s(1), 1e-6);
+    ASSERT_NEAR(smoothed.at(k)(2), x_s(2), 1e-6);
+  }
+
+  // a step keeps the robot rows and a gain per update, far less than a covarience
+  ASSERT_EQ(steps.back().P_robot.rows(), 3);
+  ASSERT_EQ(steps.back().P_robot.cols(), n);
+}
+
+TEST(Smoother, RefinesTrajectoryAndMap)
+{
+  Eigen::Matrix3d q = Eigen::Matrix3d::Identity() * 1e-4;
+  Eigen::Matrix2d r = Eigen::Matrix2d::Identity() * 1e-4;
+  ekf_slam::Slam slam(6, q, r);
+
+  std::vector<ekf_slam::StepRecord> steps;
+  std::vector<Eigen::Vector3d> truth;
+  std::vector<Eigen::VectorXd> states;
+  std::vector<Eigen::MatrixXd> covariances;
+  runLoop(slam, steps, truth, states, covariances);
+  ASSERT_EQ(slam.getNumLandmarks(), 6);
+
+  std::vector<Eigen::Vector3d> smoothed = ekf_slam::smoothTrajectory(steps);
+
+  // the poses move, and the last has nothing after it to learn from
+  double moved = 0.0;
+  for(unsigned int k = 0; k < smoothed.size(); k++)
+  {
+    moved += (smoothed.at(k).tail<2>() - states.at(k).segment<2>(1)).norm();
+    ASSERT_LT((smoothed.at(k).tail<2>() - truth.at(k).tail<2>()).norm(), 0.1);
+  }
+  ASSERT_GT(moved, 0.0);
+  ASSERT_TRUE(smoothed.back().isApprox(states.back().head<3>(), 1e-12));
+
+  const std::vector<rigid2d::Vector2D> landmarks = {{1.0, 0.3}, {0.4, 1.2}, {-0.5, 1.0},
+                                                    {-1.0, 0.1}, {-0.3, -0.9}, {0.7, -0.8}};
+  Eigen::VectorXd refined = ekf_slam::refineLandmarks(steps, smoothed, states.back(), r);
+  ASSERT_EQ(refined.size(), states.back().size());
+  for(int i = 3; i < refined.size(); i += 2)
+  {
+    double nearest = std::numeric_limits<double>::max();
+    for(auto & l : landmarks) nearest = std::min(nearest, std::hypot(refined(i) - l.x, refined(i + 1) - l.y));
+    ASSERT_LT(nearest, 0.08);
+  }
+}
+
+TEST(Reflector, ReadsBandsAsIds)
+{
+  // a full turn of 1 degree beams, a wall at 3m behind four landmarks
+  std::vector<float> ranges(360, 3.0f), intensities(360, 100.0f);
+  auto landmark = [&](int first, int last, float range)
+  {
+    for(int i = first; i <= last; i++) ranges.at(i) = range;
+  };
+  auto tape = [&](int first, int last)
+  {
+    for(int i = first; i <= last; i++) intensities.at(i) = 5000.0f;
+  };
+
+  // one band
+  landmark(20, 30, 1.0f);
+  tape(23, 25);
+
+  // three bands, one dark beam apart
+  landmark(100, 114, 1.2f);
+  tape(102, 103);
+  tape(105, 106);
+  tape(108, 109);
+
+  // no tape
+  landmark(200, 210, 1.0f);
+
+  // tape up to the edge, so the pattern may go on behind the wall
+  landmark(300, 305, 1.0f);
+  tape(300, 302);
+
+  std::vector<cylinder::Reflector> reflectors =
+    cylinder::find_reflectors(ranges, intensities, 0.0, 2.0 * rigid2d::PI / 360.0, 0.1, 3.5, 2000.0, 0.1, 2);
+
+  ASSERT_EQ(reflectors.size(), 3u);
+  ASSERT_EQ(reflectors.at(0).id, 0);
+  ASSERT_EQ(reflectors.at(0).points.size(), 3u);
+  ASSERT_EQ(reflectors.at(1).bands, 3);
+  ASSERT_EQ(reflectors.at(1).id, 2);
+  ASSERT_EQ(reflectors.at(1).points.size(), 8u);
+  ASSERT_EQ(reflectors.at(2).id, -1);
+
+  // the first point is on the first bright beam
+  ASSERT_NEAR(reflectors.at(0).points.at(0).x, std::cos(23.0 * rigid2d::PI / 180.0), 1e-6);
+  ASSERT_NEAR(reflectors.at(0).points.at(0).y, std::sin(23.0 * rigid2d::PI / 180.0), 1e-6);
+}
+
+TEST(Reflector, IdsKeepCloseLandmarksApart)
+{
+  ros::Time::init();
+
+  // two landmarks close enough that the first sighting of the second lands in the deadband of the first
+  nuslam::TurtleMap seen;
+  geometry_msgs::Point a, b;
+  a.x = 1.0;
+  a.y = 0.0;
+  b.x = 1.0;
+  b.y = 0.05;
+  seen.centers = {a, b};
+  seen.radii = {0.04, 0.04};
+
+  ekf_slam::Slam plain(4, Eigen::Matrix3d::Identity() * 1e-5, Eigen::Matrix2d::Identity() * 1e-3);
+  for(int k = 0; k < 3; k++) plain.MeasurmentModelUpdate(seen);
+  ASSERT_EQ(plain.getNumLandmarks(), 1);
+
+  seen.ids = {4, 7};
+  ekf_slam::Slam labeled(4, Eigen::Matrix3d::Identity() * 1e-5, Eigen::Matrix2d::Identity() * 1e-3);
+  for(int k = 0; k < 3; k++) labeled.MeasurmentModelUpdate(seen);
+  ASSERT_EQ(labeled.getNumLandmarks(), 2);
+
+  Eigen::VectorXd state = labeled.getStateVector();
+  ASSERT_NEAR(state(3), 1.0, 1e-2);
+  ASSERT_NEAR(state(4), 0.0, 1e-2);
+  ASSERT_NEAR(state(5), 1.0, 1e-2);
+  ASSERT_NEAR(state(6), 0.05, 1e-2);
+}
+
+TEST(FleetLocalizer, MatchesDenseEkf)
+{
+  const std::vector<rigid2d::Vector2D> map = {{1.0, 0.5}, {-0.4, 1.1}, {0.2, -0.9}};
+  ekf_slam::LocalizerParams params;
+  ekf_slam::FleetLocalizer localizer(map, params);
+  int robot = localizer.addRobot(rigid2d::Pose2D(0.3, 0.1, -0.2), 1e-3);
+
+  rigid2d::Twist2D tw(0.1, 0.2, 0.0);
+
+  // the first two landmarks as seen from slightly off the predicted pose, the third 0.25m long
+  Eigen::Vector3d truth(0.42, 0.27, -0.14);
+  nuslam::TurtleMap seen;
+  for(unsigned int l = 0; l < map.size(); l++)
+  {
+    double dx = map.at(l).x - truth(1), dy = map.at(l).y - truth(2);
+    double r = std::hypot(dx, dy) + (l == 2 ? 0.25 : 0.0);
+    double b = std::atan2(dy, dx) - truth(0);
+
+    geometry_msgs::Point c;
+    c.x = r * std::cos(b);
+    c.y = r * std::sin(b);
+    seen.centers.push_back(c);
+  }
+
+  localizer.queue(robot, tw, seen);
+  ASSERT_EQ(localizer.update(), 1u);
+  ASSERT_EQ(localizer.matched(robot), 2u);
+
+  // the same filter, dense
+  Eigen::Vector3d mu(0.3, 0.1, -0.2);
+  Eigen::Matrix3d P = Eigen::Matrix3d::Identity() * 1e-3;
+
+  double ratio = tw.vx / tw.wz, th = mu(0);
+  Eigen::Matrix3d G = Eigen::Matrix3d::Identity();
+  G(1, 0) = -ratio * std::cos(th) + ratio * std::cos(th + tw.wz);
+  G(2, 0) = -ratio * std::sin(th) + ratio * std::sin(th + tw.wz);
+  mu += Eigen::Vector3d(tw.wz, -ratio * std::sin(th) + ratio * std::sin(th + tw.wz),
+                        ratio * std::cos(th) - ratio * std::cos(th + tw.wz));
+  P = G * P * G.transpose() + params.q;
+
+  for(unsigned int l = 0; l < 3; l++)
+  {
+    double dx = map.at(l).x - mu(1), dy = map.at(l).y - mu(2);
+    double d = dx*dx + dy*dy;
+    Eigen::Matrix<double, 2, 3> H;
+    H << 0, -dx / std::sqrt(d), -dy / std::sqrt(d),
+         -1, dy / d, -dx / d;
+
+    Eigen::Vector2d z(std::hypot(seen.centers.at(l).x, seen.centers.at(l).y), std::atan2(seen.centers.at(l).y, seen.centers.at(l).x));
+    Eigen::Vector2d v(z(0) - std::sqrt(d), rigid2d::normalize_angle(z(1) - (std::atan2(dy, dx) - mu(0))));
+
+    Eigen::Matrix2d S = H * P * H.transpose() + params.r;
+    if(v.dot(S.inverse() * v) >= params.nis_gate) continue;
+
+    Eigen::Matrix<double, 3, 2> K = P * H.transpose() * S.inverse();
+    mu += K * v;
+    P = (Eigen::Matrix3d::Identity() - K * H) * P;
+  }
+
+  rigid2d::Pose2D pose = localizer.pose(robot);
+  ASSERT_NEAR(pose.th, mu(0), 1e-12);
+  ASSERT_NEAR(pose.x, mu(1), 1e-12);
+  ASSERT_NEAR(pose.y, mu(2), 1e-12);
+  ASSERT_TRUE(localizer.covariance(robot).isApprox(P, 1e-9));
+
+  // pulled toward the pose the landmarks were seen from
+  ASSERT_LT(std::hypot(pose.x - truth(1), pose.y - truth(2)), 0.05);
+}
+
+TEST(FleetLocalizer, BatchMatchesOneRobotAtATime)
+{
+  std::mt19937 gen(5);
+  std::uniform_real_distribution<double> pos(-2.0, 2.0), angle(-rigid2d::PI, rigid2d::PI), speed(-0.05, 0.05);
+
+  std::vector<rigid2d::Vector2D> map;
+  for(int l = 0; l < 20; l++) map.emplace_back(pos(gen), pos(gen));
+
+  ekf_slam::LocalizerParams params;
+  params.grain = 16;
+  ekf_slam::FleetLocalizer fleet(map, params);
+
+  const int robots = 300;
+  std::vector<std::unique_ptr<ekf_slam::FleetLocalizer>> alone;
+  std::vector<rigid2d::Pose2D> truth;
+  for(int r = 0; r < robots; r++)
+  {
+    truth.emplace_back(angle(gen), pos(gen), pos(gen));
+    fleet.addRobot(truth.back());
+    alone.emplace_back(new ekf_slam::FleetLocalizer(map, params));
+    alone.back()->addRobot(truth.back());
+  }
+
+  for(int step = 0; step < 20; step++)
+  {
+    for(int r = 0; r < robots; r++)
+    {
+      // some robots sit out a step, and each sees a different number of landmarks
+      if((r + step) % 7 == 0) continue;
+
+      rigid2d::Twist2D tw(speed(gen), speed(gen) + 0.05, 0.0);
+      truth.at(r) = rigid2d::Transform2D(truth.at(r)).integrateTwist(tw).displacementRad();
+
+      nuslam::TurtleMap seen;
+      for(auto & l : map)
+      {
+        double dx = l.x - truth.at(r).x, dy = l.y - truth.at(r).y;
+        if(std::hypot(dx, dy) > 1.5) continue;
+
+        double b = std::atan2(dy, dx) - truth.at(r).th;
+        geometry_msgs::Point c;
+        c.x = std::hypot(dx, dy) * std::cos(b) + 0.01 * speed(gen);
+        c.y = std::hypot(dx, dy) * std::sin(b) + 0.01 * speed(gen);
+        seen.centers.push_back(c);
+      }
+
+      fleet.queue(r, tw, seen);
+      alone.at(r)->queue(0, tw, seen);
+      alone.at(r)->update();
+    }
+    fleet.update();
+
+    for(int r = 0; r < robots; r++)
+    {
+      rigid2d::Pose2D a = fleet.pose(r), b = alone.at(r)->pose(0);
+      ASSERT_NEAR(a.th, b.th, 1e-12);
+      ASSERT_NEAR(a.x, b.x, 1e-12);
+      ASSERT_NEAR(a.y, b.y, 1e-12);
+      ASSERT_TRUE(fleet.covariance(r).isApprox(alone.at(r)->covariance(0), 1e-12));
+    }
+  }
+
+  // and every robot still knows where it is
+  for(int r = 0; r < robots; r++) ASSERT_LT(std::hypot(fleet.pose(r).x - truth.at(r).x, fleet.pose(r).y - truth.at(r).y), 0.05);
+}
+
+/// \brief Test that a simulated scan sees a cylinder and the wall where they are
+TEST(SyntheticRobot, ScanMatchesGeometry)
+{
+  synthetic::ArenaParams params;
+  params.landmarks = {rigid2d::Vector2D(1.0, 0.0)};
+  params.range_noise = 0.0;
+  synthetic::SyntheticRobot robot(params);
+
+  std::vector<float> ranges;
+  robot.scan(rigid2d::Pose2D(0.0, 0.0, 0.0), ranges);
+
+  ASSERT_EQ(ranges.size(), 360u);
+  ASSERT_NEAR(ranges.at(0), 1.0 - params.landmark_radius, 1e-5);
+  ASSERT_NEAR(ranges.at(90), params.wall_radius, 1e-5);
+  ASSERT_NEAR(ranges.at(180), params.wall_radius, 1e-5);
+
+  // from beside the cylinder, the beam pointing at it is a quarter turn round
+  robot.scan(rigid2d::Pose2D(0.0, 1.0, -0.5), ranges);
+  ASSERT_NEAR(ranges.at(90), 0.5 - params.landmark_radius, 1e-5);
+
+  // past the longest range reads as no return
+  params.range_max = 2.0;
+  synthetic::SyntheticRobot short_range(params);
+  short_range.scan(rigid2d::Pose2D(0.0, 0.0, 0.0), ranges);
+  ASSERT_FLOAT_EQ(ranges.at(180), 0.0f);
+}
+
+/// \brief Test that only the landmarks in range are reported, in the robot frame
+TEST(SyntheticRobot, LandmarksInRange)
+{
+  synthetic::ArenaParams params;
+  params.landmarks = {rigid2d::Vector2D(1.0, 0.0), rigid2d::Vector2D(0.0, 2.0)};
+  synthetic::SyntheticRobot robot(params);
+
+  nuslam::TurtleMap map;
+  robot.landmarks(rigid2d::Pose2D(rigid2d::PI / 2.0, 0.0, 0.0), map);
+
+  ASSERT_EQ(map.centers.size(), 1u);
+  ASSERT_EQ(map.radii.size(), 1u);
+  ASSERT_NEAR(map.centers.at(0).x, 0.0, 1e-12);
+  ASSERT_NEAR(map.centers.at(0).y, -1.0, 1e-12);
+  ASSERT_DOUBLE_EQ(map.radii.at(0), params.landmark_radius);
+}
+
+/// \brief Test that odometry on the simulated wheel angles and encoders follows the simulated pose
+TEST(SyntheticRobot, WheelsFollowPose)
+{
+  synthetic::ArenaParams params = synthetic::ringArena(8);
+  synthetic::SyntheticRobot robot(params);
+  ASSERT_EQ(params.landmarks.size(), 8u);
+
+  rigid2d::DiffDrive from_angles(rigid2d::Pose2D(0, 0, 0), params.wheel_base, params.wheel_radius);
+  rigid2d::DiffDrive from_ticks(rigid2d::Pose2D(0, 0, 0), params.wheel_base, params.wheel_radius);
+  double enc2rad = 2.0 * rigid2d::PI / params.encoder_ticks_per_rev;
+
+  const double dt = 0.01;
+  for(int k = 1; k <= 1000; k++)
+  {
+    double t = k * dt;
+
+    rigid2d::WheelVelocities angles = robot.wheelAngles(t);
+    rigid2d::WheelVelocities vel = from_angles.updateOdometry(angles.ul, angles.ur);
+
+    int32_t left = 0, right = 0;
+    robot.encoders(t, left, right);
+    from_ticks.updateOdometry(enc2rad * left, enc2rad * right);
+
+    rigid2d::Twist2D tw = from_angles.wheelsToTwist(vel);
+    ASSERT_NEAR(tw.wz, params.twist.wz * dt, 1e-9);
+    ASSERT_NEAR(tw.vx, params.twist.vx * dt, 1e-9);
+  }
+
+  rigid2d::Pose2D truth = robot.pose(10.0);
+  rigid2d::Pose2D odom = from_angles.pose();
+  ASSERT_NEAR(rigid2d::normalize_angle(odom.th - truth.th), 0.0, 1e-9);
+  ASSERT_NEAR(odom.x, truth.x, 1e-9);
+  ASSERT_NEAR(odom.y, truth.y, 1e-9);
+
+  // the ticks are whole numbers, so the encoder odometry is only close
+  rigid2d::Pose2D ticks = from_ticks.pose();
+  ASSERT_NEAR(ticks.x, truth.x, 0.01);
+  ASSERT_NEAR(ticks.y, truth.y, 0.01);
+
+  // the circle closes after one period
+  rigid2d::Pose2D lap = robot.pose(robot.period());
+  ASSERT_NEAR(lap.x, 0.0, 1e-9);
+  ASSERT_NEAR(lap.y, 0.0, 1e-9);
+}
+
+/// \brief Test that the twist of a displacement drives the filter motion model onto it
+TEST(Datasets, ArcTwistReachesDisplacement)
+{
+  // an arc, which the twist must reach exactly
+  rigid2d::Pose2D arc = rigid2d::Transform2D().integrateTwist(rigid2d::Twist2D(0.8, 0.5, 0.0)).displacementRad();
+  rigid2d::Twist2D tw = datasets::arcTwist(arc.x, arc.y, arc.th);
+  ASSERT_NEAR(tw.wz, 0.8, 1e-12);
+  ASSERT_NEAR(tw.vx, 0.5, 1e-12);
+  ASSERT_DOUBLE_EQ(tw.vy, 0.0);
+
+  // straight ahead and straight back
+  ASSERT_NEAR(datasets::arcTwist(0.3, 0.0, 0.0).vx, 0.3, 1e-12);
+  ASSERT_NEAR(datasets::arcTwist(-0.3, 0.0, 0.0).vx, -0.3, 1e-12);
+
+  // a rotate, drive, rotate motion ends on the same heading and as far away
+  rigid2d::Twist2D rdr = datasets::arcTwist(0.2 * std::cos(0.1), 0.2 * std::sin(0.1), 0.3);
+  rigid2d::Pose2D end = rigid2d::Transform2D().integrateTwist(rdr).displacementRad();
+  ASSERT_NEAR(end.th, 0.3, 1e-12);
+  ASSERT_NEAR(std::hypot(end.x, end.y), 0.2, 1e-12);
+}
+
+/// \brief Test that both odometry and both measurement forms of a range and bearing log are read
+TEST(Datasets, ReadsRangeBearingLog)
+{
+  std::string path = "/tmp/nuslam_test_dataset.txt";
+  {
+    std::ofstream file(path);
+    file << "# a comment\n"
+         << "SENSOR 4 1.0 0.0\n"
+         << "ODOMETRY 0.0 0.5 0.0\n"
+         << "SENSOR 1 2.0 1.5707963267948966\n"
+         << "SENSOR -1 1.0 3.141592653589793\n"
+         << "ODOMETRY 1 2 0.4 0.0 0.0 1 0 0 1 0 1\n"
+         << "LANDMARK 2 7 0.25 -0.5 1 0 1\n";
+  }
+
+  datasets::Dataset dataset;
+  ASSERT_TRUE(datasets::loadRangeBearingLog(path, dataset));
+  std::remove(path.c_str());
+
+  ASSERT_EQ(dataset.robots.size(), 1u);
+  ASSERT_TRUE(dataset.landmarks.empty());
+  const std::vector<datasets::Step> & steps = dataset.robots.at(0).steps;
+  ASSERT_EQ(steps.size(), 3u);
+  ASSERT_TRUE(dataset.robots.at(0).truth.empty());
+
+  // the measurement before any motion is taken standing still
+  ASSERT_DOUBLE_EQ(steps.at(0).odometry.vx, 0.0);
+  ASSERT_EQ(steps.at(0).landmarks.ids, std::vector<int>({4}));
+  ASSERT_NEAR(steps.at(0).landmarks.centers.at(0).x, 1.0, 1e-12);
+
+  ASSERT_NEAR(steps.at(1).odometry.vx, 0.5, 1e-12);
+  ASSERT_EQ(steps.at(1).landmarks.ids, std::vector<int>({1, -1}));
+  ASSERT_NEAR(steps.at(1).landmarks.centers.at(0).x, 0.0, 1e-12);
+  ASSERT_NEAR(steps.at(1).landmarks.centers.at(0).y, 2.0, 1e-12);
+  ASSERT_NEAR(steps.at(1).landmarks.centers.at(1).x, -1.0, 1e-12);
+
+  ASSERT_NEAR(steps.at(2).odometry.vx, 0.4, 1e-12);
+  ASSERT_EQ(steps.at(2).landmarks.ids, std::vector<int>({7}));
+  ASSERT_NEAR(steps.at(2).landmarks.centers.at(0).y, -0.5, 1e-12);
+  ASSERT_LT(steps.at(1).stamp, steps.at(2).stamp);
+
+  // a line missing its fields is malformed
+  {
+    std::ofstream file(path);
+    file << "ODOMETRY 0.1 0.2\n";
+  }
+  ASSERT_FALSE(datasets::loadRangeBearingLog(path, dataset));
+  std::remove(path.c_str());
+  ASSERT_FALSE(datasets::loadRangeBearingLog(path, dataset));
+}
+
+/// \brief Test that a UTIAS dataset is cut into steps of integrated odometry and landmark measurements
+TEST(Datasets, ReadsUtias)
+{
+  std::string dir = "/tmp/nuslam_test_utias";
+  mkdir(dir.c_str(), 0755);
+
+  std::vector<std::string> files = {"Barcodes.dat", "Landmark_Groundtruth.dat", "Robot1_Odometry.dat",
+                                    "Robot1_Measurement.dat", "Robot1_Groundtruth.dat"};
+  {
+    std::ofstream(dir + "/Barcodes.dat") << "# Subject Barcode\n1 5\n2 14\n6 63\n7 72\n";
+    std::ofstream(dir + "/Landmark_Groundtruth.dat") << "# Subject x y\n6 1.0 0.0 0.001 0.001\n7 0.0 2.0 0.001 0.001\n";
+
+    // drive straight, then turn on the spot from t = 10.5
+    std::ofstream(dir + "/Robot1_Odometry.dat") << "# Time v w\n10.0 0.2 0.0\n10.5 0.0 1.0\n11.0 0.0 0.0\n";
+    std::ofstream(dir + "/Robot1_Groundtruth.dat") << "# Time x y th\n9.9 0.5 0.5 0.0\n10.0 0.5 0.5 0.0\n10.5 0.6 0.5 0.0\n";
+
+    // a landmark in the first step, a robot and an unknown barcode, then a landmark in the last step
+    std::ofstream(dir + "/Robot1_Measurement.dat") << "# Time barcode r b\n10.05 63 0.5 0.0\n10.3 14 1.0 0.0\n"
+                                                   << "10.4 99 1.0 0.0\n10.99 72 1.5 1.5707963267948966\n";
+  }
+
+  datasets::Dataset dataset;
+  ASSERT_TRUE(datasets::loadUtias(dir, 0.25, dataset));
+  for(auto & file : files) std::remove((dir + "/" + file).c_str());
+  rmdir(dir.c_str());
+
+  ASSERT_EQ(dataset.landmarks.size(), 2u);
+  ASSERT_EQ(dataset.landmark_ids, std::vector<int>({6, 7}));
+  ASSERT_EQ(dataset.robots.size(), 1u);
+
+  const datasets::RobotRun & run = dataset.robots.at(0);
+  ASSERT_EQ(run.truth.size(), 3u);
+  ASSERT_NEAR(run.start.x, 0.5, 1e-12);
+  ASSERT_NEAR(run.start.y, 0.5, 1e-12);
+
+  // four steps of 0.25 s up to the last odometry line
+  ASSERT_EQ(run.steps.size(), 4u);
+  ASSERT_EQ(run.steps.at(0).stamp, 10250000000);
+  ASSERT_NEAR(run.steps.at(0).odometry.vx, 0.05, 1e-9);
+  ASSERT_NEAR(run.steps.at(0).odometry.wz, 0.0, 1e-9);
+  ASSERT_NEAR(run.steps.at(2).odometry.vx, 0.0, 1e-9);
+  ASSERT_NEAR(run.steps.at(2).odometry.wz, 0.25, 1e-9);
+
+  ASSERT_EQ(run.steps.at(0).landmarks.ids, std::vector<int>({6}));
+  ASSERT_NEAR(run.steps.at(0).landmarks.centers.at(0).x, 0.5, 1e-12);
+  ASSERT_TRUE(run.steps.at(1).landmarks.ids.empty());
+  ASSERT_EQ(run.steps.at(3).landmarks.ids, std::vector<int>({7}));
+  ASSERT_NEAR(run.steps.at(3).landmarks.centers.at(0).y, 1.5, 1e-12);
+
+  // the labeled steps drive the filter along the true path
+  ekf_slam::Slam slam(2, Eigen::Matrix3d::Identity() * 1e-12, Eigen::Matrix2d::Identity() * 1e-6);
+  for(auto & step : run.steps)
+  {
+    slam.MotionModelUpdate(step.odometry);
+    slam.MeasurmentModelUpdate(step.landmarks);
+  }
+  std::vector<double> state = slam.getRobotState();
+  ASSERT_NEAR(state.at(0), 0.5, 1e-3);
+  ASSERT_NEAR(state.at(1), 0.1, 1e-3);
+  ASSERT_NEAR(state.at(2), 0.0, 1e-3);
+}
@@ -8,6 +8,10 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <set>
+#include <mutex>
+
+#include <std_msgs/UInt64.h>
 
 #include "rigid2d/rigid2d.hpp"
 #include "nuturtlebot/WheelCommands.h"
@@ -15,6 +19,11 @@
 
 namespace gazebo
 {
+  // Drives the wheels from wheel_cmd and publishes the encoders on sensor_data at sensor_frequency.
+  // With lockstep on, the world is paused after each sensor publish until every node publishing on
+  // lockstep_topic acks the step (see rigid2d::Lockstep), so with use_sim_time the simulation runs
+  // as fast as the slowest of them and none of them drop sensor data. A step is named by the stamp
+  // of its sensor data, and only acks that echo it count.
   class TurtleDrivePlugin : public ModelPlugin
   {
 
@@ -133,6 +142,22 @@ namespace gazebo
         return;
       }
 
+      // Lockstep is optional, off unless the sdf asks for it
+      if(_sdf->HasElement("lockstep"))
+      {
+        this->lockstep = _sdf->GetElement("lockstep")->Get<bool>();
+      }
+
+      if(_sdf->HasElement("lockstep_topic"))
+      {
+        this->lockstep_topic = _sdf->GetElement("lockstep_topic")->Get<std::string>();
+      }
+
+      if(_sdf->HasElement("lockstep_timeout"))
+      {
+        this->lockstep_timeout = _sdf->GetElement("lockstep_timeout")->Get<double>();
+      }
+
       // create node handle
       this->n.reset(new ros::NodeHandle());
 
@@ -151,6 +176,10 @@ namespace gazebo
       ROS_INFO_STREAM("PLUGIN: Got max motor rot vel param: " << this->max_motor_rot_vel);
       ROS_INFO_STREAM("PLUGIN: Got motor power param: " << this->max_motor_power);
 
+      ROS_INFO_STREAM("PLUGIN: Got lockstep: " << this->lockstep);
+      ROS_INFO_STREAM("PLUGIN: Got lockstep topic name: " << this->lockstep_topic);
+      ROS_INFO_STREAM("PLUGIN: Got lockstep timeout: " << this->lockstep_timeout);
+
       this->rad2enc = this->encoder_ticks_per_rev / (2 * rigid2d::PI);
       ROS_INFO_STREAM("PLUGIN: calced enc conversion: " << this->rad2enc);
 
@@ -158,6 +187,13 @@ namespace gazebo
       this->sensor_pub = this->n->advertise<nuturtlebot::SensorData>(this->sensor_data_topic, 1);
       this->wheel_sub = this->n->subscribe(this->wheel_cmd_topic, 1, &TurtleDrivePlugin::callback_wheel_cmd, this);
 
+      if(this->lockstep)
+      {
+        // every node that publishes on the ack topic takes part in the barrier
+        this->ack_sub = this->n->subscribe(this->lockstep_topic, 10, &TurtleDrivePlugin::callback_ack, this);
+        this->ack_timer = this->n->createWallTimer(ros::WallDuration(0.01), &TurtleDrivePlugin::callback_ack_timer, this);
+      }
+
       last_update = model->GetWorld()->SimTime();
 
       // Set wheels to move according to 0
@@ -179,6 +215,69 @@ namespace gazebo
       // ROS_INFO_STREAM("Most recent calced Wheel Cmd: " << this->left_wheel_vel << " " << this->right_wheel_vel);
     }
 
+    // Callback Method for the lockstep acknowledgements
+    public: void callback_ack(const ros::MessageEvent<std_msgs::UInt64 const> & event)
+    {
+      bool done = false;
+      {
+        std::lock_guard<std::mutex> lock(this->step_mutex);
+        if(!this->waiting) return;
+
+        // a node that fell behind acks an earlier step after its timeout, that does not count for this one
+        if(event.getConstMessage()->data != this->step_id) return;
+
+        this->acked.insert(event.getPublisherName());
+        done = this->acked.size() >= this->expected;
+        if(done) this->waiting = false;
+      }
+
+      // the world holds its update lock around OnUpdate, so unpause without the step lock
+      if(done) this->model->GetWorld()->SetPaused(false);
+    }
+
+    // Callback Method for the lockstep timer, so a node that stops acking can not hang the simulation
+    public: void callback_ack_timer(const ros::WallTimerEvent &)
+    {
+      bool done = false;
+      {
+        std::lock_guard<std::mutex> lock(this->step_mutex);
+        if(!this->waiting) return;
+
+        // a node that left no longer holds up the step
+        unsigned int publishers = this->ack_sub.getNumPublishers();
+        bool timed_out = this->lockstep_timeout > 0 &&
+                         (ros::WallTime::now() - this->wait_start).toSec() > this->lockstep_timeout;
+
+        done = this->acked.size() >= publishers || timed_out;
+        if(done) this->waiting = false;
+
+        if(timed_out)
+        {
+          this->lockstep_timeouts++;
+          ROS_WARN_STREAM_THROTTLE(5.0, "PLUGIN: Lockstep step timed out with " << this->acked.size() << " of "
+                                   << this->expected << " acks, " << this->lockstep_timeouts << " timeouts so far");
+        }
+      }
+
+      if(done) this->model->GetWorld()->SetPaused(false);
+    }
+
+    // Hold the world after this update until every lockstep node acks the sensor data
+    private: void startStep(const ros::Time & stamp)
+    {
+      std::lock_guard<std::mutex> lock(this->step_mutex);
+
+      this->expected = this->ack_sub.getNumPublishers();
+      if(this->expected == 0) return;
+
+      // set before the publish, so an ack can not come back before the step is waiting for it
+      this->step_id = stamp.toNSec();
+      this->acked.clear();
+      this->waiting = true;
+      this->wait_start = ros::WallTime::now();
+      this->model->GetWorld()->SetPaused(true);
+    }
+
     // Called by the world update start event
     public: void OnUpdate()
     {
@@ -204,6 +303,9 @@ namespace gazebo
         // Calculate corresponding encoder reading
         enc_vals.left_encoder = rad2enc * left_pos;
         enc_vals.right_encoder = rad2enc * right_pos;
+        enc_vals.stamp = ros::Time(current_time.sec, current_time.nsec);
+
+        if(this->lockstep) this->startStep(enc_vals.stamp);
 
         sensor_pub.publish(enc_vals);
 
@@ -236,6 +338,20 @@ namespace gazebo
     // Timing
     private: gazebo::common::Time last_update = 0.0;
 
+    // Lockstep barrier
+    private: bool lockstep = false;
+    private: std::string lockstep_topic = "lockstep_ack";
+    private: double lockstep_timeout = 1.0;
+    private: ros::Subscriber ack_sub;
+    private: ros::WallTimer ack_timer;
+    private: std::mutex step_mutex;
+    private: bool waiting = false;
+    private: uint64_t step_id = 0;
+    private: std::set<std::string> acked;
+    private: unsigned int expected = 0;
+    private: ros::WallTime wait_start;
+    private: unsigned long lockstep_timeouts = 0;
+
     // Pointer to the model
     private: physics::ModelPtr model;
     // Pointer to the update event connection
@@ -10,6 +10,7 @@
 ///     waypoint_y: (double) A list of the y coordinates for a series of waypoints
 /// PUBLISHES:
 ///     /cmd_vel: (geometry_msgs/Twist) the twist command
+///     /diagnostics: (diagnostic_msgs/DiagnosticArray) the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /odom: (nav_msgs/Odometry) the current estimated pose of the robot
 /// SERIVCES:
@@ -24,6 +25,7 @@
 
 #include "rigid2d/rigid2d.hpp"
 #include "rigid2d/waypoints.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Quaternion.h>
@@ -148,6 +150,7 @@ int main(int argc, char** argv)
 {
   ros::init(argc, argv, "real_waypoints");
   ros::NodeHandle n;
+  rigid2d::TopicMonitor monitor(n);
 
   double kp = 0;
   double lin_thresh = 0.01;
@@ -187,7 +190,7 @@ int main(int argc, char** argv)
   // ROS Initializations
   ros::Rate r(frequency);
   ros::Publisher pub_cmd = n.advertise<geometry_msgs::Twist>("cmd_vel", 1);
-  ros::Subscriber sub_pose = n.subscribe("/odom", 1, callback_pose);
+  ros::Subscriber sub_pose = monitor.subscribe<nav_msgs::Odometry>(n, "/odom", callback_pose);
   ros::ServiceServer client_start = n.advertiseService("start", callback_start);
   ros::ServiceServer client_stop = n.advertiseService("stop", callback_stop);
   marker_pub = n.advertise<visualization_msgs::Marker>("visualization_marker", 1);
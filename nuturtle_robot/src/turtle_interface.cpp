@@ -12,25 +12,47 @@
 ///     motor_lim (double): the maximum rotation velocity of the motor
 ///     encoder_ticks_per_rev (int): the number of encoder pulses per revolution of the wheel
 ///     motor_power (int): the max command value to send the motor
+///     recorder_seconds (double): the seconds of history the flight recorder keeps
+///     recorder_directory (std::string): where the flight recorder dumps are written
+///     lockstep (bool): ack each step of sensor data to the gazebo plugin, once the joint states are out
+///     safety_stop (bool): limit the wheel commands from the local scan, off by default
+///     safety_stop_distance (double): the translation is zeroed with an obstacle this close on the path
+///     safety_slow_distance (double): the translation is scaled down with an obstacle this close on the path
+///     safety_half_angle (double): the half width of the scan sector about the path
+///     safety_horizon (double): the time of the path the scan sector covers
+///     safety_timeout (double): the translation is stopped when the latest scan is older than this
 /// PUBLISHES:
 ///     /wheel_cmd (nuturtlebot/WheelCommands): a command to control the motors on the turtlebot
 ///     /joint_states (sensor_msgs/JointState): the wheel position and velocities of the turtlebot
+///     /lockstep_ack (std_msgs/UInt64): the steps of sensor data handled, in lockstep only
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /cmd_vel (geometry_msgs/Twist): the twist command from the turtlesim package
 ///     /sensor_data (nuturtlebot/SensorData): retrives sensor info from the turtlebot
+///     /scan (sensor_msgs/LaserScan): the laser on the turtlebot, with safety_stop only
+/// SERVICES:
+///     ~dump_recorder (std_srvs/Trigger): writes the flight recorder to disk, the message is the file
 
 #include <iostream>
+#include <chrono>
+#include <memory>
 
 #include <ros/ros.h>
 
 #include <geometry_msgs/Twist.h>
 #include <sensor_msgs/JointState.h>
+#include <sensor_msgs/LaserScan.h>
+#include <std_srvs/Trigger.h>
 
 #include "nuturtlebot/SensorData.h"
 #include "nuturtlebot/WheelCommands.h"
 
 #include "rigid2d/diff_drive.hpp"
 #include "rigid2d/waypoints.hpp"
+#include "rigid2d/flight_recorder.hpp"
+#include "rigid2d/lockstep.hpp"
+#include "rigid2d/safety_stop.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 // Global Variables
 static geometry_msgs::Twist twist_cmd;
@@ -47,6 +69,14 @@ static int init_enc_left = 0;
 static int init_enc_right = 0;
 static int init_data = 0;
 
+static std::unique_ptr<flight_recorder::Recorder> recorder;
+static std::unique_ptr<rigid2d::Lockstep> lockstep;
+static std::string recorder_directory = "/tmp";
+
+static bool safety_on = false;
+static rigid2d::SafetyStop safety;
+static double published_scale = 1.0;
+
 /// \brief Calculates the proper wheel command given a twist
 ///
 void pubWheelCommands()
@@ -59,6 +89,16 @@ void pubWheelCommands()
   // convert to twist format
   tw = rigid2d::GeoTwisttoTwist2D(twist_cmd);
 
+  // slow or stop for anything on the path, from the scan on the robot itself
+  if(safety_on)
+  {
+    published_scale = safety.limit(tw, ros::Time::now().toSec());
+    if(published_scale < 1.0) ROS_WARN_STREAM_THROTTLE(1.0, "T_INT: Safety stop scaled the translation by " << published_scale);
+
+    // tag 2: the limited translation and its scale
+    recorder->record(flight_recorder::Channel::Command, ros::Time::now().toNSec(), {tw.vx, published_scale}, 2);
+  }
+
   // get wheel velocities
   wv = robot.twistToWheels(tw);
 
@@ -72,9 +112,21 @@ void pubWheelCommands()
   whl_cmd.left_velocity = std::round(rigid2d::linInterp(wv.ul, m_lim, cmd_lim));
   whl_cmd.right_velocity = std::round(rigid2d::linInterp(wv.ur, m_lim, cmd_lim));
 
+  // tag 1: the motor commands
+  recorder->record(flight_recorder::Channel::Command, ros::Time::now().toNSec(),
+                   {static_cast<double>(whl_cmd.left_velocity), static_cast<double>(whl_cmd.right_velocity)}, 1);
+
   pub_wheels.publish(whl_cmd);
 }
 
+/// \brief Publishes the wheel commands again if the safety stop now limits the last command differently
+///
+void checkSafety()
+{
+  rigid2d::Twist2D tw = rigid2d::GeoTwisttoTwist2D(twist_cmd);
+  if(safety.limit(tw, ros::Time::now().toSec()) != published_scale) pubWheelCommands();
+}
+
 /// \brief callback funtion for the cmd_vel subscriber
 ///
 void callback_twist(geometry_msgs::Twist::ConstPtr data)
@@ -93,6 +145,9 @@ void callback_twist(geometry_msgs::Twist::ConstPtr data)
     twist_cmd.angular.z = avel_lim;
   }
 
+  // tag 0: the limited twist
+  recorder->record(flight_recorder::Channel::Command, ros::Time::now().toNSec(), {twist_cmd.linear.x, twist_cmd.angular.z}, 0);
+
   pubWheelCommands();
 }
 
@@ -100,6 +155,8 @@ void callback_twist(geometry_msgs::Twist::ConstPtr data)
 ///
 void callback_sensors(nuturtlebot::SensorData::ConstPtr data)
 {
+  auto start = std::chrono::steady_clock::now();
+
   if(init_data == 0)
   {
     init_enc_left = data->left_encoder;
@@ -115,13 +172,51 @@ void callback_sensors(nuturtlebot::SensorData::ConstPtr data)
 
   wheel_vels = robot.updateOdometry(data_conv.ul, data_conv.ur);
 
-  // Create the joint state message & publish
-  js.header.stamp = ros::Time::now();
+  // Create the joint state message & publish, in lockstep the stamp names the step of the simulator
+  js.header.stamp = lockstep->enabled() ? data->stamp : ros::Time::now();
   js.name = {left_wheel_joint, right_wheel_joint};
   js.position = {data_conv.ul, data_conv.ur};
   js.velocity = {wheel_vels.ul, wheel_vels.ur};
 
   pub_encs.publish(js);
+  lockstep->ack(js.header.stamp);
+
+  uint64_t stamp = js.header.stamp.toNSec();
+  recorder->record(flight_recorder::Channel::Encoder, stamp,
+                   {static_cast<double>(data->left_encoder), static_cast<double>(data->right_encoder),
+                    data_conv.ul, data_conv.ur, wheel_vels.ul, wheel_vels.ur});
+  recorder->record(flight_recorder::Channel::Timing, stamp,
+                   {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()});
+}
+
+/// \brief callback funtion for the scan subscriber
+///
+void callback_scan(sensor_msgs::LaserScan::ConstPtr scan)
+{
+  // stamped on arrival, the age is what matters and the laser is on this machine
+  safety.setScan(scan->ranges, scan->angle_min, scan->angle_increment, scan->range_min, scan->range_max,
+                 ros::Time::now().toSec());
+
+  // react now rather than at the next cmd_vel
+  checkSafety();
+}
+
+/// \brief Timer to stop the turtlebot when the scans stop, even without a new cmd_vel
+///
+void callback_safety_timer(const ros::TimerEvent &)
+{
+  checkSafety();
+}
+
+/// \brief Service to write the flight recorder to disk
+///
+bool callback_dump(std_srvs::Trigger::Request &, std_srvs::Trigger::Response & res)
+{
+  res.message = flight_recorder::dumpPath(recorder_directory, "turtle_interface", "service");
+  res.success = recorder->dump(res.message.c_str());
+
+  ROS_INFO_STREAM("T_INT: Dumped flight recorder to " << res.message);
+  return true;
 }
 
 
@@ -132,11 +227,23 @@ int main(int argc, char** argv)
     // ros initializations
     ros::init(argc, argv, "turtle_interface");
     ros::NodeHandle n;
+    ros::NodeHandle pn("~");
+    rigid2d::TopicMonitor monitor(n);
+
+    // The recorder is filled by the callbacks, so it is set up before they can run
+    flight_recorder::RecorderParams recorder_params;
+    n.getParam("recorder_seconds", recorder_params.seconds);
+    n.getParam("recorder_directory", recorder_directory);
+
+    recorder.reset(new flight_recorder::Recorder("turtle_interface", recorder_params));
+    flight_recorder::installCrashHandler(*recorder, recorder_directory);
+    ros::ServiceServer dump_srv = pn.advertiseService("dump_recorder", callback_dump);
 
-    ros::Subscriber twist_sub = n.subscribe<geometry_msgs::Twist>("cmd_vel", 1, callback_twist);
+    ros::Subscriber twist_sub = monitor.subscribe<geometry_msgs::Twist>(n, "cmd_vel", callback_twist);
     pub_wheels = n.advertise<nuturtlebot::WheelCommands>("wheel_cmd", 1);
 
-    ros::Subscriber sensor_sub = n.subscribe("sensor_data", 1, callback_sensors);
+    lockstep.reset(new rigid2d::Lockstep(n));
+    ros::Subscriber sensor_sub = monitor.subscribe<nuturtlebot::SensorData>(n, "sensor_data", callback_sensors);
     pub_encs = n.advertise<sensor_msgs::JointState>("joint_states", 1);
 
     // Get parameters from the parameter server
@@ -155,6 +262,15 @@ int main(int argc, char** argv)
     n.getParam("encoder_ticks_per_rev", encoder_ticks_per_rev);
     n.getParam("motor_power", motor_power);
 
+    rigid2d::SafetyParams safety_params;
+    n.getParam("safety_stop", safety_on);
+    n.getParam("safety_stop_distance", safety_params.stop_distance);
+    n.getParam("safety_slow_distance", safety_params.slow_distance);
+    n.getParam("safety_half_angle", safety_params.half_angle);
+    n.getParam("safety_horizon", safety_params.horizon);
+    n.getParam("safety_timeout", safety_params.timeout);
+    safety = rigid2d::SafetyStop(safety_params);
+
     ROS_INFO_STREAM("T_INT: Got left wheel joint name: " << left_wheel_joint);
     ROS_INFO_STREAM("T_INT: Got right wheel joint name: " << right_wheel_joint);
 
@@ -169,11 +285,31 @@ int main(int argc, char** argv)
     ROS_INFO_STREAM("T_INT: Got motor power param: " << motor_power);
     ROS_INFO_STREAM("T_INT: Got encoder spec param: " << encoder_ticks_per_rev);
 
+    ROS_INFO_STREAM("T_INT: Got recorder seconds param: " << recorder_params.seconds);
+    ROS_INFO_STREAM("T_INT: Got recorder directory param: " << recorder_directory);
+    ROS_INFO_STREAM("T_INT: Got lockstep param: " << lockstep->enabled());
+
+    ROS_INFO_STREAM("T_INT: Got safety stop param: " << safety_on);
+    ROS_INFO_STREAM("T_INT: Got safety stop distance param: " << safety_params.stop_distance);
+    ROS_INFO_STREAM("T_INT: Got safety slow distance param: " << safety_params.slow_distance);
+    ROS_INFO_STREAM("T_INT: Got safety half angle param: " << safety_params.half_angle);
+    ROS_INFO_STREAM("T_INT: Got safety horizon param: " << safety_params.horizon);
+    ROS_INFO_STREAM("T_INT: Got safety timeout param: " << safety_params.timeout);
+
     // Create diff drive object to track the robot simulation
     rigid2d::Pose2D pos(0,0,0);
     rigid2d::DiffDrive robot_buf(pos, wheel_base, wheel_radius);
 
     robot = robot_buf;
 
+    // the scan comes from the laser on the same machine, no delay batching the small messages
+    ros::Subscriber scan_sub;
+    ros::Timer safety_timer;
+    if(safety_on)
+    {
+      scan_sub = monitor.subscribe<sensor_msgs::LaserScan>(n, "scan", callback_scan, ros::TransportHints().tcpNoDelay());
+      safety_timer = n.createTimer(ros::Duration(0.05), callback_safety_timer);
+    }
+
     ros::spin();
 }
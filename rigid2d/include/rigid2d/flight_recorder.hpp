@@ -0,0 +1,162 @@
+#ifndef FLIGHT_RECORDER_INCLUDE_GUARD_HPP
+#define FLIGHT_RECORDER_INCLUDE_GUARD_HPP
+/// \file
+/// \brief An always on recorder of the recent history of a node, dumped to disk when something goes wrong
+///
+/// Each node keeps one ring of fixed size binary records per channel (encoders, landmarks,
+/// innovations, commands, timings). The rings are allocated up front and sized to hold the last
+/// few seconds at the rate of the channel, so a fast channel never pushes out a slow one.
+/// Recording is a relaxed fetch_add and a 64 byte copy, with no locks and no allocation.
+///
+/// A dump writes the rings to a file with plain write() calls, so it can run from a crash signal
+/// handler. Records that are being written during a dump are left out by their sequence number.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <initializer_list>
+
+namespace flight_recorder
+{
+
+  /// \brief The kind of data in a ring
+  enum class Channel : uint16_t
+  {
+    Encoder = 0, ///< wheel encoder samples
+    Landmark = 1, ///< landmark observations
+    Innovation = 2, ///< filter innovations
+    Command = 3, ///< velocity and wheel commands
+    Timing = 4, ///< callback durations
+    Event = 5, ///< anything else worth noting
+  };
+
+  /// \brief Number of channels
+  constexpr int num_channels = 6;
+
+  /// \brief Get the name of a channel
+  const char * channelName(Channel channel);
+
+  /// \brief Number of values in a record
+  constexpr int record_values = 6;
+
+  /// \brief One sample, exactly one cache line
+  struct alignas(64) Record
+  {
+    uint64_t stamp_ns = 0; ///< time of the sample (ns)
+    uint32_t seq = 0; ///< 1 + the position of the record in its channel, 0 for a slot never written
+    uint16_t channel = 0; ///< the Channel
+    uint16_t tag = 0; ///< what the values mean, up to the node (a landmark id, a timer id)
+    double values[record_values] = {0}; ///< the sample
+  };
+
+  static_assert(sizeof(Record) == 64, "a record is one cache line");
+
+  /// \brief The history to keep for each channel
+  struct RecorderParams
+  {
+    double seconds = 10.0; ///< seconds of history to keep
+    double rates[num_channels] = {100, 50, 100, 50, 100, 10}; ///< highest expected rate (Hz) of each channel
+  };
+
+  /// \brief The rings of one node
+  class Recorder
+  {
+  public:
+    /// \brief Allocate the rings
+    /// \param name the node name, stored in the dump
+    /// \param params the history to keep
+    Recorder(const std::string & name, const RecorderParams & params = RecorderParams());
+
+    Recorder(const Recorder &) = delete;
+    Recorder & operator=(const Recorder &) = delete;
+
+    /// \brief Add a sample, safe from any thread
+    /// \param channel the ring to add it to
+    /// \param stamp_ns the time of the sample (ns)
+    /// \param values the sample, padded with zeros past count
+    /// \param count the number of values, at most record_values
+    /// \param tag what the values mean
+    void record(Channel channel, uint64_t stamp_ns, const double * values, int count, uint16_t tag=0);
+
+    /// \brief Add a sample of up to record_values values
+    void record(Channel channel, uint64_t stamp_ns, std::initializer_list<double> values, uint16_t tag=0);
+
+    /// \brief Write the rings to a file. Async signal safe: no allocation and no locks.
+    /// \param path the file to write
+    /// \returns true if the whole file was written
+    bool dump(const char * path) const;
+
+    /// \brief Get the records of a channel still in its ring
+    /// \param channel the ring
+    /// \returns the records, oldest first
+    std::vector<Record> snapshot(Channel channel) const;
+
+    /// \brief Get the number of records a channel holds
+    unsigned int capacity(Channel channel) const;
+
+    /// \brief Get the node name
+    const std::string & name() const;
+
+  private:
+    /// \brief A preallocated ring of one channel
+    struct Ring
+    {
+      std::unique_ptr<Record[]> slots; // the records
+      unsigned int size = 0; // number of slots, a power of two
+      alignas(64) std::atomic<uint64_t> head{0}; // number of records ever started
+    };
+
+    /// \brief Find the oldest record still in a ring
+    /// \returns the position to start collecting from
+    uint64_t oldest(const Ring & ring) const;
+
+    /// \brief Copy the complete records of a ring, oldest first, in chunks that fit on the stack
+    /// \param ring the ring
+    /// \param next [in/out] the position to start from, moved past the copied records
+    /// \param end the position to stop at
+    /// \param out [out] the copies
+    /// \param max the room in out
+    /// \returns the number copied
+    unsigned int collect(const Ring & ring, uint64_t & next, uint64_t end, Record * out, unsigned int max) const;
+
+    std::string node_name; // stored in the dump
+    char header_name[32] = {0}; // fixed size copy of the name for the dump
+    Ring rings[num_channels]; // one per channel
+  };
+
+  /// \brief Dump a recorder when the process gets a crash signal (SIGSEGV, SIGABRT, SIGBUS, SIGFPE,
+  /// SIGILL), then let the signal kill the process as before. A second call replaces the recorder.
+  /// The handler runs on any thread, but only the calling thread gets an alternate signal stack, so
+  /// a stack overflow on another thread dumps only if that thread called installAltStack().
+  /// \param recorder the recorder to dump, must outlive the process
+  /// \param directory where to write "<name>_crash.nfr"
+  void installCrashHandler(const Recorder & recorder, const std::string & directory);
+
+  /// \brief Give the calling thread its own alternate signal stack for the crash handler, freed when
+  /// the thread ends. Call it first on each thread that may overflow its stack. A second call does nothing.
+  void installAltStack();
+
+  /// \brief Build a dump file name that sorts by time
+  /// \param directory where to put it
+  /// \param name the node name
+  /// \param reason why it was dumped, such as "service" or "nis"
+  /// \returns "<directory>/<name>_<reason>_<unix time>.nfr"
+  std::string dumpPath(const std::string & directory, const std::string & name, const std::string & reason);
+
+  /// \brief The contents of a dump file
+  struct Dump
+  {
+    std::string name; ///< the node name
+    std::vector<Record> records[num_channels]; ///< the records of each channel, oldest first
+  };
+
+  /// \brief Read a dump file
+  /// \param path the file
+  /// \param out [out] the contents
+  /// \returns false if the file is missing or not a dump
+  bool readDump(const std::string & path, Dump & out);
+
+}
+#endif
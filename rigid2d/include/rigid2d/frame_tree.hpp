@@ -0,0 +1,137 @@
+#ifndef FRAME_TREE_INCLUDE_GUARD_HPP
+#define FRAME_TREE_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A tree of planar frames, each edge keeping a short time indexed history of its transform
+///
+/// Every frame but the roots has one parent, and the edge to the parent is a ring of stamped
+/// poses. A lookup walks both frames up to their common ancestor, interpolating each edge at the
+/// requested time with a binary search of its ring, so it costs O(depth + log n) with no
+/// allocation. Edges keep the sine and cosine of their heading, so a chain composes without trig
+/// unless an edge has to be interpolated. The last few results are cached with the versions of
+/// the edges they used, and an update of any of those edges makes the entry stale.
+///
+/// The tree is not thread safe, a node that shares one between threads must guard it.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace rigid2d
+{
+
+  /// \brief A tree of 2D frames with time indexed transforms
+  class FrameTree
+  {
+  public:
+    /// \brief Create an empty tree
+    /// \param capacity the number of transforms kept by each edge, rounded up to a power of two
+    explicit FrameTree(unsigned int capacity = 256);
+
+    /// \brief Add a frame, or get it if it is already in the tree
+    /// \param name the frame name
+    /// \param parent the parent frame name, added as a root if it is not in the tree, empty for a root
+    /// \param is_static true if the transform to the parent never changes, so it holds at any time
+    /// \returns the frame id, or -1 if the frame is already in the tree under another parent
+    int addFrame(const std::string & name, const std::string & parent = "", bool is_static = false);
+
+    /// \brief Find a frame
+    /// \returns the frame id or -1
+    int findFrame(const std::string & name) const;
+
+    /// \brief Get the name of a frame
+    const std::string & frameName(int frame) const;
+
+    /// \brief Get the parent of a frame
+    /// \returns the parent id, or -1 for a root
+    int parent(int frame) const;
+
+    /// \brief Set the transform from a frame to its parent at a time
+    /// \param frame the child frame id
+    /// \param stamp_ns the time of the transform (ns), not before the last one of the edge
+    /// \param T_parent_frame the transform taking points in the frame to the parent
+    /// \returns false for a root, an unknown frame or an older stamp. A repeated stamp replaces
+    ///          the last transform
+    bool setTransform(int frame, int64_t stamp_ns, const Transform2D & T_parent_frame);
+
+    /// \brief Get the newest time of the transform from a frame to its parent
+    /// \returns the time (ns), or -1 if it has none
+    int64_t latest(int frame) const;
+
+    /// \brief Find the transform between two frames at a time
+    /// \param target the frame to express points in
+    /// \param source the frame the points are in
+    /// \param stamp_ns the time (ns), or 0 for the newest transform of each edge
+    /// \param T_target_source [out] the transform
+    /// \returns false if the frames are not connected, or an edge has no transform at the time
+    bool lookup(int target, int source, int64_t stamp_ns, Transform2D & T_target_source) const;
+
+    /// \brief Find the transform between two frames by name
+    /// \see lookup(int, int, int64_t, Transform2D &)
+    bool lookup(const std::string & target, const std::string & source, int64_t stamp_ns,
+                Transform2D & T_target_source) const;
+
+    /// \brief Get the number of lookups answered from the cache
+    uint64_t cacheHits() const;
+
+  private:
+    /// \brief A planar transform with its sine and cosine, composed without any trig
+    struct Planar
+    {
+      double th = 0.0; // heading (rad), not normalized once composed
+      double c = 1.0; // cos(th)
+      double s = 0.0; // sin(th)
+      double x = 0.0; // translation
+      double y = 0.0;
+    };
+
+    /// \brief A stamped transform of an edge
+    struct Sample
+    {
+      int64_t stamp = 0; // time (ns)
+      Planar T; // the transform
+    };
+
+    /// \brief A frame and the edge to its parent
+    struct Frame
+    {
+      std::string name; // frame name
+      int parent = -1; // parent id, -1 for a root
+      int depth = 0; // edges up to the root
+      bool is_static = false; // the transform holds at any time
+      std::vector<Sample> ring; // transforms to the parent, ring of capacity
+      unsigned int head = 0; // position of the oldest sample
+      unsigned int size = 0; // samples in the ring
+      uint64_t version = 0; // bumped by every update
+    };
+
+    /// \brief A recent lookup
+    struct CacheEntry
+    {
+      int target = -1; // frames of the lookup
+      int source = -1;
+      int64_t stamp = -1; // time of the lookup
+      uint64_t versions = 0; // sum of the versions of the edges it used
+      Transform2D result; // the answer
+    };
+
+    /// \brief Compose two transforms, lhs * rhs
+    static Planar compose(const Planar & lhs, const Planar & rhs);
+
+    /// \brief Get the transform of an edge at a time
+    /// \returns false if the edge has no transform at the time
+    bool edgeAt(const Frame & frame, int64_t stamp_ns, Planar & T_parent_frame) const;
+
+    /// \brief Get the sum of the edge versions from two frames to their common ancestor
+    /// \returns false if they have no common ancestor
+    bool chainVersions(int target, int source, uint64_t & versions) const;
+
+    unsigned int capacity; // samples per edge, a power of two
+    std::vector<Frame> frames; // by frame id
+    mutable std::vector<CacheEntry> cache; // recent lookups, direct mapped
+    mutable uint64_t hits = 0; // lookups answered from the cache
+  };
+
+}
+#endif
@@ -0,0 +1,42 @@
+#ifndef LOCKSTEP_INCLUDE_GUARD_HPP
+#define LOCKSTEP_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A node's side of the lockstep barrier of the gazebo turtle drive plugin
+///
+/// In lockstep the plugin pauses the world after each sensor publish until every node publishing
+/// on the ack topic has acked. A node acks once it has published everything it does with one
+/// step of sensor data, and its loop must not sleep on sim time, which stops during the wait.
+/// The step is named by the stamp of its sensor data, which turtle_interface passes on in the joint
+/// states, and each ack echoes it, so a late ack for an earlier step can not release the current one.
+
+#include <string>
+#include <cstdint>
+
+#include <ros/ros.h>
+
+namespace rigid2d
+{
+
+  /// \brief Acks simulation steps when the /lockstep parameter is set
+  class Lockstep
+  {
+  public:
+    /// \brief Read /lockstep, and advertise the ack topic if it is set
+    /// \param n - the node handle to advertise with
+    /// \param topic - the ack topic of the plugin
+    explicit Lockstep(ros::NodeHandle & n, const std::string & topic = "lockstep_ack");
+
+    /// \brief Check if the node takes part in the barrier
+    bool enabled() const;
+
+    /// \brief Tell the simulator the work for a step is done, nothing if lockstep is off
+    /// \param step - the stamp of the sensor data of the step
+    void ack(const ros::Time & step);
+
+  private:
+    bool on = false; // lockstep is set
+    ros::Publisher pub; // to the plugin
+  };
+
+}
+#endif
@@ -285,6 +285,8 @@ namespace rigid2d
     /// tw [out] - output twist
     std::istream & operator>>(std::istream & is, Twist2D & tw);
 
+    class FrameTree;
+
     /// \brief a rigid body transformation in 2 dimensions
     class Transform2D
     {
@@ -348,6 +350,9 @@ namespace rigid2d
         /// for a description
         friend std::ostream & operator<<(std::ostream & os, const Transform2D & tf);
 
+        /// \brief the frame tree composes with the sine and cosine it already has
+        friend class FrameTree;
+
     private:
         /// directly initialize, useful for forming the inverse
         Transform2D(double theta, double ctheta, double stheta, double x, double y);
@@ -0,0 +1,83 @@
+#ifndef SAFETY_STOP_INCLUDE_GUARD_HPP
+#define SAFETY_STOP_INCLUDE_GUARD_HPP
+/// \file
+/// \brief A local guard that slows or stops the commanded translation from the nearest beam of a scan
+///
+/// The guard keeps the latest scan and, for each command, looks at the sector the robot would sweep.
+/// Over a short horizon a diff drive on an arc sees its path at bearings between straight ahead (or
+/// behind when reversing) and half the heading change, so the sector spans that range plus a fixed
+/// half angle on each side. The nearest valid beam in it scales the translation down between the
+/// slow and the stop distance, and zeroes it inside the stop distance. Rotation is never limited, so
+/// the robot can always turn away. A missing or old scan stops the translation.
+
+#include <vector>
+
+#include "rigid2d/rigid2d.hpp"
+
+namespace rigid2d
+{
+
+  /// \brief Find the smallest range of a run of beams, ignoring beams outside the valid range
+  /// \param ranges the beams
+  /// \param n the number of beams
+  /// \param range_min the smallest valid range, beams below it are no return
+  /// \param range_max the largest valid range
+  /// \returns the smallest valid range, or infinity if there is none
+  float minRange(const float * ranges, unsigned int n, float range_min, float range_max);
+
+  /// \brief The settings of the safety stop
+  struct SafetyParams
+  {
+    double stop_distance = 0.15; ///< the translation is zeroed with an obstacle this close (m)
+    double slow_distance = 0.4; ///< the translation is scaled down with an obstacle this close (m)
+    double half_angle = 0.35; ///< the half width of the sector about the path (rad)
+    double horizon = 0.5; ///< the time of the path the sector covers (s)
+    double timeout = 0.5; ///< the age of a scan after which the translation is stopped (s), 0 for never
+  };
+
+  /// \brief Limits velocity commands from the latest scan
+  class SafetyStop
+  {
+  public:
+    /// \brief Create a guard with no scan, which stops any translation
+    SafetyStop() = default;
+
+    /// \brief Create a guard with no scan, which stops any translation
+    /// \param params the settings
+    explicit SafetyStop(const SafetyParams & params);
+
+    /// \brief Keep a scan
+    /// \param ranges the beams, counter clockwise from angle_min
+    /// \param angle_min the bearing of the first beam (rad)
+    /// \param angle_increment the angle between beams (rad)
+    /// \param range_min the smallest valid range
+    /// \param range_max the largest valid range
+    /// \param stamp the time of the scan (s)
+    void setScan(const std::vector<float> & ranges, double angle_min, double angle_increment,
+                 double range_min, double range_max, double stamp);
+
+    /// \brief Find the nearest obstacle on the path of a command
+    /// \param tw the command
+    /// \returns the smallest valid range in the sector of the path, infinity if it is clear
+    float clearance(const Twist2D & tw) const;
+
+    /// \brief Limit a command
+    /// \param tw [in/out] the command, its translation is scaled or zeroed
+    /// \param now the current time (s)
+    /// \returns the scale applied to the translation, 1 if the path is clear
+    double limit(Twist2D & tw, double now) const;
+
+  private:
+    /// \brief Get the smallest valid range between two bearings
+    float sectorMin(double lo, double hi) const;
+
+    SafetyParams params; // settings
+    std::vector<float> ranges; // the latest scan
+    double angle_min = 0.0, angle_increment = 0.0; // beam bearings (rad)
+    float range_min = 0.0f, range_max = 0.0f; // valid ranges
+    double stamp = 0.0; // time of the scan (s)
+    bool full_circle = false; // the beams wrap around
+  };
+
+}
+#endif
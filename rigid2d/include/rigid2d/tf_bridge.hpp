@@ -0,0 +1,56 @@
+#ifndef TF_BRIDGE_INCLUDE_GUARD_HPP
+#define TF_BRIDGE_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Broadcasts edges of a frame tree to tf2 at a reduced rate, for rviz and other tf users
+
+#include <vector>
+#include <string>
+
+#include <ros/ros.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <tf2_ros/transform_broadcaster.h>
+
+#include "rigid2d/rigid2d.hpp"
+#include "rigid2d/frame_tree.hpp"
+
+namespace rigid2d
+{
+
+  /// \brief convert a 2D transform into a tf2 transform message
+  /// \param T_parent_child - the transform taking points in the child frame to the parent
+  /// \param parent - the parent frame id
+  /// \param child - the child frame id
+  /// \param stamp - the time of the transform
+  /// \return the equivalent geometry_msgs::TransformStamped
+  geometry_msgs::TransformStamped toTransformStamped(const Transform2D & T_parent_child, const std::string & parent,
+                                                     const std::string & child, const ros::Time & stamp);
+
+  /// \brief Sends the newest transform of some edges of a tree to tf2, at most at a set rate
+  class TfBridge
+  {
+  public:
+    /// \brief Create a bridge, after ros::init
+    /// \param tree - the frame tree, must outlive the bridge
+    /// \param rate - the broadcasts per second, 0 to broadcast on every update
+    TfBridge(const FrameTree & tree, double rate);
+
+    /// \brief Broadcast the edge from a frame to its parent
+    /// \param frame - the child frame id
+    void add(int frame);
+
+    /// \brief Broadcast the edges if a period has passed since the last broadcast
+    /// \param now - the current time
+    /// \return true if the edges were broadcast
+    bool update(const ros::Time & now);
+
+  private:
+    const FrameTree & tree; // the frames
+    ros::Duration period; // time between broadcasts
+    ros::Time last; // time of the last broadcast
+    std::vector<int> edges; // child frame of each broadcast edge
+    std::vector<int64_t> sent; // stamp of the last broadcast transform of each edge
+    tf2_ros::TransformBroadcaster broadcaster; // to tf2
+  };
+
+}
+#endif
@@ -0,0 +1,237 @@
+#ifndef TOPIC_MONITOR_INCLUDE_GUARD_HPP
+#define TOPIC_MONITOR_INCLUDE_GUARD_HPP
+/// \file
+/// \brief Subscribers that count the messages a node loses or sees late, reported on /diagnostics
+///
+/// The sensor subscribers keep a queue of one message, so a node that falls behind works on the
+/// newest message and the ones before it are overwritten without a trace. A monitored subscription
+/// receives every message on a thread of the monitor into a mailbox of one, and hands the newest to
+/// the callback queue of the node. The node sees the same newest only delivery as with a queue of
+/// one, and each message replaced in the mailbox is counted as an overwrite. Missing header sequence
+/// numbers, which roscpp fills in for every stamped message it sends to another process, are counted
+/// as gaps, messages lost before they arrived. The age of a delivered message is the time from its
+/// header stamp to the start of its callback, so latched and event topics such as maps, goals and
+/// initial poses, stamped when they were made rather than sent, stay on plain subscribers.
+///
+/// The counters are relaxed atomics, written by the receiving thread and the node and read once a
+/// period by the monitor, which publishes one status per topic on /diagnostics from its own thread,
+/// so the report goes out even while the node is stuck. A topic warns once the fraction of its
+/// messages lost or its mean age pass a threshold, and errors once it has warned for a number of
+/// periods in a row. The thresholds are the global parameters /diagnostics_period (s),
+/// /alarm_drop_ratio, /alarm_age (s) and /alarm_periods.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <ros/message_traits.h>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+
+namespace rigid2d
+{
+
+  /// \brief The report period and the alarm thresholds of a monitor
+  struct MonitorParams
+  {
+    double period = 1.0; ///< time between reports (s)
+    double drop_ratio = 0.05; ///< the fraction of lost messages, overwritten or missing, that warns
+    double max_age = 0.2; ///< the mean age of the delivered messages that warns (s)
+    int error_periods = 3; ///< warnings in a row that become an error
+    uint32_t receive_queue = 100; ///< queue of the receiving thread, which only fills the mailbox
+  };
+
+  /// \brief The counts of one topic over one report period
+  struct TopicWindow
+  {
+    double seconds = 0.0; ///< length of the period (s)
+    uint64_t received = 0; ///< messages that arrived
+    uint64_t delivered = 0; ///< messages handed to the node
+    uint64_t overwritten = 0; ///< messages replaced in the mailbox before the node got to them
+    uint64_t gaps = 0; ///< missing sequence numbers, messages that never arrived
+    uint64_t stamped = 0; ///< delivered messages with a stamp
+    double age_mean = 0.0; ///< mean age of the stamped messages (s)
+    double age_max = 0.0; ///< oldest stamped message (s)
+
+    /// \brief Get the fraction of the messages sent that the node never saw
+    double lostRatio() const;
+  };
+
+  /// \brief The counters of one monitored topic
+  class TopicStats
+  {
+  public:
+    /// \brief Start the counts at zero
+    /// \param topic - the resolved topic name
+    explicit TopicStats(const std::string & topic);
+
+    /// \brief Count a message arriving, from the receiving thread only
+    /// \param publisher - the node that sent it, each publisher numbers its messages on its own
+    /// \param seq - its header sequence number, 0 when it has none
+    void received(const std::string & publisher, uint32_t seq);
+
+    /// \brief Count a message replaced in the mailbox before it was delivered
+    void overwritten();
+
+    /// \brief Count a message handed to the node
+    /// \param age_ns - the time since its stamp (ns), or < 0 when it has no stamp
+    void delivered(int64_t age_ns = -1);
+
+    /// \brief Take the counts since the last window, from one thread only
+    /// \param seconds - the length of the window (s)
+    /// \returns the counts
+    TopicWindow window(double seconds);
+
+    /// \brief Get the resolved topic name
+    const std::string & topic() const;
+
+  private:
+    std::string name; // resolved topic name
+    std::map<std::string, uint32_t> last_seq; // last sequence number of each publisher, receiving thread only
+
+    std::atomic<uint64_t> received_count{0}; // messages that arrived
+    std::atomic<uint64_t> delivered_count{0}; // messages handed to the node
+    std::atomic<uint64_t> overwritten_count{0}; // messages replaced in the mailbox
+    std::atomic<uint64_t> gap_count{0}; // missing sequence numbers
+    std::atomic<uint64_t> stamped_count{0}; // delivered messages with a stamp
+    std::atomic<int64_t> age_sum{0}; // summed age of the stamped messages (ns)
+    std::atomic<int64_t> age_max{0}; // oldest stamped message since the last window (ns)
+
+    TopicWindow previous; // running totals at the last window, window thread only
+    int64_t previous_age_sum = 0; // summed age at the last window (ns)
+  };
+
+  /// \brief Get the alarm level of a topic after a window
+  /// \param window - the counts of the window
+  /// \param params - the thresholds
+  /// \param streak - [in/out] the windows in a row the topic has warned, updated
+  /// \returns diagnostic_msgs::DiagnosticStatus::OK, WARN or ERROR
+  uint8_t alarmLevel(const TopicWindow & window, const MonitorParams & params, int & streak);
+
+  /// \brief The mailbox of one monitored subscription
+  ///
+  /// It sits on the callback queue of the node at most once, and delivers the newest message when the
+  /// queue gets to it.
+  template<class M>
+  class TopicMailbox : public ros::CallbackInterface, public boost::enable_shared_from_this<TopicMailbox<M>>
+  {
+  public:
+    std::shared_ptr<TopicStats> stats; ///< counters of the topic
+    boost::function<void(const boost::shared_ptr<const M> &)> callback; ///< callback of the node
+    ros::CallbackQueueInterface * queue = nullptr; ///< callback queue of the node
+
+    /// \brief Take a message, on the receiving thread
+    void receive(const ros::MessageEvent<M const> & event)
+    {
+      const boost::shared_ptr<const M> & msg = event.getConstMessage();
+      const std_msgs::Header * header = ros::message_traits::header(*msg);
+      stats->received(event.getPublisherName(), header ? header->seq : 0);
+
+      bool post = false;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if(pending) stats->overwritten();
+        else post = true;
+        pending = msg;
+      }
+      if(post) queue->addCallback(this->shared_from_this(), reinterpret_cast<uint64_t>(this));
+    }
+
+    /// \brief Hand the newest message to the node, on the thread that spins its queue
+    CallResult call() override
+    {
+      boost::shared_ptr<const M> msg;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        msg.swap(pending);
+      }
+      if(!msg) return Success;
+
+      const std_msgs::Header * header = ros::message_traits::header(*msg);
+      if(header && !header->stamp.isZero()) stats->delivered((ros::Time::now() - header->stamp).toNSec());
+      else stats->delivered();
+
+      callback(msg);
+      return Success;
+    }
+
+  private:
+    std::mutex lock; // guards pending
+    boost::shared_ptr<const M> pending; // newest message not yet delivered
+  };
+
+  /// \brief Monitored subscriptions of one node, and their reports on /diagnostics
+  class TopicMonitor
+  {
+  public:
+    /// \brief Read the global thresholds, start the receiving thread and advertise /diagnostics
+    /// \param n - the node handle to advertise with
+    explicit TopicMonitor(ros::NodeHandle & n);
+
+    /// \brief Stop the receiving thread
+    ~TopicMonitor();
+
+    TopicMonitor(const TopicMonitor &) = delete;
+    TopicMonitor & operator=(const TopicMonitor &) = delete;
+
+    /// \brief Subscribe to a topic through a mailbox of one message
+    /// \param n - the node handle to subscribe with, its callback queue runs the callback
+    /// \param topic - the topic
+    /// \param callback - called with the newest message
+    /// \param hints - the transport
+    /// \returns the subscriber, the messages stop when it is destroyed
+    template<class M>
+    ros::Subscriber subscribe(ros::NodeHandle & n, const std::string & topic,
+                              const boost::function<void(const boost::shared_ptr<const M> &)> & callback,
+                              const ros::TransportHints & hints = ros::TransportHints())
+    {
+      auto mailbox = boost::make_shared<TopicMailbox<M>>();
+      mailbox->stats = addTopic(n.resolveName(topic));
+      mailbox->callback = callback;
+      mailbox->queue = n.getCallbackQueue() ? n.getCallbackQueue() : ros::getGlobalCallbackQueue();
+
+      ros::SubscribeOptions ops;
+      ops.template initByFullCallbackType<const ros::MessageEvent<M const> &>(topic, params.receive_queue,
+        [mailbox](const ros::MessageEvent<M const> & event) { mailbox->receive(event); });
+      ops.callback_queue = &receive_queue;
+      ops.transport_hints = hints;
+      return n.subscribe(ops);
+    }
+
+    /// \brief Check if any topic is warning or worse
+    bool alarmed() const;
+
+    /// \brief Get the thresholds
+    const MonitorParams & getParams() const;
+
+  private:
+    /// \brief Add the counters of a topic to the reports
+    std::shared_ptr<TopicStats> addTopic(const std::string & topic);
+
+    /// \brief Publish a status per topic, on the receiving thread
+    void report(const ros::WallTimerEvent & event);
+
+    MonitorParams params; // thresholds
+    std::string node; // node name
+    ros::CallbackQueue receive_queue; // the receiving side of every subscription, and the reports
+    std::unique_ptr<ros::AsyncSpinner> spinner; // spins receive_queue
+    ros::Publisher pub; // diagnostics
+    ros::WallTimer timer; // report period
+    ros::WallTime last_report; // end of the last window
+
+    std::mutex topics_lock; // guards topics, added from the node while the reports read them
+    std::vector<std::shared_ptr<TopicStats>> topics; // counters of each topic
+    std::vector<int> streaks; // warnings in a row of each topic, report thread only
+    std::vector<uint8_t> levels; // last level of each topic, report thread only
+    std::atomic<bool> alarm{false}; // any topic is warning or worse
+  };
+
+}
+#endif
@@ -9,6 +9,7 @@
 ///     frequency (double) the frequency to publish joint states at
 /// PUBLISHES:
 ///     /joint_states (sensor_msgs/JointState) publishs the scaled wheel velocities and the resulting distance of rotation for wheels moving at that velocity
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /turtle1/cmd_vel (geometry_msgs/Twist): Retrieves the current twist of the turtle
 
@@ -22,6 +23,7 @@
 #include "rigid2d/rigid2d.hpp"
 #include "rigid2d/diff_drive.hpp"
 #include "rigid2d/waypoints.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 // Global Variables
 static geometry_msgs::Twist twist_cmd;
@@ -43,8 +45,9 @@ int main(int argc, char** argv)
     ros::init(argc, argv, "fake_diff_encoders");
     ros::NodeHandle n;
     ros::NodeHandle np("~odometer");
+    rigid2d::TopicMonitor monitor(n);
 
-    ros::Subscriber twist_sub = n.subscribe("cmd_vel", 1, callback_twist);
+    ros::Subscriber twist_sub = monitor.subscribe<geometry_msgs::Twist>(n, "cmd_vel", callback_twist);
     ros::Publisher pub_joint_state = n.advertise<sensor_msgs::JointState>("joint_states", 1);
 
     // Get parameters from the parameter server
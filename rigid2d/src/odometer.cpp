@@ -9,8 +9,12 @@
 ///     wheel_base (double) the distance between the two wheels of the diff drive robot
 ///     wheel_radius (double) the radius of the wheels
 ///     frequency (double) the frequency to publish joint states at
+///     tf_rate (double) the rate to broadcast the odom to base transform to tf (Hz), 0 for every update
+///     lockstep (bool) ack each joint state to the gazebo plugin, once the odometry is out
 /// PUBLISHES:
 ///     /odom (nav_msgs/Odometry): The calculated odometry of the diff drive robot
+///     /lockstep_ack (std_msgs/UInt64): The joint states handled, in lockstep only
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /joint_states (sensor_msgs/JointState): Retrieves the calculated wheel velocities and change in wheel position
 /// SERVICES:
@@ -20,11 +24,9 @@
 
 #include <ros/ros.h>
 
-#include <tf2_ros/transform_broadcaster.h>
 #include <tf2/LinearMath/Quaternion.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 
-#include <geometry_msgs/TransformStamped.h>
 #include <geometry_msgs/Quaternion.h>
 #include <nav_msgs/Odometry.h>
 #include <sensor_msgs/JointState.h>
@@ -32,6 +34,10 @@
 #include "rigid2d/SetPose.h"
 #include "rigid2d/rigid2d.hpp"
 #include "rigid2d/diff_drive.hpp"
+#include "rigid2d/frame_tree.hpp"
+#include "rigid2d/tf_bridge.hpp"
+#include "rigid2d/lockstep.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 //Global Variables
 static sensor_msgs::JointState cur_js;
@@ -74,15 +80,14 @@ int main(int argc, char** argv)
 
     ros::NodeHandle n;
     ros::NodeHandle pn("~");
+    rigid2d::TopicMonitor monitor(n);
 
-    ros::Subscriber joint_sub = n.subscribe<sensor_msgs::JointState>("joint_states", 1, callback_joints);
+    ros::Subscriber joint_sub = monitor.subscribe<sensor_msgs::JointState>(n, "joint_states", callback_joints);
     ros::Publisher odom_pub = n.advertise<nav_msgs::Odometry>("odom", 10);
 
-
-    tf2_ros::TransformBroadcaster odom_br;
-
     std::string odom_frame_id, base_frame_id, left_wheel_joint, right_wheel_joint;;
     double frequency;
+    double tf_rate = 0;
     double wheel_base, wheel_radius;
 
     // Get private parameters
@@ -90,6 +95,7 @@ int main(int argc, char** argv)
     pn.getParam("base_frame_id", base_frame_id);
     pn.getParam("left_wheel_joint", left_wheel_joint);
     pn.getParam("right_wheel_joint", right_wheel_joint);
+    pn.getParam("tf_rate", tf_rate);
     n.getParam("/frequency", frequency);
     n.getParam("/wheel_radius", wheel_radius);
     n.getParam("/wheel_base", wheel_base);
@@ -101,6 +107,7 @@ int main(int argc, char** argv)
     ROS_INFO_STREAM("ODOM: Got wheel base param: " << wheel_base);
     ROS_INFO_STREAM("ODOM: Got wheel radius param: " << wheel_radius);
     ROS_INFO_STREAM("ODOM: Got frequency param: " << frequency);
+    ROS_INFO_STREAM("ODOM: Got tf rate param: " << tf_rate);
 
     // Create diff drive object to simuate the robot
     rigid2d::Pose2D pos;
@@ -108,6 +115,15 @@ int main(int argc, char** argv)
 
     bot = bufbot;
 
+    // The odometry goes into the frame tree every update, tf only gets it at tf_rate
+    rigid2d::FrameTree frames;
+    int base_frame = frames.addFrame(base_frame_id, odom_frame_id);
+    rigid2d::TfBridge tf_bridge(frames, tf_rate);
+    tf_bridge.add(base_frame);
+
+    rigid2d::Lockstep lockstep(n);
+    ROS_INFO_STREAM("ODOM: Got lockstep param: " << lockstep.enabled());
+
     ros::ServiceServer srv_set_pose = n.advertiseService("set_pose", callback_set_pose);
 
     ros::Rate r(frequency);
@@ -156,23 +172,9 @@ int main(int argc, char** argv)
       odom_pub.publish(odom);
 
       // Broadcast the transform
-      geometry_msgs::TransformStamped T_ob;
-
-      T_ob.header.stamp = ros::Time::now();
-      T_ob.header.frame_id = odom_frame_id;
-
-      T_ob.child_frame_id = base_frame_id;
-
-      T_ob.transform.translation.x = pos.x;
-      T_ob.transform.translation.y = pos.y;
-      T_ob.transform.translation.z = 0.0;
-
-      T_ob.transform.rotation.x = q.x();
-      T_ob.transform.rotation.y = q.y();
-      T_ob.transform.rotation.z = q.z();
-      T_ob.transform.rotation.w = q.w();
-
-      odom_br.sendTransform(T_ob);
+      frames.setTransform(base_frame, odom.header.stamp.toNSec(), rigid2d::Transform2D(pos));
+      tf_bridge.update(odom.header.stamp);
+      lockstep.ack(cur_js.header.stamp);
 
       got_data = 0;
     }
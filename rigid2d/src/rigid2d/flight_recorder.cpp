@@ -0,0 +1,287 @@
+/// \file
+/// \brief Source file for the flight recorder
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <vector>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rigid2d/flight_recorder.hpp"
+
+namespace flight_recorder
+{
+
+  namespace
+  {
+    /// \brief The start of a dump file, followed by records until the end of the file
+    struct FileHeader
+    {
+      char magic[4]; // "NUFR"
+      uint32_t version; // format version
+      uint32_t record_size; // sizeof(Record)
+      uint32_t num_channels; // channels the writer knew of
+      char name[32]; // node name
+    };
+
+    constexpr char file_magic[4] = {'N', 'U', 'F', 'R'};
+    constexpr uint32_t file_version = 1;
+
+    // the records copied on the stack between writes
+    constexpr unsigned int chunk_size = 32;
+
+    /// \brief Write a whole buffer, retrying short writes
+    bool writeAll(int fd, const void * data, size_t size)
+    {
+      const char * bytes = static_cast<const char *>(data);
+      while(size > 0)
+      {
+        ssize_t n = ::write(fd, bytes, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        bytes += n;
+        size -= n;
+      }
+      return true;
+    }
+
+    // crash handler state, set up before the handler can run
+    const Recorder * crash_recorder = nullptr;
+    char crash_path[512] = {0};
+    const int crash_signals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+    struct sigaction previous[sizeof(crash_signals) / sizeof(crash_signals[0])];
+
+    /// \brief The alternate signal stack of a thread, a stack overflow leaves no room on the normal one
+    struct AltStack
+    {
+      std::vector<char> memory; // empty until installed
+
+      /// \brief Stop using the stack before it is freed at the end of the thread
+      ~AltStack()
+      {
+        if(memory.empty()) return;
+
+        stack_t ss;
+        std::memset(&ss, 0, sizeof(ss));
+        ss.ss_flags = SS_DISABLE;
+        sigaltstack(&ss, nullptr);
+      }
+    };
+    thread_local AltStack alt_stack;
+
+    void crashHandler(int sig)
+    {
+      if(crash_recorder) crash_recorder->dump(crash_path);
+
+      // put back whatever ran before and let it finish the process
+      for(unsigned int i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+      {
+        if(crash_signals[i] == sig) sigaction(sig, &previous[i], nullptr);
+      }
+      raise(sig);
+    }
+  }
+
+  const char * channelName(Channel channel)
+  {
+    switch(channel)
+    {
+      case Channel::Encoder: return "encoder";
+      case Channel::Landmark: return "landmark";
+      case Channel::Innovation: return "innovation";
+      case Channel::Command: return "command";
+      case Channel::Timing: return "timing";
+      case Channel::Event: return "event";
+    }
+    return "unknown";
+  }
+
+  /////////////// Recorder CLASS ///////////////////////////
+  Recorder::Recorder(const std::string & name, const RecorderParams & params) : node_name(name)
+  {
+    std::strncpy(header_name, name.c_str(), sizeof(header_name) - 1);
+
+    for(int c = 0; c < num_channels; c++)
+    {
+      // round up to a power of two so the slot is a mask of the position
+      double wanted = std::max(1.0, std::ceil(params.seconds * params.rates[c]));
+      unsigned int size = 1;
+      while(size < wanted) size <<= 1;
+
+      // value initialized, so every page is touched now and not on the first records
+      rings[c].slots.reset(new Record[size]());
+      rings[c].size = size;
+    }
+  }
+
+  void Recorder::record(Channel channel, uint64_t stamp_ns, const double * values, int count, uint16_t tag)
+  {
+    Ring & ring = rings[static_cast<int>(channel)];
+    uint64_t pos = ring.head.fetch_add(1, std::memory_order_relaxed);
+    Record & slot = ring.slots[pos & (ring.size - 1)];
+
+    // seqlock write: mark the slot busy, fill it, then publish its position
+    __atomic_store_n(&slot.seq, 0, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.stamp_ns = stamp_ns;
+    slot.channel = static_cast<uint16_t>(channel);
+    slot.tag = tag;
+    count = std::min(std::max(count, 0), record_values);
+    for(int i = 0; i < record_values; i++) slot.values[i] = i < count ? values[i] : 0.0;
+
+    __atomic_store_n(&slot.seq, static_cast<uint32_t>(pos + 1), __ATOMIC_RELEASE);
+  }
+
+  void Recorder::record(Channel channel, uint64_t stamp_ns, std::initializer_list<double> values, uint16_t tag)
+  {
+    record(channel, stamp_ns, values.begin(), values.size(), tag);
+  }
+
+  uint64_t Recorder::oldest(const Ring & ring) const
+  {
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    return head > ring.size ? head - ring.size : 0;
+  }
+
+  unsigned int Recorder::collect(const Ring & ring, uint64_t & next, uint64_t end, Record * out, unsigned int max) const
+  {
+    unsigned int n = 0;
+    for(; next < end && n < max; next++)
+    {
+      const Record & slot = ring.slots[next & (ring.size - 1)];
+      uint32_t expected = static_cast<uint32_t>(next + 1);
+
+      // skip slots being written or already reused by a newer record
+      if(__atomic_load_n(&slot.seq, __ATOMIC_ACQUIRE) != expected) continue;
+      out[n] = slot;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(__atomic_load_n(&slot.seq, __ATOMIC_RELAXED) != expected) continue;
+
+      n++;
+    }
+    return n;
+  }
+
+  bool Recorder::dump(const char * path) const
+  {
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = file_version;
+    header.record_size = sizeof(Record);
+    header.num_channels = num_channels;
+    std::memcpy(header.name, header_name, sizeof(header.name));
+
+    bool ok = writeAll(fd, &header, sizeof(header));
+
+    Record chunk[chunk_size];
+    for(int c = 0; c < num_channels && ok; c++)
+    {
+      const Ring & ring = rings[c];
+      uint64_t next = oldest(ring);
+      uint64_t end = ring.head.load(std::memory_order_acquire);
+
+      while(next < end && ok)
+      {
+        unsigned int n = collect(ring, next, end, chunk, chunk_size);
+        ok = writeAll(fd, chunk, n * sizeof(Record));
+      }
+    }
+
+    return ::close(fd) == 0 && ok;
+  }
+
+  std::vector<Record> Recorder::snapshot(Channel channel) const
+  {
+    const Ring & ring = rings[static_cast<int>(channel)];
+    uint64_t next = oldest(ring);
+    uint64_t end = ring.head.load(std::memory_order_acquire);
+
+    std::vector<Record> out(end - next);
+    unsigned int n = collect(ring, next, end, out.data(), out.size());
+    out.resize(n);
+    return out;
+  }
+
+  unsigned int Recorder::capacity(Channel channel) const
+  {
+    return rings[static_cast<int>(channel)].size;
+  }
+
+  const std::string & Recorder::name() const
+  {
+    return node_name;
+  }
+
+  void installCrashHandler(const Recorder & recorder, const std::string & directory)
+  {
+    std::string path = directory + "/" + recorder.name() + "_crash.nfr";
+    std::strncpy(crash_path, path.c_str(), sizeof(crash_path) - 1);
+    crash_recorder = &recorder;
+    installAltStack();
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = crashHandler;
+    action.sa_flags = SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+
+    for(unsigned int i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+    {
+      struct sigaction old;
+      sigaction(crash_signals[i], &action, &old);
+
+      // a second install must not save our own handler as the one to restore
+      if(old.sa_handler != crashHandler) previous[i] = old;
+    }
+  }
+
+  void installAltStack()
+  {
+    if(!alt_stack.memory.empty()) return;
+
+    alt_stack.memory.resize(std::max<size_t>(64 * 1024, SIGSTKSZ));
+
+    stack_t ss;
+    std::memset(&ss, 0, sizeof(ss));
+    ss.ss_sp = alt_stack.memory.data();
+    ss.ss_size = alt_stack.memory.size();
+    sigaltstack(&ss, nullptr);
+  }
+
+  std::string dumpPath(const std::string & directory, const std::string & name, const std::string & reason)
+  {
+    return directory + "/" + name + "_" + reason + "_" + std::to_string(std::time(nullptr)) + ".nfr";
+  }
+
+  bool readDump(const std::string & path, Dump & out)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    FileHeader header;
+    if(!file.read(reinterpret_cast<char *>(&header), sizeof(header))) return false;
+    if(std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) return false;
+    if(header.version != file_version || header.record_size != sizeof(Record)) return false;
+
+    out.name.assign(header.name, strnlen(header.name, sizeof(header.name)));
+    for(auto & records : out.records) records.clear();
+
+    Record record;
+    while(file.read(reinterpret_cast<char *>(&record), sizeof(record)))
+    {
+      if(record.channel < num_channels) out.records[record.channel].push_back(record);
+    }
+
+    return true;
+  }
+}
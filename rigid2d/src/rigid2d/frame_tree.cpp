@@ -0,0 +1,277 @@
+/// \file
+/// \brief Source file for the 2D frame tree
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "rigid2d/frame_tree.hpp"
+
+namespace rigid2d
+{
+
+  // lookups remembered by the cache, a power of two
+  static constexpr unsigned int cache_size = 16;
+
+  /////////////// FrameTree CLASS //////////////////////
+  FrameTree::FrameTree(unsigned int capacity) : capacity(1), cache(cache_size)
+  {
+    // a power of two, so ring positions are a mask instead of a division
+    while(this->capacity < capacity) this->capacity <<= 1;
+  }
+
+  int FrameTree::addFrame(const std::string & name, const std::string & parent, bool is_static)
+  {
+    int parent_id = -1;
+    if(!parent.empty())
+    {
+      parent_id = findFrame(parent);
+      if(parent_id < 0) parent_id = addFrame(parent);
+    }
+
+    int id = findFrame(name);
+    if(id >= 0)
+    {
+      Frame & frame = frames.at(id);
+      if(frame.parent == parent_id || parent_id < 0) return id;
+      if(frame.parent >= 0) return -1;
+
+      // a root gets its parent, unless that makes a loop
+      for(int f = parent_id; f >= 0; f = frames.at(f).parent)
+      {
+        if(f == id) return -1;
+      }
+      frame.parent = parent_id;
+      frame.is_static = is_static;
+
+      // the depths below the frame change
+      for(auto & f : frames)
+      {
+        f.depth = 0;
+        for(int p = f.parent; p >= 0; p = frames.at(p).parent) f.depth++;
+      }
+      return id;
+    }
+
+    Frame frame;
+    frame.name = name;
+    frame.parent = parent_id;
+    frame.depth = parent_id < 0 ? 0 : frames.at(parent_id).depth + 1;
+    frame.is_static = is_static;
+    frame.ring.resize(parent_id < 0 ? 0 : capacity);
+    frames.push_back(frame);
+    return frames.size() - 1;
+  }
+
+  int FrameTree::findFrame(const std::string & name) const
+  {
+    // trees are a handful of frames, a scan is faster than a map
+    for(unsigned int i = 0; i < frames.size(); i++)
+    {
+      if(frames[i].name == name) return i;
+    }
+    return -1;
+  }
+
+  const std::string & FrameTree::frameName(int frame) const
+  {
+    return frames.at(frame).name;
+  }
+
+  int FrameTree::parent(int frame) const
+  {
+    return frames.at(frame).parent;
+  }
+
+  bool FrameTree::setTransform(int frame, int64_t stamp_ns, const Transform2D & T_parent_frame)
+  {
+    if(frame < 0 || frame >= static_cast<int>(frames.size())) return false;
+
+    Frame & f = frames[frame];
+    if(f.parent < 0) return false;
+    if(f.ring.size() != capacity) f.ring.resize(capacity);
+
+    Sample sample;
+    sample.stamp = stamp_ns;
+    sample.T.th = T_parent_frame.theta;
+    sample.T.c = T_parent_frame.ctheta;
+    sample.T.s = T_parent_frame.stheta;
+    sample.T.x = T_parent_frame.x;
+    sample.T.y = T_parent_frame.y;
+
+    if(f.size > 0)
+    {
+      Sample & newest = f.ring[(f.head + f.size - 1) & (capacity - 1)];
+      if(stamp_ns < newest.stamp) return false;
+      if(stamp_ns == newest.stamp)
+      {
+        newest = sample;
+        f.version++;
+        return true;
+      }
+    }
+
+    if(f.size < capacity)
+    {
+      f.ring[(f.head + f.size) & (capacity - 1)] = sample;
+      f.size++;
+    }
+    else
+    {
+      // full, the oldest goes
+      f.ring[f.head] = sample;
+      f.head = (f.head + 1) & (capacity - 1);
+    }
+
+    f.version++;
+    return true;
+  }
+
+  int64_t FrameTree::latest(int frame) const
+  {
+    const Frame & f = frames.at(frame);
+    if(f.size == 0) return -1;
+    return f.ring[(f.head + f.size - 1) & (capacity - 1)].stamp;
+  }
+
+  FrameTree::Planar FrameTree::compose(const Planar & lhs, const Planar & rhs)
+  {
+    Planar out;
+    out.th = lhs.th + rhs.th;
+    out.c = lhs.c * rhs.c - lhs.s * rhs.s;
+    out.s = lhs.s * rhs.c + lhs.c * rhs.s;
+    out.x = lhs.c * rhs.x - lhs.s * rhs.y + lhs.x;
+    out.y = lhs.s * rhs.x + lhs.c * rhs.y + lhs.y;
+    return out;
+  }
+
+  bool FrameTree::edgeAt(const Frame & frame, int64_t stamp_ns, Planar & T_parent_frame) const
+  {
+    if(frame.size == 0) return false;
+
+    const Sample & newest = frame.ring[(frame.head + frame.size - 1) & (capacity - 1)];
+    if(stamp_ns == 0 || frame.is_static || stamp_ns == newest.stamp)
+    {
+      T_parent_frame = newest.T;
+      return true;
+    }
+    if(stamp_ns > newest.stamp) return false;
+
+    // first sample at or after the time
+    unsigned int lo = 0, hi = frame.size - 1;
+    while(lo < hi)
+    {
+      unsigned int mid = (lo + hi) / 2;
+      if(frame.ring[(frame.head + mid) & (capacity - 1)].stamp < stamp_ns) lo = mid + 1;
+      else hi = mid;
+    }
+
+    const Sample & after = frame.ring[(frame.head + lo) & (capacity - 1)];
+    if(after.stamp == stamp_ns)
+    {
+      T_parent_frame = after.T;
+      return true;
+    }
+    if(lo == 0) return false;
+
+    const Sample & before = frame.ring[(frame.head + lo - 1) & (capacity - 1)];
+    const Planar & a = before.T, & b = after.T;
+    double s = static_cast<double>(stamp_ns - before.stamp) / static_cast<double>(after.stamp - before.stamp);
+    T_parent_frame.th = a.th + s * normalize_angle(b.th - a.th);
+    T_parent_frame.c = std::cos(T_parent_frame.th);
+    T_parent_frame.s = std::sin(T_parent_frame.th);
+    T_parent_frame.x = a.x + s * (b.x - a.x);
+    T_parent_frame.y = a.y + s * (b.y - a.y);
+    return true;
+  }
+
+  bool FrameTree::chainVersions(int target, int source, uint64_t & versions) const
+  {
+    versions = 0;
+    int a = source, b = target;
+    while(a != b)
+    {
+      if(a < 0 || b < 0) return false;
+
+      if(frames[a].depth >= frames[b].depth)
+      {
+        versions += frames[a].version;
+        a = frames[a].parent;
+      }
+      else
+      {
+        versions += frames[b].version;
+        b = frames[b].parent;
+      }
+    }
+    return true;
+  }
+
+  bool FrameTree::lookup(int target, int source, int64_t stamp_ns, Transform2D & T_target_source) const
+  {
+    int num_frames = frames.size();
+    if(target < 0 || source < 0 || target >= num_frames || source >= num_frames) return false;
+    if(target == source)
+    {
+      T_target_source = Transform2D();
+      return true;
+    }
+
+    uint64_t versions = 0;
+    if(!chainVersions(target, source, versions)) return false;
+
+    // versions only grow, so the sum changes with any update along the chain
+    uint64_t key = static_cast<uint64_t>(target) * 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(source) * 0xc2b2ae3d27d4eb4fULL ^
+                   static_cast<uint64_t>(stamp_ns);
+    CacheEntry & entry = cache[(key ^ (key >> 29)) & (cache_size - 1)];
+    if(entry.target == target && entry.source == source && entry.stamp == stamp_ns && entry.versions == versions)
+    {
+      hits++;
+      T_target_source = entry.result;
+      return true;
+    }
+
+    // walk both frames up to their common ancestor
+    Planar T_a_source, T_b_target, T_edge;
+    int a = source, b = target;
+    while(a != b)
+    {
+      if(frames[a].depth >= frames[b].depth)
+      {
+        if(!edgeAt(frames[a], stamp_ns, T_edge)) return false;
+        T_a_source = compose(T_edge, T_a_source);
+        a = frames[a].parent;
+      }
+      else
+      {
+        if(!edgeAt(frames[b], stamp_ns, T_edge)) return false;
+        T_b_target = compose(T_edge, T_b_target);
+        b = frames[b].parent;
+      }
+    }
+
+    // T_target_source = T_b_target^-1 * T_a_source
+    const Planar & B = T_b_target, & A = T_a_source;
+    double dx = A.x - B.x, dy = A.y - B.y;
+    T_target_source = Transform2D(normalize_angle(A.th - B.th), B.c * A.c + B.s * A.s, B.c * A.s - B.s * A.c,
+                                  B.c * dx + B.s * dy, -B.s * dx + B.c * dy);
+
+    entry.target = target;
+    entry.source = source;
+    entry.stamp = stamp_ns;
+    entry.versions = versions;
+    entry.result = T_target_source;
+    return true;
+  }
+
+  bool FrameTree::lookup(const std::string & target, const std::string & source, int64_t stamp_ns,
+                         Transform2D & T_target_source) const
+  {
+    return lookup(findFrame(target), findFrame(source), stamp_ns, T_target_source);
+  }
+
+  uint64_t FrameTree::cacheHits() const
+  {
+    return hits;
+  }
+
+}
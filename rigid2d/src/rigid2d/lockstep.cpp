@@ -0,0 +1,34 @@
+/// \file
+/// \brief Source file for the lockstep barrier acks
+#include <std_msgs/UInt64.h>
+
+#include "rigid2d/lockstep.hpp"
+
+namespace rigid2d
+{
+
+  /////////////// Lockstep CLASS ///////////////////////
+  Lockstep::Lockstep(ros::NodeHandle & n, const std::string & topic)
+  {
+    n.getParam("/lockstep", on);
+    if(!on) return;
+
+    // the plugin counts the publishers of the topic as the nodes to wait for
+    pub = n.advertise<std_msgs::UInt64>(topic, 10);
+  }
+
+  bool Lockstep::enabled() const
+  {
+    return on;
+  }
+
+  void Lockstep::ack(const ros::Time & step)
+  {
+    if(!on) return;
+
+    std_msgs::UInt64 msg;
+    msg.data = step.toNSec();
+    pub.publish(msg);
+  }
+
+}
@@ -0,0 +1,136 @@
+/// \file
+/// \brief Source file for the scan safety stop
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "rigid2d/safety_stop.hpp"
+
+namespace rigid2d
+{
+
+  float minRange(const float * ranges, unsigned int n, float range_min, float range_max)
+  {
+    float best = std::numeric_limits<float>::infinity();
+    unsigned int i = 0;
+
+    // four beams at a time, NaN fails both compares so it is masked out with the out of range beams
+#if defined(__SSE2__)
+    const __m128 lo = _mm_set1_ps(range_min), hi = _mm_set1_ps(range_max), inf = _mm_set1_ps(best);
+    __m128 m = inf;
+    for(; i + 4 <= n; i += 4)
+    {
+      __m128 r = _mm_loadu_ps(ranges + i);
+      __m128 valid = _mm_and_ps(_mm_cmpge_ps(r, lo), _mm_cmple_ps(r, hi));
+      m = _mm_min_ps(m, _mm_or_ps(_mm_and_ps(valid, r), _mm_andnot_ps(valid, inf)));
+    }
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = _mm_cvtss_f32(m);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const float32x4_t lo = vdupq_n_f32(range_min), hi = vdupq_n_f32(range_max), inf = vdupq_n_f32(best);
+    float32x4_t m = inf;
+    for(; i + 4 <= n; i += 4)
+    {
+      float32x4_t r = vld1q_f32(ranges + i);
+      uint32x4_t valid = vandq_u32(vcgeq_f32(r, lo), vcleq_f32(r, hi));
+      m = vminq_f32(m, vbslq_f32(valid, r, inf));
+    }
+    // pairwise, so it also builds for 32 bit arm
+    float32x2_t h = vpmin_f32(vget_low_f32(m), vget_high_f32(m));
+    h = vpmin_f32(h, h);
+    best = vget_lane_f32(h, 0);
+#endif
+
+    for(; i < n; i++)
+    {
+      if(ranges[i] >= range_min && ranges[i] <= range_max) best = std::min(best, ranges[i]);
+    }
+    return best;
+  }
+
+  /////////////// SafetyStop CLASS /////////////////////
+  SafetyStop::SafetyStop(const SafetyParams & params) : params(params) {}
+
+  void SafetyStop::setScan(const std::vector<float> & ranges, double angle_min, double angle_increment,
+                           double range_min, double range_max, double stamp)
+  {
+    this->ranges.assign(ranges.begin(), ranges.end());
+    this->angle_min = angle_min;
+    this->angle_increment = angle_increment;
+    this->range_min = range_min;
+    this->range_max = range_max;
+    this->stamp = stamp;
+
+    // within half a beam of a whole turn
+    full_circle = angle_increment > 0 && (ranges.size() + 0.5) * angle_increment >= 2.0 * PI;
+  }
+
+  float SafetyStop::sectorMin(double lo, double hi) const
+  {
+    const float inf = std::numeric_limits<float>::infinity();
+    int n = ranges.size();
+    if(n == 0 || angle_increment <= 0) return inf;
+
+    if(full_circle)
+    {
+      if(hi - lo >= 2.0 * PI) return minRange(ranges.data(), n, range_min, range_max);
+
+      // beams are taken mod n, so the sector may cross the end of the scan
+      int first = std::ceil((lo - angle_min) / angle_increment);
+      int last = std::floor((hi - angle_min) / angle_increment);
+      if(last < first) return inf;
+      int count = last - first + 1;
+      first = ((first % n) + n) % n;
+
+      if(first + count <= n) return minRange(ranges.data() + first, count, range_min, range_max);
+      return std::min(minRange(ranges.data() + first, n - first, range_min, range_max),
+                      minRange(ranges.data(), first + count - n, range_min, range_max));
+    }
+
+    // a partial scan, the sector is turned to overlap it and clipped
+    while(hi < angle_min) lo += 2.0 * PI, hi += 2.0 * PI;
+    while(lo > angle_min + 2.0 * PI) lo -= 2.0 * PI, hi -= 2.0 * PI;
+
+    int first = std::max(0, static_cast<int>(std::ceil((lo - angle_min) / angle_increment)));
+    int last = std::min(n - 1, static_cast<int>(std::floor((hi - angle_min) / angle_increment)));
+    if(last < first) return inf;
+    return minRange(ranges.data() + first, last - first + 1, range_min, range_max);
+  }
+
+  float SafetyStop::clearance(const Twist2D & tw) const
+  {
+    // the heading of the path, and the bearing it reaches over the horizon, half the turn
+    double ahead = tw.vx >= 0 ? 0.0 : PI;
+    double turn = std::clamp(0.5 * tw.wz * params.horizon, -0.5 * PI, 0.5 * PI);
+
+    double lo = ahead + std::min(0.0, turn) - params.half_angle;
+    double hi = ahead + std::max(0.0, turn) + params.half_angle;
+    return sectorMin(lo, hi);
+  }
+
+  double SafetyStop::limit(Twist2D & tw, double now) const
+  {
+    if(tw.vx == 0.0) return 1.0;
+
+    double scale = 0.0;
+    bool stale = ranges.empty() || (params.timeout > 0 && now - stamp > params.timeout);
+    if(!stale)
+    {
+      double d = clearance(tw);
+      if(d >= params.slow_distance) scale = 1.0;
+      else if(d > params.stop_distance) scale = (d - params.stop_distance) / (params.slow_distance - params.stop_distance);
+    }
+
+    tw.vx *= scale;
+    return scale;
+  }
+
+}
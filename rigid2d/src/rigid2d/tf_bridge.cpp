@@ -0,0 +1,66 @@
+/// \file
+/// \brief Source file for the frame tree to tf2 bridge
+#include <cmath>
+
+#include "rigid2d/tf_bridge.hpp"
+
+namespace rigid2d
+{
+
+  geometry_msgs::TransformStamped toTransformStamped(const Transform2D & T_parent_child, const std::string & parent,
+                                                     const std::string & child, const ros::Time & stamp)
+  {
+    Pose2D pose = T_parent_child.displacementRad();
+
+    geometry_msgs::TransformStamped T;
+    T.header.stamp = stamp;
+    T.header.frame_id = parent;
+    T.child_frame_id = child;
+
+    T.transform.translation.x = pose.x;
+    T.transform.translation.y = pose.y;
+    T.transform.translation.z = 0.0;
+
+    // a rotation about z only, no need for the general quaternion conversion
+    T.transform.rotation.x = 0.0;
+    T.transform.rotation.y = 0.0;
+    T.transform.rotation.z = std::sin(pose.th / 2.0);
+    T.transform.rotation.w = std::cos(pose.th / 2.0);
+
+    return T;
+  }
+
+  /////////////// TfBridge CLASS ///////////////////////
+  TfBridge::TfBridge(const FrameTree & tree, double rate) : tree(tree), period(rate > 0 ? 1.0 / rate : 0.0)
+  {
+  }
+
+  void TfBridge::add(int frame)
+  {
+    edges.push_back(frame);
+    sent.push_back(-1);
+  }
+
+  bool TfBridge::update(const ros::Time & now)
+  {
+    if(!last.isZero() && now - last < period) return false;
+    last = now;
+
+    Transform2D T_parent_child;
+    for(unsigned int i = 0; i < edges.size(); i++)
+    {
+      // only newer transforms, tf2 warns about repeated stamps
+      int64_t stamp = tree.latest(edges[i]);
+      if(stamp <= sent[i]) continue;
+      if(!tree.lookup(tree.parent(edges[i]), edges[i], stamp, T_parent_child)) continue;
+
+      ros::Time t;
+      t.fromNSec(stamp);
+      broadcaster.sendTransform(toTransformStamped(T_parent_child, tree.frameName(tree.parent(edges[i])),
+                                                   tree.frameName(edges[i]), t));
+      sent[i] = stamp;
+    }
+    return true;
+  }
+
+}
@@ -0,0 +1,206 @@
+/// \file
+/// \brief Source file for the monitored subscribers
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <diagnostic_msgs/KeyValue.h>
+
+#include "rigid2d/topic_monitor.hpp"
+
+namespace rigid2d
+{
+
+  double TopicWindow::lostRatio() const
+  {
+    // the gaps never arrived, so they are on top of the received messages
+    uint64_t sent = received + gaps;
+    return sent == 0 ? 0.0 : static_cast<double>(overwritten + gaps) / sent;
+  }
+
+  /////////////// TopicStats CLASS ///////////////////////
+  TopicStats::TopicStats(const std::string & topic) : name(topic)
+  {
+  }
+
+  void TopicStats::received(const std::string & publisher, uint32_t seq)
+  {
+    received_count.fetch_add(1, std::memory_order_relaxed);
+    if(seq == 0) return;
+
+    // a publisher that restarts numbers from the start again, which is not a gap
+    auto last = last_seq.find(publisher);
+    if(last != last_seq.end() && seq > last->second + 1)
+    {
+      gap_count.fetch_add(seq - last->second - 1, std::memory_order_relaxed);
+    }
+    last_seq[publisher] = seq;
+  }
+
+  void TopicStats::overwritten()
+  {
+    overwritten_count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void TopicStats::delivered(int64_t age_ns)
+  {
+    delivered_count.fetch_add(1, std::memory_order_relaxed);
+    if(age_ns < 0) return;
+
+    stamped_count.fetch_add(1, std::memory_order_relaxed);
+    age_sum.fetch_add(age_ns, std::memory_order_relaxed);
+
+    int64_t oldest = age_max.load(std::memory_order_relaxed);
+    while(age_ns > oldest && !age_max.compare_exchange_weak(oldest, age_ns, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  TopicWindow TopicStats::window(double seconds)
+  {
+    TopicWindow total;
+    total.received = received_count.load(std::memory_order_relaxed);
+    total.delivered = delivered_count.load(std::memory_order_relaxed);
+    total.overwritten = overwritten_count.load(std::memory_order_relaxed);
+    total.gaps = gap_count.load(std::memory_order_relaxed);
+    total.stamped = stamped_count.load(std::memory_order_relaxed);
+    int64_t total_age = age_sum.load(std::memory_order_relaxed);
+
+    TopicWindow w;
+    w.seconds = seconds;
+    w.received = total.received - previous.received;
+    w.delivered = total.delivered - previous.delivered;
+    w.overwritten = total.overwritten - previous.overwritten;
+    w.gaps = total.gaps - previous.gaps;
+    w.stamped = total.stamped - previous.stamped;
+    w.age_mean = w.stamped == 0 ? 0.0 : (total_age - previous_age_sum) * 1e-9 / w.stamped;
+    w.age_max = age_max.exchange(0, std::memory_order_relaxed) * 1e-9;
+
+    previous = total;
+    previous_age_sum = total_age;
+    return w;
+  }
+
+  const std::string & TopicStats::topic() const
+  {
+    return name;
+  }
+
+  uint8_t alarmLevel(const TopicWindow & window, const MonitorParams & params, int & streak)
+  {
+    bool warn = window.lostRatio() > params.drop_ratio || window.age_mean > params.max_age;
+    streak = warn ? streak + 1 : 0;
+
+    if(!warn) return diagnostic_msgs::DiagnosticStatus::OK;
+    return streak >= params.error_periods ? diagnostic_msgs::DiagnosticStatus::ERROR : diagnostic_msgs::DiagnosticStatus::WARN;
+  }
+
+  /////////////// TopicMonitor CLASS ///////////////////////
+  TopicMonitor::TopicMonitor(ros::NodeHandle & n) : node(ros::this_node::getName())
+  {
+    n.getParam("/diagnostics_period", params.period);
+    n.getParam("/alarm_drop_ratio", params.drop_ratio);
+    n.getParam("/alarm_age", params.max_age);
+    n.getParam("/alarm_periods", params.error_periods);
+
+    pub = n.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+
+    // the reports share the receiving thread, so they go out while the node is busy
+    ros::NodeHandle receiver(n);
+    receiver.setCallbackQueue(&receive_queue);
+    last_report = ros::WallTime::now();
+    timer = receiver.createWallTimer(ros::WallDuration(std::max(0.01, params.period)), &TopicMonitor::report, this);
+
+    spinner.reset(new ros::AsyncSpinner(1, &receive_queue));
+    spinner->start();
+  }
+
+  TopicMonitor::~TopicMonitor()
+  {
+    timer.stop();
+    spinner->stop();
+  }
+
+  bool TopicMonitor::alarmed() const
+  {
+    return alarm.load(std::memory_order_relaxed);
+  }
+
+  const MonitorParams & TopicMonitor::getParams() const
+  {
+    return params;
+  }
+
+  std::shared_ptr<TopicStats> TopicMonitor::addTopic(const std::string & topic)
+  {
+    auto stats = std::make_shared<TopicStats>(topic);
+
+    std::lock_guard<std::mutex> guard(topics_lock);
+    topics.push_back(stats);
+    return stats;
+  }
+
+  void TopicMonitor::report(const ros::WallTimerEvent &)
+  {
+    ros::WallTime now = ros::WallTime::now();
+    double seconds = (now - last_report).toSec();
+    last_report = now;
+
+    std::vector<std::shared_ptr<TopicStats>> current;
+    {
+      std::lock_guard<std::mutex> guard(topics_lock);
+      current = topics;
+    }
+    streaks.resize(current.size(), 0);
+    levels.resize(current.size(), diagnostic_msgs::DiagnosticStatus::OK);
+
+    diagnostic_msgs::DiagnosticArray array;
+    array.header.stamp = ros::Time::now();
+    bool any = false;
+
+    for(std::size_t t = 0; t < current.size(); t++)
+    {
+      TopicWindow w = current.at(t)->window(seconds);
+      uint8_t level = alarmLevel(w, params, streaks.at(t));
+      any = any || level != diagnostic_msgs::DiagnosticStatus::OK;
+
+      std::ostringstream message;
+      message << std::fixed << std::setprecision(1) << w.lostRatio() * 100.0 << "% lost, mean age "
+              << w.age_mean * 1e3 << " ms";
+      if(level != levels.at(t))
+      {
+        if(level == diagnostic_msgs::DiagnosticStatus::OK) ROS_INFO_STREAM("TOPIC_MONITOR: " << current.at(t)->topic() << " recovered, " << message.str());
+        else ROS_WARN_STREAM("TOPIC_MONITOR: " << current.at(t)->topic() << " is falling behind, " << message.str());
+      }
+      levels.at(t) = level;
+
+      diagnostic_msgs::DiagnosticStatus status;
+      status.level = level;
+      status.name = node + ": " + current.at(t)->topic();
+      status.hardware_id = node;
+      status.message = level == diagnostic_msgs::DiagnosticStatus::OK ? "OK" : message.str();
+
+      auto value = [&](const std::string & key, double v)
+      {
+        diagnostic_msgs::KeyValue kv;
+        kv.key = key;
+        kv.value = std::to_string(v);
+        status.values.push_back(kv);
+      };
+      double per_second = w.seconds > 0.0 ? 1.0 / w.seconds : 0.0;
+      value("received rate (Hz)", w.received * per_second);
+      value("delivered rate (Hz)", w.delivered * per_second);
+      value("overwritten", w.overwritten);
+      value("sequence gaps", w.gaps);
+      value("lost ratio", w.lostRatio());
+      value("mean age (s)", w.age_mean);
+      value("max age (s)", w.age_max);
+      array.status.push_back(status);
+    }
+
+    alarm.store(any, std::memory_order_relaxed);
+    if(!array.status.empty()) pub.publish(array);
+  }
+
+}
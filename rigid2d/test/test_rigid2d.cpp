@@ -1,8 +1,22 @@
 #include <gtest/gtest.h>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <vector>
+#include <limits>
+#include <cmath>
 #include "rigid2d/rigid2d.hpp"
 #include "rigid2d/diff_drive.hpp"
 #include "rigid2d/waypoints.hpp"
+#include "rigid2d/flight_recorder.hpp"
+#include "rigid2d/frame_tree.hpp"
+#include "rigid2d/safety_stop.hpp"
+#include "rigid2d/topic_monitor.hpp"
+#include <sensor_msgs/JointState.h>
+#include <geometry_msgs/Twist.h>
 
 TEST(rigid2dLibrary, VectorIO)
 {
@@ -372,3 +386,467 @@ TEST(diffdriveLibrary, FFTransAndRot)
   ASSERT_PRED3(rigid2d::almost_equal, pose.y, 0.0145, 1e-4);
   ASSERT_PRED3(rigid2d::almost_equal, pose.th, 0.6, 1e-4);
 }
+
+TEST(flightRecorder, KeepsTheLastSecondsOfEachChannel)
+{
+  flight_recorder::RecorderParams params;
+  params.seconds = 2.0;
+  flight_recorder::Recorder rec("test", params);
+
+  // 2 s at 100 Hz rounds up to 256 slots
+  ASSERT_EQ(rec.capacity(flight_recorder::Channel::Encoder), 256u);
+
+  // a fast channel wraps many times, a slow one keeps everything
+  for(int i = 0; i < 1000; i++) rec.record(flight_recorder::Channel::Encoder, i, {double(i), 2.0 * i});
+  for(int i = 0; i < 5; i++) rec.record(flight_recorder::Channel::Event, i, {double(i)}, 7);
+
+  std::vector<flight_recorder::Record> enc = rec.snapshot(flight_recorder::Channel::Encoder);
+  ASSERT_EQ(enc.size(), 256u);
+  ASSERT_EQ(enc.front().stamp_ns, 1000u - 256u);
+  ASSERT_EQ(enc.back().values[1], 2.0 * 999);
+  ASSERT_EQ(enc.back().values[2], 0.0);
+
+  std::vector<flight_recorder::Record> events = rec.snapshot(flight_recorder::Channel::Event);
+  ASSERT_EQ(events.size(), 5u);
+  ASSERT_EQ(events.front().tag, 7);
+}
+
+TEST(flightRecorder, DumpReadsBack)
+{
+  flight_recorder::Recorder rec("turtle_interface");
+  for(int i = 0; i < 300; i++) rec.record(flight_recorder::Channel::Command, i, {0.1 * i, -0.1 * i});
+  rec.record(flight_recorder::Channel::Innovation, 42, {0.01, -0.02, 1.5}, 3);
+
+  std::string path = flight_recorder::dumpPath("/tmp", "rigid2d_test", "unit");
+  ASSERT_TRUE(rec.dump(path.c_str()));
+
+  flight_recorder::Dump dump;
+  ASSERT_TRUE(flight_recorder::readDump(path, dump));
+  std::remove(path.c_str());
+
+  ASSERT_EQ(dump.name, "turtle_interface");
+  ASSERT_EQ(dump.records[static_cast<int>(flight_recorder::Channel::Command)].size(), 300u);
+  ASSERT_EQ(dump.records[static_cast<int>(flight_recorder::Channel::Encoder)].size(), 0u);
+
+  const flight_recorder::Record & innov = dump.records[static_cast<int>(flight_recorder::Channel::Innovation)].at(0);
+  ASSERT_EQ(innov.stamp_ns, 42u);
+  ASSERT_EQ(innov.tag, 3);
+  ASSERT_EQ(innov.values[2], 1.5);
+}
+
+TEST(flightRecorder, DumpWhileRecordingHasNoTornRecords)
+{
+  flight_recorder::RecorderParams params;
+  params.seconds = 1.0;
+  flight_recorder::Recorder rec("test", params);
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> writers;
+  for(int t = 0; t < 3; t++)
+  {
+    writers.emplace_back([&rec, &stop, t]()
+    {
+      for(uint64_t i = 0; !stop.load(); i++)
+      {
+        double v = t * 1e9 + i;
+        rec.record(flight_recorder::Channel::Timing, i, {v, v, v, v, v, v});
+      }
+    });
+  }
+
+  std::string path = flight_recorder::dumpPath("/tmp", "rigid2d_test", "torn");
+  for(int k = 0; k < 20; k++)
+  {
+    ASSERT_TRUE(rec.dump(path.c_str()));
+
+    flight_recorder::Dump dump;
+    ASSERT_TRUE(flight_recorder::readDump(path, dump));
+    for(auto & r : dump.records[static_cast<int>(flight_recorder::Channel::Timing)])
+    {
+      for(int i = 1; i < flight_recorder::record_values; i++) ASSERT_EQ(r.values[i], r.values[0]);
+    }
+  }
+
+  stop = true;
+  for(auto & w : writers) w.join();
+  std::remove(path.c_str());
+}
+
+TEST(flightRecorder, CrashSignalDumps)
+{
+  std::string path = "/tmp/rigid2d_crash_test_crash.nfr";
+  std::remove(path.c_str());
+
+  ASSERT_DEATH(
+  {
+    static flight_recorder::Recorder rec("rigid2d_crash_test");
+    rec.record(flight_recorder::Channel::Encoder, 1, {1.0, 2.0});
+    flight_recorder::installCrashHandler(rec, "/tmp");
+    std::raise(SIGSEGV);
+  }, "");
+
+  flight_recorder::Dump dump;
+  ASSERT_TRUE(flight_recorder::readDump(path, dump));
+  ASSERT_EQ(dump.records[static_cast<int>(flight_recorder::Channel::Encoder)].size(), 1u);
+  std::remove(path.c_str());
+}
+
+TEST(flightRecorder, AltStackPerThread)
+{
+  auto current = [] { stack_t ss; sigaltstack(nullptr, &ss); return ss; };
+  stack_t before, installed, again;
+
+  std::thread worker([&]
+  {
+    before = current();
+    flight_recorder::installAltStack();
+    installed = current();
+    flight_recorder::installAltStack();
+    again = current();
+  });
+  worker.join();
+
+  // a new thread has no alternate stack until it asks for its own
+  ASSERT_TRUE(before.ss_flags & SS_DISABLE);
+  ASSERT_FALSE(installed.ss_flags & SS_DISABLE);
+  ASSERT_GE(installed.ss_size, 64u * 1024u);
+  ASSERT_EQ(again.ss_sp, installed.ss_sp);
+}
+
+TEST(flightRecorder, RecordingIsCheap)
+{
+  flight_recorder::Recorder rec("test");
+  const int n = 1000000;
+  unsigned int capacity = rec.capacity(flight_recorder::Channel::Encoder);
+
+  for(int i = 0; i < n; i++) rec.record(flight_recorder::Channel::Encoder, i, {1.0, 2.0, 3.0, 4.0});
+
+  // a record overwrites one slot of the preallocated ring, so a million of them hold no more than it does
+  std::vector<flight_recorder::Record> enc = rec.snapshot(flight_recorder::Channel::Encoder);
+  ASSERT_EQ(enc.size(), capacity);
+  ASSERT_EQ(enc.front().stamp_ns, static_cast<uint64_t>(n - capacity));
+  ASSERT_EQ(enc.back().stamp_ns, static_cast<uint64_t>(n - 1));
+  ASSERT_EQ(enc.back().seq, static_cast<uint32_t>(n));
+  ASSERT_TRUE(rec.snapshot(flight_recorder::Channel::Landmark).empty());
+}
+
+TEST(frameTree, ChainMatchesComposition)
+{
+  rigid2d::FrameTree tree;
+  int odom = tree.addFrame("odom", "map");
+  int base = tree.addFrame("base_link", "odom");
+  int scan = tree.addFrame("base_scan", "base_link", true);
+  int cam = tree.addFrame("camera", "base_link", true);
+  int map = tree.findFrame("map");
+
+  rigid2d::Transform2D T_mo(rigid2d::Vector2D(1.0, -2.0), 0.3);
+  rigid2d::Transform2D T_ob(rigid2d::Vector2D(0.5, 0.25), -1.2);
+  rigid2d::Transform2D T_bs(rigid2d::Vector2D(-0.03, 0.0), 0.0);
+  rigid2d::Transform2D T_bc(rigid2d::Vector2D(0.1, 0.05), rigid2d::PI / 2.0);
+
+  ASSERT_FALSE(tree.setTransform(map, 10, T_mo));
+  ASSERT_TRUE(tree.setTransform(odom, 10, T_mo));
+  ASSERT_TRUE(tree.setTransform(base, 10, T_ob));
+  ASSERT_TRUE(tree.setTransform(scan, 0, T_bs));
+  ASSERT_TRUE(tree.setTransform(cam, 0, T_bc));
+
+  rigid2d::Transform2D T;
+  ASSERT_TRUE(tree.lookup("map", "base_scan", 10, T));
+  rigid2d::Pose2D expected = (T_mo * T_ob * T_bs).displacementRad();
+  ASSERT_NEAR(T.displacementRad().th, expected.th, 1e-12);
+  ASSERT_NEAR(T.displacementRad().x, expected.x, 1e-12);
+  ASSERT_NEAR(T.displacementRad().y, expected.y, 1e-12);
+
+  // across siblings, static edges hold at any time
+  ASSERT_TRUE(tree.lookup(cam, scan, 0, T));
+  expected = (T_bc.inv() * T_bs).displacementRad();
+  ASSERT_NEAR(T.displacementRad().th, expected.th, 1e-12);
+  ASSERT_NEAR(T.displacementRad().x, expected.x, 1e-12);
+  ASSERT_NEAR(T.displacementRad().y, expected.y, 1e-12);
+
+  // a root picks up a parent, but a frame does not change parents or make a loop
+  int world = tree.addFrame("world");
+  ASSERT_FALSE(tree.lookup(world, base, 0, T));
+  ASSERT_EQ(tree.addFrame("map", "world"), map);
+  ASSERT_EQ(tree.addFrame("base_link", "map"), -1);
+  ASSERT_EQ(tree.addFrame("world", "camera"), -1);
+  ASSERT_TRUE(tree.setTransform(map, 10, rigid2d::Transform2D()));
+  ASSERT_TRUE(tree.lookup(world, base, 0, T));
+}
+
+TEST(frameTree, InterpolatesAndInvalidatesTheCache)
+{
+  rigid2d::FrameTree tree(8);
+  int base = tree.addFrame("base_link", "odom");
+
+  // turning through pi, so the heading has to interpolate across the wrap
+  for(int i = 0; i < 20; i++)
+  {
+    ASSERT_TRUE(tree.setTransform(base, 100 * (i + 1), rigid2d::Transform2D(rigid2d::Vector2D(0.1 * i, 0.0), rigid2d::normalize_angle(2.9 + 0.1 * i))));
+  }
+  ASSERT_FALSE(tree.setTransform(base, 1000, rigid2d::Transform2D()));
+  ASSERT_EQ(tree.latest(base), 2000);
+
+  rigid2d::Transform2D T;
+  ASSERT_TRUE(tree.lookup("odom", "base_link", 1750, T));
+  ASSERT_NEAR(T.displacementRad().x, 1.65, 1e-9);
+  ASSERT_NEAR(T.displacementRad().th, rigid2d::normalize_angle(2.9 + 1.65), 1e-9);
+
+  // only the last 8 are kept, and nothing is extrapolated
+  ASSERT_TRUE(tree.lookup("odom", "base_link", 1300, T));
+  ASSERT_FALSE(tree.lookup("odom", "base_link", 1250, T));
+  ASSERT_FALSE(tree.lookup("odom", "base_link", 2001, T));
+
+  ASSERT_TRUE(tree.lookup("odom", "base_link", 0, T));
+  ASSERT_NEAR(T.displacementRad().x, 1.9, 1e-9);
+  uint64_t hits = tree.cacheHits();
+  ASSERT_TRUE(tree.lookup("odom", "base_link", 0, T));
+  ASSERT_EQ(tree.cacheHits(), hits + 1);
+
+  // an update of the edge makes the cached newest transform stale
+  ASSERT_TRUE(tree.setTransform(base, 2100, rigid2d::Transform2D(rigid2d::Vector2D(5.0, 0.0), 0.0)));
+  ASSERT_TRUE(tree.lookup("odom", "base_link", 0, T));
+  ASSERT_EQ(tree.cacheHits(), hits + 1);
+  ASSERT_NEAR(T.displacementRad().x, 5.0, 1e-9);
+}
+
+TEST(frameTree, LookupMatchesBruteForce)
+{
+  rigid2d::FrameTree tree(1000);
+  int odom = tree.addFrame("odom", "map");
+  int base = tree.addFrame("base_link", "odom");
+  tree.addFrame("base_scan", "base_link", true);
+  rigid2d::Transform2D T_bs(rigid2d::Vector2D(-0.03, 0.0));
+  tree.setTransform(tree.findFrame("base_scan"), 0, T_bs);
+  for(int i = 0; i < 1000; i++)
+  {
+    tree.setTransform(odom, i * 1000000LL, rigid2d::Transform2D(rigid2d::Vector2D(0.001 * i, 0.0), 0.0));
+    tree.setTransform(base, i * 1000000LL, rigid2d::Transform2D(rigid2d::Vector2D(0.0, 0.001 * i), 0.001 * i));
+  }
+
+  int map = tree.findFrame("map"), scan = tree.findFrame("base_scan");
+  rigid2d::Transform2D T;
+
+  for(int i = 0; i < 10000; i++)
+  {
+    // a new time every lookup, so none come from the cache, and every edge is interpolated
+    int64_t stamp = 1 + i * 99000LL;
+    ASSERT_TRUE(tree.lookup(map, scan, stamp, T));
+
+    // both edges move linearly between their samples, so their value at any time is known
+    double s = stamp * 1e-6;
+    rigid2d::Transform2D expected = rigid2d::Transform2D(rigid2d::Vector2D(0.001 * s, 0.0), 0.0) *
+                                    rigid2d::Transform2D(rigid2d::Vector2D(0.0, 0.001 * s), 0.001 * s) * T_bs;
+    ASSERT_NEAR(T.displacementRad().x, expected.displacementRad().x, 1e-9);
+    ASSERT_NEAR(T.displacementRad().y, expected.displacementRad().y, 1e-9);
+    ASSERT_NEAR(T.displacementRad().th, expected.displacementRad().th, 1e-9);
+  }
+  ASSERT_EQ(tree.cacheHits(), 0u);
+
+  // past the newest sample nothing is extrapolated
+  ASSERT_FALSE(tree.lookup(map, scan, 999000001LL, T));
+}
+
+TEST(safetyStop, MinRangeSkipsInvalidBeams)
+{
+  // every length up to a few vectors, with the nearest beam at every position
+  for(unsigned int n = 1; n < 19; n++)
+  {
+    for(unsigned int near = 0; near < n; near++)
+    {
+      std::vector<float> ranges(n, 2.0f);
+      ranges[near] = 0.5f;
+      ranges[(near + 1) % n] = n > 1 ? 0.0f : 0.5f;
+      if(n > 2) ranges[(near + 2) % n] = std::numeric_limits<float>::quiet_NaN();
+      if(n > 3) ranges[(near + 3) % n] = std::numeric_limits<float>::infinity();
+      ASSERT_EQ(rigid2d::minRange(ranges.data(), n, 0.12f, 3.5f), 0.5f);
+    }
+  }
+
+  std::vector<float> none = {0.0f, 0.05f, 10.0f, std::numeric_limits<float>::quiet_NaN(), 0.0f};
+  ASSERT_TRUE(std::isinf(rigid2d::minRange(none.data(), none.size(), 0.12f, 3.5f)));
+}
+
+TEST(safetyStop, LimitsTheSectorOfThePath)
+{
+  rigid2d::SafetyParams params;
+  params.stop_distance = 0.2;
+  params.slow_distance = 0.6;
+  params.half_angle = 0.2;
+  params.horizon = 1.0;
+  params.timeout = 0.5;
+  rigid2d::SafetyStop guard(params);
+
+  rigid2d::Twist2D tw;
+  tw.vx = 0.2;
+  ASSERT_EQ(guard.limit(tw, 0.0), 0.0);
+  ASSERT_EQ(tw.vx, 0.0);
+
+  // one beam a degree, an obstacle 0.4m away 20 degrees to the right, across the wrap of the scan
+  std::vector<float> ranges(360, 3.0f);
+  ranges[340] = 0.4f;
+  guard.setScan(ranges, 0.0, 2.0 * rigid2d::PI / 360, 0.12, 3.5, 10.0);
+
+  tw.vx = 0.2;
+  ASSERT_EQ(guard.limit(tw, 10.1), 1.0);
+
+  // turning right sweeps the sector over it
+  tw.wz = -1.5;
+  ASSERT_NEAR(guard.clearance(tw), 0.4, 1e-6);
+  ASSERT_NEAR(guard.limit(tw, 10.1), 0.5, 1e-6);
+  ASSERT_NEAR(tw.vx, 0.1, 1e-6);
+
+  // reversing looks behind, and rotation is never limited
+  ranges[180] = 0.1f;
+  guard.setScan(ranges, 0.0, 2.0 * rigid2d::PI / 360, 0.12, 3.5, 10.0);
+  tw.vx = -0.2;
+  tw.wz = 0.0;
+  ASSERT_EQ(guard.limit(tw, 10.1), 1.0);
+  ranges[180] = 0.13f;
+  guard.setScan(ranges, 0.0, 2.0 * rigid2d::PI / 360, 0.12, 3.5, 10.0);
+  ASSERT_EQ(guard.limit(tw, 10.1), 0.0);
+  tw.wz = 2.0;
+  ASSERT_EQ(guard.limit(tw, 10.1), 1.0);
+  ASSERT_EQ(tw.wz, 2.0);
+
+  // inside the stop distance, and an old scan
+  ranges[2] = 0.15f;
+  guard.setScan(ranges, 0.0, 2.0 * rigid2d::PI / 360, 0.12, 3.5, 11.0);
+  tw.vx = 0.2;
+  ASSERT_EQ(guard.limit(tw, 11.0), 0.0);
+  ranges[2] = 3.0f;
+  ranges[340] = 3.0f;
+  guard.setScan(ranges, 0.0, 2.0 * rigid2d::PI / 360, 0.12, 3.5, 12.0);
+  tw.vx = 0.2;
+  ASSERT_EQ(guard.limit(tw, 12.2), 1.0);
+  ASSERT_EQ(guard.limit(tw, 12.6), 0.0);
+}
+
+TEST(topicMonitor, CountsGapsPerPublisher)
+{
+  rigid2d::TopicStats stats("/joint_states");
+
+  // two publishers interleaved, one skipping two messages and then restarting
+  stats.received("/a", 1);
+  stats.received("/b", 7);
+  stats.received("/a", 2);
+  stats.received("/b", 8);
+  stats.received("/a", 5);
+  stats.received("/a", 1);
+  stats.received("/c", 0);
+  stats.received("/c", 0);
+  stats.overwritten();
+  stats.delivered(2000000);
+  stats.delivered(6000000);
+  stats.delivered();
+
+  rigid2d::TopicWindow w = stats.window(2.0);
+  ASSERT_EQ(w.received, 8u);
+  ASSERT_EQ(w.gaps, 2u);
+  ASSERT_EQ(w.overwritten, 1u);
+  ASSERT_EQ(w.delivered, 3u);
+  ASSERT_EQ(w.stamped, 2u);
+  ASSERT_NEAR(w.age_mean, 0.004, 1e-12);
+  ASSERT_NEAR(w.age_max, 0.006, 1e-12);
+  ASSERT_NEAR(w.lostRatio(), 3.0 / 10.0, 1e-12);
+
+  // the next window only counts what came after
+  stats.received("/a", 2);
+  stats.delivered(1000000);
+  w = stats.window(1.0);
+  ASSERT_EQ(w.received, 1u);
+  ASSERT_EQ(w.gaps, 0u);
+  ASSERT_EQ(w.overwritten, 0u);
+  ASSERT_NEAR(w.age_mean, 0.001, 1e-12);
+  ASSERT_NEAR(w.age_max, 0.001, 1e-12);
+  ASSERT_EQ(w.lostRatio(), 0.0);
+}
+
+TEST(topicMonitor, AlarmEscalatesAndClears)
+{
+  rigid2d::MonitorParams params;
+  params.drop_ratio = 0.1;
+  params.max_age = 0.05;
+  params.error_periods = 3;
+  int streak = 0;
+
+  rigid2d::TopicWindow fine;
+  fine.received = 100;
+  fine.overwritten = 5;
+  fine.stamped = 95;
+  fine.age_mean = 0.01;
+  ASSERT_EQ(rigid2d::alarmLevel(fine, params, streak), diagnostic_msgs::DiagnosticStatus::OK);
+
+  rigid2d::TopicWindow dropping = fine;
+  dropping.overwritten = 20;
+  ASSERT_EQ(rigid2d::alarmLevel(dropping, params, streak), diagnostic_msgs::DiagnosticStatus::WARN);
+
+  // stale with nothing lost still warns
+  rigid2d::TopicWindow stale = fine;
+  stale.age_mean = 0.08;
+  ASSERT_EQ(rigid2d::alarmLevel(stale, params, streak), diagnostic_msgs::DiagnosticStatus::WARN);
+  ASSERT_EQ(rigid2d::alarmLevel(dropping, params, streak), diagnostic_msgs::DiagnosticStatus::ERROR);
+  ASSERT_EQ(streak, 3);
+
+  ASSERT_EQ(rigid2d::alarmLevel(fine, params, streak), diagnostic_msgs::DiagnosticStatus::OK);
+  ASSERT_EQ(streak, 0);
+  ASSERT_EQ(rigid2d::alarmLevel(dropping, params, streak), diagnostic_msgs::DiagnosticStatus::WARN);
+}
+
+TEST(topicMonitor, MailboxDeliversNewestOnly)
+{
+  ros::Time::init();
+  ros::CallbackQueue queue;
+
+  auto stats = std::make_shared<rigid2d::TopicStats>("/joint_states");
+  auto mailbox = boost::make_shared<rigid2d::TopicMailbox<sensor_msgs::JointState>>();
+  mailbox->stats = stats;
+  mailbox->queue = &queue;
+
+  std::vector<uint32_t> seen;
+  mailbox->callback = [&](const sensor_msgs::JointState::ConstPtr & msg) { seen.push_back(msg->header.seq); };
+
+  auto send = [&](uint32_t seq, double age)
+  {
+    boost::shared_ptr<sensor_msgs::JointState> msg(new sensor_msgs::JointState);
+    msg->header.seq = seq;
+    msg->header.stamp = ros::Time::now() - ros::Duration(age);
+    mailbox->receive(ros::MessageEvent<sensor_msgs::JointState const>(msg));
+  };
+
+  // three arrive while the node is busy, it only gets the last
+  send(1, 0.1);
+  send(2, 0.1);
+  send(3, 0.1);
+  queue.callAvailable();
+  ASSERT_EQ(seen, std::vector<uint32_t>({3}));
+
+  // nothing new, nothing delivered, then a gap
+  queue.callAvailable();
+  send(6, 0.1);
+  queue.callAvailable();
+  ASSERT_EQ(seen, std::vector<uint32_t>({3, 6}));
+
+  rigid2d::TopicWindow w = stats->window(1.0);
+  ASSERT_EQ(w.received, 4u);
+  ASSERT_EQ(w.overwritten, 2u);
+  ASSERT_EQ(w.delivered, 2u);
+  ASSERT_EQ(w.gaps, 2u);
+  ASSERT_EQ(w.stamped, 2u);
+  ASSERT_GE(w.age_mean, 0.1);
+  ASSERT_LT(w.age_mean, 1.0);
+
+  // a message without a header has no sequence and no age
+  auto twist_stats = std::make_shared<rigid2d::TopicStats>("/cmd_vel");
+  auto twist_box = boost::make_shared<rigid2d::TopicMailbox<geometry_msgs::Twist>>();
+  twist_box->stats = twist_stats;
+  twist_box->queue = &queue;
+  twist_box->callback = [](const geometry_msgs::Twist::ConstPtr &) {};
+  twist_box->receive(ros::MessageEvent<geometry_msgs::Twist const>(boost::make_shared<geometry_msgs::Twist>()));
+  queue.callAvailable();
+
+  w = twist_stats->window(1.0);
+  ASSERT_EQ(w.delivered, 1u);
+  ASSERT_EQ(w.stamped, 0u);
+  ASSERT_EQ(w.gaps, 0u);
+}
@@ -12,6 +12,7 @@
 /// PUBLISHES:
 ///     /pose_error (tsim/PoseError): The positional error of the turtle at each cycle.
 ///     /turtle1/cmd_vel (geometry_msgs/Twist): The velcotiy command to control the turtle.
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /turtle1/pose (turtlesim/Pose): Retrieves the current pose of the turtle
 /// SERVICES:
@@ -29,6 +30,7 @@
 #include "tsim/PoseError.h"
 
 #include "rigid2d/rigid2d.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 
 /// \brief A struct to hold related positional values
@@ -143,11 +145,13 @@ int main(int argc, char **argv)
   ros::init(argc, argv, "turtle_rect");
 
   ros::NodeHandle n;
+  rigid2d::TopicMonitor monitor(n);
 
   ros::Publisher pub_vel = n.advertise<geometry_msgs::Twist>("turtle1/cmd_vel", 2);
   ros::Publisher pub_error = n.advertise<tsim::PoseError>("pose_error", 2);
 
-  ros::Subscriber sub_pose = n.subscribe("turtle1/pose", 1, callback_pose);
+  ros::Subscriber sub_pose = monitor.subscribe<turtlesim::Pose>(n, "turtle1/pose",
+    [](const turtlesim::Pose::ConstPtr & msg) { callback_pose(*msg); });
 
   ros::ServiceServer srv_reset = n.advertiseService("reset_traj", callback_reset_traj);
 
@@ -12,6 +12,7 @@
 /// PUBLISHES:
 ///     /pose_error (tsim/PoseError): The positional error of the turtle at each cycle.
 ///     /turtle1/cmd_vel (geometry_msgs/Twist): The velcotiy command to control the turtle.
+///     /diagnostics (diagnostic_msgs/DiagnosticArray): the messages each subscriber lost or saw late
 /// SUBSCRIBES:
 ///     /turtle1/pose (turtlesim/Pose): Retrieves the current pose of the turtle
 
@@ -29,6 +30,7 @@
 #include "rigid2d/rigid2d.hpp"
 #include "rigid2d/diff_drive.hpp"
 #include "rigid2d/waypoints.hpp"
+#include "rigid2d/topic_monitor.hpp"
 
 
 // State Machine Variables
@@ -125,11 +127,13 @@ int main(int argc, char **argv)
   ros::init(argc, argv, "turtle_way");
 
   ros::NodeHandle n;
+  rigid2d::TopicMonitor monitor(n);
 
   ros::Publisher pub_vel = n.advertise<geometry_msgs::Twist>("turtle1/cmd_vel", 2);
   ros::Publisher pub_error = n.advertise<tsim::PoseError>("pose_error", 2);
 
-  ros::Subscriber sub_pose = n.subscribe("turtle1/pose", 1, callback_pose);
+  ros::Subscriber sub_pose = monitor.subscribe<turtlesim::Pose>(n, "turtle1/pose",
+    [](const turtlesim::Pose::ConstPtr & msg) { callback_pose(*msg); });
 
   client_telabs = n.serviceClient<turtlesim::TeleportAbsolute>("turtle1/teleport_absolute");
   client_pen = n.serviceClient<turtlesim::SetPen>("turtle1/set_pen");